@@ -0,0 +1,116 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/* Dispatch latency of vaccel_noop() with debug logging on
+ *
+ * Runs the same loop with logging off, with debug messages written
+ * synchronously and with VACCEL_LOG_ASYNC=enabled. The log itself goes
+ * to stdout, so run it with stdout redirected, e.g.:
+ *
+ *   VACCEL_BACKENDS=libvaccel-noop.so ./log_dispatch > /dev/null
+ *
+ * Results are printed on stderr. In a tight loop the per-thread rings
+ * of the asynchronous logger may fill up between two flushes; the
+ * number of dropped messages is reported in the log.
+ */
+
+#include "log.h"
+#include "session.h"
+#include "ops/noop.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define ITERATIONS 200000
+
+static uint64_t lat[ITERATIONS];
+
+static uint64_t now_nsec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void set_logging(const char *level, int async)
+{
+	vaccel_log_shutdown();
+
+	setenv("VACCEL_DEBUG_LEVEL", level, 1);
+	if (async)
+		setenv("VACCEL_LOG_ASYNC", "enabled", 1);
+	else
+		unsetenv("VACCEL_LOG_ASYNC");
+
+	vaccel_log_init();
+}
+
+static void run(const char *name, struct vaccel_session *sess)
+{
+	/* Warm up caches and lazy initialization */
+	for (int i = 0; i < ITERATIONS / 100; ++i)
+		vaccel_noop(sess);
+
+	uint64_t total = 0;
+	for (int i = 0; i < ITERATIONS; ++i) {
+		uint64_t start = now_nsec();
+		vaccel_noop(sess);
+		lat[i] = now_nsec() - start;
+		total += lat[i];
+	}
+
+	/* Let the writer catch up before the next run */
+	vaccel_log_flush();
+
+	qsort(lat, ITERATIONS, sizeof(*lat), cmp_u64);
+	fprintf(stderr, "%-20s mean %8.1f  p50 %6lu  p99 %6lu  p99.9 %7lu ns\n",
+			name, (double)total / ITERATIONS, lat[ITERATIONS / 2],
+			lat[ITERATIONS * 99 / 100],
+			lat[ITERATIONS * 999 / 1000]);
+}
+
+int main(void)
+{
+	struct vaccel_session sess;
+
+	if (vaccel_sess_init(&sess, 0)) {
+		fprintf(stderr, "Could not initialize session\n");
+		return 1;
+	}
+
+	set_logging("0", 0);
+	run("logging off", &sess);
+
+	set_logging("4", 0);
+	run("debug, synchronous", &sess);
+
+	set_logging("4", 1);
+	run("debug, asynchronous", &sess);
+
+	vaccel_sess_free(&sess);
+
+	return 0;
+}
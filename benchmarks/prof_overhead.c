@@ -0,0 +1,114 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/* Per-call overhead of profiling timestamps and regions
+ *
+ * Compares the clocks the profiler can use, and the cost of a region
+ * entry and exit with each of them.
+ */
+
+#include "profiling/clock.h"
+#include "vaccel_prof.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define ITERATIONS 2000000
+
+static volatile uint64_t sink;
+
+static uint64_t now_nsec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void read_clock(clockid_t clock)
+{
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	sink += ts.tv_nsec;
+}
+
+static void clock_monotonic_raw(void)
+{
+	read_clock(CLOCK_MONOTONIC_RAW);
+}
+
+static void clock_monotonic(void)
+{
+	read_clock(CLOCK_MONOTONIC);
+}
+
+static void clock_prof(void)
+{
+	sink += prof_clock_nsec();
+}
+
+static struct vaccel_prof_region region = VACCEL_PROF_REGION_INIT("bench");
+
+static void region_enter_exit(void)
+{
+	vaccel_prof_token_t token = vaccel_prof_region_enter(&region);
+	vaccel_prof_region_exit(&region, token);
+}
+
+static void run(const char *name, void (*fn)(void))
+{
+	/* Warm up caches and lazy initialization */
+	for (int i = 0; i < ITERATIONS / 100; ++i)
+		fn();
+
+	uint64_t start = now_nsec();
+	for (int i = 0; i < ITERATIONS; ++i)
+		fn();
+	uint64_t elapsed = now_nsec() - start;
+
+	printf("%-40s %8.1f ns/call\n", name, (double)elapsed / ITERATIONS);
+}
+
+/* Switch the profiling clock, returning false if it is not usable */
+static int use_clock(const char *source)
+{
+	setenv("VACCEL_PROF_CLOCK", source, 1);
+	__atomic_store_n(&prof_clock.source, PROF_CLOCK_UNKNOWN,
+			__ATOMIC_RELEASE);
+
+	return prof_clock_init();
+}
+
+int main(void)
+{
+	vaccel_prof_set_enabled(true);
+
+	run("clock_gettime(CLOCK_MONOTONIC_RAW)", clock_monotonic_raw);
+	run("clock_gettime(CLOCK_MONOTONIC)", clock_monotonic);
+
+	use_clock("monotonic");
+	run("prof_clock_nsec() [monotonic]", clock_prof);
+	run("region enter+exit [monotonic]", region_enter_exit);
+
+	if (use_clock("tsc") == PROF_CLOCK_TSC) {
+		run("prof_clock_nsec() [tsc]", clock_prof);
+		run("region enter+exit [tsc]", region_enter_exit);
+	} else {
+		printf("TSC is not usable on this machine\n");
+	}
+
+	return 0;
+}
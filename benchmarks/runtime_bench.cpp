@@ -0,0 +1,320 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/* Google Benchmark suite of the runtime's hot paths
+ *
+ * Results are emitted as JSON with:
+ *
+ *   runtime_bench --benchmark_out=results.json --benchmark_out_format=json
+ *
+ * or by building the `run_benchmarks` target, which does the above with
+ * the no-op plugin loaded if it is built. Dispatch benchmarks need a
+ * plugin implementing the no-op operation in VACCEL_BACKENDS.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "id_pool.h"
+#include "session.h"
+#include "vaccel.h"
+#include "vaccel_file.h"
+#include "vaccel_prof.h"
+#include "resources/shared_object.h"
+}
+
+/* Sends stdout to /dev/null while in scope, so that what plugins print
+ * on every call, like the noop one does, is not part of the measurement
+ * and does not end up in the results */
+class QuietStdout {
+public:
+	QuietStdout()
+	{
+		fflush(stdout);
+		saved = dup(STDOUT_FILENO);
+		int null = open("/dev/null", O_WRONLY);
+		if (null >= 0) {
+			dup2(null, STDOUT_FILENO);
+			close(null);
+		}
+	}
+
+	~QuietStdout()
+	{
+		fflush(stdout);
+		if (saved >= 0) {
+			dup2(saved, STDOUT_FILENO);
+			close(saved);
+		}
+	}
+
+private:
+	int saved;
+};
+
+/* Dispatch of the no-op operation, through its own API call and
+ * through the generic one */
+static void BM_noop_dispatch(benchmark::State &state)
+{
+	QuietStdout quiet;
+	struct vaccel_session sess;
+
+	if (vaccel_sess_init(&sess, 0)) {
+		state.SkipWithError("could not initialize session");
+		return;
+	}
+
+	if (vaccel_noop(&sess) != VACCEL_OK) {
+		state.SkipWithError("no plugin implements noop");
+		goto out;
+	}
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(vaccel_noop(&sess));
+
+out:
+	vaccel_sess_free(&sess);
+}
+BENCHMARK(BM_noop_dispatch);
+
+static void BM_genop_dispatch(benchmark::State &state)
+{
+	QuietStdout quiet;
+	struct vaccel_session sess;
+	enum vaccel_op_type op = VACCEL_NO_OP;
+	struct vaccel_arg read[] = { { sizeof(op), 0, &op } };
+
+	if (vaccel_sess_init(&sess, 0)) {
+		state.SkipWithError("could not initialize session");
+		return;
+	}
+
+	if (vaccel_genop(&sess, read, 1, NULL, 0) != VACCEL_OK) {
+		state.SkipWithError("no plugin implements noop");
+		goto out;
+	}
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(vaccel_genop(&sess, read, 1, NULL, 0));
+
+out:
+	vaccel_sess_free(&sess);
+}
+BENCHMARK(BM_genop_dispatch);
+
+/* Session creation and teardown */
+static void BM_session_churn(benchmark::State &state)
+{
+	for (auto _ : state) {
+		struct vaccel_session sess;
+
+		if (vaccel_sess_init(&sess, 0)) {
+			state.SkipWithError("could not initialize session");
+			break;
+		}
+		vaccel_sess_free(&sess);
+	}
+}
+BENCHMARK(BM_session_churn)->ThreadRange(1, 8)->UseRealTime();
+
+/* Full lifetime of a resource: creation from a buffer, registration
+ * with a session, unregistration and destruction */
+static void BM_resource_lifecycle(benchmark::State &state)
+{
+	const uint8_t buff[] = "not really a shared object";
+	struct vaccel_session sess;
+
+	if (vaccel_sess_init(&sess, 0)) {
+		state.SkipWithError("could not initialize session");
+		return;
+	}
+
+	for (auto _ : state) {
+		struct vaccel_shared_object object;
+
+		if (vaccel_shared_object_new_from_buffer(&object, buff,
+					sizeof(buff))) {
+			state.SkipWithError("could not create resource");
+			break;
+		}
+
+		vaccel_sess_register(&sess, object.resource);
+		vaccel_sess_unregister(&sess, object.resource);
+		vaccel_shared_object_destroy(&object);
+	}
+
+	vaccel_sess_free(&sess);
+}
+BENCHMARK(BM_resource_lifecycle);
+
+/* Id allocation, with all threads sharing one pool */
+static id_pool_t bench_pool;
+
+static void id_pool_setup(const benchmark::State &)
+{
+	id_pool_new(&bench_pool, 1024);
+}
+
+static void id_pool_teardown(const benchmark::State &)
+{
+	id_pool_destroy(&bench_pool);
+}
+
+static void BM_id_pool(benchmark::State &state)
+{
+	for (auto _ : state) {
+		vaccel_id_t id = id_pool_get(&bench_pool);
+		if (!id) {
+			state.SkipWithError("id pool exhausted");
+			break;
+		}
+		id_pool_release(&bench_pool, id);
+	}
+}
+BENCHMARK(BM_id_pool)
+	->Setup(id_pool_setup)
+	->Teardown(id_pool_teardown)
+	->ThreadRange(1, 8)
+	->UseRealTime();
+
+/* Entry and exit of a profiling region, with profiling on and off */
+static void BM_prof_region(benchmark::State &state)
+{
+	static struct vaccel_prof_region region =
+		VACCEL_PROF_REGION_INIT("bench");
+
+	bool enabled = vaccel_prof_enabled();
+	vaccel_prof_set_enabled(state.range(0));
+
+	for (auto _ : state) {
+		vaccel_prof_token_t token = vaccel_prof_region_enter(&region);
+		vaccel_prof_region_exit(&region, token);
+	}
+
+	vaccel_prof_set_enabled(enabled);
+}
+BENCHMARK(BM_prof_region)->ArgName("enabled")->Arg(0)->Arg(1);
+
+/* Persisting in-memory data to a file and reading files back */
+static char bench_dir[] = "/tmp/vaccel_bench.XXXXXX";
+static std::string bench_file;
+
+static void file_setup(const benchmark::State &state)
+{
+	if (!mkdtemp(bench_dir))
+		return;
+
+	bench_file = std::string(bench_dir) + "/data";
+
+	FILE *fp = fopen(bench_file.c_str(), "w");
+	if (!fp)
+		return;
+
+	std::vector<uint8_t> data(state.range(0), 0xa5);
+	fwrite(data.data(), 1, data.size(), fp);
+	fclose(fp);
+}
+
+static void file_teardown(const benchmark::State &)
+{
+	unlink(bench_file.c_str());
+	rmdir(bench_dir);
+
+	/* Make the template usable again for the next run */
+	strcpy(bench_dir, "/tmp/vaccel_bench.XXXXXX");
+}
+
+static void BM_file_persist(benchmark::State &state)
+{
+	std::vector<uint8_t> data(state.range(0), 0x5a);
+
+	for (auto _ : state) {
+		struct vaccel_file file;
+
+		if (vaccel_file_from_buffer(&file, data.data(), data.size(),
+					"persist", true, bench_dir, true)) {
+			state.SkipWithError("could not persist file");
+			break;
+		}
+		vaccel_file_destroy(&file);
+	}
+
+	state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_file_persist)
+	->Setup(file_setup)
+	->Teardown(file_teardown)
+	->RangeMultiplier(16)
+	->Range(4 << 10, 16 << 20);
+
+static void BM_file_read(benchmark::State &state)
+{
+	for (auto _ : state) {
+		struct vaccel_file file;
+
+		if (vaccel_file_new(&file, bench_file.c_str()) ||
+				vaccel_file_read(&file)) {
+			state.SkipWithError("could not read file");
+			break;
+		}
+
+		/* Files are mapped, so go through all of the data to
+		 * actually read it */
+		size_t size;
+		const uint8_t *data = vaccel_file_data(&file, &size);
+		uint64_t sum = 0;
+		for (size_t off = 0; off + sizeof(uint64_t) <= size;
+				off += sizeof(uint64_t)) {
+			uint64_t word;
+			memcpy(&word, data + off, sizeof(word));
+			sum += word;
+		}
+		benchmark::DoNotOptimize(sum);
+
+		vaccel_file_destroy(&file);
+	}
+
+	state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_file_read)
+	->Setup(file_setup)
+	->Teardown(file_teardown)
+	->RangeMultiplier(16)
+	->Range(4 << 10, 16 << 20);
+
+int main(int argc, char **argv)
+{
+	benchmark::Initialize(&argc, argv);
+	if (benchmark::ReportUnrecognizedArguments(argc, argv))
+		return 1;
+
+	/* Tag the results, so that they can be compared between releases */
+	benchmark::AddCustomContext("vaccelrt_version", VACCELRT_VERSION);
+
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+
+	return 0;
+}
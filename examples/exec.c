@@ -17,22 +17,44 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <vaccel.h>
 
+#define DEFAULT_LIBRARY "/usr/local/lib/libmytestlib.so"
+
+static double now_sec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Usage: exec <iterations> [library]
+ *
+ * Prints the number of exec operations per second. Run with
+ * VACCEL_EXEC_DLCACHE=disabled to compare against loading the library
+ * on every call */
 int main(int argc, char *argv[])
 {
 	int ret;
 	struct vaccel_session sess;
 	int input;
 	char out_text[512];
+	const char *library = DEFAULT_LIBRARY;
 
 	if (argc < 2) {
 		fprintf(stderr, "You must specify the number of iterations\n");
 		return 1;
 	}
 
+	if (argc > 2)
+		library = argv[2];
+
+	int iterations = atoi(argv[1]);
+
 	sess.hint = VACCEL_PLUGIN_DEBUG;
 	ret = vaccel_sess_init(&sess, sess.hint);
 	if (ret != VACCEL_OK) {
@@ -52,16 +74,21 @@ int main(int argc, char *argv[])
 
 	//vaccel_get_plugins(&sess, 7);
 
-	for (int i = 0; i < atoi(argv[1]); ++i) {
-		ret =
-		    vaccel_exec(&sess, "/usr/local/lib/libmytestlib.so",
-				"mytestfunc", read, 1, write, 1);
+	double start = now_sec();
+	for (int i = 0; i < iterations; ++i) {
+		ret = vaccel_exec(&sess, library, "mytestfunc", read, 1,
+				write, 1);
 		if (ret) {
 			fprintf(stderr, "Could not run op: %d\n", ret);
 			goto close_session;
 		}
 	}
+	double elapsed = now_sec() - start;
+
 	printf("output: %s\n", out_text);
+	if (iterations > 0 && elapsed > 0)
+		fprintf(stderr, "%d ops in %.3f s: %.0f ops/sec\n",
+				iterations, elapsed, iterations / elapsed);
 
  close_session:
 	if (vaccel_sess_free(&sess) != VACCEL_OK) {
@@ -0,0 +1,134 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/* Compare running a function over many inputs one call at a time
+ * against running them all with a single batch.
+ *
+ * Usage: exec_batch <library> <symbol> [nr_sets]
+ *
+ * The function gets an int as its only read argument and a 512-byte
+ * buffer as its only write argument, like `mytestfunc` of
+ * libmytestlib.so. Set VACCEL_EXEC_BATCH_THREADS to control the number
+ * of threads running a batch.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <vaccel.h>
+
+#define OUT_SIZE 512
+
+static double now_sec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+	int ret;
+	struct vaccel_session sess;
+
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s <library> <symbol> [nr_sets]\n",
+				argv[0]);
+		return 1;
+	}
+
+	const char *library = argv[1], *symbol = argv[2];
+	int nr_sets = (argc > 3) ? atoi(argv[3]) : 10000;
+	if (nr_sets <= 0) {
+		fprintf(stderr, "Invalid number of sets\n");
+		return 1;
+	}
+
+	int *inputs = malloc(nr_sets * sizeof(*inputs));
+	char *outputs = malloc((size_t)nr_sets * OUT_SIZE);
+	struct vaccel_arg *args = malloc(2 * nr_sets * sizeof(*args));
+	struct vaccel_genop_set *sets = malloc(nr_sets * sizeof(*sets));
+	if (!inputs || !outputs || !args || !sets) {
+		fprintf(stderr, "Could not allocate arguments\n");
+		return 1;
+	}
+
+	for (int i = 0; i < nr_sets; ++i) {
+		inputs[i] = i;
+
+		struct vaccel_arg *read = &args[2 * i];
+		struct vaccel_arg *write = &args[2 * i + 1];
+		*read = (struct vaccel_arg){
+			.size = sizeof(inputs[i]), .buf = &inputs[i]
+		};
+		*write = (struct vaccel_arg){
+			.size = OUT_SIZE, .buf = &outputs[(size_t)i * OUT_SIZE]
+		};
+
+		sets[i].read = read;
+		sets[i].nr_read = 1;
+		sets[i].write = write;
+		sets[i].nr_write = 1;
+		sets[i].ret = -1;
+	}
+
+	ret = vaccel_sess_init(&sess, 0);
+	if (ret != VACCEL_OK) {
+		fprintf(stderr, "Could not initialize session\n");
+		return 1;
+	}
+
+	double start = now_sec();
+	for (int i = 0; i < nr_sets; ++i) {
+		ret = vaccel_exec(&sess, library, symbol, sets[i].read, 1,
+				sets[i].write, 1);
+		if (ret) {
+			fprintf(stderr, "Could not run op: %d\n", ret);
+			goto close_session;
+		}
+	}
+	double serial = now_sec() - start;
+
+	start = now_sec();
+	ret = vaccel_exec_batch(&sess, library, symbol, sets, nr_sets);
+	double batch = now_sec() - start;
+	if (ret) {
+		int nr_failed = 0;
+		for (int i = 0; i < nr_sets; ++i)
+			nr_failed += (sets[i].ret != VACCEL_OK);
+
+		fprintf(stderr, "%d of %d calls failed: %d\n", nr_failed,
+				nr_sets, ret);
+		goto close_session;
+	}
+
+	fprintf(stderr, "serial: %.0f calls/sec\n", nr_sets / serial);
+	fprintf(stderr, "batch:  %.0f calls/sec\n", nr_sets / batch);
+
+close_session:
+	if (vaccel_sess_free(&sess) != VACCEL_OK) {
+		fprintf(stderr, "Could not clear session\n");
+		return 1;
+	}
+
+	free(sets);
+	free(args);
+	free(outputs);
+	free(inputs);
+
+	return ret;
+}
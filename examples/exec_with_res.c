@@ -126,6 +126,16 @@ int main(int argc, char *argv[])
 		exit(1);
 	}
 
+	/* Load the second object up front, so that even the first call
+	 * to it does not need to load the library */
+	const char *symbols[] = { "mytestfunc" };
+	ret = vaccel_shared_object_preload(&object2, symbols, 1);
+	if (ret)
+	{
+		fprintf(stderr, "Could not preload object 2\n");
+		exit(1);
+	}
+
 	ret = vaccel_sess_register(&sess, object2.resource);
 	if (ret)
 	{
@@ -0,0 +1,169 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Compare the time it takes to load a model from a compressed file
+ * against loading it from its decompressed copy.
+ *
+ * Usage: file_decompress <model.lz4> [iterations]
+ *
+ * Set VACCEL_DECOMPRESS_THREADS to control the number of decompression
+ * threads.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vaccel.h>
+
+static double now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static unsigned char *read_file(const char *path, size_t *len)
+{
+	struct stat stat;
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror("Could not open file");
+		return NULL;
+	}
+
+	if (fstat(fd, &stat) < 0) {
+		perror("Could not stat file");
+		close(fd);
+		return NULL;
+	}
+
+	unsigned char *ptr = malloc(stat.st_size);
+	if (!ptr) {
+		close(fd);
+		return NULL;
+	}
+
+	if (read(fd, ptr, stat.st_size) != stat.st_size) {
+		perror("Could not read file");
+		free(ptr);
+		close(fd);
+		return NULL;
+	}
+
+	close(fd);
+	*len = stat.st_size;
+
+	return ptr;
+}
+
+int main(int argc, char *argv[])
+{
+	int ret = 0;
+	struct vaccel_file file;
+	char raw_path[1024];
+	size_t raw_size = 0, compressed_size = 0;
+	double compressed_ms = 0, raw_ms = 0;
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s <model.lz4> [iterations]\n",
+				argv[0]);
+		return 1;
+	}
+
+	int iterations = (argc > 2) ? atoi(argv[2]) : 10;
+	if (iterations <= 0)
+		iterations = 1;
+
+	const char *dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+
+	/* Load straight from the compressed file */
+	for (int i = 0; i < iterations; ++i) {
+		double start = now_ms();
+
+		unsigned char *buff = read_file(argv[1], &compressed_size);
+		if (!buff)
+			return 1;
+
+		ret = vaccel_file_from_compressed_buffer(&file, buff,
+				compressed_size, "model", dir, true);
+		free(buff);
+		if (ret) {
+			fprintf(stderr, "Could not decompress file: %d\n", ret);
+			return 1;
+		}
+
+		compressed_ms += now_ms() - start;
+
+		/* Keep a decompressed copy around for the comparison */
+		if (!i) {
+			unsigned char *data = vaccel_file_data(&file, &raw_size);
+			snprintf(raw_path, sizeof(raw_path), "%s/model.raw",
+					dir);
+
+			FILE *fp = fopen(raw_path, "w");
+			if (!fp || fwrite(data, 1, raw_size, fp) != raw_size) {
+				fprintf(stderr, "Could not write %s\n", raw_path);
+				if (fp)
+					fclose(fp);
+				vaccel_file_destroy(&file);
+				return 1;
+			}
+			fclose(fp);
+		}
+
+		vaccel_file_destroy(&file);
+	}
+
+	/* Load the same data, uncompressed */
+	for (int i = 0; i < iterations; ++i) {
+		double start = now_ms();
+
+		size_t len;
+		unsigned char *buff = read_file(raw_path, &len);
+		if (!buff) {
+			ret = 1;
+			goto remove_raw;
+		}
+
+		ret = vaccel_file_from_buffer(&file, buff, len, "model", true,
+				dir, true);
+		free(buff);
+		if (ret) {
+			fprintf(stderr, "Could not persist file: %d\n", ret);
+			goto remove_raw;
+		}
+
+		raw_ms += now_ms() - start;
+		vaccel_file_destroy(&file);
+	}
+
+	printf("compressed: %zu bytes, %.3f ms/load\n", compressed_size,
+			compressed_ms / iterations);
+	printf("raw:        %zu bytes, %.3f ms/load\n", raw_size,
+			raw_ms / iterations);
+	printf("ratio:      %.2fx smaller, %.2fx load time\n",
+			(double)raw_size / compressed_size,
+			compressed_ms / raw_ms);
+
+remove_raw:
+	unlink(raw_path);
+	return ret;
+}
@@ -24,6 +24,7 @@
 
 struct vaccel_arg {
 	uint32_t len;
+	uint32_t flags;
 	void *buf;
 };
 
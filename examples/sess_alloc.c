@@ -0,0 +1,173 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/* Compare the per-request allocations of the op layer when using the
+ * system allocator against using the session's arena.
+ *
+ * Every request creates a few TensorFlow tensors and nodes and a Torch
+ * buffer, the way a frontend prepares the arguments of an inference.
+ * For each mode we report the number of calls to the system allocator
+ * per request and the average latency of a request.
+ *
+ * Usage: sess_alloc [iterations]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <vaccel.h>
+
+#define NR_TENSORS 8
+
+/* Count the calls to the system allocator by interposing glibc's */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static size_t nr_mallocs;
+
+void *malloc(size_t size)
+{
+	nr_mallocs++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	nr_mallocs++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	nr_mallocs++;
+	return __libc_realloc(ptr, size);
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int request_heap(void)
+{
+	uint32_t dims[] = { 1, 224, 224, 3 };
+	struct vaccel_tf_tensor *tensors[NR_TENSORS];
+	struct vaccel_tf_node *nodes[NR_TENSORS];
+	int ret = 0;
+
+	for (int i = 0; i < NR_TENSORS; ++i) {
+		tensors[i] = vaccel_tf_tensor_new(4, dims, VACCEL_TF_FLOAT);
+		nodes[i] = vaccel_tf_node_new("serving_default_input_1", i);
+		if (!tensors[i] || !nodes[i])
+			ret = 1;
+	}
+
+	struct vaccel_torch_buffer *buffer = vaccel_torch_buffer_new(NULL, 0);
+	if (!buffer)
+		ret = 1;
+
+	for (int i = 0; i < NR_TENSORS; ++i) {
+		vaccel_tf_tensor_destroy(tensors[i]);
+		vaccel_tf_node_destroy(nodes[i]);
+	}
+	if (buffer)
+		vaccel_torch_buffer_destroy(buffer);
+
+	return ret;
+}
+
+static int request_arena(struct vaccel_session *sess)
+{
+	uint32_t dims[] = { 1, 224, 224, 3 };
+	int ret = 0;
+
+	for (int i = 0; i < NR_TENSORS; ++i) {
+		if (!vaccel_tf_tensor_sess_new(sess, 4, dims, VACCEL_TF_FLOAT))
+			ret = 1;
+		if (!vaccel_tf_node_sess_new(sess, "serving_default_input_1", i))
+			ret = 1;
+	}
+
+	if (!vaccel_torch_buffer_sess_new(sess, NULL, 0))
+		ret = 1;
+
+	vaccel_sess_reset(sess);
+
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	int ret;
+	struct vaccel_session sess;
+	long iterations = (argc > 1) ? atol(argv[1]) : 100000;
+
+	if (iterations <= 0) {
+		fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+		return 1;
+	}
+
+	ret = vaccel_sess_init(&sess, 0);
+	if (ret != VACCEL_OK) {
+		fprintf(stderr, "Could not initialize session\n");
+		return 1;
+	}
+
+	/* Warm up both paths, so that the arena reaches its steady
+	 * state */
+	ret = request_heap() || request_arena(&sess);
+	if (ret) {
+		fprintf(stderr, "Could not allocate op objects\n");
+		goto close_session;
+	}
+
+	nr_mallocs = 0;
+	double start = now_ns();
+	for (long i = 0; i < iterations && !ret; ++i)
+		ret = request_heap();
+	double heap_ns = (now_ns() - start) / iterations;
+	size_t heap_mallocs = nr_mallocs;
+
+	nr_mallocs = 0;
+	start = now_ns();
+	for (long i = 0; i < iterations && !ret; ++i)
+		ret = request_arena(&sess);
+	double arena_ns = (now_ns() - start) / iterations;
+	size_t arena_mallocs = nr_mallocs;
+
+	if (ret) {
+		fprintf(stderr, "Could not allocate op objects\n");
+		goto close_session;
+	}
+
+	printf("%-6s %14s %14s\n", "mode", "mallocs/req", "ns/req");
+	printf("%-6s %14.2f %14.1f\n", "heap",
+			(double)heap_mallocs / iterations, heap_ns);
+	printf("%-6s %14.2f %14.1f\n", "arena",
+			(double)arena_mallocs / iterations, arena_ns);
+
+close_session:
+	if (vaccel_sess_free(&sess) != VACCEL_OK) {
+		fprintf(stderr, "Could not clear session\n");
+		return 1;
+	}
+
+	return ret;
+}
@@ -106,14 +106,14 @@ int create_from_path(const char *path)
 	}
 
 	vaccel_id_t model_id = vaccel_tf_saved_model_id(model);
-	vaccel_info("Registered new resource: %ld", model_id);
+	vaccel_info("Registered new resource: %lld", model_id);
 
 	struct vaccel_session sess;
 	ret = create_session(&sess);
 	if (ret)
 		return ret;
 
-	vaccel_info("Registering model %ld with session %u", model_id,
+	vaccel_info("Registering model %lld with session %u", model_id,
 			sess.session_id);
 
 	ret = vaccel_sess_register(&sess, model->resource);
@@ -122,7 +122,7 @@ int create_from_path(const char *path)
 		return ret;
 	}
 
-	vaccel_info("Unregistering model %ld from session %u", model_id,
+	vaccel_info("Unregistering model %lld from session %u", model_id,
 			sess.session_id);
 
 	ret = vaccel_sess_unregister(&sess, model->resource);
@@ -131,7 +131,7 @@ int create_from_path(const char *path)
 		return ret;
 	}
 
-	vaccel_info("Destroying model %ld", model_id);
+	vaccel_info("Destroying model %lld", model_id);
 	ret = vaccel_tf_saved_model_destroy(model);
 	if (ret) {
 		vaccel_error("Could not destroy model");
@@ -190,7 +190,7 @@ int create_from_in_mem(const char *path)
 	}
 
 	vaccel_id_t model_id = vaccel_tf_saved_model_id(model);
-	vaccel_info("Registered new resource: %ld", model_id);
+	vaccel_info("Registered new resource: %lld", model_id);
 
 
 	struct vaccel_session sess;
@@ -198,7 +198,7 @@ int create_from_in_mem(const char *path)
 	if (ret)
 		return ret;
 
-	vaccel_info("Registering model %ld with session %u", model_id,
+	vaccel_info("Registering model %lld with session %u", model_id,
 			sess.session_id);
 
 	ret = vaccel_sess_register(&sess, model->resource);
@@ -207,7 +207,7 @@ int create_from_in_mem(const char *path)
 		return ret;
 	}
 
-	vaccel_info("Unregistering model %ld from session %u", model_id,
+	vaccel_info("Unregistering model %lld from session %u", model_id,
 			sess.session_id);
 
 	ret = vaccel_sess_unregister(&sess, model->resource);
@@ -216,7 +216,7 @@ int create_from_in_mem(const char *path)
 		return ret;
 	}
 
-	vaccel_info("Destroying model %ld", model_id);
+	vaccel_info("Destroying model %lld", model_id);
 	ret = vaccel_tf_saved_model_destroy(model);
 	if (ret) {
 		vaccel_error("Could not destroy model");
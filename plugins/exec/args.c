@@ -0,0 +1,145 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "args.h"
+#include "workers.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static bool has_ext_args(const struct vaccel_arg *args, size_t nr_args)
+{
+	for (size_t i = 0; i < nr_args; ++i) {
+		if (vaccel_arg_is_ext(&args[i]))
+			return true;
+	}
+
+	return false;
+}
+
+static int flatten_arg(struct vaccel_arg *arg, void **buf)
+{
+	uint64_t size = vaccel_arg_size(arg);
+
+	/* Libraries take 32-bit sizes */
+	if (size > UINT32_MAX) {
+		vaccel_error("[exec] Argument of %ju bytes is too large",
+				(uintmax_t)size);
+		return VACCEL_ENOTSUP;
+	}
+
+	void *data = vaccel_arg_buf(arg);
+	if (!data) {
+		data = exec_shm_alloc(size ? size : 1);
+		if (!data)
+			return VACCEL_ENOMEM;
+
+		struct vaccel_iovec single;
+		const struct vaccel_iovec *segs;
+		uint32_t nr_segs = vaccel_arg_segs(arg, &single, &segs);
+
+		uint8_t *dst = data;
+		for (uint32_t i = 0; i < nr_segs; ++i) {
+			memcpy(dst, segs[i].base, segs[i].len);
+			dst += segs[i].len;
+		}
+
+		*buf = data;
+	}
+
+	arg->size = size;
+	arg->flags = 0;
+	arg->buf = data;
+
+	return VACCEL_OK;
+}
+
+int exec_args_flatten(struct exec_args *flat, struct vaccel_arg *read,
+		size_t nr_read, struct vaccel_arg *write, size_t nr_write)
+{
+	memset(flat, 0, sizeof(*flat));
+	flat->read = read;
+	flat->write = write;
+
+	if (!has_ext_args(read, nr_read) && !has_ext_args(write, nr_write))
+		return VACCEL_OK;
+
+	size_t nr_args = nr_read + nr_write;
+	flat->args = malloc(nr_args * sizeof(*flat->args));
+	flat->bufs = calloc(nr_args, sizeof(*flat->bufs));
+	if (!flat->args || !flat->bufs) {
+		exec_args_release(flat);
+		return VACCEL_ENOMEM;
+	}
+
+	flat->nr_read = nr_read;
+	flat->nr_write = nr_write;
+	if (nr_read)
+		memcpy(flat->args, read, nr_read * sizeof(*read));
+	if (nr_write)
+		memcpy(flat->args + nr_read, write, nr_write * sizeof(*write));
+
+	for (size_t i = 0; i < nr_args; ++i) {
+		if (!vaccel_arg_is_ext(&flat->args[i]))
+			continue;
+
+		int ret = flatten_arg(&flat->args[i], &flat->bufs[i]);
+		if (ret) {
+			exec_args_release(flat);
+			return ret;
+		}
+	}
+
+	flat->read = nr_read ? flat->args : NULL;
+	flat->write = nr_write ? flat->args + nr_read : NULL;
+
+	return VACCEL_OK;
+}
+
+void exec_args_scatter(const struct exec_args *flat,
+		struct vaccel_arg *write)
+{
+	if (!flat->bufs)
+		return;
+
+	for (size_t i = 0; i < flat->nr_write; ++i) {
+		const uint8_t *src = flat->bufs[flat->nr_read + i];
+		if (!src)
+			continue;
+
+		struct vaccel_iovec single;
+		const struct vaccel_iovec *segs;
+		uint32_t nr_segs = vaccel_arg_segs(&write[i], &single, &segs);
+
+		for (uint32_t j = 0; j < nr_segs; ++j) {
+			memcpy(segs[j].base, src, segs[j].len);
+			src += segs[j].len;
+		}
+	}
+}
+
+void exec_args_release(struct exec_args *flat)
+{
+	if (flat->bufs) {
+		for (size_t i = 0; i < flat->nr_read + flat->nr_write; ++i)
+			exec_shm_free(flat->bufs[i]);
+	}
+
+	free(flat->bufs);
+	free(flat->args);
+	flat->bufs = NULL;
+	flat->args = NULL;
+}
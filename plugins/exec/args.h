@@ -0,0 +1,56 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __EXEC_ARGS_H__
+#define __EXEC_ARGS_H__
+
+#include <stddef.h>
+
+#include <vaccel.h>
+
+/* Arguments of an exec call, as the library gets them
+ *
+ * The plugin is handed extended arguments as they are, while libraries
+ * only know about contiguous ones. An extended argument of a single
+ * segment is passed in place. The segments of any other one are
+ * gathered in a buffer from exec_shm_alloc(), so that the workers get
+ * it without one more copy, and for write arguments they are scattered
+ * back once the call is done.
+ */
+struct exec_args {
+	/* Arguments to pass to the library, read then write. Point to the
+	 * caller's arrays if none of the arguments is extended */
+	struct vaccel_arg *read;
+	struct vaccel_arg *write;
+
+	/* Copy of the arguments, if any is extended, and the buffers
+	 * segments are gathered in */
+	struct vaccel_arg *args;
+	void **bufs;
+	size_t nr_read;
+	size_t nr_write;
+};
+
+int exec_args_flatten(struct exec_args *flat, struct vaccel_arg *read,
+		size_t nr_read, struct vaccel_arg *write, size_t nr_write);
+
+/* Copy what the library wrote back to the segments of the caller's
+ * write arguments */
+void exec_args_scatter(const struct exec_args *flat,
+		struct vaccel_arg *write);
+
+void exec_args_release(struct exec_args *flat);
+
+#endif /* __EXEC_ARGS_H__ */
@@ -0,0 +1,346 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "args.h"
+#include "batch.h"
+#include "dl_cache.h"
+#include "workers.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_BATCH_THREADS 64
+
+typedef int (*exec_fn_t)(void *, size_t, void *, size_t);
+
+/* Sets [next, end) of the batch still to be run by a thread */
+struct batch_range {
+	pthread_mutex_t lock;
+	int next;
+	int end;
+} __attribute__((aligned(64)));
+
+/* A batch being run. It lives on the stack of the thread that called
+ * exec_batch(), which works on range 0, while pool thread `i` works on
+ * range `i + 1` if it joins */
+struct batch {
+	struct vaccel_genop_set *sets;
+	struct batch_range ranges[MAX_BATCH_THREADS + 1];
+	int nr_ranges;
+
+	/* Set while some of the sets have not been picked up yet, i.e.
+	 * while it is worth joining the batch */
+	bool open;
+
+	/* Pool threads working on the batch */
+	int nr_helpers;
+
+	struct batch *next;
+};
+
+static struct {
+	pthread_mutex_t lock;
+
+	/* Signaled when a new batch is posted or when shutting down */
+	pthread_cond_t work;
+
+	/* Signaled when a pool thread leaves a batch */
+	pthread_cond_t done;
+
+	/* Pool threads, shared by all the batches */
+	pthread_t threads[MAX_BATCH_THREADS];
+	int nr_threads;
+
+	bool started;
+	bool stopping;
+
+	/* Batches pool threads can join */
+	struct batch *batches;
+} pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.work = PTHREAD_COND_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER,
+};
+
+static bool range_pop(struct batch_range *range, int *idx)
+{
+	bool ret = false;
+
+	pthread_mutex_lock(&range->lock);
+	if (range->next < range->end) {
+		*idx = range->next++;
+		ret = true;
+	}
+	pthread_mutex_unlock(&range->lock);
+
+	return ret;
+}
+
+/* Move the second half of the sets left in some other thread's range
+ * to the (empty) range of `self` */
+static bool range_steal(struct batch *batch, int self)
+{
+	int nr_ranges = batch->nr_ranges;
+
+	for (int k = 1; k < nr_ranges; ++k) {
+		struct batch_range *victim =
+			&batch->ranges[(self + k) % nr_ranges];
+
+		pthread_mutex_lock(&victim->lock);
+		int left = victim->end - victim->next;
+		int start = victim->end - (left + 1) / 2;
+		int end = victim->end;
+		if (left > 0)
+			victim->end = start;
+		pthread_mutex_unlock(&victim->lock);
+
+		if (left <= 0)
+			continue;
+
+		struct batch_range *range = &batch->ranges[self];
+		pthread_mutex_lock(&range->lock);
+		range->next = start;
+		range->end = end;
+		pthread_mutex_unlock(&range->lock);
+
+		return true;
+	}
+
+	return false;
+}
+
+/* Run a single set. `entry` caches the symbol of the previous set run
+ * by the thread, which for batches of vaccel_exec_batch() is the
+ * symbol of all of them */
+static int batch_run_set(struct vaccel_genop_set *set,
+		struct dl_entry **entry)
+{
+	if (set->nr_read < 2)
+		return VACCEL_EINVAL;
+
+	struct exec_args args;
+	int ret = exec_args_flatten(&args, set->read, set->nr_read,
+			set->write, set->nr_write);
+	if (ret)
+		return ret;
+
+	const char *library = args.read[0].buf;
+	const char *symbol = args.read[1].buf;
+	struct vaccel_arg *read = &args.read[2];
+	int nr_read = set->nr_read - 2;
+
+	if (!library || !symbol) {
+		ret = VACCEL_EINVAL;
+		goto out;
+	}
+
+	if (exec_workers_enabled()) {
+		ret = exec_workers_run(library, symbol, read, nr_read,
+				args.write, set->nr_write);
+		goto out;
+	}
+
+	if (!*entry || strcmp((*entry)->path, library) ||
+			strcmp((*entry)->symbol, symbol)) {
+		dl_cache_put(*entry);
+		*entry = NULL;
+
+		ret = dl_cache_get(0, library, symbol, entry);
+		if (ret)
+			goto out;
+	}
+
+	if (((exec_fn_t)(*entry)->fptr)(nr_read ? read : NULL, nr_read,
+				args.write, set->nr_write))
+		ret = VACCEL_ENOEXEC;
+
+out:
+	if (!ret)
+		exec_args_scatter(&args, set->write);
+
+	exec_args_release(&args);
+	return ret;
+}
+
+/* Run sets of the batch until there are none left to pick up */
+static void batch_work(struct batch *batch, int self)
+{
+	struct dl_entry *entry = NULL;
+
+	while (true) {
+		int idx;
+		if (!range_pop(&batch->ranges[self], &idx)) {
+			if (!range_steal(batch, self))
+				break;
+
+			continue;
+		}
+
+		struct vaccel_genop_set *set = &batch->sets[idx];
+		set->ret = batch_run_set(set, &entry);
+	}
+
+	dl_cache_put(entry);
+}
+
+static struct batch *batch_find_open(void)
+{
+	struct batch *batch = pool.batches;
+	while (batch && !batch->open)
+		batch = batch->next;
+
+	return batch;
+}
+
+static void *batch_thread(void *arg)
+{
+	int self = (int)(intptr_t)arg;
+
+	pthread_mutex_lock(&pool.lock);
+	while (true) {
+		struct batch *batch;
+		while (!(batch = batch_find_open()) && !pool.stopping)
+			pthread_cond_wait(&pool.work, &pool.lock);
+
+		if (pool.stopping)
+			break;
+
+		batch->nr_helpers++;
+		pthread_mutex_unlock(&pool.lock);
+
+		batch_work(batch, self);
+
+		pthread_mutex_lock(&pool.lock);
+
+		/* Every set has been picked up by someone */
+		batch->open = false;
+		if (!--batch->nr_helpers)
+			pthread_cond_broadcast(&pool.done);
+	}
+	pthread_mutex_unlock(&pool.lock);
+
+	return NULL;
+}
+
+/* Spawn the pool threads. Called with the pool lock held */
+static void batch_start(void)
+{
+	int nr_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	char *env = getenv("VACCEL_EXEC_BATCH_THREADS");
+	if (env && atoi(env) > 0)
+		nr_threads = atoi(env);
+
+	/* The calling thread is one of the batch threads */
+	nr_threads--;
+	if (nr_threads > MAX_BATCH_THREADS)
+		nr_threads = MAX_BATCH_THREADS;
+
+	for (int i = 0; i < nr_threads; ++i) {
+		if (pthread_create(&pool.threads[i], NULL, batch_thread,
+					(void *)(intptr_t)(i + 1)))
+			break;
+
+		pool.nr_threads++;
+	}
+
+	pool.started = true;
+	vaccel_debug("[exec] Started %d batch threads", pool.nr_threads);
+}
+
+int exec_batch(struct vaccel_session *sess, struct vaccel_genop_set *sets,
+		int nr_sets)
+{
+	if (!sets || nr_sets <= 0)
+		return VACCEL_EINVAL;
+
+	vaccel_debug("Calling exec batch of %d sets for session %u", nr_sets,
+			sess->session_id);
+
+	pthread_mutex_lock(&pool.lock);
+	if (!pool.started)
+		batch_start();
+	int nr_threads = pool.nr_threads;
+	pthread_mutex_unlock(&pool.lock);
+
+	struct batch batch = {
+		.sets = sets,
+		.nr_ranges = nr_threads + 1,
+	};
+
+	/* Split the sets evenly. Pool threads busy with other batches
+	 * might never join this one, in which case their share is
+	 * stolen by those that do */
+	for (int i = 0, start = 0; i < batch.nr_ranges; ++i) {
+		int len = nr_sets / batch.nr_ranges +
+			(i < nr_sets % batch.nr_ranges);
+		pthread_mutex_init(&batch.ranges[i].lock, NULL);
+		batch.ranges[i].next = start;
+		batch.ranges[i].end = start + len;
+		start += len;
+	}
+
+	bool shared = nr_threads && nr_sets > 1;
+	if (shared) {
+		pthread_mutex_lock(&pool.lock);
+		batch.open = true;
+		batch.next = pool.batches;
+		pool.batches = &batch;
+		pthread_cond_broadcast(&pool.work);
+		pthread_mutex_unlock(&pool.lock);
+	}
+
+	batch_work(&batch, 0);
+
+	if (shared) {
+		pthread_mutex_lock(&pool.lock);
+		batch.open = false;
+
+		struct batch **pprev = &pool.batches;
+		while (*pprev != &batch)
+			pprev = &(*pprev)->next;
+		*pprev = batch.next;
+
+		/* Wait for the sets pool threads are still running */
+		while (batch.nr_helpers)
+			pthread_cond_wait(&pool.done, &pool.lock);
+		pthread_mutex_unlock(&pool.lock);
+	}
+
+	for (int i = 0; i < batch.nr_ranges; ++i)
+		pthread_mutex_destroy(&batch.ranges[i].lock);
+
+	return VACCEL_OK;
+}
+
+void exec_batch_shutdown(void)
+{
+	pthread_mutex_lock(&pool.lock);
+	pool.stopping = true;
+	pthread_cond_broadcast(&pool.work);
+	pthread_mutex_unlock(&pool.lock);
+
+	for (int i = 0; i < pool.nr_threads; ++i)
+		pthread_join(pool.threads[i], NULL);
+
+	pthread_mutex_lock(&pool.lock);
+	pool.nr_threads = 0;
+	pool.started = false;
+	pool.stopping = false;
+	pthread_mutex_unlock(&pool.lock);
+}
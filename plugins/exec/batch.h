@@ -0,0 +1,38 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __EXEC_BATCH_H__
+#define __EXEC_BATCH_H__
+
+#include <vaccel.h>
+
+/* Batch implementation of exec
+ *
+ * The sets of a batch are spread across a pool of threads, of
+ * VACCEL_EXEC_BATCH_THREADS threads or one per online CPU by default,
+ * which the calling thread joins for the duration of the batch. Every
+ * thread starts with an equal share of the sets and, once it is done
+ * with it, steals half of the remaining sets of another thread.
+ *
+ * Batches run concurrently, each with its own state, and share the
+ * pool threads. A function of a batch may itself run a batch.
+ */
+int exec_batch(struct vaccel_session *sess, struct vaccel_genop_set *sets,
+		int nr_sets);
+
+/* Stop the threads of the pool */
+void exec_batch_shutdown(void);
+
+#endif /* __EXEC_BATCH_H__ */
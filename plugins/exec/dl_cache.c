@@ -0,0 +1,259 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "dl_cache.h"
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vaccel.h>
+
+#define DL_CACHE_BUCKETS 256
+
+static struct {
+	pthread_rwlock_t lock;
+	struct dl_entry *buckets[DL_CACHE_BUCKETS];
+} cache = {
+	.lock = PTHREAD_RWLOCK_INITIALIZER,
+};
+
+/* The cache can be disabled with VACCEL_EXEC_DLCACHE=disabled, in
+ * which case every call loads the library and resolves the symbol */
+static bool dl_cache_enabled(void)
+{
+	static int enabled = -1;
+
+	if (enabled < 0) {
+		char *env = getenv("VACCEL_EXEC_DLCACHE");
+		enabled = !(env && !strncmp(env, "disabled", 8));
+	}
+
+	return enabled;
+}
+
+static uint32_t fnv1a(uint32_t hash, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+
+	for (size_t i = 0; i < len; ++i) {
+		hash ^= p[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static uint32_t dl_hash(vaccel_id_t res_id, const char *path,
+		const char *symbol)
+{
+	uint32_t hash = fnv1a(2166136261u, &res_id, sizeof(res_id));
+
+	/* Resource entries are keyed by id only, the path is just
+	 * where the resource happens to live */
+	if (!res_id)
+		hash = fnv1a(hash, path, strlen(path) + 1);
+
+	return fnv1a(hash, symbol, strlen(symbol));
+}
+
+static bool dl_match(const struct dl_entry *entry, uint32_t hash,
+		vaccel_id_t res_id, const char *path, const char *symbol)
+{
+	if (entry->hash != hash || entry->res_id != res_id)
+		return false;
+
+	if (!res_id && strcmp(entry->path, path))
+		return false;
+
+	return !strcmp(entry->symbol, symbol);
+}
+
+static void dl_entry_free(struct dl_entry *entry)
+{
+	if (entry->handle)
+		dlclose(entry->handle);
+
+	free(entry->path);
+	free(entry->symbol);
+	free(entry);
+}
+
+static struct dl_entry *dl_entry_new(vaccel_id_t res_id, const char *path,
+		const char *symbol, uint32_t hash, int *ret)
+{
+	struct dl_entry *entry = calloc(1, sizeof(*entry));
+	if (!entry) {
+		*ret = VACCEL_ENOMEM;
+		return NULL;
+	}
+
+	entry->res_id = res_id;
+	entry->hash = hash;
+	entry->path = strdup(path);
+	entry->symbol = strdup(symbol);
+	if (!entry->path || !entry->symbol) {
+		*ret = VACCEL_ENOMEM;
+		goto free_entry;
+	}
+
+	vaccel_debug("[exec] library: %s", path);
+	entry->handle = dlopen(path, RTLD_NOW);
+	if (!entry->handle) {
+		vaccel_error("%s", dlerror());
+		*ret = VACCEL_EINVAL;
+		goto free_entry;
+	}
+
+	/* Get the function pointer based on the relevant symbol */
+	vaccel_debug("[exec] symbol: %s", symbol);
+	entry->fptr = dlsym(entry->handle, symbol);
+	if (!entry->fptr) {
+		vaccel_error("%s", dlerror());
+		*ret = VACCEL_EINVAL;
+		goto free_entry;
+	}
+
+	atomic_init(&entry->refcount, 1);
+	*ret = VACCEL_OK;
+
+	return entry;
+
+free_entry:
+	dl_entry_free(entry);
+	return NULL;
+}
+
+static struct dl_entry *dl_lookup(uint32_t hash, vaccel_id_t res_id,
+		const char *path, const char *symbol)
+{
+	struct dl_entry *entry = cache.buckets[hash % DL_CACHE_BUCKETS];
+	for (; entry; entry = entry->next) {
+		if (dl_match(entry, hash, res_id, path, symbol)) {
+			atomic_fetch_add(&entry->refcount, 1);
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+int dl_cache_get(vaccel_id_t res_id, const char *path, const char *symbol,
+		struct dl_entry **entry)
+{
+	if (!path || !symbol || !entry)
+		return VACCEL_EINVAL;
+
+	int ret;
+	uint32_t hash = dl_hash(res_id, path, symbol);
+
+	if (!dl_cache_enabled()) {
+		*entry = dl_entry_new(res_id, path, symbol, hash, &ret);
+		return ret;
+	}
+
+	pthread_rwlock_rdlock(&cache.lock);
+	*entry = dl_lookup(hash, res_id, path, symbol);
+	pthread_rwlock_unlock(&cache.lock);
+	if (*entry)
+		return VACCEL_OK;
+
+	/* Load the library without holding the lock, the loader might
+	 * run constructors that take a while */
+	struct dl_entry *new = dl_entry_new(res_id, path, symbol, hash, &ret);
+	if (!new)
+		return ret;
+
+	pthread_rwlock_wrlock(&cache.lock);
+	*entry = dl_lookup(hash, res_id, path, symbol);
+	if (!*entry) {
+		/* One reference for the cache, one for the caller */
+		atomic_fetch_add(&new->refcount, 1);
+		new->next = cache.buckets[hash % DL_CACHE_BUCKETS];
+		cache.buckets[hash % DL_CACHE_BUCKETS] = new;
+		*entry = new;
+		new = NULL;
+	}
+	pthread_rwlock_unlock(&cache.lock);
+
+	/* Somebody else got there first */
+	if (new)
+		dl_entry_free(new);
+
+	return VACCEL_OK;
+}
+
+void dl_cache_put(struct dl_entry *entry)
+{
+	if (entry && atomic_fetch_sub(&entry->refcount, 1) == 1)
+		dl_entry_free(entry);
+}
+
+/* Unlink the entries `match` returns true for and drop the cache's
+ * reference on them */
+static void dl_cache_remove(bool (*match)(struct dl_entry *, vaccel_id_t),
+		vaccel_id_t res_id)
+{
+	struct dl_entry *removed = NULL;
+
+	pthread_rwlock_wrlock(&cache.lock);
+	for (int i = 0; i < DL_CACHE_BUCKETS; ++i) {
+		struct dl_entry **pprev = &cache.buckets[i];
+		while (*pprev) {
+			struct dl_entry *entry = *pprev;
+			if (!match(entry, res_id)) {
+				pprev = &entry->next;
+				continue;
+			}
+
+			*pprev = entry->next;
+			entry->next = removed;
+			removed = entry;
+		}
+	}
+	pthread_rwlock_unlock(&cache.lock);
+
+	while (removed) {
+		struct dl_entry *next = removed->next;
+		dl_cache_put(removed);
+		removed = next;
+	}
+}
+
+static bool match_resource(struct dl_entry *entry, vaccel_id_t res_id)
+{
+	return entry->res_id == res_id;
+}
+
+static bool match_all(struct dl_entry *entry, vaccel_id_t res_id)
+{
+	(void)entry;
+	(void)res_id;
+
+	return true;
+}
+
+void dl_cache_invalidate(vaccel_id_t res_id)
+{
+	if (res_id)
+		dl_cache_remove(match_resource, res_id);
+}
+
+void dl_cache_flush(void)
+{
+	dl_cache_remove(match_all, 0);
+}
@@ -0,0 +1,66 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __EXEC_DL_CACHE_H__
+#define __EXEC_DL_CACHE_H__
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include <vaccel_id.h>
+
+/* Cache of resolved symbols
+ *
+ * Entries are keyed by (library, symbol), where the library is either
+ * a path or the id of a shared object resource. Each entry holds its
+ * own dlopen() handle, so the library stays loaded for as long as an
+ * entry points into it. Lookups take a reference on the entry, which
+ * callers drop with dl_cache_put() once they are done calling the
+ * function.
+ */
+struct dl_entry {
+	/* Key of the entry. `res_id` is 0 for path-based entries */
+	vaccel_id_t res_id;
+	char *path;
+	char *symbol;
+	uint32_t hash;
+
+	/* The library and the resolved symbol */
+	void *handle;
+	void *fptr;
+
+	/* One reference is held by the cache while the entry is
+	 * reachable and one by each caller using the entry */
+	atomic_int refcount;
+
+	struct dl_entry *next;
+};
+
+/* Find or create the entry for `symbol` in the library at `path`.
+ * `res_id` is the id of the shared object resource `path` belongs to,
+ * or 0 for plain paths */
+int dl_cache_get(vaccel_id_t res_id, const char *path, const char *symbol,
+		struct dl_entry **entry);
+
+/* Drop a reference taken by dl_cache_get() */
+void dl_cache_put(struct dl_entry *entry);
+
+/* Remove all the entries of a shared object resource */
+void dl_cache_invalidate(vaccel_id_t res_id);
+
+/* Remove all the entries */
+void dl_cache_flush(void);
+
+#endif /* __EXEC_DL_CACHE_H__ */
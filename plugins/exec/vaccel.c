@@ -15,7 +15,11 @@
 #include <stdio.h>
 #include <vaccel.h>
 #include <byteswap.h>
-#include <dlfcn.h>
+
+#include "args.h"
+#include "batch.h"
+#include "dl_cache.h"
+#include "workers.h"
 
 #if 0
 struct vector_arg {
@@ -33,77 +37,85 @@ static int noop(struct vaccel_session *session)
 	return VACCEL_OK;
 }
 
+typedef int (*exec_fn_t)(void *, size_t, void *, size_t);
+
+static int exec_symbol(vaccel_id_t res_id, const char *library,
+		const char *fn_symbol, void *read, size_t nr_read,
+		void *write, size_t nr_write)
+{
+	struct dl_entry *entry;
+	int ret = dl_cache_get(res_id, library, fn_symbol, &entry);
+	if (ret)
+		return ret;
+
+	ret = ((exec_fn_t)entry->fptr)(read, nr_read, write, nr_write);
+	dl_cache_put(entry);
+	if (ret)
+		return VACCEL_ENOEXEC;
+
+	return VACCEL_OK;
+}
+
 static int exec(struct vaccel_session *session, const char *library, const char
 		*fn_symbol, void *read, size_t nr_read, void *write,
 		size_t nr_write)
 {
-	int i = 0;
-	void *dl;
-	int (*fptr)(void *, size_t, void *, size_t);
-	int ret;
-	struct vaccel_arg *args;
-
 	vaccel_debug("Calling exec for session %u", session->session_id);
 
-	vaccel_debug("[exec] library: %s", library);
-	dl = dlopen(library, RTLD_NOW);
-	if (!dl) {
-		vaccel_error("%s", dlerror());
-		return VACCEL_EINVAL;
-	}
+	struct exec_args args;
+	int ret = exec_args_flatten(&args, read, nr_read, write, nr_write);
+	if (ret)
+		return ret;
 
-	/* Get the function pointer based on the relevant symbol */
-	vaccel_debug("[exec] symbol: %s", fn_symbol);
-	fptr = (int (*)(void*, size_t, void*,size_t))dlsym(dl, fn_symbol);
-	if (!fptr) {
-		vaccel_error("%s", dlerror());
-		return VACCEL_EINVAL;
-	}
+	if (exec_workers_enabled())
+		ret = exec_workers_run(library, fn_symbol, args.read, nr_read,
+				args.write, nr_write);
+	else
+		ret = exec_symbol(0, library, fn_symbol, args.read, nr_read,
+				args.write, nr_write);
 
-	ret = (*fptr)(read, nr_read, write, nr_write);
-	if (ret)
-		return VACCEL_ENOEXEC;
+	if (!ret)
+		exec_args_scatter(&args, write);
 
-	return VACCEL_OK;
+	exec_args_release(&args);
+	return ret;
+}
+
+/* Drop the cached symbols of a shared object that is being destroyed */
+static void exec_object_release(struct vaccel_shared_object *object)
+{
+	dl_cache_invalidate(vaccel_shared_object_get_id(object));
 }
 
 static int exec_with_resource(struct vaccel_session *session, struct vaccel_shared_object *object, const char *fn_symbol, void *read, size_t nr_read, void *write,
 							  size_t nr_write)
 {
-	int i = 0;
-	void *dl;
-	int (*fptr)(void *, size_t, void *, size_t);
-	int ret;
-	struct vaccel_arg *args;
-	struct vaccel_file *file;
-
 	vaccel_debug("Calling exec_with_resource for session %u", session->session_id);
 
-	file = &object->file;
-	const char *library = file->path;
-
-	vaccel_debug("[exec_with_resource] library: %s", library);
-	dl = dlopen(library, RTLD_NOW);
-	if (!dl)
-	{
-		vaccel_error("%s", dlerror());
-		return VACCEL_EINVAL;
-	}
-
-	/* Get the function pointer based on the relevant symbol */
-	vaccel_debug("[exec] symbol: %s", fn_symbol);
-	fptr = (int (*)(void *, size_t, void *, size_t))dlsym(dl, fn_symbol);
-	if (!fptr)
-	{
-		vaccel_error("%s", dlerror());
-		return VACCEL_EINVAL;
+	struct exec_args args;
+	int ret = exec_args_flatten(&args, read, nr_read, write, nr_write);
+	if (ret)
+		return ret;
+
+	/* Preloaded symbols can be called directly. They live as long as
+	 * the object, which callers must not destroy while using it */
+	exec_fn_t fptr = vaccel_shared_object_symbol(object, fn_symbol);
+	if (fptr) {
+		if (fptr(args.read, nr_read, args.write, nr_write))
+			ret = VACCEL_ENOEXEC;
+	} else {
+		object->plugin_data_free = exec_object_release;
+
+		ret = exec_symbol(vaccel_shared_object_get_id(object),
+				object->file.path, fn_symbol, args.read,
+				nr_read, args.write, nr_write);
 	}
 
-	ret = (*fptr)(read, nr_read, write, nr_write);
-	if (ret)
-		return VACCEL_ENOEXEC;
+	if (!ret)
+		exec_args_scatter(&args, write);
 
-	return VACCEL_OK;
+	exec_args_release(&args);
+	return ret;
 }
 
 struct vaccel_op ops[] = {
@@ -112,13 +124,30 @@ struct vaccel_op ops[] = {
 	VACCEL_OP_INIT(ops[2], VACCEL_EXEC_WITH_RESOURCE, exec_with_resource),
 };
 
+struct vaccel_op batch_ops[] = {
+	VACCEL_OP_INIT(batch_ops[0], VACCEL_EXEC, exec_batch),
+};
+
 static int init(void)
 {
-	return register_plugin_functions(ops, sizeof(ops) / sizeof(ops[0]));
+	int ret = exec_workers_init();
+	if (ret)
+		return ret;
+
+	ret = register_plugin_functions(ops, sizeof(ops) / sizeof(ops[0]));
+	if (ret)
+		return ret;
+
+	return register_plugin_batch_functions(batch_ops,
+			sizeof(batch_ops) / sizeof(batch_ops[0]));
 }
 
 static int fini(void)
 {
+	exec_batch_shutdown();
+	exec_workers_shutdown();
+	dl_cache_flush();
+
 	return VACCEL_OK;
 }
 
@@ -127,4 +156,7 @@ VACCEL_MODULE(
 		.version = VACCELRT_VERSION,
 		.type = VACCEL_PLUGIN_SOFTWARE | VACCEL_PLUGIN_GENERIC | VACCEL_PLUGIN_CPU,
 		.init = init,
-		.fini = fini)
+		.fini = fini,
+		.sg_capable = true,
+		.mem_alloc = exec_shm_alloc,
+		.mem_free = exec_shm_free)
@@ -0,0 +1,666 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "workers.h"
+#include "dl_cache.h"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define MAX_EXEC_WORKERS 64
+#define MAX_EXEC_SYMBOL 256
+#define DEFAULT_SHM_SIZE_MB 64
+
+/* Blocks of the shared heap are powers of two, from 64 bytes up */
+#define SHM_MIN_CLASS 6
+#define SHM_MAX_CLASS 47
+
+typedef int (*exec_fn_t)(void *, size_t, void *, size_t);
+
+/* An exec call, as seen by a worker. It lives in the shared heap and
+ * its address is what we send to the worker. The read arguments are
+ * followed by the write arguments in `args` */
+struct exec_req {
+	char library[PATH_MAX];
+	char symbol[MAX_EXEC_SYMBOL];
+	size_t nr_read;
+	size_t nr_write;
+	int ret;
+	struct vaccel_arg args[];
+};
+
+struct shm_block {
+	/* log2 of the size of the block, including this header */
+	size_t class;
+
+	/* Next block in the free list of the class, while free */
+	struct shm_block *next;
+};
+
+static struct {
+	pthread_mutex_t lock;
+
+	/* The shared mapping and how much of it has been handed out */
+	char *base;
+	size_t size;
+	size_t brk;
+
+	/* Free blocks of each size class */
+	struct shm_block *free[SHM_MAX_CLASS + 1];
+} shm = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static pthread_once_t shm_once = PTHREAD_ONCE_INIT;
+
+struct exec_worker {
+	pid_t pid;
+
+	/* Our end of the socket pair connecting us to the worker */
+	int fd;
+};
+
+static struct {
+	pthread_mutex_t lock;
+
+	/* Signaled when a worker becomes idle */
+	pthread_cond_t idle_cond;
+
+	struct exec_worker workers[MAX_EXEC_WORKERS];
+	int nr_workers;
+
+	/* Stack of idle workers */
+	struct exec_worker *idle[MAX_EXEC_WORKERS];
+	int nr_idle;
+
+	/* Workers that are either idle or running a call */
+	int nr_alive;
+
+	/* Timeout of a call in milliseconds, -1 for none */
+	int timeout;
+
+	bool started;
+
+	/* Process forking the workers on our behalf, and our end of the
+	 * socket pair connecting us to it */
+	pid_t spawner_pid;
+	int spawner_fd;
+} pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.idle_cond = PTHREAD_COND_INITIALIZER,
+	.spawner_fd = -1,
+};
+
+static int env_to_int(const char *name, int def, int max)
+{
+	char *env = getenv(name);
+	if (!env)
+		return def;
+
+	int val = atoi(env);
+	if (val <= 0)
+		return def;
+
+	return (val > max) ? max : val;
+}
+
+bool exec_workers_enabled(void)
+{
+	static int nr_workers = -1;
+
+	if (nr_workers < 0)
+		nr_workers = env_to_int("VACCEL_EXEC_WORKERS", 0,
+				MAX_EXEC_WORKERS);
+
+	return nr_workers > 0;
+}
+
+static void shm_setup(void)
+{
+	size_t size = (size_t)env_to_int("VACCEL_EXEC_SHM_SIZE",
+			DEFAULT_SHM_SIZE_MB, 1024 * 1024) << 20;
+
+	/* Pages are only backed by memory once they are touched */
+	void *base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (base == MAP_FAILED) {
+		vaccel_error("[exec] Could not map %zu bytes of shared memory",
+				size);
+		return;
+	}
+
+	shm.base = base;
+	shm.size = size;
+}
+
+static bool shm_contains(const void *ptr, size_t len)
+{
+	const char *p = ptr;
+
+	return shm.base && p >= shm.base && len <= shm.size &&
+		(size_t)(p - shm.base) <= shm.size - len;
+}
+
+static void *shm_alloc(size_t size)
+{
+	if (size > ((size_t)1 << SHM_MAX_CLASS) - sizeof(struct shm_block))
+		return NULL;
+
+	size_t class = SHM_MIN_CLASS;
+	while (((size_t)1 << class) < size + sizeof(struct shm_block))
+		class++;
+
+	struct shm_block *block = NULL;
+
+	pthread_mutex_lock(&shm.lock);
+	if (shm.free[class]) {
+		block = shm.free[class];
+		shm.free[class] = block->next;
+	} else if (shm.size - shm.brk >= ((size_t)1 << class)) {
+		block = (struct shm_block *)(shm.base + shm.brk);
+		shm.brk += (size_t)1 << class;
+	}
+	pthread_mutex_unlock(&shm.lock);
+
+	if (!block)
+		return NULL;
+
+	block->class = class;
+
+	return block + 1;
+}
+
+static void shm_free(void *ptr)
+{
+	struct shm_block *block = (struct shm_block *)ptr - 1;
+
+	pthread_mutex_lock(&shm.lock);
+	block->next = shm.free[block->class];
+	shm.free[block->class] = block;
+	pthread_mutex_unlock(&shm.lock);
+}
+
+void *exec_shm_alloc(size_t size)
+{
+	if (!exec_workers_enabled())
+		return malloc(size);
+
+	pthread_once(&shm_once, shm_setup);
+	if (!shm.base)
+		return malloc(size);
+
+	return shm_alloc(size);
+}
+
+void exec_shm_free(void *ptr)
+{
+	if (!ptr)
+		return;
+
+	if (shm_contains(ptr, 1))
+		shm_free(ptr);
+	else
+		free(ptr);
+}
+
+static void worker_preload(void)
+{
+	char *env = getenv("VACCEL_EXEC_PRELOAD");
+	if (!env)
+		return;
+
+	char *libs = strdup(env);
+	if (!libs)
+		return;
+
+	char *saveptr;
+	for (char *lib = strtok_r(libs, ":", &saveptr); lib;
+			lib = strtok_r(NULL, ":", &saveptr)) {
+		/* We never close these, they are meant to stay loaded for
+		 * the lifetime of the worker */
+		if (!dlopen(lib, RTLD_NOW))
+			vaccel_warn("[exec] Could not preload %s: %s", lib,
+					dlerror());
+	}
+
+	free(libs);
+}
+
+static void __attribute__((noreturn)) worker_main(int fd)
+{
+	worker_preload();
+
+	while (true) {
+		struct exec_req *req;
+		if (recv(fd, &req, sizeof(req), 0) != sizeof(req))
+			_exit(0);
+
+		struct dl_entry *entry;
+		int ret = dl_cache_get(0, req->library, req->symbol, &entry);
+		if (!ret) {
+			exec_fn_t fptr = (exec_fn_t)entry->fptr;
+			if (fptr(req->args, req->nr_read,
+					req->args + req->nr_read,
+					req->nr_write))
+				ret = VACCEL_ENOEXEC;
+
+			dl_cache_put(entry);
+		}
+
+		/* Workers are killed when they time out, so do not keep
+		 * the output of the function buffered */
+		fflush(NULL);
+
+		req->ret = ret;
+		if (send(fd, &ret, sizeof(ret), MSG_NOSIGNAL) != sizeof(ret))
+			_exit(1);
+	}
+}
+
+/* Send a worker's pid, and its socket if it could be forked */
+static int spawner_reply(int fd, pid_t pid, int worker_fd)
+{
+	char cmsg_buf[CMSG_SPACE(sizeof(int))] = { 0 };
+	struct iovec iov = { .iov_base = &pid, .iov_len = sizeof(pid) };
+	struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+
+	if (pid > 0) {
+		msg.msg_control = cmsg_buf;
+		msg.msg_controllen = sizeof(cmsg_buf);
+
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &worker_fd, sizeof(int));
+	}
+
+	return sendmsg(fd, &msg, MSG_NOSIGNAL) == sizeof(pid) ? 0 : -1;
+}
+
+/* Main loop of the spawner, which forks a worker for every request we
+ * send it. It is forked before any exec call runs, so unlike us it is
+ * single-threaded and none of the locks it inherits can be held */
+static void __attribute__((noreturn)) spawner_main(int fd)
+{
+	/* Workers are reaped automatically */
+	signal(SIGCHLD, SIG_IGN);
+
+	while (true) {
+		char cmd;
+		if (recv(fd, &cmd, sizeof(cmd), 0) != sizeof(cmd))
+			_exit(0);
+
+		int sv[2];
+		pid_t pid = -1;
+		if (!socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv)) {
+			pid = fork();
+			if (!pid) {
+				close(fd);
+				close(sv[0]);
+				signal(SIGCHLD, SIG_DFL);
+				worker_main(sv[1]);
+			}
+
+			close(sv[1]);
+		}
+
+		int ret = spawner_reply(fd, pid, sv[0]);
+		if (pid > 0)
+			close(sv[0]);
+		if (ret)
+			_exit(1);
+	}
+}
+
+/* Fork the spawner. The shared heap is mapped first, so that it is
+ * inherited by the workers */
+static int spawner_start(void)
+{
+	pthread_once(&shm_once, shm_setup);
+	if (!shm.base)
+		return VACCEL_ENOMEM;
+
+	int sv[2];
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv))
+		return VACCEL_EIO;
+
+	/* Buffered output would otherwise be written by both processes */
+	fflush(NULL);
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		close(sv[0]);
+		close(sv[1]);
+		return VACCEL_ENOMEM;
+	}
+
+	if (!pid) {
+		close(sv[0]);
+		spawner_main(sv[1]);
+	}
+
+	close(sv[1]);
+	pool.spawner_pid = pid;
+	pool.spawner_fd = sv[0];
+
+	return VACCEL_OK;
+}
+
+/* Have the spawner fork the worker at `w`. Called with the pool lock
+ * held */
+static int worker_spawn(struct exec_worker *w)
+{
+	char cmd = 0;
+	if (pool.spawner_fd < 0 ||
+			send(pool.spawner_fd, &cmd, sizeof(cmd), MSG_NOSIGNAL) !=
+			sizeof(cmd))
+		return VACCEL_EIO;
+
+	pid_t pid;
+	char cmsg_buf[CMSG_SPACE(sizeof(int))];
+	struct iovec iov = { .iov_base = &pid, .iov_len = sizeof(pid) };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = cmsg_buf,
+		.msg_controllen = sizeof(cmsg_buf),
+	};
+
+	if (recvmsg(pool.spawner_fd, &msg, MSG_CMSG_CLOEXEC) != sizeof(pid))
+		return VACCEL_EIO;
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	if (pid <= 0 || !cmsg || cmsg->cmsg_type != SCM_RIGHTS)
+		return VACCEL_ENOMEM;
+
+	w->pid = pid;
+	memcpy(&w->fd, CMSG_DATA(cmsg), sizeof(int));
+
+	return VACCEL_OK;
+}
+
+/* Kill a worker and wait for it to be gone
+ *
+ * The spawner reaps the worker, so we cannot wait for it. Its end of
+ * the socket is closed only once it has exited, after its memory is
+ * gone, so seeing the end of the socket means the worker cannot write
+ * to the shared heap anymore and the blocks of its call can be
+ * reused. */
+static void worker_reap(struct exec_worker *w)
+{
+	if (w->fd < 0)
+		return;
+
+	kill(w->pid, SIGKILL);
+
+	while (true) {
+		int result;
+		ssize_t ret = recv(w->fd, &result, sizeof(result), 0);
+		if (!ret || (ret < 0 && errno != EINTR))
+			break;
+	}
+
+	close(w->fd);
+	w->fd = -1;
+}
+
+int exec_workers_init(void)
+{
+	if (!exec_workers_enabled())
+		return VACCEL_OK;
+
+	pthread_mutex_lock(&pool.lock);
+	int ret = pool.spawner_fd < 0 ? spawner_start() : VACCEL_OK;
+	pthread_mutex_unlock(&pool.lock);
+
+	if (ret)
+		vaccel_error("[exec] Could not start the worker spawner");
+
+	return ret;
+}
+
+static int pool_start(void)
+{
+	int ret = VACCEL_OK;
+
+	pthread_mutex_lock(&pool.lock);
+	if (pool.started)
+		goto unlock;
+
+	int timeout = env_to_int("VACCEL_EXEC_TIMEOUT", 0, INT_MAX);
+	pool.timeout = timeout ? timeout : -1;
+
+	int nr_workers = env_to_int("VACCEL_EXEC_WORKERS", 0,
+			MAX_EXEC_WORKERS);
+	for (int i = 0; i < nr_workers; ++i) {
+		struct exec_worker *w = &pool.workers[i];
+		w->fd = -1;
+		if (worker_spawn(w))
+			break;
+
+		pool.nr_workers++;
+		pool.idle[pool.nr_idle++] = w;
+	}
+
+	if (!pool.nr_workers) {
+		vaccel_error("[exec] Could not spawn worker processes");
+		ret = VACCEL_ENOMEM;
+		goto unlock;
+	}
+
+	pool.nr_alive = pool.nr_workers;
+	pool.started = true;
+	vaccel_debug("[exec] Started %d worker processes", pool.nr_workers);
+
+unlock:
+	pthread_mutex_unlock(&pool.lock);
+	return ret;
+}
+
+static struct exec_worker *worker_get(void)
+{
+	struct exec_worker *w = NULL;
+
+	pthread_mutex_lock(&pool.lock);
+	while (!pool.nr_idle && pool.nr_alive)
+		pthread_cond_wait(&pool.idle_cond, &pool.lock);
+
+	if (pool.nr_idle)
+		w = pool.idle[--pool.nr_idle];
+	pthread_mutex_unlock(&pool.lock);
+
+	return w;
+}
+
+/* Return a worker to the pool. A worker that failed is replaced by a
+ * new one first */
+static void worker_put(struct exec_worker *w, bool failed)
+{
+	/* Nobody else uses the worker until it is back in the pool */
+	if (failed)
+		worker_reap(w);
+
+	pthread_mutex_lock(&pool.lock);
+	if (failed) {
+		if (worker_spawn(w)) {
+			vaccel_error("[exec] Could not replace worker process");
+			pool.nr_alive--;
+			pthread_cond_broadcast(&pool.idle_cond);
+			goto unlock;
+		}
+	}
+
+	pool.idle[pool.nr_idle++] = w;
+	pthread_cond_signal(&pool.idle_cond);
+
+unlock:
+	pthread_mutex_unlock(&pool.lock);
+}
+
+/* Hand a request to a worker and wait for it to complete */
+static int worker_call(struct exec_worker *w, struct exec_req *req)
+{
+	if (send(w->fd, &req, sizeof(req), MSG_NOSIGNAL) != sizeof(req))
+		return VACCEL_EIO;
+
+	struct pollfd pfd = { .fd = w->fd, .events = POLLIN };
+	int ret;
+	do {
+		ret = poll(&pfd, 1, pool.timeout);
+	} while (ret < 0 && errno == EINTR);
+
+	if (!ret) {
+		vaccel_error("[exec] %s timed out in worker %d", req->symbol,
+				w->pid);
+		return VACCEL_ETIMEDOUT;
+	}
+
+	int result;
+	if (ret < 0 || recv(w->fd, &result, sizeof(result), 0) !=
+			sizeof(result)) {
+		vaccel_error("[exec] Worker %d died running %s", w->pid,
+				req->symbol);
+		return VACCEL_EIO;
+	}
+
+	return VACCEL_OK;
+}
+
+static inline struct vaccel_arg *user_arg(struct vaccel_arg *read,
+		size_t nr_read, struct vaccel_arg *write, size_t i)
+{
+	return (i < nr_read) ? &read[i] : &write[i - nr_read];
+}
+
+int exec_workers_run(const char *library, const char *fn_symbol,
+		struct vaccel_arg *read, size_t nr_read,
+		struct vaccel_arg *write, size_t nr_write)
+{
+	if (!library || !fn_symbol)
+		return VACCEL_EINVAL;
+
+	if (strlen(library) >= PATH_MAX || strlen(fn_symbol) >= MAX_EXEC_SYMBOL)
+		return VACCEL_ENAMETOOLONG;
+
+	int ret = pool_start();
+	if (ret)
+		return ret;
+
+	size_t nr_args = nr_read + nr_write;
+	struct exec_req *req =
+		shm_alloc(sizeof(*req) + nr_args * sizeof(struct vaccel_arg));
+	if (!req)
+		return VACCEL_ENOMEM;
+
+	strcpy(req->library, library);
+	strcpy(req->symbol, fn_symbol);
+	req->nr_read = nr_read;
+	req->nr_write = nr_write;
+	req->ret = VACCEL_OK;
+
+	for (size_t i = 0; i < nr_args; ++i)
+		req->args[i] = *user_arg(read, nr_read, write, i);
+
+	/* Buffers that do not live in the shared heap go through a
+	 * bounce buffer */
+	for (size_t i = 0; i < nr_args; ++i) {
+		struct vaccel_arg *arg = &req->args[i];
+		if (!arg->buf || shm_contains(arg->buf, arg->size))
+			continue;
+
+		void *bounce = shm_alloc(arg->size ? arg->size : 1);
+		if (!bounce) {
+			ret = VACCEL_ENOMEM;
+			goto free_args;
+		}
+
+		memcpy(bounce, arg->buf, arg->size);
+		arg->buf = bounce;
+	}
+
+	struct exec_worker *w = worker_get();
+	if (!w) {
+		ret = VACCEL_EBACKEND;
+		goto free_args;
+	}
+
+	ret = worker_call(w, req);
+	worker_put(w, ret != VACCEL_OK);
+	if (ret)
+		goto free_args;
+
+	ret = req->ret;
+	for (size_t i = nr_read; i < nr_args; ++i) {
+		struct vaccel_arg *arg = user_arg(read, nr_read, write, i);
+
+		/* The worker can shrink an argument, never grow it past
+		 * the caller's buffer */
+		uint32_t size = req->args[i].size < arg->size ?
+			req->args[i].size : arg->size;
+		if (req->args[i].buf != arg->buf)
+			memcpy(arg->buf, req->args[i].buf, size);
+
+		arg->size = size;
+	}
+
+free_args:
+	for (size_t i = 0; i < nr_args; ++i) {
+		struct vaccel_arg *arg = user_arg(read, nr_read, write, i);
+		if (req->args[i].buf != arg->buf)
+			shm_free(req->args[i].buf);
+	}
+	shm_free(req);
+
+	return ret;
+}
+
+void exec_workers_shutdown(void)
+{
+	pthread_mutex_lock(&pool.lock);
+	for (int i = 0; i < pool.nr_workers; ++i) {
+		struct exec_worker *w = &pool.workers[i];
+		if (w->fd < 0)
+			continue;
+
+		/* Workers exit once they see their socket closed */
+		close(w->fd);
+		w->fd = -1;
+	}
+
+	if (pool.spawner_fd >= 0) {
+		close(pool.spawner_fd);
+		pool.spawner_fd = -1;
+		waitpid(pool.spawner_pid, NULL, 0);
+	}
+
+	pool.nr_workers = 0;
+	pool.nr_idle = 0;
+	pool.nr_alive = 0;
+	pool.started = false;
+	pthread_mutex_unlock(&pool.lock);
+}
@@ -0,0 +1,65 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __EXEC_WORKERS_H__
+#define __EXEC_WORKERS_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <vaccel.h>
+
+/* Pool of worker processes executing exec calls
+ *
+ * When VACCEL_EXEC_WORKERS is set to a positive number, that many
+ * worker processes are started the first time they are needed and exec
+ * calls are dispatched to whichever of them is idle. A function that
+ * crashes or, with VACCEL_EXEC_TIMEOUT (in milliseconds) set, runs for
+ * too long, only takes down its worker, which is replaced.
+ *
+ * Forking a multithreaded process is only safe if the child does not
+ * touch locks other threads might hold, which the workers do. So they
+ * are forked by a spawner process, itself forked at plugin init before
+ * any exec call runs.
+ *
+ * Arguments are passed through a heap shared with the workers, of
+ * VACCEL_EXEC_SHM_SIZE MiB. It is mapped before forking, so pointers
+ * into it are valid in all processes. Buffers allocated from it with
+ * exec_shm_alloc() are passed as is; any other buffer is copied in and
+ * out of it. Libraries listed in VACCEL_EXEC_PRELOAD (colon-separated)
+ * are loaded by every worker when it starts.
+ */
+
+/* Fork the spawner of the worker processes, if they are enabled */
+int exec_workers_init(void);
+
+/* Whether exec calls should be dispatched to the worker pool */
+bool exec_workers_enabled(void);
+
+/* Run `fn_symbol` of `library` in a worker process */
+int exec_workers_run(const char *library, const char *fn_symbol,
+		struct vaccel_arg *read, size_t nr_read,
+		struct vaccel_arg *write, size_t nr_write);
+
+/* Terminate the workers. The shared heap stays mapped, as buffers
+ * allocated from it might still be in use */
+void exec_workers_shutdown(void);
+
+/* Allocate memory that is visible to the worker processes. Without a
+ * worker pool this falls back to malloc() */
+void *exec_shm_alloc(size_t size);
+void exec_shm_free(void *ptr);
+
+#endif /* __EXEC_WORKERS_H__ */
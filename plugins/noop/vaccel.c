@@ -507,10 +507,53 @@ struct vaccel_op ops[] = {
 	VACCEL_OP_INIT(ops[19], VACCEL_OPENCV, noop_opencv),
 };
 
+static int noop_noop_batch(struct vaccel_session *sess,
+		struct vaccel_genop_set *sets, int nr_sets)
+{
+	fprintf(stdout, "[noop] Calling batch of %d no-ops for session %u\n",
+		nr_sets, sess->session_id);
+
+	for (int i = 0; i < nr_sets; ++i)
+		sets[i].ret = VACCEL_OK;
+
+	return VACCEL_OK;
+}
+
+static int noop_exec_batch(struct vaccel_session *sess,
+		struct vaccel_genop_set *sets, int nr_sets)
+{
+	fprintf(stdout, "[noop] Calling batch of %d execs for session %u\n",
+		nr_sets, sess->session_id);
+
+	for (int i = 0; i < nr_sets; ++i) {
+		struct vaccel_genop_set *set = &sets[i];
+		if (set->nr_read < 2) {
+			set->ret = VACCEL_EINVAL;
+			continue;
+		}
+
+		fprintf(stdout, "[noop] library: %s symbol: %s nr_read: %d nr_write: %d\n",
+			(char *)set->read[0].buf, (char *)set->read[1].buf,
+			set->nr_read - 2, set->nr_write);
+		set->ret = VACCEL_OK;
+	}
+
+	return VACCEL_OK;
+}
+
+struct vaccel_op batch_ops[] = {
+	VACCEL_OP_INIT(batch_ops[0], VACCEL_NO_OP, noop_noop_batch),
+	VACCEL_OP_INIT(batch_ops[1], VACCEL_EXEC, noop_exec_batch),
+};
 
 static int init(void)
 {
-	return register_plugin_functions(ops, sizeof(ops) / sizeof(ops[0]));
+	int ret = register_plugin_functions(ops, sizeof(ops) / sizeof(ops[0]));
+	if (ret)
+		return ret;
+
+	return register_plugin_batch_functions(batch_ops,
+			sizeof(batch_ops) / sizeof(batch_ops[0]));
 }
 
 static int fini(void)
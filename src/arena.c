@@ -0,0 +1,133 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "arena.h"
+
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define ARENA_MIN_CHUNK (4 * 1024)
+#define ARENA_MAX_CHUNK (1024 * 1024)
+
+struct arena_chunk {
+	struct arena_chunk *next;
+
+	/* Capacity and bytes in use of `data` */
+	size_t size;
+	size_t used;
+
+	max_align_t data[];
+};
+
+static inline size_t align_up(size_t size)
+{
+	return (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+}
+
+void arena_init(struct arena *arena)
+{
+	arena->head = NULL;
+	arena->cur = NULL;
+	arena->next_size = ARENA_MIN_CHUNK;
+	arena->nr_chunks = 0;
+	arena->nr_allocs = 0;
+}
+
+/* Add a chunk that can fit at least `size` bytes right after the
+ * current one. Chunk sizes double up to ARENA_MAX_CHUNK, so a
+ * session needs only a few of them to reach its steady state */
+static struct arena_chunk *arena_grow(struct arena *arena, size_t size)
+{
+	size_t chunk_size = arena->next_size;
+	if (chunk_size < size)
+		chunk_size = size;
+
+	if (chunk_size > SIZE_MAX - sizeof(struct arena_chunk))
+		return NULL;
+
+	struct arena_chunk *chunk =
+		malloc(sizeof(struct arena_chunk) + chunk_size);
+	if (!chunk)
+		return NULL;
+
+	chunk->size = chunk_size;
+	chunk->used = 0;
+
+	if (arena->cur) {
+		chunk->next = arena->cur->next;
+		arena->cur->next = chunk;
+	} else {
+		chunk->next = arena->head;
+		arena->head = chunk;
+	}
+
+	if (arena->next_size < ARENA_MAX_CHUNK)
+		arena->next_size *= 2;
+
+	arena->nr_chunks++;
+
+	return chunk;
+}
+
+void *arena_alloc(struct arena *arena, size_t size)
+{
+	if (!size || size > SIZE_MAX - alignof(max_align_t))
+		return NULL;
+
+	size = align_up(size);
+
+	struct arena_chunk *chunk = arena->cur;
+
+	/* After a reset, there might be chunks after the current one we
+	 * can reuse */
+	while (chunk && chunk->size - chunk->used < size)
+		chunk = chunk->next;
+
+	if (!chunk) {
+		chunk = arena_grow(arena, size);
+		if (!chunk)
+			return NULL;
+	}
+
+	void *ret = (char *)chunk->data + chunk->used;
+	chunk->used += size;
+	arena->cur = chunk;
+	arena->nr_allocs++;
+
+	return ret;
+}
+
+void arena_reset(struct arena *arena)
+{
+	for (struct arena_chunk *chunk = arena->head; chunk;
+			chunk = chunk->next)
+		chunk->used = 0;
+
+	arena->cur = arena->head;
+	arena->nr_allocs = 0;
+}
+
+void arena_destroy(struct arena *arena)
+{
+	struct arena_chunk *chunk = arena->head;
+	while (chunk) {
+		struct arena_chunk *next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+
+	arena_init(arena);
+}
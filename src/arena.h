@@ -0,0 +1,56 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stddef.h>
+
+/* Bump allocator
+ *
+ * Memory is carved out of a list of chunks by bumping an offset, so an
+ * allocation is a handful of instructions in the common case. Single
+ * allocations cannot be freed; all of them are released at once by
+ * arena_reset(), which keeps the chunks around for reuse, or by
+ * arena_destroy(), which returns them to the system. An arena is not
+ * thread-safe; its users need to serialize access to it.
+ */
+struct arena_chunk;
+
+struct arena {
+	/* First chunk and the chunk we are allocating from */
+	struct arena_chunk *head;
+	struct arena_chunk *cur;
+
+	/* Size of the next chunk we will need to allocate */
+	size_t next_size;
+
+	/* Statistics */
+	size_t nr_chunks;
+	size_t nr_allocs;
+};
+
+void arena_init(struct arena *arena);
+
+/* Allocate `size` bytes, aligned for any type */
+void *arena_alloc(struct arena *arena, size_t size);
+
+/* Release all the allocations, keeping the chunks for reuse */
+void arena_reset(struct arena *arena);
+
+/* Release all the allocations and the chunks */
+void arena_destroy(struct arena *arena);
+
+#endif /* __ARENA_H__ */
@@ -0,0 +1,225 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "async.h"
+#include "error.h"
+#include "list.h"
+#include "log.h"
+#include "profiling/metrics.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define DEFAULT_ASYNC_WORKERS 4
+#define DEFAULT_ASYNC_INFLIGHT 32
+#define MAX_ASYNC_WORKERS 64
+
+struct async_job {
+	/* The actual work */
+	int (*fn)(void *arg);
+	void *arg;
+
+	/* Completion callback */
+	async_cb_t done;
+	void *priv;
+
+	/* Entry in the pending jobs queue */
+	list_entry_t entry;
+};
+
+static struct {
+	pthread_mutex_t lock;
+
+	/* Signaled when new jobs are queued or when shutting down */
+	pthread_cond_t work;
+
+	/* Signaled when an in-flight job completes */
+	pthread_cond_t space;
+
+	/* Pending jobs */
+	list_t queue;
+
+	/* Number of queued and running jobs */
+	int nr_inflight;
+
+	/* Maximum number of queued and running jobs */
+	int max_inflight;
+
+	pthread_t workers[MAX_ASYNC_WORKERS];
+	int nr_workers;
+
+	bool stopping;
+} async_state = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.work = PTHREAD_COND_INITIALIZER,
+	.space = PTHREAD_COND_INITIALIZER,
+	.queue = LIST_ENTRY_INIT(async_state.queue),
+};
+
+/* Set in the worker threads */
+static __thread bool async_self;
+
+static int env_to_int(const char *name, int def, int max)
+{
+	char *env = getenv(name);
+	if (!env)
+		return def;
+
+	int val = atoi(env);
+	if (val <= 0)
+		return def;
+
+	return (val > max) ? max : val;
+}
+
+static void *async_worker(void *arg)
+{
+	(void)arg;
+
+	async_self = true;
+
+	pthread_mutex_lock(&async_state.lock);
+	while (true) {
+		while (list_empty(&async_state.queue) && !async_state.stopping)
+			pthread_cond_wait(&async_state.work, &async_state.lock);
+
+		list_entry_t *entry = list_remove_head(&async_state.queue);
+		if (!entry)
+			break;
+
+		pthread_mutex_unlock(&async_state.lock);
+
+		struct async_job *job =
+			get_container(entry, struct async_job, entry);
+		int ret = job->fn(job->arg);
+		if (job->done)
+			job->done(ret, job->priv);
+		free(job);
+
+		pthread_mutex_lock(&async_state.lock);
+		async_state.nr_inflight--;
+		metrics_async_queue(async_state.nr_inflight);
+		pthread_cond_broadcast(&async_state.space);
+	}
+	pthread_mutex_unlock(&async_state.lock);
+
+	return NULL;
+}
+
+/* Spawn the worker threads. Called with the lock held */
+static int async_start(void)
+{
+	int nr_workers = env_to_int("VACCEL_ASYNC_WORKERS",
+			DEFAULT_ASYNC_WORKERS, MAX_ASYNC_WORKERS);
+
+	async_state.max_inflight = env_to_int("VACCEL_ASYNC_MAX_INFLIGHT",
+			DEFAULT_ASYNC_INFLIGHT, INT_MAX);
+
+	for (int i = 0; i < nr_workers; ++i) {
+		if (pthread_create(&async_state.workers[i], NULL,
+					async_worker, NULL))
+			break;
+
+		async_state.nr_workers++;
+	}
+
+	if (!async_state.nr_workers) {
+		vaccel_error("Could not spawn asynchronous workers");
+		return VACCEL_ENOMEM;
+	}
+
+	vaccel_debug("Started %d asynchronous workers (max in-flight: %d)",
+			async_state.nr_workers, async_state.max_inflight);
+
+	return VACCEL_OK;
+}
+
+int async_submit(int (*fn)(void *arg), void *arg, async_cb_t done,
+		void *priv)
+{
+	if (!fn)
+		return VACCEL_EINVAL;
+
+	struct async_job *job = malloc(sizeof(*job));
+	if (!job)
+		return VACCEL_ENOMEM;
+
+	job->fn = fn;
+	job->arg = arg;
+	job->done = done;
+	job->priv = priv;
+	list_init_entry(&job->entry);
+
+	int ret = VACCEL_OK;
+	pthread_mutex_lock(&async_state.lock);
+
+	if (async_state.stopping) {
+		ret = VACCEL_EPERM;
+		goto unlock;
+	}
+
+	if (!async_state.nr_workers) {
+		ret = async_start();
+		if (ret)
+			goto unlock;
+	}
+
+	/* Jobs and completion callbacks submitting more work run on a
+	 * worker, which would wait for itself if every in-flight job
+	 * were one of those. Their jobs go past the bound instead */
+	while (async_state.nr_inflight >= async_state.max_inflight &&
+			!async_self)
+		pthread_cond_wait(&async_state.space, &async_state.lock);
+
+	list_add_tail(&async_state.queue, &job->entry);
+	async_state.nr_inflight++;
+	metrics_async_queue(async_state.nr_inflight);
+	pthread_cond_signal(&async_state.work);
+
+unlock:
+	pthread_mutex_unlock(&async_state.lock);
+	if (ret)
+		free(job);
+
+	return ret;
+}
+
+int async_wait(void)
+{
+	pthread_mutex_lock(&async_state.lock);
+	while (async_state.nr_inflight)
+		pthread_cond_wait(&async_state.space, &async_state.lock);
+	pthread_mutex_unlock(&async_state.lock);
+
+	return VACCEL_OK;
+}
+
+int async_shutdown(void)
+{
+	async_wait();
+
+	pthread_mutex_lock(&async_state.lock);
+	async_state.stopping = true;
+	pthread_cond_broadcast(&async_state.work);
+	pthread_mutex_unlock(&async_state.lock);
+
+	for (int i = 0; i < async_state.nr_workers; ++i)
+		pthread_join(async_state.workers[i], NULL);
+
+	async_state.nr_workers = 0;
+
+	return VACCEL_OK;
+}
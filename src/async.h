@@ -0,0 +1,42 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ASYNC_H__
+#define __ASYNC_H__
+
+/* Completion callback of an asynchronous job. It is called from the
+ * worker thread that executed the job, with the job's return value */
+typedef void (*async_cb_t)(int ret, void *priv);
+
+/* Queue a job for asynchronous execution
+ *
+ * `fn` will be called with `arg` from one of the runtime's worker
+ * threads and, if set, `done` will be called with its return value
+ * and `priv` once it completes. The number of outstanding jobs is
+ * bounded; if the bound has been reached, this will block until an
+ * in-flight job completes. Jobs and completion callbacks may submit
+ * jobs too, which are queued even past the bound.
+ */
+int async_submit(int (*fn)(void *arg), void *arg, async_cb_t done,
+		void *priv);
+
+/* Wait until all the jobs submitted so far have completed
+ *
+ * This must not be called from within a completion callback */
+int async_wait(void);
+
+/* Wait for in-flight jobs and stop the worker threads */
+int async_shutdown(void);
+
+#endif /* __ASYNC_H__ */
@@ -0,0 +1,188 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "checksum.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+/* Reflected CRC32C polynomial */
+#define CRC32C_POLY 0x82f63b78
+
+typedef uint32_t (*crc32c_fn_t)(uint32_t crc, const uint8_t *buf, size_t len);
+
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+static crc32c_fn_t crc32c_impl;
+static bool crc32c_hw;
+
+/* Slicing-by-8 lookup tables for the software implementation */
+static uint32_t crc32c_table[8][256];
+
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t *buf, size_t len)
+{
+	while (len && ((uintptr_t)buf & 7)) {
+		crc = crc32c_table[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+		len--;
+	}
+
+	while (len >= 8) {
+		uint64_t word;
+		memcpy(&word, buf, sizeof(word));
+		word ^= crc;
+
+		crc = crc32c_table[7][word & 0xff] ^
+			crc32c_table[6][(word >> 8) & 0xff] ^
+			crc32c_table[5][(word >> 16) & 0xff] ^
+			crc32c_table[4][(word >> 24) & 0xff] ^
+			crc32c_table[3][(word >> 32) & 0xff] ^
+			crc32c_table[2][(word >> 40) & 0xff] ^
+			crc32c_table[1][(word >> 48) & 0xff] ^
+			crc32c_table[0][word >> 56];
+
+		buf += 8;
+		len -= 8;
+	}
+
+	while (len--)
+		crc = crc32c_table[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+
+	return crc;
+}
+
+#if defined(__x86_64__)
+/* Bytes processed by each of the three interleaved streams of the
+ * hardware implementation per iteration */
+#define CRC32C_LANE 4096
+
+/* Tables shifting a CRC state over CRC32C_LANE zero bytes, used for
+ * merging the states of the interleaved streams */
+static uint32_t crc32c_lane_shift[4][256];
+
+static inline uint32_t crc32c_shift(uint32_t crc)
+{
+	return crc32c_lane_shift[0][crc & 0xff] ^
+		crc32c_lane_shift[1][(crc >> 8) & 0xff] ^
+		crc32c_lane_shift[2][(crc >> 16) & 0xff] ^
+		crc32c_lane_shift[3][crc >> 24];
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42_serial(uint32_t crc, const uint8_t *buf,
+		size_t len)
+{
+	uint64_t crc64 = crc;
+
+	while (len && ((uintptr_t)buf & 7)) {
+		crc64 = _mm_crc32_u8((uint32_t)crc64, *buf++);
+		len--;
+	}
+
+	while (len >= 8) {
+		uint64_t word;
+		memcpy(&word, buf, sizeof(word));
+		crc64 = _mm_crc32_u64(crc64, word);
+		buf += 8;
+		len -= 8;
+	}
+
+	while (len--)
+		crc64 = _mm_crc32_u8((uint32_t)crc64, *buf++);
+
+	return (uint32_t)crc64;
+}
+
+/* The crc32 instruction has a latency of three cycles but a throughput
+ * of one per cycle, so we checksum three independent streams at a time
+ * and merge their states using the fact that CRC is linear */
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *buf, size_t len)
+{
+	while (len >= 3 * CRC32C_LANE) {
+		uint64_t crc0 = crc, crc1 = 0, crc2 = 0;
+
+		for (size_t i = 0; i < CRC32C_LANE; i += 8) {
+			uint64_t w0, w1, w2;
+			memcpy(&w0, buf + i, sizeof(w0));
+			memcpy(&w1, buf + CRC32C_LANE + i, sizeof(w1));
+			memcpy(&w2, buf + 2 * CRC32C_LANE + i, sizeof(w2));
+
+			crc0 = _mm_crc32_u64(crc0, w0);
+			crc1 = _mm_crc32_u64(crc1, w1);
+			crc2 = _mm_crc32_u64(crc2, w2);
+		}
+
+		crc = crc32c_shift(crc32c_shift((uint32_t)crc0) ^ (uint32_t)crc1)
+			^ (uint32_t)crc2;
+		buf += 3 * CRC32C_LANE;
+		len -= 3 * CRC32C_LANE;
+	}
+
+	return crc32c_sse42_serial(crc, buf, len);
+}
+
+static void crc32c_sse42_init(void)
+{
+	static const uint8_t zeros[CRC32C_LANE];
+
+	for (int i = 0; i < 4; ++i)
+		for (uint32_t b = 0; b < 256; ++b)
+			crc32c_lane_shift[i][b] = crc32c_sse42_serial(
+					b << (8 * i), zeros, CRC32C_LANE);
+}
+#endif
+
+static void crc32c_init(void)
+{
+	for (uint32_t i = 0; i < 256; ++i) {
+		uint32_t crc = i;
+		for (int j = 0; j < 8; ++j)
+			crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+
+		crc32c_table[0][i] = crc;
+	}
+
+	for (uint32_t i = 0; i < 256; ++i)
+		for (int j = 1; j < 8; ++j)
+			crc32c_table[j][i] = crc32c_table[0][crc32c_table[j - 1][i] & 0xff]
+				^ (crc32c_table[j - 1][i] >> 8);
+
+	crc32c_impl = crc32c_sw;
+
+#if defined(__x86_64__)
+	if (__builtin_cpu_supports("sse4.2")) {
+		crc32c_sse42_init();
+		crc32c_impl = crc32c_sse42;
+		crc32c_hw = true;
+	}
+#endif
+}
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len)
+{
+	pthread_once(&crc32c_once, crc32c_init);
+
+	return ~crc32c_impl(~crc, (const uint8_t *)buf, len);
+}
+
+bool crc32c_hw_enabled(void)
+{
+	pthread_once(&crc32c_once, crc32c_init);
+
+	return crc32c_hw;
+}
@@ -0,0 +1,34 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CHECKSUM_H__
+#define __CHECKSUM_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Update a CRC32C (Castagnoli) checksum with the contents of a buffer
+ *
+ * `crc` is the checksum of the data seen so far, or 0 when starting a
+ * new checksum, so that data can be checksummed in chunks. It uses the
+ * CPU's CRC32 instructions when available and a table-driven software
+ * implementation otherwise.
+ */
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
+
+/* Returns true if crc32c() is hardware-accelerated on this CPU */
+bool crc32c_hw_enabled(void);
+
+#endif /* __CHECKSUM_H__ */
@@ -0,0 +1,599 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "decompress.h"
+#include "error.h"
+#include "log.h"
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LZ4_MAGIC 0x184D2204U
+#define ZSTD_MAGIC 0xFD2FB528U
+
+#define LZ4_FLG_VERSION(flg) (((flg) >> 6) & 0x3)
+#define LZ4_FLG_BLOCK_INDEP (1 << 5)
+#define LZ4_FLG_BLOCK_CHECKSUM (1 << 4)
+#define LZ4_FLG_CONTENT_SIZE (1 << 3)
+#define LZ4_FLG_CONTENT_CHECKSUM (1 << 2)
+#define LZ4_FLG_DICT_ID (1 << 0)
+#define LZ4_BLOCK_UNCOMPRESSED (1U << 31)
+#define LZ4_MIN_MATCH 4
+
+#define MAX_DECOMPRESS_THREADS 64
+
+#define ZSTD_LIBRARY "libzstd.so.1"
+#define ZSTD_CONTENTSIZE_ERROR (0ULL - 2)
+
+/* Returned when the frame needs to be decompressed serially */
+#define LZ4_IRREGULAR_BLOCKS (-1)
+
+struct lz4_block {
+	const uint8_t *src;
+	size_t len;
+	bool uncompressed;
+
+	/* Decompressed size, filled in by the decoder */
+	size_t out_len;
+	int ret;
+};
+
+struct lz4_frame {
+	bool independent;
+	size_t block_max;
+
+	bool has_content_size;
+	size_t content_size;
+
+	struct lz4_block *blocks;
+	size_t nr_blocks;
+};
+
+static uint32_t read_le32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+		(uint32_t)p[3] << 24;
+}
+
+static uint64_t read_le64(const uint8_t *p)
+{
+	return (uint64_t)read_le32(p) | (uint64_t)read_le32(p + 4) << 32;
+}
+
+enum compression_format compression_detect(const void *src, size_t len)
+{
+	if (!src || len < 4)
+		return COMPRESSION_NONE;
+
+	switch (read_le32(src)) {
+	case LZ4_MAGIC:
+		return COMPRESSION_LZ4;
+	case ZSTD_MAGIC:
+		return COMPRESSION_ZSTD;
+	default:
+		return COMPRESSION_NONE;
+	}
+}
+
+/* Parse the header and the block table of an LZ4 frame
+ *
+ * Only the block sizes are read here; the blocks themselves are not
+ * touched until they are decoded. Header, block and content checksums
+ * are skipped. */
+static int lz4_frame_parse(const uint8_t *src, size_t len,
+		struct lz4_frame *frame)
+{
+	const uint8_t *ip = src + 4, *iend = src + len;
+
+	memset(frame, 0, sizeof(*frame));
+
+	/* FLG + BD + HC */
+	if (iend - ip < 3)
+		return VACCEL_EINVAL;
+
+	uint8_t flg = ip[0], bd = ip[1];
+	ip += 2;
+
+	if (LZ4_FLG_VERSION(flg) != 1) {
+		vaccel_error("Unsupported LZ4 frame version");
+		return VACCEL_EINVAL;
+	}
+
+	if (flg & LZ4_FLG_DICT_ID) {
+		vaccel_error("LZ4 frames with dictionaries are not supported");
+		return VACCEL_ENOTSUP;
+	}
+
+	int bsid = (bd >> 4) & 0x7;
+	if (bsid < 4) {
+		vaccel_error("Invalid LZ4 block size");
+		return VACCEL_EINVAL;
+	}
+
+	frame->block_max = (size_t)1 << (8 + 2 * bsid);
+	frame->independent = flg & LZ4_FLG_BLOCK_INDEP;
+
+	if (flg & LZ4_FLG_CONTENT_SIZE) {
+		if (iend - ip < 8)
+			return VACCEL_EINVAL;
+
+		uint64_t content_size = read_le64(ip);
+		if (content_size > SIZE_MAX)
+			return VACCEL_ENOMEM;
+
+		frame->has_content_size = true;
+		frame->content_size = content_size;
+		ip += 8;
+	}
+
+	/* Header checksum */
+	if (iend - ip < 1)
+		goto truncated;
+	ip++;
+
+	size_t checksum_len = (flg & LZ4_FLG_BLOCK_CHECKSUM) ? 4 : 0;
+	size_t nr_alloc = 0;
+	while (true) {
+		if (iend - ip < 4)
+			goto truncated;
+
+		uint32_t bsize = read_le32(ip);
+		ip += 4;
+
+		/* EndMark */
+		if (!bsize)
+			break;
+
+		size_t blen = bsize & ~LZ4_BLOCK_UNCOMPRESSED;
+		if (blen > frame->block_max ||
+				(size_t)(iend - ip) < blen + checksum_len)
+			goto truncated;
+
+		if (frame->nr_blocks == nr_alloc) {
+			nr_alloc = nr_alloc ? 2 * nr_alloc : 16;
+			struct lz4_block *blocks = realloc(frame->blocks,
+					nr_alloc * sizeof(*blocks));
+			if (!blocks) {
+				free(frame->blocks);
+				return VACCEL_ENOMEM;
+			}
+
+			frame->blocks = blocks;
+		}
+
+		struct lz4_block *block = &frame->blocks[frame->nr_blocks++];
+		block->src = ip;
+		block->len = blen;
+		block->uncompressed = bsize & LZ4_BLOCK_UNCOMPRESSED;
+		block->out_len = 0;
+		block->ret = VACCEL_OK;
+
+		ip += blen + checksum_len;
+	}
+
+	if (flg & LZ4_FLG_CONTENT_CHECKSUM) {
+		if (iend - ip < 4)
+			goto truncated;
+		ip += 4;
+	}
+
+	/* Only a single frame is decompressed, so anything after it,
+	 * further or skippable frames included, would be lost */
+	if (ip != iend) {
+		vaccel_error("Trailing data after LZ4 frame");
+		free(frame->blocks);
+		frame->blocks = NULL;
+		return VACCEL_EINVAL;
+	}
+
+	return VACCEL_OK;
+
+truncated:
+	vaccel_error("Truncated LZ4 frame");
+	free(frame->blocks);
+	frame->blocks = NULL;
+	return VACCEL_EINVAL;
+}
+
+static size_t lz4_frame_bound(const struct lz4_frame *frame)
+{
+	if (frame->has_content_size)
+		return frame->content_size;
+
+	size_t bound = 0;
+	for (size_t i = 0; i < frame->nr_blocks; ++i) {
+		const struct lz4_block *block = &frame->blocks[i];
+		bound += block->uncompressed ? block->len : frame->block_max;
+	}
+
+	return bound;
+}
+
+static int lz4_read_length(const uint8_t **ip, const uint8_t *iend,
+		size_t *len)
+{
+	uint8_t byte;
+
+	do {
+		if (*ip >= iend)
+			return VACCEL_EINVAL;
+
+		byte = *(*ip)++;
+		*len += byte;
+	} while (byte == 255);
+
+	return VACCEL_OK;
+}
+
+/* Decode a single LZ4 block into `dst`
+ *
+ * Matches may reference any data between `prefix` and the current
+ * output position, which allows decoding linked blocks in place */
+static int lz4_block_decode(const uint8_t *src, size_t len,
+		const uint8_t *prefix, uint8_t *dst, size_t dst_len,
+		size_t *out_len)
+{
+	const uint8_t *ip = src, *iend = src + len;
+	uint8_t *op = dst, *oend = dst + dst_len;
+
+	while (ip < iend) {
+		uint8_t token = *ip++;
+
+		size_t lit_len = token >> 4;
+		if (lit_len == 15 && lz4_read_length(&ip, iend, &lit_len))
+			return VACCEL_EINVAL;
+
+		if ((size_t)(iend - ip) < lit_len ||
+				(size_t)(oend - op) < lit_len)
+			return VACCEL_EINVAL;
+
+		/* Short literal runs are copied 16 bytes at a time, when
+		 * there is room for overshooting */
+		if (lit_len <= 16 && iend - ip >= 16 && oend - op >= 16)
+			memcpy(op, ip, 16);
+		else
+			memcpy(op, ip, lit_len);
+		ip += lit_len;
+		op += lit_len;
+
+		/* The last sequence of a block has only literals */
+		if (ip == iend)
+			break;
+
+		if (iend - ip < 2)
+			return VACCEL_EINVAL;
+
+		size_t offset = ip[0] | ip[1] << 8;
+		ip += 2;
+		if (!offset || offset > (size_t)(op - prefix))
+			return VACCEL_EINVAL;
+
+		size_t match_len = token & 0xf;
+		if (match_len == 15 && lz4_read_length(&ip, iend, &match_len))
+			return VACCEL_EINVAL;
+
+		match_len += LZ4_MIN_MATCH;
+		if ((size_t)(oend - op) < match_len)
+			return VACCEL_EINVAL;
+
+		const uint8_t *match = op - offset;
+		if (offset >= 8 && (size_t)(oend - op) >= match_len + 8) {
+			/* Chunks never overlap their own source */
+			uint8_t *end = op + match_len;
+			do {
+				memcpy(op, match, 8);
+				op += 8;
+				match += 8;
+			} while (op < end);
+			op = end;
+		} else if (offset >= match_len) {
+			memcpy(op, match, match_len);
+			op += match_len;
+		} else {
+			/* Overlapping copy, repeating the last `offset` bytes */
+			for (size_t i = 0; i < match_len; ++i)
+				*op++ = *match++;
+		}
+	}
+
+	*out_len = op - dst;
+	return VACCEL_OK;
+}
+
+static int lz4_block_decompress(struct lz4_block *block, const uint8_t *prefix,
+		uint8_t *dst, size_t dst_len)
+{
+	if (block->uncompressed) {
+		if (block->len > dst_len)
+			return VACCEL_EINVAL;
+
+		memcpy(dst, block->src, block->len);
+		block->out_len = block->len;
+		return VACCEL_OK;
+	}
+
+	return lz4_block_decode(block->src, block->len, prefix, dst, dst_len,
+			&block->out_len);
+}
+
+static int lz4_decompress_serial(struct lz4_frame *frame, uint8_t *dst,
+		size_t dst_len, size_t *out_len)
+{
+	size_t off = 0;
+
+	for (size_t i = 0; i < frame->nr_blocks; ++i) {
+		struct lz4_block *block = &frame->blocks[i];
+		const uint8_t *prefix = frame->independent ? dst + off : dst;
+
+		int ret = lz4_block_decompress(block, prefix, dst + off,
+				dst_len - off);
+		if (ret) {
+			vaccel_error("Corrupted LZ4 block %zu", i);
+			return ret;
+		}
+
+		off += block->out_len;
+	}
+
+	*out_len = off;
+	return VACCEL_OK;
+}
+
+struct lz4_parallel {
+	struct lz4_frame *frame;
+	uint8_t *dst;
+	size_t dst_len;
+	atomic_size_t next;
+};
+
+/* Every block but the last one of a frame decompresses to exactly
+ * the maximum block size, so the output offset of each block is known
+ * in advance and workers can pick blocks in any order */
+static void *lz4_worker(void *arg)
+{
+	struct lz4_parallel *p = arg;
+	struct lz4_frame *frame = p->frame;
+
+	while (true) {
+		size_t i = atomic_fetch_add(&p->next, 1);
+		if (i >= frame->nr_blocks)
+			break;
+
+		struct lz4_block *block = &frame->blocks[i];
+		size_t off = i * frame->block_max;
+		if (off >= p->dst_len) {
+			block->ret = VACCEL_EINVAL;
+			continue;
+		}
+
+		size_t len = p->dst_len - off;
+		if (len > frame->block_max)
+			len = frame->block_max;
+
+		block->ret = lz4_block_decompress(block, p->dst + off,
+				p->dst + off, len);
+	}
+
+	return NULL;
+}
+
+static int lz4_decompress_parallel(struct lz4_frame *frame, uint8_t *dst,
+		size_t dst_len, size_t *out_len, int nr_threads)
+{
+	struct lz4_parallel p = {
+		.frame = frame,
+		.dst = dst,
+		.dst_len = dst_len,
+	};
+	pthread_t threads[MAX_DECOMPRESS_THREADS];
+	int nr_started = 0;
+
+	atomic_init(&p.next, 0);
+
+	/* The calling thread works too */
+	for (int i = 1; i < nr_threads; ++i) {
+		if (pthread_create(&threads[nr_started], NULL, lz4_worker, &p))
+			break;
+
+		nr_started++;
+	}
+
+	lz4_worker(&p);
+
+	for (int i = 0; i < nr_started; ++i)
+		pthread_join(threads[i], NULL);
+
+	size_t total = 0;
+	for (size_t i = 0; i < frame->nr_blocks; ++i) {
+		struct lz4_block *block = &frame->blocks[i];
+		if (block->ret)
+			return block->ret;
+
+		/* A short block in the middle of the frame; the offsets we
+		 * guessed were wrong */
+		if (i + 1 < frame->nr_blocks &&
+				block->out_len != frame->block_max)
+			return LZ4_IRREGULAR_BLOCKS;
+
+		total += block->out_len;
+	}
+
+	vaccel_debug("Decompressed %zu LZ4 blocks using %d threads",
+			frame->nr_blocks, nr_started + 1);
+
+	*out_len = total;
+	return VACCEL_OK;
+}
+
+/* zstd frames are decoded by libzstd, which is loaded the first time
+ * it is needed, so that it stays an optional runtime dependency */
+static struct {
+	pthread_once_t once;
+	void *dl;
+	size_t (*decompress)(void *dst, size_t dst_len, const void *src,
+			size_t len);
+	unsigned long long (*decompress_bound)(const void *src, size_t len);
+	unsigned (*is_error)(size_t code);
+	const char *(*get_error_name)(size_t code);
+} zstd = {
+	.once = PTHREAD_ONCE_INIT,
+};
+
+static void zstd_load(void)
+{
+	void *dl = dlopen(ZSTD_LIBRARY, RTLD_NOW | RTLD_LOCAL);
+	if (!dl) {
+		vaccel_debug("Could not load %s: %s", ZSTD_LIBRARY, dlerror());
+		return;
+	}
+
+	zstd.decompress = dlsym(dl, "ZSTD_decompress");
+	zstd.decompress_bound = dlsym(dl, "ZSTD_decompressBound");
+	zstd.is_error = dlsym(dl, "ZSTD_isError");
+	zstd.get_error_name = dlsym(dl, "ZSTD_getErrorName");
+	if (!zstd.decompress || !zstd.decompress_bound || !zstd.is_error ||
+			!zstd.get_error_name) {
+		vaccel_debug("Unsupported %s version", ZSTD_LIBRARY);
+		dlclose(dl);
+		return;
+	}
+
+	zstd.dl = dl;
+}
+
+static int zstd_available(void)
+{
+	pthread_once(&zstd.once, zstd_load);
+	if (!zstd.dl) {
+		vaccel_error("zstd compressed data need %s", ZSTD_LIBRARY);
+		return VACCEL_ENOTSUP;
+	}
+
+	return VACCEL_OK;
+}
+
+static int zstd_bound(const void *src, size_t len, size_t *bound)
+{
+	int ret = zstd_available();
+	if (ret)
+		return ret;
+
+	unsigned long long size = zstd.decompress_bound(src, len);
+	if (size == ZSTD_CONTENTSIZE_ERROR) {
+		vaccel_error("Invalid zstd frame");
+		return VACCEL_EINVAL;
+	}
+
+	if (size > SIZE_MAX)
+		return VACCEL_ENOMEM;
+
+	*bound = size;
+	return VACCEL_OK;
+}
+
+/* zstd blocks depend on each other, so frames are always decompressed
+ * serially */
+static int zstd_decompress(const void *src, size_t len, void *dst,
+		size_t dst_len, size_t *out_len)
+{
+	int ret = zstd_available();
+	if (ret)
+		return ret;
+
+	size_t size = zstd.decompress(dst, dst_len, src, len);
+	if (zstd.is_error(size)) {
+		vaccel_error("Corrupted zstd frame: %s",
+				zstd.get_error_name(size));
+		return VACCEL_EINVAL;
+	}
+
+	*out_len = size;
+	return VACCEL_OK;
+}
+
+int decompress_bound(const void *src, size_t len, size_t *bound)
+{
+	if (!src || !bound)
+		return VACCEL_EINVAL;
+
+	switch (compression_detect(src, len)) {
+	case COMPRESSION_LZ4:
+		break;
+	case COMPRESSION_ZSTD:
+		return zstd_bound(src, len, bound);
+	default:
+		return VACCEL_EINVAL;
+	}
+
+	struct lz4_frame frame;
+	int ret = lz4_frame_parse(src, len, &frame);
+	if (ret)
+		return ret;
+
+	*bound = lz4_frame_bound(&frame);
+	free(frame.blocks);
+
+	return VACCEL_OK;
+}
+
+int decompress(const void *src, size_t len, void *dst, size_t dst_len,
+		size_t *out_len, int nr_threads)
+{
+	if (!src || !dst || !out_len)
+		return VACCEL_EINVAL;
+
+	switch (compression_detect(src, len)) {
+	case COMPRESSION_LZ4:
+		break;
+	case COMPRESSION_ZSTD:
+		return zstd_decompress(src, len, dst, dst_len, out_len);
+	default:
+		return VACCEL_EINVAL;
+	}
+
+	struct lz4_frame frame;
+	int ret = lz4_frame_parse(src, len, &frame);
+	if (ret)
+		return ret;
+
+	if (lz4_frame_bound(&frame) > dst_len) {
+		ret = VACCEL_EINVAL;
+		goto free_blocks;
+	}
+
+	if (nr_threads > MAX_DECOMPRESS_THREADS)
+		nr_threads = MAX_DECOMPRESS_THREADS;
+	if ((size_t)nr_threads > frame.nr_blocks)
+		nr_threads = frame.nr_blocks;
+
+	if (frame.independent && nr_threads > 1) {
+		ret = lz4_decompress_parallel(&frame, dst, dst_len, out_len,
+				nr_threads);
+		if (ret != LZ4_IRREGULAR_BLOCKS)
+			goto free_blocks;
+
+		vaccel_debug("Irregular LZ4 block sizes, decompressing serially");
+	}
+
+	ret = lz4_decompress_serial(&frame, dst, dst_len, out_len);
+
+free_blocks:
+	free(frame.blocks);
+	return ret;
+}
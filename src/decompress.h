@@ -0,0 +1,50 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __DECOMPRESS_H__
+#define __DECOMPRESS_H__
+
+#include <stddef.h>
+
+enum compression_format {
+	COMPRESSION_NONE = 0,
+	COMPRESSION_LZ4,
+	COMPRESSION_ZSTD,
+};
+
+/* Detect the compression format of a buffer from its frame magic */
+enum compression_format compression_detect(const void *src, size_t len);
+
+/* Get the size of the buffer needed to decompress `src`
+ *
+ * This is the exact decompressed size if the frame carries it, or an
+ * upper bound otherwise. `src` is validated as by decompress() */
+int decompress_bound(const void *src, size_t len, size_t *bound);
+
+/* Decompress a frame into `dst`
+ *
+ * `dst` needs to be at least as large as the bound returned by
+ * decompress_bound(). The actual decompressed size is returned in
+ * `out_len`.
+ *
+ * LZ4 data must be exactly one frame; anything after it, skippable
+ * frames included, fails with VACCEL_EINVAL. Frames made of independent
+ * blocks are decompressed in parallel using up to `nr_threads` threads.
+ * zstd data are handed to libzstd as a whole, which decompresses
+ * consecutive frames and skips skippable ones. They need libzstd at
+ * runtime and fail with VACCEL_ENOTSUP if it is missing */
+int decompress(const void *src, size_t len, void *dst, size_t dst_len,
+		size_t *out_len, int nr_threads);
+
+#endif /* __DECOMPRESS_H__ */
@@ -27,7 +27,8 @@ int id_pool_new(id_pool_t *pool, int nr_ids)
 		return VACCEL_ENOMEM;
 
 	pool->max = nr_ids;
-	atomic_init(&pool->next, 0);
+	pool->next = 0;
+	pthread_mutex_init(&pool->lock, NULL);
 
 	return VACCEL_OK;
 
@@ -41,6 +42,8 @@ int id_pool_destroy(id_pool_t *pool)
 	if (pool->ids)
 		free(pool->ids);
 
+	pthread_mutex_destroy(&pool->lock);
+
 	return VACCEL_OK;
 }
 
@@ -49,14 +52,19 @@ vaccel_id_t id_pool_get(id_pool_t *pool)
 	if (!pool)
 		return 0;
 
-	int ptr = atomic_fetch_add(&pool->next, 1);
-	if (ptr >= pool->max)
-		return 0;
+	vaccel_id_t id = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	if (pool->next < pool->max) {
+		int ptr = pool->next++;
+		if (!pool->ids[ptr])
+			pool->ids[ptr] = ptr + 1;
 
-	if (!pool->ids[ptr])
-		pool->ids[ptr] = ptr + 1;
+		id = pool->ids[ptr];
+	}
+	pthread_mutex_unlock(&pool->lock);
 
-	return pool->ids[ptr];
+	return id;
 }
 
 void id_pool_release(id_pool_t *pool, vaccel_id_t id)
@@ -67,12 +75,8 @@ void id_pool_release(id_pool_t *pool, vaccel_id_t id)
 	if (!id || id > pool->max)
 		return;
 
-	int curr = pool->next;
-	int ptr = curr - 1;
-
-	/* Atomically decrease the pointer value */
-	while (!atomic_compare_exchange_strong(&pool->next, &curr, ptr))
-		ptr = curr - 1;
-
-	pool->ids[ptr] = id;
+	pthread_mutex_lock(&pool->lock);
+	if (pool->next > 0)
+		pool->ids[--pool->next] = id;
+	pthread_mutex_unlock(&pool->lock);
 }
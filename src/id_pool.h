@@ -15,12 +15,7 @@
 #ifndef __GENID_H__
 #define __GENID_H__
 
-#ifdef __cplusplus
-    #include <atomic> 
-    using namespace std;
-#else
-    #include <stdatomic.h> 
-#endif
+#include <pthread.h>
 #include <stdint.h>
 
 #include "include/vaccel_id.h"
@@ -33,7 +28,10 @@ typedef struct id_pool {
 	int max;
 
 	/* Next available id */
-	atomic_int next;
+	int next;
+
+	/* Protects `ids` and `next` */
+	pthread_mutex_t lock;
 } id_pool_t;
 
 /* Create and initialize a new id pool */
@@ -35,5 +35,8 @@
 #define VACCEL_ENAMETOOLONG ENAMETOOLONG  /* ENAMETOOLONG: File name too long */
 #define VACCEL_EUSERS       EUSERS        /* Too many users */
 #define VACCEL_EPERM        EPERM         /* Operation not permitted */
+#define VACCEL_EBADMSG      EBADMSG       /* EBADMSG: Bad message (checksum mismatch) */
+#define VACCEL_ECANCELED    ECANCELED     /* ECANCELED: Operation canceled */
+#define VACCEL_ETIMEDOUT    ETIMEDOUT     /* ETIMEDOUT: Connection timed out */
 
 #endif /* __VACCEL_ERROR_H__ */
@@ -21,13 +21,48 @@ extern "C" {
 
 #include <slog.h>
 
+#define VACCEL_DEBUG_LVL_ERROR 1
+#define VACCEL_DEBUG_LVL_WARN  2
+#define VACCEL_DEBUG_LVL_INFO  3
+#define VACCEL_DEBUG_LVL_DEBUG 4
+
+/* Most verbose level compiled in. Messages above it are eliminated at
+ * build time, whatever VACCEL_DEBUG_LEVEL says at runtime */
+#ifndef VACCEL_LOG_MAX_LEVEL
+#define VACCEL_LOG_MAX_LEVEL VACCEL_DEBUG_LVL_DEBUG
+#endif
+
+/* slog flags of the levels enabled at runtime. It is checked before
+ * calling into the logger, so disabled levels cost a single load */
+extern int vaccel_log_flags;
+
 int vaccel_log_init(void);
 int vaccel_log_shutdown(void);
 
-#define vaccel_info slog_info
-#define vaccel_warn slog_warn
-#define vaccel_debug slog_debug
-#define vaccel_error slog_error
+/* Write out pending asynchronous records and stop the writer thread.
+ * Logging goes on synchronously afterwards */
+int vaccel_log_flush(void);
+
+void vaccel_log_print(int flag, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+#define vaccel_log(level, flag, ...)                                       \
+	do {                                                               \
+		if ((level) <= VACCEL_LOG_MAX_LEVEL &&                     \
+				__builtin_expect(__atomic_load_n(          \
+					&vaccel_log_flags,                 \
+					__ATOMIC_RELAXED) & (flag), 0))    \
+			vaccel_log_print((flag), __VA_ARGS__);             \
+	} while (0)
+
+#define vaccel_info(...) \
+	vaccel_log(VACCEL_DEBUG_LVL_INFO, SLOG_INFO, __VA_ARGS__)
+#define vaccel_warn(...) \
+	vaccel_log(VACCEL_DEBUG_LVL_WARN, SLOG_WARN, __VA_ARGS__)
+#define vaccel_debug(...) \
+	vaccel_log(VACCEL_DEBUG_LVL_DEBUG, SLOG_DEBUG, __VA_ARGS__)
+#define vaccel_error(...) \
+	vaccel_log(VACCEL_DEBUG_LVL_ERROR, SLOG_ERROR, __VA_ARGS__)
 #define vaccel_trace slog_trace
 #define vaccel_fatal slog_fatal
 
@@ -24,6 +24,7 @@ extern "C" {
 struct vaccel_session;
 struct vaccel_arg;
 struct vaccel_shared_object;
+struct vaccel_genop_set;
 
 int vaccel_exec(struct vaccel_session *sess, const char *library,
                 const char *fn_symbol, struct vaccel_arg *read,
@@ -33,6 +34,19 @@ int vaccel_exec_with_resource(struct vaccel_session *sess, struct vaccel_shared_
                 const char *fn_symbol, struct vaccel_arg *read,
                 size_t nr_read, struct vaccel_arg *write, size_t nr_write);
 
+/* Call `fn_symbol` of `library` once for every argument set
+ *
+ * The read and write arguments of each set are passed to the function
+ * as with vaccel_exec() and the result of each call is stored in the
+ * `ret` field of its set. Plugins with a batch implementation of exec
+ * can run the calls in parallel, so they must be independent of each
+ * other. Returns VACCEL_OK if all calls succeeded, or the error of the
+ * first one that failed.
+ */
+int vaccel_exec_batch(struct vaccel_session *sess, const char *library,
+                const char *fn_symbol, struct vaccel_genop_set *sets,
+                int nr_sets);
+
 #ifdef __cplusplus
 }
 #endif
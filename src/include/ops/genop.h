@@ -15,6 +15,7 @@
 #ifndef __VACCEL_GENOP_H__
 #define __VACCEL_GENOP_H__
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -23,16 +24,101 @@ extern "C" {
 
 struct vaccel_session;
 
+/* The flags live in what used to be padding after `size`, so the
+ * layout, and the array stride exec libraries rely on, is unchanged.
+ * Positional initializers must list them though: { size, 0, buf } */
 struct vaccel_arg {
 	uint32_t size;
+
+	/* VACCEL_ARG_FLAG_* bits. Regular arguments have none, so this
+	 * must be zeroed */
+	uint32_t flags;
+
 	void *buf;
 };
 
+/* Extended argument: `buf` points to a struct vaccel_arg_ext describing
+ * the actual data and `size` is not used */
+#define VACCEL_ARG_FLAG_EXT (1U << 0)
+
+/* Reference to an intermediate tensor of a pipeline, whose id is stored
+ * in `buf` */
+#define VACCEL_ARG_FLAG_TENSOR (1U << 1)
+
+#define VACCEL_ARG_EXT_VERSION 1
+
+/* A contiguous segment of an extended argument */
+struct vaccel_iovec {
+	void *base;
+	uint64_t len;
+};
+
+/* Extended argument: data of any size, possibly scattered in multiple
+ * segments */
+struct vaccel_arg_ext {
+	/* VACCEL_ARG_EXT_VERSION */
+	uint32_t version;
+
+	uint32_t nr_segs;
+	struct vaccel_iovec *segs;
+};
+
+/* Set up `arg` as an extended argument made of `nr_segs` segments. `ext`
+ * and `segs` need to stay around for as long as `arg` is used */
+int vaccel_arg_init_ext(struct vaccel_arg *arg, struct vaccel_arg_ext *ext,
+		struct vaccel_iovec *segs, uint32_t nr_segs);
+
+/* Check if `arg` is an extended argument */
+bool vaccel_arg_is_ext(const struct vaccel_arg *arg);
+
+/* Total size of the data of an argument */
+uint64_t vaccel_arg_size(const struct vaccel_arg *arg);
+
+/* Pointer to the data of an argument, or NULL if they are not
+ * contiguous */
+void *vaccel_arg_buf(const struct vaccel_arg *arg);
+
+/* Get the segments of an argument. A regular argument is a single
+ * segment, which is stored in `single`. Returns the number of
+ * segments */
+uint32_t vaccel_arg_segs(const struct vaccel_arg *arg,
+		struct vaccel_iovec *single, const struct vaccel_iovec **segs);
+
+/* Arguments of one of the operations of a batch */
+struct vaccel_genop_set {
+	/* Read arguments, starting with the op code */
+	struct vaccel_arg *read;
+	int nr_read;
+
+	/* Write arguments */
+	struct vaccel_arg *write;
+	int nr_write;
+
+	/* Result of the operation, set by vaccel_genop_batch() */
+	int ret;
+};
+
+/* Vectorized implementation of an operation type, which plugins may
+ * register with register_plugin_batch_function(). It gets `nr_sets`
+ * argument sets, without the op code, and sets the result of each */
+typedef int (*vaccel_batch_func_t)(struct vaccel_session *sess,
+		struct vaccel_genop_set *sets, int nr_sets);
+
 /* Call one of the supported functions, given an op code and a set of arbitrary
  * arguments */
 int vaccel_genop(struct vaccel_session *sess, struct vaccel_arg *read,
 		int nr_read, struct vaccel_arg *write, int nr_write);
 
+/* Call a batch of functions, given a set of arguments for each one
+ *
+ * Operations are grouped by type, so that the plugin implementing each
+ * type is looked up once, and are handed to the plugin's batch entry
+ * point if it has one. Operations of the same type run in the order
+ * they appear in `sets`, while there is no ordering between types.
+ * Returns the result of the first operation that failed, if any */
+int vaccel_genop_batch(struct vaccel_session *sess,
+		struct vaccel_genop_set *sets, int nr_sets);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,75 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __VACCEL_PIPELINE_H__
+#define __VACCEL_PIPELINE_H__
+
+#include <stdint.h>
+
+#include "genop.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct vaccel_session;
+struct vaccel_pipeline;
+
+/* Create an empty pipeline */
+int vaccel_pipeline_new(struct vaccel_pipeline **pipeline);
+
+/* Declare an intermediate tensor of `size` bytes
+ *
+ * Intermediate tensors are allocated by the runtime, using the memory
+ * allocator of the plugin that produces them, if it has one. They never
+ * reach the caller. The id of the tensor is returned in `tensor` */
+int vaccel_pipeline_tensor(struct vaccel_pipeline *pipeline, uint64_t size,
+		int *tensor);
+
+/* Make `arg` refer to an intermediate tensor, setting its
+ * VACCEL_ARG_FLAG_TENSOR flag */
+void vaccel_pipeline_tensor_arg(struct vaccel_arg *arg, int tensor);
+
+/* Add a stage to the pipeline
+ *
+ * Arguments are the same as those of vaccel_genop(), except that they
+ * may refer to intermediate tensors. Each tensor needs to be written by
+ * exactly one stage, which has to be added before the stages reading
+ * it. The argument arrays are copied, the data they point to are not.
+ * The id of the stage is returned in `stage`, if not NULL */
+int vaccel_pipeline_add(struct vaccel_pipeline *pipeline,
+		struct vaccel_arg *read, int nr_read,
+		struct vaccel_arg *write, int nr_write, int *stage);
+
+/* Run all the stages of the pipeline
+ *
+ * Stages run as soon as the stages producing their inputs complete, so
+ * independent stages run concurrently, on up to VACCEL_PIPELINE_THREADS
+ * threads. If a stage fails, the stages depending on it are skipped.
+ * Returns the result of the first stage that failed, if any */
+int vaccel_pipeline_run(struct vaccel_session *sess,
+		struct vaccel_pipeline *pipeline);
+
+/* Result of a stage in the last run of the pipeline */
+int vaccel_pipeline_stage_result(struct vaccel_pipeline *pipeline,
+		int stage);
+
+/* Destroy a pipeline and release its intermediate tensors */
+int vaccel_pipeline_destroy(struct vaccel_pipeline *pipeline);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VACCEL_PIPELINE_H__ */
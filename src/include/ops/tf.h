@@ -76,6 +76,14 @@ struct vaccel_tf_node {
 };
 
 struct vaccel_tf_node *vaccel_tf_node_new(const char *name, long long int id);
+
+/* Create a node in the session's arena. It is released along with the
+ * rest of the arena and must not be passed to vaccel_tf_node_destroy() */
+struct vaccel_tf_node *vaccel_tf_node_sess_new(
+	struct vaccel_session *sess,
+	const char *name,
+	long long int id
+);
 void vaccel_tf_node_destroy(struct vaccel_tf_node *node);
 const char *vaccel_tf_node_get_name(struct vaccel_tf_node *node);
 long long int vaccel_tf_node_get_id(struct vaccel_tf_node *node);
@@ -106,6 +114,16 @@ vaccel_tf_tensor_new(
 	enum vaccel_tf_data_type type
 );
 
+/* Create a tensor in the session's arena. It is released along with the
+ * rest of the arena and must not be passed to vaccel_tf_tensor_destroy() */
+struct vaccel_tf_tensor *
+vaccel_tf_tensor_sess_new(
+	struct vaccel_session *sess,
+	int nr_dims,
+	uint32_t *dims,
+	enum vaccel_tf_data_type type
+);
+
 struct vaccel_tf_tensor *
 vaccel_tf_tensor_allocate(
 	int nr_dims, uint32_t *dims,
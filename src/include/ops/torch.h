@@ -139,6 +139,12 @@ int vaccel_torch_tensor_set_data(
 
 void *vaccel_torch_tensor_get_data(struct vaccel_torch_tensor *tensor);
 struct vaccel_torch_buffer *vaccel_torch_buffer_new(char *data, size_t size);
+
+/* Create a buffer in the session's arena. The buffer is released along
+ * with the rest of the arena and must not be passed to
+ * vaccel_torch_buffer_destroy(). `data` is not owned by the buffer */
+struct vaccel_torch_buffer *vaccel_torch_buffer_sess_new(
+		struct vaccel_session *sess, char *data, size_t size);
 #ifdef __cplusplus
 }
 #endif
@@ -103,6 +103,17 @@ struct vaccel_plugin_info {
 	int (*sess_unregister)(uint32_t sess_id, vaccel_id_t resource_id);
 	int (*resource_new)(vaccel_resource_t, void *data, vaccel_id_t *id);
 	int (*resource_destroy)(vaccel_id_t id);
+
+	/* Optional allocator for buffers the plugin works on directly,
+	 * e.g. the intermediate tensors of pipelines */
+	void *(*mem_alloc)(size_t size);
+	void (*mem_free)(void *ptr);
+
+	/* Set if the plugin handles extended arguments of exec operations
+	 * itself, see vaccel_arg_segs(). Otherwise, and for the arguments
+	 * of every other operation, they are turned into regular arguments
+	 * before they reach it */
+	bool sg_capable;
 };
 
 struct vaccel_plugin {
@@ -164,6 +175,9 @@ int register_plugin(struct vaccel_plugin *plugin);
 int unregister_plugin(struct vaccel_plugin *plugin);
 int register_plugin_function(struct vaccel_op *plugin_op);
 int register_plugin_functions(struct vaccel_op *plugin_ops, size_t nr_ops);
+int register_plugin_batch_function(struct vaccel_op *plugin_op);
+int register_plugin_batch_functions(struct vaccel_op *plugin_ops,
+		size_t nr_ops);
 
 #ifdef __cplusplus
 }
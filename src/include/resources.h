@@ -35,6 +35,15 @@ struct vaccel_resource;
 
 vaccel_id_t resource_get_id(struct vaccel_resource *resource);
 
+/* Completion callback of asynchronous resource operations
+ *
+ * It is called from a vAccel worker thread with the return value
+ * of the operation and the private pointer passed by the user */
+typedef void (*vaccel_resource_cb_t)(int ret, void *priv);
+
+/* Wait for all in-flight asynchronous resource operations */
+int vaccel_resources_wait(void);
+
 #ifdef __cplusplus
 }
 #endif
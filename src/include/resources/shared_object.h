@@ -19,6 +19,7 @@
 
 #include <vaccel_id.h>
 #include <vaccel_file.h>
+#include <resources.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -26,6 +27,12 @@ extern "C" {
 
 struct vaccel_resource;
 
+/* A symbol of a preloaded shared object */
+struct vaccel_shared_object_symbol {
+	char *name;
+	void *addr;
+};
+
 struct vaccel_shared_object {
 	/* Underlying resource object */
 	struct vaccel_resource *resource;
@@ -35,6 +42,16 @@ struct vaccel_shared_object {
 
 	/* Plugin specific data */
 	void *plugin_data;
+
+	/* Set by plugins that keep state about the object, e.g. a loaded
+	 * copy of the library. Called when the object is destroyed */
+	void (*plugin_data_free)(struct vaccel_shared_object *object);
+
+	/* Handle and symbols of the library, if it has been loaded with
+	 * vaccel_shared_object_preload() */
+	void *dl_handle;
+	struct vaccel_shared_object_symbol *symbols;
+	size_t nr_symbols;
 };
 
 int vaccel_shared_object_new(
@@ -48,6 +65,14 @@ int vaccel_shared_object_new_from_buffer(
 	size_t size
 );
 
+int vaccel_shared_object_new_from_buffer_async(
+	struct vaccel_shared_object *object,
+	const uint8_t *buff,
+	size_t size,
+	vaccel_resource_cb_t cb,
+	void *priv
+);
+
 int vaccel_shared_object_destroy(struct vaccel_shared_object *object);
 
 vaccel_id_t vaccel_shared_object_get_id(
@@ -58,6 +83,31 @@ const uint8_t *vaccel_shared_object_get(
 	struct vaccel_shared_object *object, size_t *len
 );
 
+/* Load the library and resolve a list of its symbols
+ *
+ * Normally the library of a shared object is loaded by the plugin the
+ * first time a function of it is executed, so the first request pays
+ * for loading it and resolving the symbol. Preloading does this work
+ * in advance and lets vaccel_exec_with_resource() call preloaded
+ * symbols directly. The library is unloaded when the object is
+ * destroyed. This must not be called concurrently with operations on
+ * the object. When the operations are offloaded through VirtIO there
+ * is nothing to load locally, and this is a no-op.
+ */
+int vaccel_shared_object_preload(
+	struct vaccel_shared_object *object,
+	const char *const *symbols,
+	size_t nr_symbols
+);
+
+/* Get the address of a symbol resolved by vaccel_shared_object_preload()
+ *
+ * Returns NULL if the symbol has not been preloaded */
+void *vaccel_shared_object_symbol(
+	const struct vaccel_shared_object *object,
+	const char *name
+);
+
 #ifdef __cplusplus
 }
 #endif
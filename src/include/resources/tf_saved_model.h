@@ -16,6 +16,7 @@
 
 #include <vaccel_id.h>
 #include <vaccel_file.h>
+#include <resources.h>
 
 #include <stdint.h>
 #include <stddef.h>
@@ -94,6 +95,11 @@ const uint8_t *vaccel_tf_saved_model_get_var_index(
 
 int vaccel_tf_saved_model_register(struct vaccel_tf_saved_model *model);
 
+int vaccel_tf_saved_model_register_async(
+	struct vaccel_tf_saved_model *model,
+	vaccel_resource_cb_t cb, void *priv
+);
+
 int vaccel_tf_saved_model_destroy(struct vaccel_tf_saved_model *model);
 
 vaccel_id_t vaccel_tf_saved_model_id(const struct vaccel_tf_saved_model *model);
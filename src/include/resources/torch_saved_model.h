@@ -16,6 +16,7 @@
 
 #include <vaccel_id.h>
 #include <vaccel_file.h>
+#include <resources.h>
 
 #include <stdint.h>
 #include <stddef.h>
@@ -86,6 +87,11 @@ const uint8_t *vaccel_torch_saved_model_get_var_index(
 
 int vaccel_torch_saved_model_register(struct vaccel_torch_saved_model *model);
 
+int vaccel_torch_saved_model_register_async(
+	struct vaccel_torch_saved_model *model,
+	vaccel_resource_cb_t cb, void *priv
+);
+
 int vaccel_torch_saved_model_destroy(struct vaccel_torch_saved_model *model);
 
 vaccel_id_t vaccel_torch_saved_model_id(const struct vaccel_torch_saved_model *model);
@@ -15,6 +15,7 @@
 #ifndef __VACCEL_SESSION_H__
 #define __VACCEL_SESSION_H__
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -66,6 +67,26 @@ bool vaccel_sess_has_resource(
 	struct vaccel_resource *resource
 );
 
+/* Allocate memory from the session's arena
+ *
+ * The memory is aligned for any type and remains valid until the next
+ * call to vaccel_sess_reset() or vaccel_sess_free(), which release all
+ * the session's allocations at once. It must not be passed to free().
+ * Allocations on the same session need to be serialized by the caller.
+ */
+void *vaccel_sess_alloc(struct vaccel_session *sess, size_t size);
+
+/* Duplicate a string in the session's arena */
+char *vaccel_sess_strdup(struct vaccel_session *sess, const char *str);
+
+/* Release all the arena allocations of a session
+ *
+ * The memory backing the arena is kept around, so that a session that
+ * resets its arena after every request stops hitting the system
+ * allocator once it reaches its steady state.
+ */
+int vaccel_sess_reset(struct vaccel_session *sess);
+
 #ifdef __cplusplus
 }
 #endif
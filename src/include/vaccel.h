@@ -28,6 +28,7 @@
 #include "ops/minmax.h"
 #include "ops/exec.h"
 #include "ops/genop.h"
+#include "ops/pipeline.h"
 #include "ops/image.h"
 #include "ops/noop.h"
 #include "ops/tf.h"
@@ -37,6 +38,7 @@
 #include "resources/shared_object.h"
 #include "misc.h"
 #include "vaccel_prof.h"
+#include "vaccel_trace.h"
 #include "ops/torch.h"
 #include "resources/torch_saved_model.h"
 #endif /* __VACCEL_H__ */
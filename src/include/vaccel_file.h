@@ -36,9 +36,23 @@ struct vaccel_file {
 	 * in a buffer */
 	uint8_t *data;
 	size_t size;
+
+	/* CRC32C checksum of the contents of the file. Valid only
+	 * if `checksum_valid` is set */
+	uint32_t checksum;
+	bool checksum_valid;
+
+	/* Reference to the shared store object backing the file,
+	 * or -1 if the file is not in the shared store */
+	int store_fd;
 };
 
 int vaccel_file_new(struct vaccel_file *file, const char *path);
+int vaccel_file_new_verified(
+	struct vaccel_file *file,
+	const char *path,
+	uint32_t checksum
+);
 int vaccel_file_from_buffer(
 	struct vaccel_file *file,
 	const uint8_t *buff,
@@ -48,6 +62,20 @@ int vaccel_file_from_buffer(
 	const char *dir,
 	bool randomize
 );
+int vaccel_file_from_compressed_buffer(
+	struct vaccel_file *file,
+	const uint8_t *buff,
+	size_t size,
+	const char *filename,
+	const char *dir,
+	bool randomize
+);
+int vaccel_file_new_compressed(
+	struct vaccel_file *file,
+	const char *path,
+	const char *dir,
+	bool randomize
+);
 int vaccel_file_persist(
 	struct vaccel_file *file,
 	const char *dir,
@@ -59,6 +87,8 @@ bool vaccel_file_initialized(struct vaccel_file *file);
 int vaccel_file_read(struct vaccel_file *file);
 uint8_t *vaccel_file_data(struct vaccel_file *file, size_t *size);
 const char *vaccel_file_path(struct vaccel_file *file);
+int vaccel_file_checksum(struct vaccel_file *file, uint32_t *checksum);
+int vaccel_file_verify(struct vaccel_file *file, uint32_t checksum);
 
 #ifdef __cplusplus
 }
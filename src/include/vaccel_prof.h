@@ -32,6 +32,43 @@ struct vaccel_prof_sample {
 	uint64_t time;
 };
 
+/* Hardware counters collected with VACCEL_PROF_COUNTERS=enabled */
+enum vaccel_prof_counter {
+	VACCEL_PROF_CYCLES = 0,
+	VACCEL_PROF_INSTRUCTIONS,
+	VACCEL_PROF_LLC_MISSES,
+	VACCEL_PROF_BRANCH_MISSES,
+	VACCEL_PROF_CTX_SWITCHES,
+	VACCEL_PROF_COUNTERS_NR
+};
+
+/* Latency statistics of a region, in nsec
+ *
+ * When only some entries are measured (see VACCEL_PROF_SAMPLE), the
+ * statistics are extrapolated from the `nr_sampled` measured ones */
+struct vaccel_prof_stats {
+	uint64_t nr_entries;
+	uint64_t nr_sampled;
+	uint64_t total_time;
+	uint64_t min;
+	uint64_t mean;
+	uint64_t p50;
+	uint64_t p90;
+	uint64_t p99;
+	uint64_t p999;
+	uint64_t max;
+
+	/* Bitmask of the hardware counters that could be collected, by
+	 * enum vaccel_prof_counter, and their totals over the
+	 * `nr_counted` entries that collected them */
+	uint32_t counters;
+	uint64_t nr_counted;
+	uint64_t counter_totals[VACCEL_PROF_COUNTERS_NR];
+};
+
+/* Samples collected by a single thread for a region */
+struct vaccel_prof_thread_buf;
+
 struct vaccel_prof_region {
 	/* Name of the region */
 	const char *name;
@@ -39,26 +76,78 @@ struct vaccel_prof_region {
 	/* 'true' if we own the memory of 'name' */
 	bool name_owned;
 
-	/* Number of collected samples */
-	size_t nr_entries;
-
-	/* Array of collected samples */
-	struct vaccel_prof_sample *samples;
-
-	/* Allocated size for the array */
-	size_t size;
+	/* Per-thread histograms. Each thread only ever records to its
+	 * own buffer; the buffers are merged when reporting */
+	struct vaccel_prof_thread_buf *bufs;
 };
 
-#define VACCEL_PROF_REGION_INIT(name) { (name), false, 0, NULL, 0 }
+#define VACCEL_PROF_REGION_INIT(name) { (name), false, NULL }
+
+/* Handle of an entry into a region, to be passed to the matching
+ * vaccel_prof_region_exit(). It is 0 when profiling is disabled */
+typedef uint64_t vaccel_prof_token_t;
 
 bool vaccel_prof_enabled(void);
 
-/* Start profiling a region */
+/* Switch profiling on or off at runtime, overriding VACCEL_PROF_ENABLED
+ *
+ * Regions keep the samples recorded so far; see vaccel_prof_reset() */
+int vaccel_prof_set_enabled(bool enabled);
+
+/* Append the profile of the operations run so far to `path`, in the
+ * format used when the process exits. This works whether profiling is
+ * currently enabled or not */
+int vaccel_prof_dump(const char *path);
+
+/* Drop the profile of the operations run so far */
+int vaccel_prof_reset(void);
+
+/* Enter a region
+ *
+ * Returns a token identifying this entry, which is passed to
+ * vaccel_prof_region_exit() to record the time spent in the region.
+ * Any number of threads can be inside the same region at once.
+ */
+vaccel_prof_token_t vaccel_prof_region_enter(struct vaccel_prof_region *region);
+
+/* Exit a region entered with vaccel_prof_region_enter() */
+int vaccel_prof_region_exit(
+		struct vaccel_prof_region *region,
+		vaccel_prof_token_t token
+);
+
+/* Start profiling a region
+ *
+ * Same as vaccel_prof_region_enter(), but the entry is kept on a
+ * per-thread stack, to be closed by the next vaccel_prof_region_stop()
+ * for the region on the same thread */
 int vaccel_prof_region_start(struct vaccel_prof_region *region);
 
 /* Stop profiling a region */
 int vaccel_prof_region_stop(const struct vaccel_prof_region *region);
 
+/* Get the latency statistics of a region
+ *
+ * Every region keeps a fixed-size log-linear histogram per thread, so
+ * percentiles are accurate to within 1/64th of their value, and memory
+ * does not grow with the number of samples */
+int vaccel_prof_region_stats(
+		const struct vaccel_prof_region *region,
+		struct vaccel_prof_stats *stats
+);
+
+/* Get a copy of the raw samples kept for a region
+ *
+ * Raw samples are only kept when VACCEL_PROF_SAMPLES=<n> is set, in
+ * which case the last <n> samples of each thread are merged in
+ * `*samples`, which the caller needs to free(). The copy is only
+ * guaranteed to be consistent when no thread is recording samples. */
+int vaccel_prof_region_samples(
+		const struct vaccel_prof_region *region,
+		struct vaccel_prof_sample **samples,
+		size_t *nr_samples
+);
+
 /* Dump profiling results of a region */
 int vaccel_prof_region_print(const struct vaccel_prof_region *region);
 
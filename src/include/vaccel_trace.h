@@ -0,0 +1,46 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "error.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Tracing of vAccel operations
+ *
+ * With VACCEL_TRACE_ENABLED=enabled, the runtime records a begin and
+ * an end event for every operation it dispatches, along with the
+ * session, the operation type, the plugin, the thread and the size of
+ * the arguments. Events go to an in-memory ring holding the last
+ * VACCEL_TRACE_BUFFER events (65536 by default), which is written to
+ * VACCEL_TRACE_FILE (vaccel-trace-<pid>.json by default) at exit.
+ *
+ * Traces are in the Chrome trace event format, which both
+ * chrome://tracing and the Perfetto UI open. */
+bool vaccel_trace_enabled(void);
+
+/* Write the events currently in the trace buffer to `path`, or to
+ * VACCEL_TRACE_FILE if `path` is NULL */
+int vaccel_trace_flush(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
@@ -12,26 +12,119 @@
  * limitations under the License.
  */
 
+
 #include "error.h"
 #include "log.h"
 
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
 #include <slog.h>
 
-#define VACCEL_DEBUG_LVL_ERROR 1
-#define VACCEL_DEBUG_LVL_WARN  2
-#define VACCEL_DEBUG_LVL_INFO  3
-#define VACCEL_DEBUG_LVL_DEBUG 4
+/* Records per thread ring. Must be a power of two */
+#define LOG_RING_SLOTS 1024
+
+/* Longer asynchronous messages are truncated */
+#define LOG_MSG_MAX 240
+
+/* How often the writer thread drains the rings */
+#define LOG_FLUSH_INTERVAL_NSEC (10 * 1000 * 1000)
+
+struct log_record {
+	/* CLOCK_MONOTONIC time the message was logged at */
+	uint64_t tstamp;
+
+	/* slog flag of the message's level */
+	int flag;
+
+	/* Thread that logged the message */
+	uint32_t tid;
+
+	char msg[LOG_MSG_MAX];
+};
+
+/* Single-producer single-consumer ring of a logging thread. Only the
+ * owning thread advances `head` and only the writer thread advances
+ * `tail`, so neither side needs a lock */
+struct log_ring {
+	uint64_t head __attribute__((aligned(64)));
+
+	/* Messages dropped because the ring was full */
+	uint64_t dropped;
+
+	uint64_t tail __attribute__((aligned(64)));
+
+	/* Where the current drain pass stops. Private to the writer */
+	uint64_t drain_head;
+
+	/* Set when the owning thread exits, so that a new thread can take
+	 * the ring over */
+	int orphan;
+
+	/* Set by the owning thread while it is adding a record, so that a
+	 * flush can wait for records added after it stopped the writer */
+	int busy;
+
+	/* Next ring in the global list */
+	struct log_ring *next;
+
+	struct log_record slots[LOG_RING_SLOTS];
+};
+
+/* A record picked up by the writer in a drain pass */
+struct log_pending {
+	struct log_record *rec;
+	uint64_t pos;
+};
+
+int vaccel_log_flags;
+
+static struct {
+	/* Every ring ever created. Rings are only pushed at the head and
+	 * are never freed, since exited threads hand theirs over */
+	struct log_ring *rings;
+
+	/* Marks rings of exiting threads as orphans */
+	pthread_key_t key;
+	pthread_once_t once;
+
+	pthread_t writer;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool stopping;
+
+	/* Set while the writer thread is accepting records */
+	int running;
+
+	/* Scratch space of the writer for sorting records */
+	struct log_pending *pending;
+	size_t nr_pending_max;
+} log_async = {
+	.once = PTHREAD_ONCE_INIT,
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+static __thread struct log_ring *log_ring_self;
+static __thread uint32_t log_tid;
 
 static void set_debug_level(void)
 {
+	int nEnabledLevels = 0;
+
 	char *env = getenv("VACCEL_DEBUG_LEVEL");
 	if (!env)
-		return;
+		goto out;
 
 	int level = atoi(env);
-	int nEnabledLevels = 0;
 	switch (level) {
 		/* FALLTHRU */
 		case VACCEL_DEBUG_LVL_DEBUG:
@@ -53,6 +146,9 @@ static void set_debug_level(void)
 	slog_config_get(&cfg);
 	cfg.nFlags = nEnabledLevels;
 	slog_config_set(&cfg);
+
+out:
+	__atomic_store_n(&vaccel_log_flags, nEnabledLevels, __ATOMIC_RELAXED);
 }
 
 static void set_log_file(void)
@@ -75,18 +171,326 @@ static void set_log_file(void)
 	slog_config_set(&cfg);
 }
 
+static void log_ring_release(void *arg)
+{
+	struct log_ring *ring = arg;
+	__atomic_store_n(&ring->orphan, 1, __ATOMIC_RELEASE);
+}
+
+/* A process forking while other threads log, e.g. the exec plugin
+ * starting its workers, must not leave the child with the slog mutex
+ * held by a thread that does not exist there */
+static void log_atfork_prepare(void)
+{
+	slog_fork_prepare();
+}
+
+static void log_atfork_parent(void)
+{
+	slog_fork_parent();
+}
+
+/* Only the forking thread survives in a child process, so there is no
+ * writer thread there and its messages need to be logged synchronously */
+static void log_atfork_child(void)
+{
+	log_tid = 0;
+	log_async.running = 0;
+	pthread_mutex_init(&log_async.lock, NULL);
+	pthread_cond_init(&log_async.cond, NULL);
+
+	slog_fork_child();
+}
+
+static void log_atfork_once(void)
+{
+	pthread_atfork(log_atfork_prepare, log_atfork_parent,
+			log_atfork_child);
+}
+
+static void log_async_once(void)
+{
+	pthread_key_create(&log_async.key, log_ring_release);
+}
+
+/* Get the calling thread's ring, adopting an orphan one or creating
+ * a new one on its first message */
+static struct log_ring *log_ring_get(void)
+{
+	struct log_ring *ring = log_ring_self;
+	if (ring)
+		return ring;
+
+	ring = __atomic_load_n(&log_async.rings, __ATOMIC_ACQUIRE);
+	for (; ring; ring = ring->next) {
+		int orphan = 1;
+		if (__atomic_compare_exchange_n(&ring->orphan, &orphan, 0,
+					false, __ATOMIC_ACQUIRE,
+					__ATOMIC_RELAXED))
+			goto out;
+	}
+
+	ring = aligned_alloc(64, sizeof(*ring));
+	if (!ring)
+		return NULL;
+
+	memset(ring, 0, sizeof(*ring));
+	ring->next = __atomic_load_n(&log_async.rings, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&log_async.rings, &ring->next,
+				ring, true, __ATOMIC_RELEASE,
+				__ATOMIC_RELAXED))
+		;
+
+out:
+	pthread_setspecific(log_async.key, ring);
+	log_ring_self = ring;
+	return ring;
+}
+
+static void log_ring_put(struct log_ring *ring, int flag, const char *fmt,
+		va_list ap)
+{
+	uint64_t head = ring->head;
+	uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+	if (head - tail == LOG_RING_SLOTS) {
+		__atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	struct log_record *rec = &ring->slots[head & (LOG_RING_SLOTS - 1)];
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	rec->tstamp = ts.tv_sec * 1000000000UL + ts.tv_nsec;
+	rec->flag = flag;
+	if (!log_tid)
+		log_tid = syscall(SYS_gettid);
+	rec->tid = log_tid;
+	vsnprintf(rec->msg, sizeof(rec->msg), fmt, ap);
+
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static int log_pending_cmp(const void *a, const void *b)
+{
+	const struct log_pending *pa = a;
+	const struct log_pending *pb = b;
+
+	if (pa->rec->tstamp != pb->rec->tstamp)
+		return (pa->rec->tstamp < pb->rec->tstamp) ? -1 : 1;
+
+	/* Same thread, same timestamp: keep the order they were logged */
+	if (pa->pos != pb->pos)
+		return (pa->pos < pb->pos) ? -1 : 1;
+
+	return 0;
+}
+
+/* Wall-clock time of a record, for its output. The offset between the
+ * clocks is taken at each drain pass, so that it follows adjustments of
+ * the system time */
+static void log_record_time(const struct log_record *rec, int64_t offset,
+		struct timespec *ts)
+{
+	int64_t tstamp = (int64_t)rec->tstamp + offset;
+
+	ts->tv_sec = tstamp / 1000000000L;
+	ts->tv_nsec = tstamp % 1000000000L;
+}
+
+static int64_t log_clock_offset(void)
+{
+	struct timespec mono, real;
+
+	clock_gettime(CLOCK_MONOTONIC, &mono);
+	clock_gettime(CLOCK_REALTIME, &real);
+
+	return (real.tv_sec - mono.tv_sec) * 1000000000L +
+		(real.tv_nsec - mono.tv_nsec);
+}
+
+/* Write out everything queued in the rings so far, in timestamp order.
+ * Records are printed with the time they were logged at and the thread
+ * that logged them, rather than those of the writer. Only called by the
+ * writer thread, or once it has exited */
+static void log_async_drain(void)
+{
+	struct log_ring *rings =
+		__atomic_load_n(&log_async.rings, __ATOMIC_ACQUIRE);
+	size_t nr_pending = 0;
+	uint64_t dropped = 0;
+
+	for (struct log_ring *ring = rings; ring; ring = ring->next) {
+		uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		uint64_t tail = ring->tail;
+		size_t nr = head - tail;
+
+		ring->drain_head = tail;
+		if (nr_pending + nr > log_async.nr_pending_max) {
+			size_t max = (nr_pending + nr) * 2;
+			struct log_pending *p = realloc(log_async.pending,
+					max * sizeof(*p));
+			if (!p)
+				continue;
+
+			log_async.pending = p;
+			log_async.nr_pending_max = max;
+		}
+
+		for (uint64_t pos = tail; pos != head; ++pos) {
+			struct log_pending *p = &log_async.pending[nr_pending++];
+			p->rec = &ring->slots[pos & (LOG_RING_SLOTS - 1)];
+			p->pos = pos;
+		}
+
+		ring->drain_head = head;
+		dropped += __atomic_exchange_n(&ring->dropped, 0,
+				__ATOMIC_RELAXED);
+	}
+
+	if (nr_pending > 1)
+		qsort(log_async.pending, nr_pending, sizeof(*log_async.pending),
+				log_pending_cmp);
+
+	int64_t offset = log_clock_offset();
+	for (size_t i = 0; i < nr_pending; ++i) {
+		struct log_record *rec = log_async.pending[i].rec;
+		struct timespec ts;
+
+		log_record_time(rec, offset, &ts);
+		slog_print_at(rec->flag, 1, &ts, rec->tid, "%s", rec->msg);
+	}
+
+	/* Hand the slots back to the producers */
+	for (struct log_ring *ring = rings; ring; ring = ring->next)
+		__atomic_store_n(&ring->tail, ring->drain_head,
+				__ATOMIC_RELEASE);
+
+	if (dropped)
+		slog_print(SLOG_WARN, 1, "Dropped %lu log messages", dropped);
+}
+
+static void *log_writer(void *arg)
+{
+	(void)arg;
+
+	pthread_mutex_lock(&log_async.lock);
+	while (!log_async.stopping) {
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += LOG_FLUSH_INTERVAL_NSEC;
+		if (ts.tv_nsec >= 1000000000L) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000L;
+		}
+
+		pthread_cond_timedwait(&log_async.cond, &log_async.lock, &ts);
+
+		pthread_mutex_unlock(&log_async.lock);
+		log_async_drain();
+		pthread_mutex_lock(&log_async.lock);
+	}
+	pthread_mutex_unlock(&log_async.lock);
+
+	log_async_drain();
+
+	return NULL;
+}
+
+/* Start the writer thread for VACCEL_LOG_ASYNC=enabled. If that fails
+ * we just log synchronously */
+static void log_async_start(void)
+{
+	char *env = getenv("VACCEL_LOG_ASYNC");
+	if (!env || strcmp(env, "enabled"))
+		return;
+
+	if (__atomic_load_n(&log_async.running, __ATOMIC_RELAXED))
+		return;
+
+	pthread_once(&log_async.once, log_async_once);
+
+	log_async.stopping = false;
+	if (pthread_create(&log_async.writer, NULL, log_writer, NULL))
+		return;
+
+	__atomic_store_n(&log_async.running, 1, __ATOMIC_RELEASE);
+}
+
+int vaccel_log_flush(void)
+{
+	if (!__atomic_exchange_n(&log_async.running, 0, __ATOMIC_SEQ_CST))
+		return VACCEL_OK;
+
+	/* New messages are logged synchronously from now on. Wait for the
+	 * ones being added to a ring, so that the last drain sees them */
+	struct log_ring *ring =
+		__atomic_load_n(&log_async.rings, __ATOMIC_ACQUIRE);
+	for (; ring; ring = ring->next)
+		while (__atomic_load_n(&ring->busy, __ATOMIC_SEQ_CST))
+			sched_yield();
+
+	pthread_mutex_lock(&log_async.lock);
+	log_async.stopping = true;
+	pthread_cond_signal(&log_async.cond);
+	pthread_mutex_unlock(&log_async.lock);
+
+	/* The writer drains the rings once more before exiting */
+	pthread_join(log_async.writer, NULL);
+
+	return VACCEL_OK;
+}
+
+void vaccel_log_print(int flag, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+
+	if (__atomic_load_n(&log_async.running, __ATOMIC_RELAXED)) {
+		struct log_ring *ring = log_ring_get();
+		if (ring) {
+			/* Pairs with vaccel_log_flush(): either it sees us
+			 * busy and waits, or we see the writer stopped */
+			__atomic_store_n(&ring->busy, 1, __ATOMIC_SEQ_CST);
+			bool queued = __atomic_load_n(&log_async.running,
+					__ATOMIC_SEQ_CST);
+			if (queued)
+				log_ring_put(ring, flag, fmt, ap);
+			__atomic_store_n(&ring->busy, 0, __ATOMIC_RELEASE);
+
+			if (queued)
+				goto out;
+		}
+	}
+
+	char msg[SLOG_MESSAGE_MAX];
+	vsnprintf(msg, sizeof(msg), fmt, ap);
+	slog_print(flag, 1, "%s", msg);
+
+out:
+	va_end(ap);
+}
+
 int vaccel_log_init(void)
 {
-	slog_init("/dev/stdout", 0, 0);
+	static pthread_once_t atfork_once = PTHREAD_ONCE_INIT;
+
+	/* vAccel spawns worker threads, so make the logger thread-safe */
+	slog_init("/dev/stdout", 0, 1);
+	pthread_once(&atfork_once, log_atfork_once);
 
 	set_debug_level();
 	set_log_file();
 
+	log_async_start();
+
 	return VACCEL_OK;
 }
 
 int vaccel_log_shutdown(void)
 {
+	vaccel_log_flush();
 	slog_destroy();
 	return VACCEL_OK;
 }
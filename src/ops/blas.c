@@ -49,7 +49,8 @@ int vaccel_sgemm(
 	if (!plugin_op)
 		return VACCEL_ENOTSUP;
 
-	return plugin_op(sess, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+	return plugin_op_call(sess, VACCEL_BLAS_SGEMM, plugin_op,
+			sess, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
 }
 
 int vaccel_sgemm_unpack(
@@ -69,18 +70,18 @@ int vaccel_sgemm_unpack(
 		return VACCEL_EINVAL;
 	}
 
-	long long int m = *(long long int*)read[0].buf;
-	long long int n = *(long long int*)read[1].buf;
-	long long int k = *(long long int*)read[2].buf;
-	float alpha = *(float *)read[3].buf;
-	long long int lda  = (long long int)read[4].size;
-	float *a = (float *)read[4].buf;
-	long long int ldb = (long long int)read[5].size;
-	float *b = (float *)read[5].buf;
-	float beta = *(float *)read[6].buf;
+	long long int m = *(long long int*)vaccel_arg_buf(&read[0]);
+	long long int n = *(long long int*)vaccel_arg_buf(&read[1]);
+	long long int k = *(long long int*)vaccel_arg_buf(&read[2]);
+	float alpha = *(float *)vaccel_arg_buf(&read[3]);
+	long long int lda  = (long long int)vaccel_arg_size(&read[4]);
+	float *a = (float *)vaccel_arg_buf(&read[4]);
+	long long int ldb = (long long int)vaccel_arg_size(&read[5]);
+	float *b = (float *)vaccel_arg_buf(&read[5]);
+	float beta = *(float *)vaccel_arg_buf(&read[6]);
 
-	long long int ldc = (long long int)write[0].size;
-	float *c = (float *)write[0].buf;
+	long long int ldc = (long long int)vaccel_arg_size(&write[0]);
+	float *c = (float *)vaccel_arg_buf(&write[0]);
 
 	return vaccel_sgemm(sess, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
 }
@@ -25,6 +25,48 @@
 #include "session.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Hand regular arguments to plugins that cannot handle extended ones.
+ * On success, `read` and `write` point to the arrays to pass on to the
+ * plugin */
+static int exec_args_prepare(struct vaccel_session *sess,
+		enum vaccel_op_type op_type, struct vaccel_arg **read,
+		size_t nr_read, struct vaccel_arg **write, size_t nr_write,
+		struct genop_linear_args *linear_read,
+		struct genop_linear_args *linear_write)
+{
+	int nr_ext_read = genop_nr_ext_args(*read, nr_read);
+	int nr_ext_write = genop_nr_ext_args(*write, nr_write);
+	if (nr_ext_read < 0 || nr_ext_write < 0)
+		return VACCEL_EINVAL;
+
+	if (!(nr_ext_read + nr_ext_write) || genop_sg_capable(sess, op_type))
+		return VACCEL_OK;
+
+	int ret = genop_linearize(*read, nr_read, linear_read);
+	if (!ret)
+		ret = genop_linearize(*write, nr_write, linear_write);
+	if (ret)
+		return ret;
+
+	*read = linear_read->args;
+	*write = linear_write->args;
+	return VACCEL_OK;
+}
+
+static void exec_args_finish(struct vaccel_arg *write,
+		struct genop_linear_args *linear_read,
+		struct genop_linear_args *linear_write)
+{
+	if (linear_write->args)
+		genop_linear_scatter(linear_write, write);
+
+	genop_linear_free(linear_write);
+	genop_linear_free(linear_read);
+}
+
 int vaccel_exec(struct vaccel_session *sess, const char *library,
 				const char *fn_symbol, struct vaccel_arg *read,
 				size_t nr_read, struct vaccel_arg *write, size_t nr_write)
@@ -40,8 +82,17 @@ int vaccel_exec(struct vaccel_session *sess, const char *library,
 	if (!plugin_op)
 		return VACCEL_ENOTSUP;
 
-	return plugin_op(sess, library, fn_symbol, read, nr_read,
-					 write, nr_write);
+	struct genop_linear_args linear_read = { 0 }, linear_write = { 0 };
+	struct vaccel_arg *plugin_read = read, *plugin_write = write;
+	int ret = exec_args_prepare(sess, VACCEL_EXEC, &plugin_read, nr_read,
+			&plugin_write, nr_write, &linear_read, &linear_write);
+	if (!ret)
+		ret = plugin_op_call(sess, VACCEL_EXEC, plugin_op,
+				sess, library, fn_symbol, plugin_read, nr_read,
+				plugin_write, nr_write);
+
+	exec_args_finish(write, &linear_read, &linear_write);
+	return ret;
 }
 
 int vaccel_exec_with_resource(struct vaccel_session *sess, struct vaccel_shared_object *object,
@@ -59,8 +110,111 @@ int vaccel_exec_with_resource(struct vaccel_session *sess, struct vaccel_shared_
 	if (!plugin_op)
 		return VACCEL_ENOTSUP;
 
-	return plugin_op(sess, object, fn_symbol, read, nr_read,
-					 write, nr_write);
+	struct genop_linear_args linear_read = { 0 }, linear_write = { 0 };
+	struct vaccel_arg *plugin_read = read, *plugin_write = write;
+	int ret = exec_args_prepare(sess, VACCEL_EXEC_WITH_RESOURCE,
+			&plugin_read, nr_read, &plugin_write, nr_write,
+			&linear_read, &linear_write);
+	if (!ret)
+		ret = plugin_op_call(sess, VACCEL_EXEC_WITH_RESOURCE,
+				plugin_op, sess, object, fn_symbol,
+				plugin_read, nr_read, plugin_write, nr_write);
+
+	exec_args_finish(write, &linear_read, &linear_write);
+	return ret;
+}
+
+int vaccel_exec_batch(struct vaccel_session *sess, const char *library,
+		const char *fn_symbol, struct vaccel_genop_set *sets,
+		int nr_sets)
+{
+	int ret = VACCEL_OK;
+
+	if (!sess || !library || !fn_symbol || !sets || nr_sets <= 0)
+		return VACCEL_EINVAL;
+
+	vaccel_debug("session:%u Looking for plugin implementing exec batch",
+				 sess->session_id);
+
+	vaccel_batch_func_t batch = get_plugin_batch_op(VACCEL_EXEC,
+			sess->hint);
+	if (!batch) {
+		for (int i = 0; i < nr_sets; ++i) {
+			struct vaccel_genop_set *set = &sets[i];
+			set->ret = vaccel_exec(sess, library, fn_symbol,
+					set->read, set->nr_read, set->write,
+					set->nr_write);
+		}
+
+		goto first_error;
+	}
+
+	/* Batch implementations get the sets in the unpacked genop
+	 * format, i.e. with the library and the symbol as their first
+	 * two read arguments */
+	size_t nr_args = 0;
+	for (int i = 0; i < nr_sets; ++i) {
+		if (sets[i].nr_read < 0 || (sets[i].nr_read && !sets[i].read))
+			return VACCEL_EINVAL;
+
+		if (sets[i].nr_write < 0 ||
+				(sets[i].nr_write && !sets[i].write))
+			return VACCEL_EINVAL;
+
+		nr_args += sets[i].nr_read + 2;
+	}
+
+	struct vaccel_arg *args = malloc(nr_args * sizeof(*args));
+	struct vaccel_genop_set *unpacked = malloc(nr_sets * sizeof(*unpacked));
+	if (!args || !unpacked) {
+		ret = VACCEL_ENOMEM;
+		goto free_arrays;
+	}
+
+	struct vaccel_arg *arg = args;
+	for (int i = 0; i < nr_sets; ++i) {
+		unpacked[i] = sets[i];
+		unpacked[i].read = arg;
+		unpacked[i].nr_read = sets[i].nr_read + 2;
+		unpacked[i].ret = VACCEL_OK;
+
+		arg[0] = (struct vaccel_arg){
+			.size = strlen(library) + 1,
+			.buf = (void *)library,
+		};
+		arg[1] = (struct vaccel_arg){
+			.size = strlen(fn_symbol) + 1,
+			.buf = (void *)fn_symbol,
+		};
+		if (sets[i].nr_read)
+			memcpy(&arg[2], sets[i].read,
+					sets[i].nr_read * sizeof(*arg));
+
+		arg += unpacked[i].nr_read;
+	}
+
+	ret = genop_batch_call(sess, VACCEL_EXEC, batch, unpacked, nr_sets);
+	for (int i = 0; i < nr_sets; ++i) {
+		sets[i].ret = unpacked[i].ret;
+
+		/* The plugin failed as a whole */
+		if (ret && sets[i].ret == VACCEL_OK)
+			sets[i].ret = ret;
+	}
+
+free_arrays:
+	free(unpacked);
+	free(args);
+	if (ret == VACCEL_ENOMEM)
+		return ret;
+
+first_error:
+	for (int i = 0; i < nr_sets; ++i) {
+		if (sets[i].ret)
+			return sets[i].ret;
+	}
+
+	return VACCEL_OK;
 }
 
 int vaccel_exec_unpack(struct vaccel_session *sess,
@@ -74,8 +228,12 @@ int vaccel_exec_unpack(struct vaccel_session *sess,
 	}
 
 	/* Pop the first two arguments */
-	char *library = (char *)read[0].buf;
-	char *fn_symbol = (char *)read[1].buf;
+	char *library = (char *)vaccel_arg_buf(&read[0]);
+	char *fn_symbol = (char *)vaccel_arg_buf(&read[1]);
+	if (!library || !fn_symbol) {
+		vaccel_error("Invalid library or symbol argument in exec");
+		return VACCEL_EINVAL;
+	}
 
 	/* Pass on the rest of the read and all write arguments */
 	return vaccel_exec (sess, library, fn_symbol, &read[2],
@@ -97,7 +255,7 @@ int vaccel_exec_with_res_unpack(struct vaccel_session *sess,
 	struct vaccel_resource *resource;
 	struct vaccel_shared_object *object;
 
-	ret = resource_get_by_id(&resource, *(long long int*)read[0].buf);
+	ret = resource_get_by_id(&resource, *(long long int*)vaccel_arg_buf(&read[0]));
 	if (ret) {
 		vaccel_error("cannot find resource: %d", ret);
 		return ret;
@@ -109,7 +267,7 @@ int vaccel_exec_with_res_unpack(struct vaccel_session *sess,
 	}
 
 	char *library = (char*)object->file.path;
-	char *fn_symbol = (char *)read[1].buf;
+	char *fn_symbol = (char *)vaccel_arg_buf(&read[1]);
 
 	/* Pass on the rest of the read and all write arguments */
 	return vaccel_exec (sess, library, fn_symbol, &read[2],
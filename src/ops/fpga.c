@@ -19,7 +19,8 @@ int vaccel_fpga_arraycopy(struct vaccel_session *sess, int array[], int out_arra
 	if (!plugin_op)
 		return VACCEL_ENOTSUP;
 
-	return plugin_op(sess, array, out_array, len_array);
+	return plugin_op_call(sess, VACCEL_F_ARRAYCOPY, plugin_op,
+			sess, array, out_array, len_array);
 }
 
 int vaccel_fpga_arraycopy_unpack(struct vaccel_session *sess, struct vaccel_arg *read,
@@ -36,9 +37,9 @@ int vaccel_fpga_arraycopy_unpack(struct vaccel_session *sess, struct vaccel_arg
 				nr_write);
 		return VACCEL_EINVAL;
 	}
-	int *array = (int*)read[0].buf;
-	size_t len_array = (size_t)read[0].size / sizeof(array[0]);
-	int *out_array = (int*)write[0].buf;
+	int *array = (int*)vaccel_arg_buf(&read[0]);
+	size_t len_array = (size_t)vaccel_arg_size(&read[0]) / sizeof(array[0]);
+	int *out_array = (int*)vaccel_arg_buf(&write[0]);
 
 	return vaccel_fpga_arraycopy(sess, array, out_array, len_array);
 }
@@ -61,7 +62,8 @@ int vaccel_fpga_mmult(struct vaccel_session *sess, float A_array[], float B_arra
 	if (!plugin_op)
 		return VACCEL_ENOTSUP;
 
-	return plugin_op(sess, A_array, B_array, C_array, lenA);
+	return plugin_op_call(sess, VACCEL_F_MMULT, plugin_op,
+			sess, A_array, B_array, C_array, lenA);
 }
 
 int vaccel_fpga_mmult_unpack(struct vaccel_session *sess, struct vaccel_arg *read,
@@ -78,10 +80,10 @@ int vaccel_fpga_mmult_unpack(struct vaccel_session *sess, struct vaccel_arg *rea
 				nr_write);
 		return VACCEL_EINVAL;
 	}
-	float *A_array = (float*)read[0].buf;
-	float *B_array = (float*)read[1].buf;
-    	size_t lenA = (size_t)read[0].buf;
-    	float *C_array = (float*)write[0].buf;
+	float *A_array = (float*)vaccel_arg_buf(&read[0]);
+	float *B_array = (float*)vaccel_arg_buf(&read[1]);
+    	size_t lenA = (size_t)vaccel_arg_buf(&read[0]);
+    	float *C_array = (float*)vaccel_arg_buf(&write[0]);
 
 	return vaccel_fpga_mmult(sess, A_array, B_array, C_array, lenA);
 }
@@ -103,7 +105,8 @@ int vaccel_fpga_parallel(struct vaccel_session *sess, float A_array[], float B_a
 	if (!plugin_op)
 		return VACCEL_ENOTSUP;
 
-	return plugin_op(sess, A_array, B_array, add_output, mult_output, len_a);
+	return plugin_op_call(sess, VACCEL_F_PARALLEL, plugin_op,
+			sess, A_array, B_array, add_output, mult_output, len_a);
 }
 
 int vaccel_fpga_parallel_unpack(struct vaccel_session *sess, struct vaccel_arg *read,
@@ -120,11 +123,11 @@ int vaccel_fpga_parallel_unpack(struct vaccel_session *sess, struct vaccel_arg *
 				nr_write);
 		return VACCEL_EINVAL;
 	}
-	float *A_array      = (float*)read[0].buf;
-	float *B_array      = (float*)read[1].buf;
-    float *add_output   = (float*)write[0].buf;
-    float *mult_output  = (float*)write[1].buf;
-	size_t len_a 		= (size_t)read[0].size/sizeof(A_array[0]);
+	float *A_array      = (float*)vaccel_arg_buf(&read[0]);
+	float *B_array      = (float*)vaccel_arg_buf(&read[1]);
+    float *add_output   = (float*)vaccel_arg_buf(&write[0]);
+    float *mult_output  = (float*)vaccel_arg_buf(&write[1]);
+	size_t len_a 		= (size_t)vaccel_arg_size(&read[0])/sizeof(A_array[0]);
 
 
 	return vaccel_fpga_parallel(sess, A_array, B_array, add_output, mult_output, len_a);
@@ -148,7 +151,8 @@ int vaccel_fpga_vadd(struct vaccel_session *sess, float A[], float B[], float C[
 	if (!plugin_op)
 		return VACCEL_ENOTSUP;
 
-	return plugin_op(sess, A, B, C, len_a, len_b);
+	return plugin_op_call(sess, VACCEL_F_VECTORADD, plugin_op,
+			sess, A, B, C, len_a, len_b);
 }
 
 int vaccel_fpga_vadd_unpack(struct vaccel_session *sess, struct vaccel_arg *read,
@@ -165,11 +169,11 @@ int vaccel_fpga_vadd_unpack(struct vaccel_session *sess, struct vaccel_arg *read
 				nr_write);
 		return VACCEL_EINVAL;
 	}
-	float *A      = (float*)read[0].buf;
-	float *B      = (float*)read[1].buf;
-    float *C      = (float*)write[0].buf;
-	size_t len_a  = (size_t)read[0].size/sizeof(A[0]);
-	size_t len_b  = (size_t)read[1].size/sizeof(B[0]);
+	float *A      = (float*)vaccel_arg_buf(&read[0]);
+	float *B      = (float*)vaccel_arg_buf(&read[1]);
+    float *C      = (float*)vaccel_arg_buf(&write[0]);
+	size_t len_a  = (size_t)vaccel_arg_size(&read[0])/sizeof(A[0]);
+	size_t len_b  = (size_t)vaccel_arg_size(&read[1])/sizeof(B[0]);
 
     return vaccel_fpga_vadd(sess, A,B,C, len_a, len_b);
 }
@@ -26,8 +26,13 @@
 #include <session.h>
 #include <error.h>
 #include <log.h>
+#include "plugin.h"
 #include "torch.h"
 
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
 typedef int (*unpack_func_t)(
 	struct vaccel_session *sess,
 	struct vaccel_arg *read,
@@ -63,19 +68,526 @@ unpack_func_t callbacks[VACCEL_FUNCTIONS_NR] = {
 	vaccel_opencv_unpack,			/* 23 */
 };
 
-int vaccel_genop(struct vaccel_session *sess, struct vaccel_arg  *read,
-		int nr_read, struct vaccel_arg *write, int nr_write)
+int vaccel_arg_init_ext(struct vaccel_arg *arg, struct vaccel_arg_ext *ext,
+		struct vaccel_iovec *segs, uint32_t nr_segs)
+{
+	if (!arg || !ext || !nr_segs || !segs)
+		return VACCEL_EINVAL;
+
+	ext->version = VACCEL_ARG_EXT_VERSION;
+	ext->nr_segs = nr_segs;
+	ext->segs = segs;
+
+	arg->size = 0;
+	arg->flags = VACCEL_ARG_FLAG_EXT;
+	arg->buf = ext;
+
+	return VACCEL_OK;
+}
+
+bool vaccel_arg_is_ext(const struct vaccel_arg *arg)
+{
+	return arg->flags & VACCEL_ARG_FLAG_EXT;
+}
+
+uint64_t vaccel_arg_size(const struct vaccel_arg *arg)
+{
+	if (!vaccel_arg_is_ext(arg))
+		return arg->size;
+
+	const struct vaccel_arg_ext *ext = arg->buf;
+	uint64_t size = 0;
+	for (uint32_t i = 0; i < ext->nr_segs; ++i)
+		size += ext->segs[i].len;
+
+	return size;
+}
+
+void *vaccel_arg_buf(const struct vaccel_arg *arg)
+{
+	if (!vaccel_arg_is_ext(arg))
+		return arg->buf;
+
+	const struct vaccel_arg_ext *ext = arg->buf;
+	return (ext->nr_segs == 1) ? ext->segs[0].base : NULL;
+}
+
+uint32_t vaccel_arg_segs(const struct vaccel_arg *arg,
+		struct vaccel_iovec *single, const struct vaccel_iovec **segs)
+{
+	if (vaccel_arg_is_ext(arg)) {
+		const struct vaccel_arg_ext *ext = arg->buf;
+		*segs = ext->segs;
+		return ext->nr_segs;
+	}
+
+	single->base = arg->buf;
+	single->len = arg->size;
+	*segs = single;
+
+	return 1;
+}
+
+static bool genop_ext_valid(const struct vaccel_arg *arg)
+{
+	const struct vaccel_arg_ext *ext = arg->buf;
+
+	return ext && ext->version == VACCEL_ARG_EXT_VERSION &&
+		ext->nr_segs && ext->segs;
+}
+
+int genop_nr_ext_args(const struct vaccel_arg *args, int nr_args)
+{
+	int nr_ext = 0;
+
+	for (int i = 0; i < nr_args; ++i) {
+		/* Tensor references only mean something in a pipeline,
+		 * which resolves them before running its operations */
+		if (args[i].flags & ~VACCEL_ARG_FLAG_EXT) {
+			vaccel_error("Invalid flags 0x%x of argument %d",
+					args[i].flags, i);
+			return -VACCEL_EINVAL;
+		}
+
+		if (!vaccel_arg_is_ext(&args[i]))
+			continue;
+
+		if (!genop_ext_valid(&args[i])) {
+			vaccel_error("Invalid extended argument %d", i);
+			return -VACCEL_EINVAL;
+		}
+
+		nr_ext++;
+	}
+
+	return nr_ext;
+}
+
+/* Operations whose plugin functions get the caller's argument arrays as
+ * they are, instead of going through a typed unpack function */
+static bool genop_op_raw_args(enum vaccel_op_type op)
+{
+	return op == VACCEL_EXEC || op == VACCEL_EXEC_WITH_RESOURCE;
+}
+
+bool genop_sg_capable(struct vaccel_session *sess, enum vaccel_op_type op)
 {
-	if (!nr_read) {
+	if (!genop_op_raw_args(op))
+		return false;
+
+	struct vaccel_plugin *owner =
+		get_plugin_op_owner(op, sess ? sess->hint : 0);
+
+	return owner && owner->info->sg_capable;
+}
+
+static void genop_gather(const struct vaccel_arg *arg, uint8_t *dst)
+{
+	const struct vaccel_arg_ext *ext = arg->buf;
+
+	for (uint32_t i = 0; i < ext->nr_segs; ++i) {
+		memcpy(dst, ext->segs[i].base, ext->segs[i].len);
+		dst += ext->segs[i].len;
+	}
+}
+
+static void genop_scatter(const struct vaccel_arg *arg, const uint8_t *src)
+{
+	const struct vaccel_arg_ext *ext = arg->buf;
+
+	for (uint32_t i = 0; i < ext->nr_segs; ++i) {
+		memcpy(ext->segs[i].base, src, ext->segs[i].len);
+		src += ext->segs[i].len;
+	}
+}
+
+int genop_linearize(struct vaccel_arg *args, int nr_args,
+		struct genop_linear_args *linear)
+{
+	linear->nr_args = nr_args;
+	linear->args = malloc(nr_args * sizeof(*linear->args));
+	linear->bufs = calloc(nr_args, sizeof(*linear->bufs));
+	if (nr_args && (!linear->args || !linear->bufs))
+		return VACCEL_ENOMEM;
+
+	for (int i = 0; i < nr_args; ++i) {
+		linear->args[i] = args[i];
+		if (!vaccel_arg_is_ext(&args[i]))
+			continue;
+
+		uint64_t size = vaccel_arg_size(&args[i]);
+		if (size > UINT32_MAX) {
+			vaccel_error("Argument %d is too large for the plugin",
+					i);
+			return VACCEL_ENOTSUP;
+		}
+
+		void *buf = vaccel_arg_buf(&args[i]);
+		if (!buf) {
+			buf = malloc(size ? size : 1);
+			if (!buf)
+				return VACCEL_ENOMEM;
+
+			genop_gather(&args[i], buf);
+			linear->bufs[i] = buf;
+		}
+
+		linear->args[i].size = size;
+		linear->args[i].flags = 0;
+		linear->args[i].buf = buf;
+	}
+
+	return VACCEL_OK;
+}
+
+void genop_linear_scatter(const struct genop_linear_args *linear,
+		struct vaccel_arg *args)
+{
+	for (int i = 0; i < linear->nr_args; ++i) {
+		if (linear->bufs[i])
+			genop_scatter(&args[i], linear->bufs[i]);
+	}
+}
+
+void genop_linear_free(struct genop_linear_args *linear)
+{
+	if (linear->bufs) {
+		for (int i = 0; i < linear->nr_args; ++i)
+			free(linear->bufs[i]);
+	}
+
+	free(linear->bufs);
+	free(linear->args);
+	linear->bufs = NULL;
+	linear->args = NULL;
+}
+
+int genop_sets_linearize(struct vaccel_genop_set *sets, int nr_sets,
+		struct genop_linear_sets *linear)
+{
+	linear->nr_sets = nr_sets;
+	linear->sets = malloc(nr_sets * sizeof(*linear->sets));
+	linear->read = calloc(nr_sets, sizeof(*linear->read));
+	linear->write = calloc(nr_sets, sizeof(*linear->write));
+	if (!linear->sets || !linear->read || !linear->write)
+		return VACCEL_ENOMEM;
+
+	for (int i = 0; i < nr_sets; ++i) {
+		struct vaccel_genop_set *set = &sets[i];
+
+		int ret = genop_linearize(set->read, set->nr_read,
+				&linear->read[i]);
+		if (!ret)
+			ret = genop_linearize(set->write, set->nr_write,
+					&linear->write[i]);
+		if (ret)
+			return ret;
+
+		linear->sets[i] = *set;
+		linear->sets[i].read = linear->read[i].args;
+		linear->sets[i].write = linear->write[i].args;
+	}
+
+	return VACCEL_OK;
+}
+
+void genop_sets_unlinearize(struct genop_linear_sets *linear,
+		struct vaccel_genop_set *sets)
+{
+	for (int i = 0; i < linear->nr_sets; ++i) {
+		sets[i].ret = linear->sets[i].ret;
+		genop_linear_scatter(&linear->write[i], sets[i].write);
+	}
+}
+
+void genop_sets_linear_free(struct genop_linear_sets *linear)
+{
+	for (int i = 0; i < linear->nr_sets; ++i) {
+		if (linear->read)
+			genop_linear_free(&linear->read[i]);
+		if (linear->write)
+			genop_linear_free(&linear->write[i]);
+	}
+
+	free(linear->write);
+	free(linear->read);
+	free(linear->sets);
+}
+
+static uint64_t genop_args_size(const struct vaccel_arg *args, int nr_args)
+{
+	uint64_t size = 0;
+
+	/* Arguments have not been checked yet */
+	for (int i = 0; i < nr_args; ++i) {
+		if (!vaccel_arg_is_ext(&args[i]) || genop_ext_valid(&args[i]))
+			size += vaccel_arg_size(&args[i]);
+	}
+
+	return size;
+}
+
+/* Call the unpack function of the operation, which in turn calls into
+ * the plugin */
+static int genop_unpack(struct vaccel_session *sess,
+		enum vaccel_op_type op, struct vaccel_arg *read, int nr_read,
+		struct vaccel_arg *write, int nr_write)
+{
+	/* Unpack functions expect no array for no arguments */
+	if (!nr_read)
+		read = NULL;
+	if (!nr_write)
+		write = NULL;
+
+	struct op_span span;
+	int instr = op_instr();
+	if (!instr)
+		return callbacks[op](sess, read, nr_read, write, nr_write);
+
+	struct trace_info info = {
+		.sess_id = sess ? sess->session_id : 0,
+		.op_type = op,
+	};
+
+	op_span_begin(&span, instr, OP_PHASE_UNPACK, &info);
+	int ret = callbacks[op](sess, read, nr_read, write, nr_write);
+	op_span_end(&span, ret);
+
+	return ret;
+}
+
+static int __genop_dispatch(struct vaccel_session *sess,
+		enum vaccel_op_type op, struct vaccel_arg *read, int nr_read,
+		struct vaccel_arg *write, int nr_write)
+{
+	int nr_ext_read = genop_nr_ext_args(read, nr_read);
+	int nr_ext_write = genop_nr_ext_args(write, nr_write);
+	if (nr_ext_read < 0 || nr_ext_write < 0)
+		return VACCEL_EINVAL;
+
+	if (!(nr_ext_read + nr_ext_write))
+		return genop_unpack(sess, op, read, nr_read, write, nr_write);
+
+	/* Unpack functions read typed values out of the arguments, so
+	 * hand them contiguous copies of the extended ones */
+	vaccel_debug("Linearizing %d extended arguments of %s",
+			nr_ext_read + nr_ext_write, vaccel_op_type_str(op));
+
+	struct genop_linear_args linear_read = { 0 }, linear_write = { 0 };
+	int ret = genop_linearize(read, nr_read, &linear_read);
+	if (ret)
+		goto free_args;
+
+	ret = genop_linearize(write, nr_write, &linear_write);
+	if (ret)
+		goto free_args;
+
+	ret = genop_unpack(sess, op, linear_read.args, nr_read,
+			linear_write.args, nr_write);
+	genop_linear_scatter(&linear_write, write);
+
+free_args:
+	genop_linear_free(&linear_write);
+	genop_linear_free(&linear_read);
+	return ret;
+}
+
+static int genop_dispatch(struct vaccel_session *sess,
+		enum vaccel_op_type op, struct vaccel_arg *read, int nr_read,
+		struct vaccel_arg *write, int nr_write)
+{
+	struct op_span span;
+	int instr = op_instr();
+	if (!instr)
+		return __genop_dispatch(sess, op, read, nr_read, write,
+				nr_write);
+
+	struct trace_info info = {
+		.sess_id = sess ? sess->session_id : 0,
+		.op_type = op,
+		.read_bytes = genop_args_size(read, nr_read),
+		.write_bytes = genop_args_size(write, nr_write),
+	};
+
+	op_span_begin(&span, instr, OP_PHASE_DISPATCH, &info);
+	int ret = __genop_dispatch(sess, op, read, nr_read, write, nr_write);
+	op_span_end(&span, ret);
+
+	return ret;
+}
+
+static int genop_op_type(struct vaccel_arg *read, int nr_read,
+		enum vaccel_op_type *op)
+{
+	if (!nr_read || !read || !vaccel_arg_buf(&read[0])) {
 		vaccel_error("Calling genop without op type");
 		return VACCEL_EINVAL;
 	}
 
-	enum vaccel_op_type op = *(enum vaccel_op_type *)read[0].buf;
-	if (op >= VACCEL_FUNCTIONS_NR) {
-		vaccel_error("Invalid operation type: %u", op);
+	*op = *(enum vaccel_op_type *)vaccel_arg_buf(&read[0]);
+	if (*op >= VACCEL_FUNCTIONS_NR) {
+		vaccel_error("Invalid operation type: %u", *op);
+		return VACCEL_EINVAL;
+	}
+
+	return VACCEL_OK;
+}
+
+int vaccel_genop(struct vaccel_session *sess, struct vaccel_arg  *read,
+		int nr_read, struct vaccel_arg *write, int nr_write)
+{
+	enum vaccel_op_type op;
+
+	int ret = genop_op_type(read, nr_read, &op);
+	if (ret)
+		return ret;
+
+	return genop_dispatch(sess, op, &read[1], nr_read - 1, write,
+			nr_write);
+}
+
+int genop_batch_call(struct vaccel_session *sess, enum vaccel_op_type op,
+		vaccel_batch_func_t batch, struct vaccel_genop_set *sets,
+		int nr_sets)
+{
+	bool has_ext = false;
+	for (int i = 0; i < nr_sets; ++i) {
+		int nr_ext_read = genop_nr_ext_args(sets[i].read,
+				sets[i].nr_read);
+		int nr_ext_write = genop_nr_ext_args(sets[i].write,
+				sets[i].nr_write);
+		if (nr_ext_read < 0 || nr_ext_write < 0)
+			return VACCEL_EINVAL;
+
+		has_ext |= nr_ext_read + nr_ext_write > 0;
+	}
+
+	if (!has_ext || genop_sg_capable(sess, op))
+		return plugin_op_call(sess, op, batch, sess, sets, nr_sets);
+
+	struct genop_linear_sets linear = { 0 };
+	int ret = genop_sets_linearize(sets, nr_sets, &linear);
+	if (!ret) {
+		ret = plugin_op_call(sess, op, batch, sess, linear.sets,
+				nr_sets);
+		genop_sets_unlinearize(&linear, sets);
+	}
+
+	genop_sets_linear_free(&linear);
+	return ret;
+}
+
+/* Run `nr_sets` operations of type `op`, through the batch entry point
+ * of the plugin if it has one */
+static void genop_batch_type(struct vaccel_session *sess,
+		enum vaccel_op_type op, struct vaccel_genop_set *sets,
+		int nr_sets)
+{
+	vaccel_batch_func_t batch = get_plugin_batch_op(op, sess->hint);
+
+	if (!batch) {
+		for (int i = 0; i < nr_sets; ++i) {
+			struct vaccel_genop_set *set = &sets[i];
+			set->ret = genop_dispatch(sess, op, set->read,
+					set->nr_read, set->write,
+					set->nr_write);
+		}
+
+		return;
+	}
+
+	vaccel_debug("Running batch of %d %s operations", nr_sets,
+			vaccel_op_type_str(op));
+
+	for (int i = 0; i < nr_sets; ++i)
+		sets[i].ret = VACCEL_OK;
+
+	int ret = genop_batch_call(sess, op, batch, sets, nr_sets);
+	if (!ret)
+		return;
+
+	/* The plugin failed as a whole, without telling us which
+	 * operations failed */
+	for (int i = 0; i < nr_sets; ++i) {
+		if (sets[i].ret == VACCEL_OK)
+			sets[i].ret = ret;
+	}
+}
+
+int vaccel_genop_batch(struct vaccel_session *sess,
+		struct vaccel_genop_set *sets, int nr_sets)
+{
+	int ret = VACCEL_OK;
+
+	if (!sess || !sets || nr_sets <= 0)
 		return VACCEL_EINVAL;
+
+	/* Group operations by type, keeping their relative order. `ops`
+	 * holds the op type of every set, or VACCEL_FUNCTIONS_NR for
+	 * invalid sets */
+	int offsets[VACCEL_FUNCTIONS_NR + 1] = { 0 };
+	enum vaccel_op_type *ops = malloc(nr_sets * sizeof(*ops));
+	struct vaccel_genop_set *grouped = malloc(nr_sets * sizeof(*grouped));
+	int *order = malloc(nr_sets * sizeof(*order));
+	if (!ops || !grouped || !order) {
+		ret = VACCEL_ENOMEM;
+		goto free_arrays;
+	}
+
+	for (int i = 0; i < nr_sets; ++i) {
+		sets[i].ret = genop_op_type(sets[i].read, sets[i].nr_read,
+				&ops[i]);
+		if (sets[i].ret)
+			ops[i] = VACCEL_FUNCTIONS_NR;
+		else
+			offsets[ops[i]]++;
+	}
+
+	for (int op = 0, off = 0; op <= VACCEL_FUNCTIONS_NR; ++op) {
+		int count = offsets[op];
+		offsets[op] = off;
+		off += count;
+	}
+
+	/* The sets handed to plugins do not include the op code */
+	for (int i = 0; i < nr_sets; ++i) {
+		if (ops[i] == VACCEL_FUNCTIONS_NR)
+			continue;
+
+		int pos = offsets[ops[i]]++;
+		grouped[pos] = sets[i];
+		grouped[pos].read = &sets[i].read[1];
+		grouped[pos].nr_read = sets[i].nr_read - 1;
+		order[pos] = i;
+	}
+
+	plugin_op_cache_enable();
+
+	for (int op = 0, start = 0; op < VACCEL_FUNCTIONS_NR; ++op) {
+		/* offsets[op] now points at the end of the group */
+		int end = offsets[op];
+		if (end > start)
+			genop_batch_type(sess, op, &grouped[start],
+					end - start);
+		start = end;
+	}
+
+	plugin_op_cache_disable();
+
+	int nr_grouped = offsets[VACCEL_FUNCTIONS_NR];
+	for (int pos = 0; pos < nr_grouped; ++pos)
+		sets[order[pos]].ret = grouped[pos].ret;
+
+	for (int i = 0; i < nr_sets; ++i) {
+		if (sets[i].ret) {
+			ret = sets[i].ret;
+			break;
+		}
 	}
 
-	return callbacks[op](sess, &read[1], nr_read - 1, write, nr_write);
+free_arrays:
+	free(order);
+	free(grouped);
+	free(ops);
+	return ret;
 }
@@ -16,5 +16,54 @@
 #define __GENOP_H__
 
 #include "include/ops/genop.h"
+#include "include/ops/vaccel_ops.h"
+
+/* Number of extended arguments in an array, or -VACCEL_EINVAL if any
+ * of them is invalid or has flags other than VACCEL_ARG_FLAG_EXT */
+int genop_nr_ext_args(const struct vaccel_arg *args, int nr_args);
+
+/* Check if the plugin running operations of type `op` for the session
+ * handles extended arguments itself. Only operations that pass the
+ * caller's argument arrays on to the plugin as they are (exec) can
+ * skip linearizing; the rest read typed values out of them */
+bool genop_sg_capable(struct vaccel_session *sess, enum vaccel_op_type op);
+
+/* Copy of an argument array where extended arguments are replaced by
+ * regular ones. Scattered arguments are copied in contiguous buffers,
+ * which `bufs` holds */
+struct genop_linear_args {
+	struct vaccel_arg *args;
+	void **bufs;
+	int nr_args;
+};
+
+int genop_linearize(struct vaccel_arg *args, int nr_args,
+		struct genop_linear_args *linear);
+
+/* Copy the data the plugin wrote in the contiguous buffers back to the
+ * segments of the original arguments */
+void genop_linear_scatter(const struct genop_linear_args *linear,
+		struct vaccel_arg *args);
+void genop_linear_free(struct genop_linear_args *linear);
+
+/* Same as above, for the argument sets of a batch */
+struct genop_linear_sets {
+	struct vaccel_genop_set *sets;
+	struct genop_linear_args *read;
+	struct genop_linear_args *write;
+	int nr_sets;
+};
+
+int genop_sets_linearize(struct vaccel_genop_set *sets, int nr_sets,
+		struct genop_linear_sets *linear);
+void genop_sets_unlinearize(struct genop_linear_sets *linear,
+		struct vaccel_genop_set *sets);
+void genop_sets_linear_free(struct genop_linear_sets *linear);
+
+/* Call the batch implementation of `op`, linearizing the arguments of
+ * the sets if the plugin needs it */
+int genop_batch_call(struct vaccel_session *sess, enum vaccel_op_type op,
+		vaccel_batch_func_t batch, struct vaccel_genop_set *sets,
+		int nr_sets);
 
 #endif /* __GENOP_H__ */
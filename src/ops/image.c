@@ -37,7 +37,7 @@ int vaccel_image_op(enum vaccel_op_type op_type, struct vaccel_session *sess,
 	vaccel_debug("session:%u Looking for plugin implementing %s",
 			sess->session_id, vaccel_op_type_str(op_type));
 
-	vaccel_prof_region_start(&image_op_stats);
+	vaccel_prof_token_t token = vaccel_prof_region_enter(&image_op_stats);
 
 	//Get implementation
 	int (*plugin_op)() = get_plugin_op(op_type, sess->hint);
@@ -47,15 +47,17 @@ int vaccel_image_op(enum vaccel_op_type op_type, struct vaccel_session *sess,
 	}
 
 	if (out_text != NULL && len_out_text > 0) {
-		ret = plugin_op(sess, img, out_text, out_imgname, len_img,
+		ret = plugin_op_call(sess, op_type, plugin_op,
+				sess, img, out_text, out_imgname, len_img,
 				len_out_text, len_out_imgname);
 	} else {
-		ret = plugin_op(sess, img, out_imgname, len_img,
+		ret = plugin_op_call(sess, op_type, plugin_op,
+				sess, img, out_imgname, len_img,
 				len_out_imgname);
 	}
 
 out:
-	vaccel_prof_region_stop(&image_op_stats);
+	vaccel_prof_region_exit(&image_op_stats, token);
 	return ret;
 }
 
@@ -83,21 +85,21 @@ int vaccel_image_op_unpack(enum vaccel_op_type op_type,
 		return VACCEL_EINVAL;
 	}
 
-	void *img = (void *)read[0].buf;
-	size_t len_img = (size_t)read[0].size;
+	void *img = (void *)vaccel_arg_buf(&read[0]);
+	size_t len_img = (size_t)vaccel_arg_size(&read[0]);
 
 	if (nr_write_req == 2) {
-		unsigned char *out_text = (unsigned char *)write[0].buf;
-		size_t len_out_text = (size_t)write[0].size;
-		unsigned char *out_imgname = (unsigned char *)write[1].buf;
-		size_t len_out_imgname = (size_t)write[1].size;
+		unsigned char *out_text = (unsigned char *)vaccel_arg_buf(&write[0]);
+		size_t len_out_text = (size_t)vaccel_arg_size(&write[0]);
+		unsigned char *out_imgname = (unsigned char *)vaccel_arg_buf(&write[1]);
+		size_t len_out_imgname = (size_t)vaccel_arg_size(&write[1]);
 
 		return vaccel_image_op(op_type, sess, img, out_text,
 				out_imgname, len_img, len_out_text,
 				len_out_imgname);
 	} else {
-		unsigned char *out_imgname = (unsigned char *)write[0].buf;
-		size_t len_out_imgname = (size_t)write[0].size;
+		unsigned char *out_imgname = (unsigned char *)vaccel_arg_buf(&write[0]);
+		size_t len_out_imgname = (size_t)vaccel_arg_size(&write[0]);
 
 		return vaccel_image_op_no_text(op_type, sess, img, out_imgname,
 				len_img, len_out_imgname);
@@ -31,7 +31,8 @@ int vaccel_minmax(
 	if (!plugin_op)
 		return VACCEL_ENOTSUP;
 
-	return plugin_op(sess, indata, ndata, low_threshold, high_threshold,
+	return plugin_op_call(sess, VACCEL_MINMAX, plugin_op,
+			sess, indata, ndata, low_threshold, high_threshold,
 			outdata, min, max);
 }
 
@@ -52,16 +53,16 @@ int vaccel_minmax_unpack(
 		return VACCEL_EINVAL;
 	}
 
-	double *indata = (double *)read[0].buf;
-	int ndata = *(int*)read[1].buf;
-	int low_threshold = *(int*)read[2].buf;
-	int high_threshold = *(int*)read[3].buf;
+	double *indata = (double *)vaccel_arg_buf(&read[0]);
+	int ndata = *(int*)vaccel_arg_buf(&read[1]);
+	int low_threshold = *(int*)vaccel_arg_buf(&read[2]);
+	int high_threshold = *(int*)vaccel_arg_buf(&read[3]);
 
-	vaccel_info("number of data: %d\n", *(int*)read[1].buf);
+	vaccel_info("number of data: %d\n", *(int*)vaccel_arg_buf(&read[1]));
 	vaccel_info("number of data: %d\n", ndata);
-	double *outdata = (double *)write[0].buf;
-	double *min = (double *)write[1].buf;
-	double *max = (double *)write[2].buf;
+	double *outdata = (double *)vaccel_arg_buf(&write[0]);
+	double *min = (double *)vaccel_arg_buf(&write[1]);
+	double *max = (double *)vaccel_arg_buf(&write[2]);
 
 	return vaccel_minmax(sess, indata, ndata, low_threshold, high_threshold, outdata, min, max);
 }
@@ -34,7 +34,7 @@ int vaccel_noop(struct vaccel_session *sess)
 	if (!plugin_op)
 		return VACCEL_ENOTSUP;
 
-	return plugin_op(sess);
+	return plugin_op_call(sess, VACCEL_NO_OP, plugin_op, sess);
 }
 
 int vaccel_noop_unpack(struct vaccel_session *sess,
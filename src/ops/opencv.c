@@ -20,7 +20,8 @@ int vaccel_opencv(struct vaccel_session *sess, struct vaccel_arg *read,
 	if (!plugin_op)
 		return VACCEL_ENOTSUP;
 
-	return plugin_op(sess, read, nr_read, write, nr_write);
+	return plugin_op_call(sess, VACCEL_OPENCV, plugin_op,
+			sess, read, nr_read, write, nr_write);
 }
 
 int vaccel_opencv_unpack(struct vaccel_session *sess, struct vaccel_arg *read,
@@ -0,0 +1,500 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pipeline.h"
+#include "genop.h"
+#include "vaccel_ops.h"
+
+#include "error.h"
+#include "log.h"
+#include "plugin.h"
+#include "session.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_PIPELINE_THREADS 4
+#define MAX_PIPELINE_THREADS 64
+
+struct pipeline_tensor {
+	uint64_t size;
+
+	/* Stage writing the tensor, or -1 if none yet */
+	int producer;
+
+	/* Memory of the tensor and the plugin that allocated it, if any */
+	void *buf;
+	struct vaccel_plugin *owner;
+};
+
+struct pipeline_stage {
+	/* Arguments as given by the user. `args` holds the read arguments
+	 * followed by the write ones */
+	struct vaccel_arg *args;
+	int nr_read;
+	int nr_write;
+
+	/* Arguments with tensor references resolved */
+	struct vaccel_arg *resolved;
+	struct vaccel_arg_ext *exts;
+	struct vaccel_iovec *segs;
+
+	/* Stages reading tensors this stage writes */
+	int *dependents;
+	int nr_dependents;
+
+	/* Number of stages this stage reads tensors from */
+	int nr_deps;
+
+	/* Run state */
+	int pending;
+	int ret;
+};
+
+struct vaccel_pipeline {
+	struct pipeline_stage *stages;
+	int nr_stages;
+
+	struct pipeline_tensor *tensors;
+	int nr_tensors;
+
+	/* Scheduling state of a run */
+	struct vaccel_session *sess;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int *ready;
+	int nr_ready;
+	int nr_done;
+};
+
+static bool arg_is_tensor(const struct vaccel_arg *arg)
+{
+	return arg->flags & VACCEL_ARG_FLAG_TENSOR;
+}
+
+static int arg_tensor(const struct vaccel_arg *arg)
+{
+	return (int)(intptr_t)arg->buf;
+}
+
+int vaccel_pipeline_new(struct vaccel_pipeline **pipeline)
+{
+	if (!pipeline)
+		return VACCEL_EINVAL;
+
+	struct vaccel_pipeline *p = calloc(1, sizeof(*p));
+	if (!p)
+		return VACCEL_ENOMEM;
+
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->cond, NULL);
+	*pipeline = p;
+
+	return VACCEL_OK;
+}
+
+int vaccel_pipeline_tensor(struct vaccel_pipeline *pipeline, uint64_t size,
+		int *tensor)
+{
+	if (!pipeline || !size || size > SIZE_MAX || !tensor)
+		return VACCEL_EINVAL;
+
+	struct pipeline_tensor *tensors = realloc(pipeline->tensors,
+			(pipeline->nr_tensors + 1) * sizeof(*tensors));
+	if (!tensors)
+		return VACCEL_ENOMEM;
+
+	pipeline->tensors = tensors;
+
+	struct pipeline_tensor *t = &tensors[pipeline->nr_tensors];
+	t->size = size;
+	t->producer = -1;
+	t->buf = NULL;
+	t->owner = NULL;
+
+	*tensor = pipeline->nr_tensors++;
+
+	return VACCEL_OK;
+}
+
+void vaccel_pipeline_tensor_arg(struct vaccel_arg *arg, int tensor)
+{
+	arg->size = 0;
+	arg->flags = VACCEL_ARG_FLAG_TENSOR;
+	arg->buf = (void *)(intptr_t)tensor;
+}
+
+static int stage_add_dependent(struct pipeline_stage *producer, int stage)
+{
+	/* Dependents are added in stage order */
+	if (producer->nr_dependents &&
+			producer->dependents[producer->nr_dependents - 1] == stage)
+		return VACCEL_OK;
+
+	int *dependents = realloc(producer->dependents,
+			(producer->nr_dependents + 1) * sizeof(*dependents));
+	if (!dependents)
+		return VACCEL_ENOMEM;
+
+	producer->dependents = dependents;
+	producer->dependents[producer->nr_dependents++] = stage;
+
+	return VACCEL_OK;
+}
+
+/* Check the tensor references of a new stage */
+static int stage_check_tensors(struct vaccel_pipeline *pipeline,
+		struct vaccel_arg *read, int nr_read,
+		struct vaccel_arg *write, int nr_write)
+{
+	for (int i = 0; i < nr_read + nr_write; ++i) {
+		bool is_write = i >= nr_read;
+		struct vaccel_arg *arg = is_write ? &write[i - nr_read] : &read[i];
+		if (!arg_is_tensor(arg))
+			continue;
+
+		int tensor = arg_tensor(arg);
+		if (tensor < 0 || tensor >= pipeline->nr_tensors) {
+			vaccel_error("Unknown pipeline tensor %d", tensor);
+			return VACCEL_EINVAL;
+		}
+
+		int producer = pipeline->tensors[tensor].producer;
+		if (is_write && producer >= 0) {
+			vaccel_error("Tensor %d is written by stage %d already",
+					tensor, producer);
+			return VACCEL_EINVAL;
+		}
+
+		if (!is_write && producer < 0) {
+			vaccel_error("Tensor %d is read before it is written",
+					tensor);
+			return VACCEL_EINVAL;
+		}
+	}
+
+	return VACCEL_OK;
+}
+
+int vaccel_pipeline_add(struct vaccel_pipeline *pipeline,
+		struct vaccel_arg *read, int nr_read,
+		struct vaccel_arg *write, int nr_write, int *stage)
+{
+	if (!pipeline || !read || nr_read <= 0 || nr_write < 0 ||
+			(nr_write && !write))
+		return VACCEL_EINVAL;
+
+	if (arg_is_tensor(&read[0]) || !vaccel_arg_buf(&read[0]) ||
+			*(enum vaccel_op_type *)vaccel_arg_buf(&read[0]) >=
+			VACCEL_FUNCTIONS_NR) {
+		vaccel_error("Invalid operation type for pipeline stage");
+		return VACCEL_EINVAL;
+	}
+
+	int ret = stage_check_tensors(pipeline, read, nr_read, write,
+			nr_write);
+	if (ret)
+		return ret;
+
+	struct pipeline_stage *stages = realloc(pipeline->stages,
+			(pipeline->nr_stages + 1) * sizeof(*stages));
+	if (!stages)
+		return VACCEL_ENOMEM;
+
+	pipeline->stages = stages;
+
+	int id = pipeline->nr_stages;
+	struct pipeline_stage *s = &stages[id];
+	int nr_args = nr_read + nr_write;
+
+	memset(s, 0, sizeof(*s));
+	s->nr_read = nr_read;
+	s->nr_write = nr_write;
+	s->args = malloc(nr_args * sizeof(*s->args));
+	s->resolved = malloc(nr_args * sizeof(*s->resolved));
+	s->exts = malloc(nr_args * sizeof(*s->exts));
+	s->segs = malloc(nr_args * sizeof(*s->segs));
+	if (!s->args || !s->resolved || !s->exts || !s->segs) {
+		ret = VACCEL_ENOMEM;
+		goto free_stage;
+	}
+
+	memcpy(s->args, read, nr_read * sizeof(*read));
+	if (nr_write)
+		memcpy(&s->args[nr_read], write, nr_write * sizeof(*write));
+
+	/* Find the stages producing our inputs */
+	for (int i = 0; i < nr_read; ++i) {
+		if (!arg_is_tensor(&read[i]))
+			continue;
+
+		int producer = pipeline->tensors[arg_tensor(&read[i])].producer;
+		int nr_dependents = stages[producer].nr_dependents;
+
+		ret = stage_add_dependent(&stages[producer], id);
+		if (ret)
+			goto free_stage;
+
+		if (stages[producer].nr_dependents != nr_dependents)
+			s->nr_deps++;
+	}
+
+	for (int i = 0; i < nr_write; ++i) {
+		if (arg_is_tensor(&write[i]))
+			pipeline->tensors[arg_tensor(&write[i])].producer = id;
+	}
+
+	pipeline->nr_stages++;
+	if (stage)
+		*stage = id;
+
+	return VACCEL_OK;
+
+free_stage:
+	/* Undo dependents we may have added */
+	for (int i = 0; i < id; ++i) {
+		if (stages[i].nr_dependents &&
+				stages[i].dependents[stages[i].nr_dependents - 1] == id)
+			stages[i].nr_dependents--;
+	}
+
+	free(s->segs);
+	free(s->exts);
+	free(s->resolved);
+	free(s->args);
+	return ret;
+}
+
+/* Allocate the intermediate tensors that are not allocated yet, using
+ * the allocator of the plugin running the stage producing each one */
+static int pipeline_alloc_tensors(struct vaccel_pipeline *pipeline,
+		struct vaccel_session *sess)
+{
+	for (int i = 0; i < pipeline->nr_tensors; ++i) {
+		struct pipeline_tensor *t = &pipeline->tensors[i];
+		if (t->buf)
+			continue;
+
+		if (t->producer < 0) {
+			vaccel_error("Tensor %d is never written", i);
+			return VACCEL_EINVAL;
+		}
+
+		struct pipeline_stage *s = &pipeline->stages[t->producer];
+		enum vaccel_op_type op =
+			*(enum vaccel_op_type *)vaccel_arg_buf(&s->args[0]);
+
+		struct vaccel_plugin *owner = get_plugin_op_owner(op,
+				sess->hint);
+		if (owner && owner->info->mem_alloc && owner->info->mem_free) {
+			t->buf = owner->info->mem_alloc(t->size);
+			t->owner = owner;
+		} else {
+			t->buf = calloc(1, t->size);
+			t->owner = NULL;
+		}
+
+		if (!t->buf)
+			return VACCEL_ENOMEM;
+	}
+
+	return VACCEL_OK;
+}
+
+static void stage_resolve_args(struct vaccel_pipeline *pipeline,
+		struct pipeline_stage *s)
+{
+	for (int i = 0; i < s->nr_read + s->nr_write; ++i) {
+		struct vaccel_arg *arg = &s->args[i];
+		if (!arg_is_tensor(arg)) {
+			s->resolved[i] = *arg;
+			continue;
+		}
+
+		struct pipeline_tensor *t = &pipeline->tensors[arg_tensor(arg)];
+		if (t->size <= UINT32_MAX) {
+			s->resolved[i].size = t->size;
+			s->resolved[i].flags = 0;
+			s->resolved[i].buf = t->buf;
+			continue;
+		}
+
+		s->segs[i].base = t->buf;
+		s->segs[i].len = t->size;
+		vaccel_arg_init_ext(&s->resolved[i], &s->exts[i], &s->segs[i],
+				1);
+	}
+}
+
+static void *pipeline_worker(void *arg)
+{
+	struct vaccel_pipeline *p = arg;
+
+	pthread_mutex_lock(&p->lock);
+	while (true) {
+		while (!p->nr_ready && p->nr_done < p->nr_stages)
+			pthread_cond_wait(&p->cond, &p->lock);
+
+		if (!p->nr_ready)
+			break;
+
+		int id = p->ready[--p->nr_ready];
+		struct pipeline_stage *s = &p->stages[id];
+
+		/* Stages depending on failed ones have `ret` set already */
+		if (!s->ret) {
+			pthread_mutex_unlock(&p->lock);
+			s->ret = vaccel_genop(p->sess, s->resolved, s->nr_read,
+					s->nr_write ? &s->resolved[s->nr_read] :
+					NULL, s->nr_write);
+			pthread_mutex_lock(&p->lock);
+
+			if (s->ret)
+				vaccel_debug("Pipeline stage %d failed: %d", id,
+						s->ret);
+		}
+
+		p->nr_done++;
+		for (int i = 0; i < s->nr_dependents; ++i) {
+			struct pipeline_stage *d = &p->stages[s->dependents[i]];
+			if (s->ret && !d->ret)
+				d->ret = VACCEL_ECANCELED;
+
+			if (!--d->pending)
+				p->ready[p->nr_ready++] = s->dependents[i];
+		}
+
+		pthread_cond_broadcast(&p->cond);
+	}
+	pthread_mutex_unlock(&p->lock);
+
+	return NULL;
+}
+
+static int pipeline_threads(int nr_stages)
+{
+	int nr_threads = DEFAULT_PIPELINE_THREADS;
+
+	char *env = getenv("VACCEL_PIPELINE_THREADS");
+	if (env && atoi(env) > 0)
+		nr_threads = atoi(env);
+
+	if (nr_threads > MAX_PIPELINE_THREADS)
+		nr_threads = MAX_PIPELINE_THREADS;
+
+	return (nr_threads < nr_stages) ? nr_threads : nr_stages;
+}
+
+int vaccel_pipeline_run(struct vaccel_session *sess,
+		struct vaccel_pipeline *pipeline)
+{
+	pthread_t threads[MAX_PIPELINE_THREADS];
+	int nr_started = 0;
+
+	if (!sess || !pipeline || !pipeline->nr_stages)
+		return VACCEL_EINVAL;
+
+	int ret = pipeline_alloc_tensors(pipeline, sess);
+	if (ret)
+		return ret;
+
+	struct vaccel_pipeline *p = pipeline;
+	p->ready = malloc(p->nr_stages * sizeof(*p->ready));
+	if (!p->ready)
+		return VACCEL_ENOMEM;
+
+	p->sess = sess;
+	p->nr_ready = 0;
+	p->nr_done = 0;
+
+	/* Stages with no dependencies are pushed in reverse, so that they
+	 * are popped in the order they were added */
+	for (int i = p->nr_stages - 1; i >= 0; --i) {
+		struct pipeline_stage *s = &p->stages[i];
+
+		stage_resolve_args(p, s);
+		s->pending = s->nr_deps;
+		s->ret = VACCEL_OK;
+		if (!s->nr_deps)
+			p->ready[p->nr_ready++] = i;
+	}
+
+	/* The calling thread runs stages too */
+	int nr_threads = pipeline_threads(p->nr_stages);
+	for (int i = 1; i < nr_threads; ++i) {
+		if (pthread_create(&threads[nr_started], NULL, pipeline_worker,
+					p))
+			break;
+
+		nr_started++;
+	}
+
+	pipeline_worker(p);
+
+	for (int i = 0; i < nr_started; ++i)
+		pthread_join(threads[i], NULL);
+
+	free(p->ready);
+	p->ready = NULL;
+
+	for (int i = 0; i < p->nr_stages; ++i) {
+		if (p->stages[i].ret)
+			return p->stages[i].ret;
+	}
+
+	return VACCEL_OK;
+}
+
+int vaccel_pipeline_stage_result(struct vaccel_pipeline *pipeline,
+		int stage)
+{
+	if (!pipeline || stage < 0 || stage >= pipeline->nr_stages)
+		return VACCEL_EINVAL;
+
+	return pipeline->stages[stage].ret;
+}
+
+int vaccel_pipeline_destroy(struct vaccel_pipeline *pipeline)
+{
+	if (!pipeline)
+		return VACCEL_EINVAL;
+
+	for (int i = 0; i < pipeline->nr_tensors; ++i) {
+		struct pipeline_tensor *t = &pipeline->tensors[i];
+		if (t->owner)
+			t->owner->info->mem_free(t->buf);
+		else
+			free(t->buf);
+	}
+
+	for (int i = 0; i < pipeline->nr_stages; ++i) {
+		struct pipeline_stage *s = &pipeline->stages[i];
+		free(s->dependents);
+		free(s->segs);
+		free(s->exts);
+		free(s->resolved);
+		free(s->args);
+	}
+
+	pthread_mutex_destroy(&pipeline->lock);
+	pthread_cond_destroy(&pipeline->cond);
+	free(pipeline->tensors);
+	free(pipeline->stages);
+	free(pipeline);
+
+	return VACCEL_OK;
+}
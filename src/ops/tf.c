@@ -105,6 +105,23 @@ free_node:
 	return NULL;
 }
 
+struct vaccel_tf_node *vaccel_tf_node_sess_new(
+	struct vaccel_session *sess,
+	const char *name,
+	long long int id
+) {
+	struct vaccel_tf_node *ret = vaccel_sess_alloc(sess, sizeof(*ret));
+	if (!ret)
+		return NULL;
+
+	ret->name = vaccel_sess_strdup(sess, name);
+	if (!ret->name)
+		return NULL;
+
+	ret->id = id;
+	return ret;
+}
+
 /* Destroy a TensorFlow node */
 void vaccel_tf_node_destroy(struct vaccel_tf_node *node)
 {
@@ -162,6 +179,38 @@ vaccel_tf_tensor_new(int nr_dims, uint32_t *dims, enum vaccel_tf_data_type type)
 	return ret;
 }
 
+struct vaccel_tf_tensor *
+vaccel_tf_tensor_sess_new(
+	struct vaccel_session *sess,
+	int nr_dims,
+	uint32_t *dims,
+	enum vaccel_tf_data_type type
+) {
+	if (nr_dims < 0)
+		return NULL;
+
+	/* Keep the tensor and its dimensions in a single allocation */
+	size_t dims_size = nr_dims * sizeof(*dims);
+	struct vaccel_tf_tensor *ret =
+		vaccel_sess_alloc(sess, sizeof(*ret) + dims_size);
+	if (!ret)
+		return NULL;
+
+	ret->data = NULL;
+	ret->size = 0;
+	ret->owned = false;
+	ret->data_type = type;
+	ret->nr_dims = nr_dims;
+	ret->dims = (uint32_t *)(ret + 1);
+
+	if (dims)
+		memcpy(ret->dims, dims, dims_size);
+	else
+		memset(ret->dims, 0, dims_size);
+
+	return ret;
+}
+
 struct vaccel_tf_tensor *
 vaccel_tf_tensor_allocate(
 	int nr_dims, uint32_t *dims,
@@ -245,7 +294,7 @@ int vaccel_tf_session_load(
 		return VACCEL_EINVAL;
 	}
 
-	vaccel_prof_region_start(&tf_load_stats);
+	vaccel_prof_token_t token = vaccel_prof_region_enter(&tf_load_stats);
 
 	// Get implementation
 	int (*plugin_op)(
@@ -258,10 +307,11 @@ int vaccel_tf_session_load(
 		goto out;
 	}
 
-	ret = plugin_op(session, model, status);
+	ret = plugin_op_call(session, VACCEL_TF_SESSION_LOAD, plugin_op,
+			session, model, status);
 
 out:
-	vaccel_prof_region_stop(&tf_load_stats);
+	vaccel_prof_region_exit(&tf_load_stats, token);
 	return ret;
 }
 
@@ -283,7 +333,7 @@ int vaccel_tf_session_run(
 		return VACCEL_EINVAL;
 	}
 
-	vaccel_prof_region_start(&tf_session_run_stats);
+	vaccel_prof_token_t token = vaccel_prof_region_enter(&tf_session_run_stats);
 
 	// Get implementation
 	int (*plugin_op)(
@@ -298,11 +348,12 @@ int vaccel_tf_session_run(
 		goto out;
 	}
 
-	ret = plugin_op(session, model, run_options, in_nodes, in, nr_inputs,
+	ret = plugin_op_call(session, VACCEL_TF_SESSION_RUN, plugin_op,
+			session, model, run_options, in_nodes, in, nr_inputs,
 			out_nodes, out, nr_outputs, status);
 
 out:
-	vaccel_prof_region_stop(&tf_session_run_stats);
+	vaccel_prof_region_exit(&tf_session_run_stats, token);
 	return ret;
 }
 
@@ -322,6 +373,9 @@ int vaccel_tf_session_delete(
 		return VACCEL_EINVAL;
 	}
 
+	vaccel_prof_token_t token =
+		vaccel_prof_region_enter(&tf_session_delete_stats);
+
 	int (*plugin_op)(
 		struct vaccel_session *, struct vaccel_tf_saved_model *,
 		struct vaccel_tf_status *
@@ -331,10 +385,11 @@ int vaccel_tf_session_delete(
 		goto out;
 	}
 
-	ret = plugin_op(session, model, status);
+	ret = plugin_op_call(session, VACCEL_TF_SESSION_DELETE, plugin_op,
+			session, model, status);
 
 out:
-	vaccel_prof_region_stop(&tf_session_delete_stats);
+	vaccel_prof_region_exit(&tf_session_delete_stats, token);
 	return ret;
 }
 
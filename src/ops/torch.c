@@ -28,6 +28,19 @@ struct vaccel_torch_buffer *vaccel_torch_buffer_new(char *data, size_t size)
 	return ret;
 }
 
+struct vaccel_torch_buffer *vaccel_torch_buffer_sess_new(
+		struct vaccel_session *sess, char *data, size_t size)
+{
+	struct vaccel_torch_buffer *ret = vaccel_sess_alloc(sess, sizeof(*ret));
+	if (!ret)
+		return NULL;
+
+	ret->data = data;
+	ret->size = size;
+
+	return ret;
+}
+
 // Destory Torch buffer data
 void vaccel_torch_buffer_destroy(struct vaccel_torch_buffer *buffer)
 {
@@ -173,10 +186,10 @@ int vaccel_torch_unpack(struct vaccel_session *sess, struct vaccel_arg *read,
 	}
 	
 	
-	char* model_path = (char*)read[0].buf;
-	char * img = (char*)read[1].buf;
-	size_t img_size = *(size_t*)read[2].buf;
-	char *tags = (char*)write[0].buf;
+	char* model_path = (char*)vaccel_arg_buf(&read[0]);
+	char * img = (char*)vaccel_arg_buf(&read[1]);
+	size_t img_size = *(size_t*)vaccel_arg_buf(&read[2]);
+	char *tags = (char*)vaccel_arg_buf(&write[0]);
 	
     return vaccel_torch_jitload_forward(sess, model_path, img, img_size, &tags);
 }
@@ -229,7 +242,8 @@ int vaccel_torch_jitload_forward(struct vaccel_session *sess,
 	if (!plugin_op)
 		return VACCEL_ENOTSUP;
 	// write -> tags
-	return plugin_op(sess, model, run_options, in_tensor, nr_read, out_tensor, nr_write);
+	return plugin_op_call(sess, VACCEL_TORCH_JITLOAD_FORWARD, plugin_op,
+			sess, model, run_options, in_tensor, nr_read, out_tensor, nr_write);
 }
 
 int vaccel_torch_sgemm(struct vaccel_session *sess,
@@ -258,5 +272,6 @@ int vaccel_torch_sgemm(struct vaccel_session *sess,
 		vaccel_debug("Plugin loading failed");
 		return VACCEL_ENOTSUP;
 	}
-	return plugin_op(sess, in_A, in_B, in_C, M, N, K, out);
+	return plugin_op_call(sess, VACCEL_TORCH_SGEMM, plugin_op,
+			sess, in_A, in_B, in_C, M, N, K, out);
 }
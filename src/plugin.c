@@ -38,8 +38,21 @@ static struct {
 	 * function
 	 */
 	list_t ops[VACCEL_FUNCTIONS_NR];
+
+	/* array of available batch implementations for every supported
+	 * function
+	 */
+	list_t batch_ops[VACCEL_FUNCTIONS_NR];
 } plugin_state = {0};
 
+/* Lookups memoized by the calling thread, while a batch of operations
+ * is dispatched */
+static __thread struct {
+	int depth;
+	unsigned int hint[VACCEL_FUNCTIONS_NR];
+	struct vaccel_op *op[VACCEL_FUNCTIONS_NR];
+} op_cache;
+
 static int check_plugin_info(const struct vaccel_plugin_info *pinfo)
 {
 	if (!pinfo->name) {
@@ -148,7 +161,8 @@ int unregister_plugin(struct vaccel_plugin *plugin)
 	return VACCEL_OK;
 }
 
-int register_plugin_function(struct vaccel_op *plugin_op)
+static int __register_plugin_function(struct vaccel_op *plugin_op,
+		list_t *ops)
 {
 	if (!plugin_op || !plugin_op->func) {
 		vaccel_error("Invalid vaccel function");
@@ -167,16 +181,21 @@ int register_plugin_function(struct vaccel_op *plugin_op)
 	}
 
 	list_add_tail(&plugin->ops, &plugin_op->plugin_entry);
-	list_add_tail(&plugin_state.ops[plugin_op->type],
-			&plugin_op->func_entry);
+	list_add_tail(&ops[plugin_op->type], &plugin_op->func_entry);
 
-	vaccel_debug("Registered function %s from plugin %s",
+	vaccel_debug("Registered %sfunction %s from plugin %s",
+			ops == plugin_state.batch_ops ? "batch " : "",
 			vaccel_op_type_str(plugin_op->type),
 			plugin->info->name);
 
 	return VACCEL_OK;
 }
 
+int register_plugin_function(struct vaccel_op *plugin_op)
+{
+	return __register_plugin_function(plugin_op, plugin_state.ops);
+}
+
 int register_plugin_functions(struct vaccel_op *plugin_ops, size_t nr_ops)
 {
 	for (size_t i = 0; i < nr_ops; ++i) {
@@ -188,7 +207,31 @@ int register_plugin_functions(struct vaccel_op *plugin_ops, size_t nr_ops)
 	return VACCEL_OK;
 }
 
-void *get_plugin_op(enum vaccel_op_type op_type, unsigned int hint)
+/* Register a vectorized implementation of a function
+ *
+ * The function needs to be a vaccel_batch_func_t. It is used by
+ * vaccel_genop_batch() whenever the plugin is the one selected to
+ * run operations of the type.
+ */
+int register_plugin_batch_function(struct vaccel_op *plugin_op)
+{
+	return __register_plugin_function(plugin_op, plugin_state.batch_ops);
+}
+
+int register_plugin_batch_functions(struct vaccel_op *plugin_ops,
+		size_t nr_ops)
+{
+	for (size_t i = 0; i < nr_ops; ++i) {
+		int ret = register_plugin_batch_function(&plugin_ops[i]);
+		if (ret)
+			return ret;
+	}
+
+	return VACCEL_OK;
+}
+
+static struct vaccel_op *find_plugin_op(enum vaccel_op_type op_type,
+		unsigned int hint)
 {
 	unsigned int env_priority = hint;
 	struct vaccel_op *op = NULL;
@@ -198,6 +241,10 @@ void *get_plugin_op(enum vaccel_op_type op_type, unsigned int hint)
 		return NULL;
 	}
 
+	if (op_cache.depth && op_cache.op[op_type] &&
+			op_cache.hint[op_type] == hint)
+		return op_cache.op[op_type];
+
 	if (list_empty(&plugin_state.ops[op_type])) {
 		vaccel_warn("None of the loaded plugins implement %s",
 				vaccel_op_type_str(op_type));
@@ -229,7 +276,88 @@ void *get_plugin_op(enum vaccel_op_type op_type, unsigned int hint)
 
 	vaccel_debug("Found implementation in %s plugin", op->owner->info->name);
 
-	return op->func;
+	if (op_cache.depth) {
+		op_cache.op[op_type] = op;
+		op_cache.hint[op_type] = hint;
+	}
+
+	return op;
+}
+
+void *get_plugin_op(enum vaccel_op_type op_type, unsigned int hint)
+{
+	struct op_span span;
+	int instr = op_instr();
+
+	if (!instr) {
+		struct vaccel_op *op = find_plugin_op(op_type, hint);
+		return op ? op->func : NULL;
+	}
+
+	struct trace_info info = { .op_type = op_type };
+	op_span_begin(&span, instr, OP_PHASE_LOOKUP, &info);
+
+	struct vaccel_op *op = find_plugin_op(op_type, hint);
+
+	op_span_end(&span, op ? VACCEL_OK : VACCEL_ENOTSUP);
+
+	return op ? op->func : NULL;
+}
+
+/* Get the plugin that would run operations of the type */
+struct vaccel_plugin *get_plugin_op_owner(enum vaccel_op_type op_type,
+		unsigned int hint)
+{
+	struct vaccel_op *op = find_plugin_op(op_type, hint);
+
+	return op ? op->owner : NULL;
+}
+
+/* Get the batch implementation of the plugin that would run single
+ * operations of the type, if that plugin has one */
+void *get_plugin_batch_op(enum vaccel_op_type op_type, unsigned int hint)
+{
+	struct vaccel_op *op = find_plugin_op(op_type, hint);
+	if (!op)
+		return NULL;
+
+	struct vaccel_op *batch_op;
+	for_each_container(batch_op, &plugin_state.batch_ops[op_type],
+			struct vaccel_op, func_entry) {
+		if (batch_op->owner == op->owner)
+			return batch_op->func;
+	}
+
+	return NULL;
+}
+
+/* Start the span of a plugin running an operation */
+void plugin_op_span_begin(struct op_span *span, int flags,
+		struct vaccel_session *sess, enum vaccel_op_type op_type)
+{
+	struct vaccel_op *op = find_plugin_op(op_type, sess->hint);
+	struct trace_info info = {
+		.sess_id = sess->session_id,
+		.op_type = op_type,
+		.plugin = op ? op->owner->info->name : NULL,
+	};
+
+	op_span_begin(span, flags, OP_PHASE_PLUGIN, &info);
+}
+
+/* Memoize the lookups of the calling thread until the matching
+ * plugin_op_cache_disable(). Plugins must not be unregistered
+ * in the meantime */
+void plugin_op_cache_enable(void)
+{
+	if (!op_cache.depth++)
+		memset(op_cache.op, 0, sizeof(op_cache.op));
+}
+
+void plugin_op_cache_disable(void)
+{
+	if (op_cache.depth)
+		op_cache.depth--;
 }
 
 int get_available_plugins(enum vaccel_op_type op_type) {
@@ -255,8 +383,10 @@ int plugins_bootstrap()
 {
 	list_init(&plugin_state.plugins);
 
-	for (size_t i = 0; i < VACCEL_FUNCTIONS_NR; ++i)
+	for (size_t i = 0; i < VACCEL_FUNCTIONS_NR; ++i) {
 		list_init(&plugin_state.ops[i]);
+		list_init(&plugin_state.batch_ops[i]);
+	}
 
 	plugin_state.initialized = true;
 
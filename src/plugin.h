@@ -17,11 +17,37 @@
 
 #include "include/plugin.h"
 #include "ops/vaccel_ops.h"
+#include "profiling/op_prof.h"
 
+#include <stdbool.h>
 #include <stdint.h>
 #include "vaccel.h"
 
 void *get_plugin_op(enum vaccel_op_type op_type, unsigned int hint);
+void *get_plugin_batch_op(enum vaccel_op_type op_type, unsigned int hint);
+struct vaccel_plugin *get_plugin_op_owner(enum vaccel_op_type op_type,
+		unsigned int hint);
+void plugin_op_cache_enable(void);
+void plugin_op_cache_disable(void);
+void plugin_op_span_begin(struct op_span *span, int flags,
+		struct vaccel_session *sess, enum vaccel_op_type op_type);
+
+/* Call `func`, the implementation of `op_type` we got from
+ * get_plugin_op(), with the rest of the arguments, profiling and
+ * tracing the call if enabled. Evaluates to the return value of
+ * `func` */
+#define plugin_op_call(sess, op_type, func, ...) __extension__ ({	\
+	struct op_span __span;						\
+	int __instr = op_instr();					\
+	if (__instr)							\
+		plugin_op_span_begin(&__span, __instr, (sess),		\
+				(op_type));				\
+	int __ret = (func)(__VA_ARGS__);				\
+	if (__instr)							\
+		op_span_end(&__span, __ret);				\
+	__ret;								\
+})
+
 int get_available_plugins(enum vaccel_op_type op_type);
 struct vaccel_plugin *get_virtio_plugin(void);
 int plugins_bootstrap(void);
@@ -0,0 +1,161 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "clock.h"
+
+#include "log.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef PROF_CLOCK_HAVE_TSC
+#include <cpuid.h>
+#endif
+
+/* Time the TSC is calibrated against CLOCK_MONOTONIC for */
+#define PROF_CLOCK_CALIBRATION_NSEC 10000000
+
+#define PROF_CLOCKSOURCE \
+	"/sys/devices/system/clocksource/clocksource0/current_clocksource"
+
+struct prof_clock prof_clock = {
+	.source = PROF_CLOCK_UNKNOWN,
+};
+
+const char *prof_clock_name(void)
+{
+	int source = __atomic_load_n(&prof_clock.source, __ATOMIC_ACQUIRE);
+	if (source == PROF_CLOCK_UNKNOWN)
+		source = prof_clock_init();
+
+	return (source == PROF_CLOCK_TSC) ? "tsc" : "monotonic";
+}
+
+#ifdef PROF_CLOCK_HAVE_TSC
+/* The TSC ticks at a constant rate in all power states and has rdtscp */
+static bool prof_clock_tsc_invariant(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) ||
+			!(edx & (1U << 27)))
+		return false;
+
+	if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+		return false;
+
+	return edx & (1U << 8);
+}
+
+/* The kernel only keeps the TSC as its clocksource if it is in sync
+ * across CPUs */
+static bool prof_clock_tsc_trusted(void)
+{
+	char source[32] = "";
+
+	FILE *fp = fopen(PROF_CLOCKSOURCE, "re");
+	if (!fp)
+		return false;
+
+	bool ok = fgets(source, sizeof(source), fp) &&
+		!strncmp(source, "tsc", 3);
+	fclose(fp);
+
+	return ok;
+}
+
+/* Read the TSC and CLOCK_MONOTONIC as close together as we can */
+static void prof_clock_pair(uint64_t *tsc, uint64_t *ns)
+{
+	uint64_t best = UINT64_MAX;
+
+	for (int i = 0; i < 5; ++i) {
+		unsigned int aux;
+		uint64_t before = prof_clock_monotonic();
+		uint64_t t = __rdtscp(&aux);
+		uint64_t after = prof_clock_monotonic();
+
+		if (after - before < best) {
+			best = after - before;
+			*tsc = t;
+			*ns = before + (after - before) / 2;
+		}
+	}
+}
+
+static bool prof_clock_calibrate(void)
+{
+	uint64_t tsc0, ns0, tsc1, ns1;
+
+	prof_clock_pair(&tsc0, &ns0);
+
+	struct timespec wait = { .tv_nsec = PROF_CLOCK_CALIBRATION_NSEC };
+	nanosleep(&wait, NULL);
+
+	prof_clock_pair(&tsc1, &ns1);
+
+	uint64_t cycles = tsc1 - tsc0, ns = ns1 - ns0;
+
+	/* Anything outside 100MHz-10GHz means the TSC is not usable */
+	if (cycles < ns / 10 || cycles > ns * 10)
+		return false;
+
+	prof_clock.tsc_base = tsc1;
+	prof_clock.ns_base = ns1;
+	prof_clock.mult = ((unsigned __int128)ns << PROF_CLOCK_SHIFT) / cycles;
+
+	vaccel_debug("[prof] TSC runs at %.3f GHz", (double)cycles / ns);
+
+	return true;
+}
+#endif
+
+int prof_clock_init(void)
+{
+	static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+	pthread_mutex_lock(&lock);
+
+	/* Somebody might have picked the source in the meantime */
+	int source = __atomic_load_n(&prof_clock.source, __ATOMIC_ACQUIRE);
+	if (source != PROF_CLOCK_UNKNOWN)
+		goto unlock;
+
+	source = PROF_CLOCK_MONOTONIC;
+
+	char *env = getenv("VACCEL_PROF_CLOCK");
+	bool force_tsc = env && !strcmp(env, "tsc");
+
+#ifdef PROF_CLOCK_HAVE_TSC
+	bool force_monotonic = env && !strcmp(env, "monotonic");
+	if (!force_monotonic && prof_clock_tsc_invariant() &&
+			(force_tsc || prof_clock_tsc_trusted()) &&
+			prof_clock_calibrate())
+		source = PROF_CLOCK_TSC;
+#endif
+	if (force_tsc && source != PROF_CLOCK_TSC)
+		vaccel_warn("[prof] TSC is not usable, using CLOCK_MONOTONIC");
+
+	/* Publish the calibration along with the source */
+	__atomic_store_n(&prof_clock.source, source, __ATOMIC_RELEASE);
+
+unlock:
+	pthread_mutex_unlock(&lock);
+
+	return source;
+}
@@ -0,0 +1,93 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __PROF_CLOCK_H__
+#define __PROF_CLOCK_H__
+
+#include <stdint.h>
+#include <time.h>
+
+/* Cycles are converted with 128-bit arithmetic, which 32-bit targets
+ * do not have */
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#define PROF_CLOCK_HAVE_TSC 1
+#endif
+
+/* Profiling clock
+ *
+ * Timestamps are read from the TSC when it is invariant and the kernel
+ * trusts it as its clocksource, which means it is synchronized across
+ * CPUs, and converted to nsec with a calibrated fixed-point multiply.
+ * Otherwise they come from CLOCK_MONOTONIC, which the vDSO serves
+ * without a syscall. VACCEL_PROF_CLOCK=tsc or VACCEL_PROF_CLOCK=monotonic
+ * overrides the choice. Either way, timestamps are nsec since the same
+ * epoch as CLOCK_MONOTONIC.
+ */
+enum prof_clock_source {
+	PROF_CLOCK_UNKNOWN = -1,
+	PROF_CLOCK_MONOTONIC = 0,
+	PROF_CLOCK_TSC,
+};
+
+struct prof_clock {
+	int source;
+
+	/* nsec = ns_base + ((tsc - tsc_base) * mult) >> PROF_CLOCK_SHIFT */
+	uint64_t tsc_base;
+	uint64_t ns_base;
+	uint64_t mult;
+};
+
+#define PROF_CLOCK_SHIFT 32
+
+extern struct prof_clock prof_clock;
+
+/* Pick the clock source, calibrating the TSC if it is to be used. This
+ * takes about 10 msec the first time a timestamp is read */
+int prof_clock_init(void);
+
+const char *prof_clock_name(void);
+
+static inline uint64_t prof_clock_monotonic(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Current time in nsec */
+static inline uint64_t prof_clock_nsec(void)
+{
+#ifdef PROF_CLOCK_HAVE_TSC
+	int source = __atomic_load_n(&prof_clock.source, __ATOMIC_ACQUIRE);
+	if (__builtin_expect(source == PROF_CLOCK_UNKNOWN, 0))
+		source = prof_clock_init();
+
+	if (__builtin_expect(source == PROF_CLOCK_TSC, 1)) {
+		/* rdtscp waits for the preceding instructions to complete,
+		 * so the region being timed does not leak past it */
+		unsigned int aux;
+		uint64_t delta = __rdtscp(&aux) - prof_clock.tsc_base;
+
+		return prof_clock.ns_base + (uint64_t)(((unsigned __int128)delta *
+					prof_clock.mult) >> PROF_CLOCK_SHIFT);
+	}
+#endif
+	return prof_clock_monotonic();
+}
+
+#endif /* __PROF_CLOCK_H__ */
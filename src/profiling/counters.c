@@ -0,0 +1,240 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "counters.h"
+
+#include "log.h"
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const struct {
+	uint32_t type;
+	uint64_t config;
+	const char *name;
+} prof_counter_events[VACCEL_PROF_COUNTERS_NR] = {
+	[VACCEL_PROF_CYCLES] = {
+		PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles"
+	},
+	[VACCEL_PROF_INSTRUCTIONS] = {
+		PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions"
+	},
+	[VACCEL_PROF_LLC_MISSES] = {
+		PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "LLC misses"
+	},
+	[VACCEL_PROF_BRANCH_MISSES] = {
+		PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES,
+		"branch misses"
+	},
+	[VACCEL_PROF_CTX_SWITCHES] = {
+		PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES,
+		"context switches"
+	},
+};
+
+/* -1 until we have looked at the environment, 0 if counters are
+ * disabled or turned out to be unavailable */
+static _Atomic int prof_counters_state = -1;
+
+static pthread_key_t prof_counters_key;
+static pthread_once_t prof_counters_once = PTHREAD_ONCE_INIT;
+
+static __thread struct {
+	/* 0 until the thread has tried to open its counters, 1 if it
+	 * has them and -1 if it could not open any */
+	int state;
+
+	/* Group leader and members, -1 for counters not opened */
+	int fds[VACCEL_PROF_COUNTERS_NR];
+	int leader;
+
+	/* Position of every counter in the values of the group */
+	int pos[VACCEL_PROF_COUNTERS_NR];
+	int nr_open;
+	uint32_t mask;
+} prof_thread_counters;
+
+bool prof_counters_enabled(void)
+{
+	int state = atomic_load_explicit(&prof_counters_state,
+			memory_order_relaxed);
+	if (state >= 0)
+		return state;
+
+	char *env = getenv("VACCEL_PROF_COUNTERS");
+	state = env && !strncmp(env, "enabled", 7);
+	atomic_store_explicit(&prof_counters_state, state,
+			memory_order_relaxed);
+
+	return state;
+}
+
+static void prof_counters_close(void *data)
+{
+	(void)data;
+
+	for (int i = 0; i < VACCEL_PROF_COUNTERS_NR; ++i) {
+		if (prof_thread_counters.fds[i] >= 0)
+			close(prof_thread_counters.fds[i]);
+		prof_thread_counters.fds[i] = -1;
+	}
+
+	prof_thread_counters.state = -1;
+}
+
+static void prof_counters_key_create(void)
+{
+	pthread_key_create(&prof_counters_key, prof_counters_close);
+}
+
+static int prof_counter_open(int counter, int group_fd)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = prof_counter_events[counter].type;
+	attr.config = prof_counter_events[counter].config;
+	attr.read_format = PERF_FORMAT_GROUP |
+		PERF_FORMAT_TOTAL_TIME_ENABLED |
+		PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+	/* We are interested in what the calling code does, and user space
+	 * only counting works with perf_event_paranoid up to 2. Context
+	 * switches happen in the kernel, so they are only counted when
+	 * we are allowed to */
+	attr.exclude_kernel = (attr.type == PERF_TYPE_HARDWARE);
+	attr.exclude_hv = 1;
+
+	/* Programs spawned by the thread have no use for its counters */
+	return syscall(SYS_perf_event_open, &attr, 0, -1, group_fd,
+			PERF_FLAG_FD_CLOEXEC);
+}
+
+static void prof_counters_unavailable(int err)
+{
+	int paranoid = -1;
+
+	FILE *fp = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
+	if (fp) {
+		if (fscanf(fp, "%d", &paranoid) != 1)
+			paranoid = -1;
+		fclose(fp);
+	}
+
+	vaccel_warn("[prof] Hardware counters unavailable: %s "
+			"(perf_event_paranoid: %d)", strerror(err), paranoid);
+
+	atomic_store_explicit(&prof_counters_state, 0, memory_order_relaxed);
+}
+
+static bool prof_counters_open(void)
+{
+	int err = 0;
+
+	prof_thread_counters.leader = -1;
+	prof_thread_counters.nr_open = 0;
+	prof_thread_counters.mask = 0;
+
+	for (int i = 0; i < VACCEL_PROF_COUNTERS_NR; ++i) {
+		prof_thread_counters.pos[i] = -1;
+		prof_thread_counters.fds[i] = prof_counter_open(i,
+				prof_thread_counters.leader);
+		if (prof_thread_counters.fds[i] < 0) {
+			err = errno;
+			vaccel_debug("[prof] Could not open %s counter: %s",
+					prof_counter_events[i].name,
+					strerror(err));
+			continue;
+		}
+
+		if (prof_thread_counters.leader < 0)
+			prof_thread_counters.leader =
+				prof_thread_counters.fds[i];
+
+		prof_thread_counters.pos[i] = prof_thread_counters.nr_open++;
+		prof_thread_counters.mask |= 1U << i;
+	}
+
+	if (!prof_thread_counters.nr_open) {
+		prof_thread_counters.state = -1;
+		prof_counters_unavailable(err);
+		return false;
+	}
+
+	pthread_once(&prof_counters_once, prof_counters_key_create);
+	pthread_setspecific(prof_counters_key, &prof_thread_counters);
+	prof_thread_counters.state = 1;
+
+	return true;
+}
+
+bool prof_counters_read(struct prof_counters *counters)
+{
+	counters->mask = 0;
+
+	if (!prof_counters_enabled() || prof_thread_counters.state < 0)
+		return false;
+
+	if (!prof_thread_counters.state && !prof_counters_open())
+		return false;
+
+	/* nr, time enabled, time running and the values of the group */
+	uint64_t data[3 + VACCEL_PROF_COUNTERS_NR];
+	ssize_t expected = (3 + prof_thread_counters.nr_open) * sizeof(data[0]);
+	if (read(prof_thread_counters.leader, data, sizeof(data)) < expected)
+		return false;
+
+	uint64_t enabled = data[1], running = data[2];
+	for (int i = 0; i < VACCEL_PROF_COUNTERS_NR; ++i) {
+		int pos = prof_thread_counters.pos[i];
+		if (pos < 0)
+			continue;
+
+		/* Scale the values if the group has been multiplexed with
+		 * other events */
+		uint64_t value = data[3 + pos];
+		if (running && running < enabled)
+			value = (double)value * enabled / running;
+
+		counters->values[i] = value;
+	}
+
+	counters->mask = prof_thread_counters.mask;
+
+	return true;
+}
+
+void prof_counters_sub(struct prof_counters *end,
+		const struct prof_counters *start)
+{
+	end->mask &= start->mask;
+
+	for (int i = 0; i < VACCEL_PROF_COUNTERS_NR; ++i) {
+		if (!(end->mask & (1U << i)))
+			continue;
+
+		/* Scaling might make counters go backwards */
+		end->values[i] = (end->values[i] > start->values[i]) ?
+			end->values[i] - start->values[i] : 0;
+	}
+}
@@ -0,0 +1,49 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __PROF_COUNTERS_H__
+#define __PROF_COUNTERS_H__
+
+#include "include/vaccel_prof.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Hardware performance counters of the calling thread
+ *
+ * With VACCEL_PROF_COUNTERS=enabled every thread that profiles a region
+ * opens a perf event group counting the events of enum
+ * vaccel_prof_counter in user space. Events the kernel or the hardware
+ * does not support are left out, and if none can be opened, e.g.
+ * because perf_event_paranoid forbids it, counters are disabled with a
+ * warning.
+ */
+struct prof_counters {
+	/* Bitmask of the counters in `values` */
+	uint32_t mask;
+	uint64_t values[VACCEL_PROF_COUNTERS_NR];
+};
+
+bool prof_counters_enabled(void);
+
+/* Read the counters of the calling thread. Returns false if they are
+ * not available */
+bool prof_counters_read(struct prof_counters *counters);
+
+/* Turn `end` into the difference between `end` and `start` */
+void prof_counters_sub(struct prof_counters *end,
+		const struct prof_counters *start);
+
+#endif /* __PROF_COUNTERS_H__ */
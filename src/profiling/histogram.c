@@ -0,0 +1,141 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "histogram.h"
+
+#include <stddef.h>
+
+#define load(ptr) __atomic_load_n((ptr), __ATOMIC_RELAXED)
+#define store(ptr, val) __atomic_store_n((ptr), (val), __ATOMIC_RELAXED)
+
+static unsigned int hist_index(uint64_t value)
+{
+	if (value < HIST_SUB_COUNT)
+		return value;
+
+	unsigned int msb = 63 - __builtin_clzll(value);
+	if (msb > HIST_MAX_BITS)
+		return HIST_BUCKETS - 1;
+
+	/* Keep the HIST_SUB_BITS most significant bits of the value. The
+	 * top one is always set, so they select one of HIST_HALF_COUNT
+	 * buckets of the power of two */
+	unsigned int shift = msb - (HIST_SUB_BITS - 1);
+	unsigned int sub = (value >> shift) - HIST_HALF_COUNT;
+
+	return HIST_SUB_COUNT + (shift - 1) * HIST_HALF_COUNT + sub;
+}
+
+/* Largest value that falls in bucket `idx` */
+static uint64_t hist_bucket_value(unsigned int idx)
+{
+	if (idx < HIST_SUB_COUNT)
+		return idx;
+
+	unsigned int shift = (idx - HIST_SUB_COUNT) / HIST_HALF_COUNT + 1;
+	uint64_t sub = (idx - HIST_SUB_COUNT) % HIST_HALF_COUNT +
+		HIST_HALF_COUNT;
+
+	return ((sub + 1) << shift) - 1;
+}
+
+void hist_init(struct prof_hist *hist)
+{
+	store(&hist->count, 0);
+	store(&hist->total, 0);
+	store(&hist->min, UINT64_MAX);
+	store(&hist->max, 0);
+
+	for (size_t i = 0; i < HIST_BUCKETS; ++i)
+		store(&hist->buckets[i], 0);
+}
+
+void hist_record(struct prof_hist *hist, uint64_t value)
+{
+	hist_record_n(hist, value, 1);
+}
+
+void hist_record_n(struct prof_hist *hist, uint64_t value, uint64_t n)
+{
+	uint64_t *bucket = &hist->buckets[hist_index(value)];
+
+	store(bucket, load(bucket) + n);
+	store(&hist->total, load(&hist->total) + value * n);
+
+	if (value < load(&hist->min))
+		store(&hist->min, value);
+	if (value > load(&hist->max))
+		store(&hist->max, value);
+
+	store(&hist->count, load(&hist->count) + n);
+}
+
+void hist_merge(struct prof_hist *dst, const struct prof_hist *src)
+{
+	uint64_t count = 0;
+
+	for (size_t i = 0; i < HIST_BUCKETS; ++i) {
+		uint64_t n = load(&src->buckets[i]);
+		if (!n)
+			continue;
+
+		store(&dst->buckets[i], load(&dst->buckets[i]) + n);
+		count += n;
+	}
+
+	/* Use the bucket counts, so that percentiles add up even if
+	 * `src` is being written to */
+	store(&dst->count, load(&dst->count) + count);
+	store(&dst->total, load(&dst->total) + load(&src->total));
+
+	if (load(&src->min) < load(&dst->min))
+		store(&dst->min, load(&src->min));
+	if (load(&src->max) > load(&dst->max))
+		store(&dst->max, load(&src->max));
+}
+
+uint64_t hist_percentile(const struct prof_hist *hist, double percentile)
+{
+	uint64_t count = load(&hist->count);
+	if (!count)
+		return 0;
+
+	if (percentile >= 100.0)
+		return load(&hist->max);
+
+	uint64_t rank = (uint64_t)(percentile / 100.0 * count + 0.5);
+	if (!rank)
+		rank = 1;
+
+	uint64_t seen = 0;
+	for (unsigned int i = 0; i < HIST_BUCKETS; ++i) {
+		seen += load(&hist->buckets[i]);
+		if (seen < rank)
+			continue;
+
+		/* Report the bucket's upper bound, within the observed
+		 * range of values. The last bucket also holds everything
+		 * above the tracked range */
+		uint64_t value = hist_bucket_value(i);
+		if (value > load(&hist->max) || i == HIST_BUCKETS - 1)
+			value = load(&hist->max);
+		if (value < load(&hist->min))
+			value = load(&hist->min);
+
+		return value;
+	}
+
+	return load(&hist->max);
+}
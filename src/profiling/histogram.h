@@ -0,0 +1,61 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __PROF_HISTOGRAM_H__
+#define __PROF_HISTOGRAM_H__
+
+#include <stdint.h>
+
+/* Log-linear latency histogram
+ *
+ * Values below 2^HIST_SUB_BITS nsec get a bucket each. Above that,
+ * every power of two is split in 2^(HIST_SUB_BITS - 1) linear buckets,
+ * so a value is known within 1/64th of itself. The largest tracked
+ * value is 2^HIST_MAX_BITS nsec (about 18 minutes); larger values are
+ * counted in the last bucket, but min and max are exact.
+ *
+ * Histograms are written by a single thread and can be read by any
+ * thread at any time, so fields are accessed with relaxed atomics.
+ */
+#define HIST_SUB_BITS 7
+#define HIST_MAX_BITS 40
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_HALF_COUNT (HIST_SUB_COUNT / 2)
+#define HIST_BUCKETS \
+	(HIST_SUB_COUNT + (HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_HALF_COUNT)
+
+struct prof_hist {
+	uint64_t count;
+	uint64_t total;
+	uint64_t min;
+	uint64_t max;
+	uint64_t buckets[HIST_BUCKETS];
+};
+
+void hist_init(struct prof_hist *hist);
+
+/* Record a value. Only one thread may record into a histogram */
+void hist_record(struct prof_hist *hist, uint64_t value);
+
+/* Record a value `n` times, e.g. for a sample standing for `n` values */
+void hist_record_n(struct prof_hist *hist, uint64_t value, uint64_t n);
+
+/* Add the values of `src` to `dst` */
+void hist_merge(struct prof_hist *dst, const struct prof_hist *src);
+
+/* The value below which `percentile` percent of the values fall */
+uint64_t hist_percentile(const struct prof_hist *hist, double percentile);
+
+#endif /* __PROF_HISTOGRAM_H__ */
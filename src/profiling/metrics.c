@@ -0,0 +1,353 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "metrics.h"
+#include "op_prof.h"
+
+#include "error.h"
+#include "log.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Most iterations a writer spins for before yielding */
+#define METRICS_MAX_SPINS 1024
+
+static struct {
+	/* The segment, NULL if metrics are not published */
+	struct metrics_shm *shm;
+	char name[64];
+
+	/* Keys of the plugin entries, i.e. the address of the plugin
+	 * names, in the same order as in the segment */
+	const char *plugin_keys[METRICS_MAX_PLUGINS];
+	pthread_mutex_t lock;
+} metrics = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+bool metrics_enabled(void)
+{
+	return __atomic_load_n(&metrics.shm, __ATOMIC_ACQUIRE) != NULL;
+}
+
+static inline void metrics_cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+/* Seqlock write side. There can be many writers of an entry, so the
+ * sequence number is moved from even to odd with a CAS. Writers that
+ * find the entry busy back off exponentially, and eventually yield the
+ * CPU, in case the writer holding it got preempted */
+static void metrics_write_lock(uint32_t *seq)
+{
+	unsigned int spins = 1;
+	uint32_t cur = __atomic_load_n(seq, __ATOMIC_RELAXED);
+
+	while (true) {
+		if (!(cur & 1) && __atomic_compare_exchange_n(seq, &cur,
+					cur + 1, true, __ATOMIC_ACQUIRE,
+					__ATOMIC_RELAXED))
+			break;
+
+		for (unsigned int i = 0; i < spins; ++i)
+			metrics_cpu_relax();
+
+		if (spins < METRICS_MAX_SPINS)
+			spins <<= 1;
+		else
+			sched_yield();
+
+		cur = __atomic_load_n(seq, __ATOMIC_RELAXED);
+	}
+
+	/* Order the entry updates after the odd sequence number */
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void metrics_write_unlock(uint32_t *seq)
+{
+	__atomic_add_fetch(seq, 1, __ATOMIC_RELEASE);
+}
+
+static void metrics_gauge_add(int64_t *gauge, int64_t val)
+{
+	__atomic_add_fetch(gauge, val, __ATOMIC_RELAXED);
+}
+
+static void metrics_entry_update(struct metrics_entry *entry, uint64_t time,
+		int ret)
+{
+	metrics_write_lock(&entry->seq);
+
+	entry->nr_ops++;
+	if (ret)
+		entry->nr_errors++;
+	hist_record(&entry->latency, time);
+
+	metrics_write_unlock(&entry->seq);
+}
+
+static struct metrics_entry *metrics_plugin(struct metrics_shm *shm,
+		const char *plugin)
+{
+	if (!plugin)
+		return NULL;
+
+	uint32_t nr = __atomic_load_n(&shm->nr_plugins, __ATOMIC_ACQUIRE);
+	for (uint32_t i = 0; i < nr; ++i) {
+		if (metrics.plugin_keys[i] == plugin)
+			return &shm->plugins[i];
+	}
+
+	struct metrics_entry *entry = NULL;
+
+	pthread_mutex_lock(&metrics.lock);
+
+	/* Somebody might have added the plugin in the meantime */
+	for (nr = 0; nr < shm->nr_plugins; ++nr) {
+		if (metrics.plugin_keys[nr] == plugin)
+			break;
+	}
+
+	if (nr < METRICS_MAX_PLUGINS) {
+		entry = &shm->plugins[nr];
+		if (nr == shm->nr_plugins) {
+			snprintf(entry->name, METRICS_NAME_LEN, "%s", plugin);
+			metrics.plugin_keys[nr] = plugin;
+			__atomic_store_n(&shm->nr_plugins, nr + 1,
+					__ATOMIC_RELEASE);
+		}
+	}
+
+	pthread_mutex_unlock(&metrics.lock);
+
+	return entry;
+}
+
+static struct metrics_session *metrics_session(struct metrics_shm *shm,
+		uint32_t sess_id)
+{
+	if (!sess_id)
+		return NULL;
+
+	struct metrics_session *slot =
+		&shm->sessions[sess_id % METRICS_MAX_SESSIONS];
+
+	/* Sessions sharing a slot with an older one are not tracked */
+	if (__atomic_load_n(&slot->id, __ATOMIC_RELAXED) != sess_id)
+		return NULL;
+
+	return slot;
+}
+
+void metrics_op_begin(unsigned int op_type, const char *plugin,
+		uint32_t sess_id)
+{
+	struct metrics_shm *shm = __atomic_load_n(&metrics.shm,
+			__ATOMIC_ACQUIRE);
+	if (!shm || op_type >= VACCEL_FUNCTIONS_NR)
+		return;
+
+	metrics_gauge_add(&shm->inflight, 1);
+	metrics_gauge_add(&shm->ops[op_type].inflight, 1);
+
+	struct metrics_entry *entry = metrics_plugin(shm, plugin);
+	if (entry)
+		metrics_gauge_add(&entry->inflight, 1);
+
+	struct metrics_session *sess = metrics_session(shm, sess_id);
+	if (sess)
+		metrics_gauge_add(&sess->inflight, 1);
+}
+
+void metrics_op_end(unsigned int op_type, const char *plugin,
+		uint32_t sess_id, uint64_t time, int ret)
+{
+	struct metrics_shm *shm = __atomic_load_n(&metrics.shm,
+			__ATOMIC_ACQUIRE);
+	if (!shm || op_type >= VACCEL_FUNCTIONS_NR)
+		return;
+
+	metrics_entry_update(&shm->ops[op_type], time, ret);
+	metrics_gauge_add(&shm->ops[op_type].inflight, -1);
+
+	struct metrics_entry *entry = metrics_plugin(shm, plugin);
+	if (entry) {
+		metrics_entry_update(entry, time, ret);
+		metrics_gauge_add(&entry->inflight, -1);
+	}
+
+	struct metrics_session *sess = metrics_session(shm, sess_id);
+	if (sess) {
+		metrics_write_lock(&sess->seq);
+		sess->nr_ops++;
+		if (ret)
+			sess->nr_errors++;
+		sess->total_time += time;
+		metrics_write_unlock(&sess->seq);
+
+		metrics_gauge_add(&sess->inflight, -1);
+	}
+
+	metrics_gauge_add(&shm->inflight, -1);
+}
+
+bool metrics_session_open(uint32_t sess_id)
+{
+	struct metrics_shm *shm = __atomic_load_n(&metrics.shm,
+			__ATOMIC_ACQUIRE);
+	if (!shm || !sess_id)
+		return false;
+
+	metrics_gauge_add(&shm->nr_sessions, 1);
+
+	struct metrics_session *slot =
+		&shm->sessions[sess_id % METRICS_MAX_SESSIONS];
+
+	uint32_t free_slot = 0;
+	if (!__atomic_compare_exchange_n(&slot->id, &free_slot, sess_id, false,
+				__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return true;
+
+	metrics_write_lock(&slot->seq);
+	slot->inflight = 0;
+	slot->nr_ops = 0;
+	slot->nr_errors = 0;
+	slot->total_time = 0;
+	metrics_write_unlock(&slot->seq);
+
+	return true;
+}
+
+void metrics_session_close(uint32_t sess_id)
+{
+	struct metrics_shm *shm = __atomic_load_n(&metrics.shm,
+			__ATOMIC_ACQUIRE);
+	if (!shm || !sess_id)
+		return;
+
+	metrics_gauge_add(&shm->nr_sessions, -1);
+
+	struct metrics_session *slot =
+		&shm->sessions[sess_id % METRICS_MAX_SESSIONS];
+
+	uint32_t id = sess_id;
+	__atomic_compare_exchange_n(&slot->id, &id, 0, false,
+			__ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+void metrics_async_queue(int depth)
+{
+	struct metrics_shm *shm = __atomic_load_n(&metrics.shm,
+			__ATOMIC_ACQUIRE);
+	if (!shm)
+		return;
+
+	__atomic_store_n(&shm->async_queue, depth, __ATOMIC_RELAXED);
+}
+
+static int metrics_env_enabled(void)
+{
+	char *env = getenv("VACCEL_METRICS_ENABLED");
+
+	return env && !strcmp(env, "enabled");
+}
+
+int metrics_bootstrap(void)
+{
+	if (metrics_enabled() || !metrics_env_enabled())
+		return VACCEL_OK;
+
+	snprintf(metrics.name, sizeof(metrics.name), "%s%d",
+			METRICS_SHM_PREFIX, getpid());
+
+	int fd = shm_open(metrics.name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		vaccel_error("Could not create metrics segment %s",
+				metrics.name);
+		return VACCEL_EIO;
+	}
+
+	int ret = VACCEL_OK;
+	size_t size = sizeof(struct metrics_shm);
+	if (ftruncate(fd, size)) {
+		ret = VACCEL_EIO;
+		goto unlink;
+	}
+
+	struct metrics_shm *shm = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			MAP_SHARED, fd, 0);
+	if (shm == MAP_FAILED) {
+		ret = VACCEL_ENOMEM;
+		goto unlink;
+	}
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	shm->version = METRICS_VERSION;
+	shm->size = size;
+	shm->pid = getpid();
+	shm->start_time = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	for (int op = 0; op < VACCEL_FUNCTIONS_NR; ++op) {
+		snprintf(shm->ops[op].name, METRICS_NAME_LEN, "%s",
+				vaccel_op_type_str(op));
+		hist_init(&shm->ops[op].latency);
+	}
+	for (int i = 0; i < METRICS_MAX_PLUGINS; ++i)
+		hist_init(&shm->plugins[i].latency);
+
+	/* Readers check the magic last */
+	__atomic_store_n(&shm->magic, METRICS_MAGIC, __ATOMIC_RELEASE);
+	__atomic_store_n(&metrics.shm, shm, __ATOMIC_RELEASE);
+	close(fd);
+
+	vaccel_info("Publishing metrics in %s", metrics.name);
+
+	/* Let the dispatching layer know it should report to us */
+	op_instr_init();
+
+	return VACCEL_OK;
+
+unlink:
+	vaccel_error("Could not set up metrics segment %s", metrics.name);
+	close(fd);
+	shm_unlink(metrics.name);
+	return ret;
+}
+
+void metrics_shutdown(void)
+{
+	if (!metrics_enabled())
+		return;
+
+	/* Operations might still be running in other threads, so the
+	 * segment stays mapped until the process exits. Removing its name
+	 * lets readers know we are gone */
+	shm_unlink(metrics.name);
+}
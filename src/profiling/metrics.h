@@ -0,0 +1,134 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __PROF_METRICS_H__
+#define __PROF_METRICS_H__
+
+#include "histogram.h"
+#include "include/ops/vaccel_ops.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Live metrics
+ *
+ * With VACCEL_METRICS_ENABLED=enabled the runtime publishes counters,
+ * in-flight gauges and latency histograms of every operation type,
+ * plugin and session in a shared memory segment named
+ * METRICS_SHM_PREFIX<pid>, which tools like vaccel-top map read-only.
+ *
+ * Every entry is protected by a seqlock: writers make its sequence
+ * number odd while they update it, and readers retry copying it until
+ * they see the same even sequence number before and after, so readers
+ * never block the runtime. Gauges are single words updated atomically
+ * outside of the seqlocks.
+ */
+#define METRICS_SHM_PREFIX "/vaccel-metrics-"
+#define METRICS_MAGIC 0x76616d74 /* "vamt" */
+#define METRICS_VERSION 1
+
+#define METRICS_NAME_LEN 32
+#define METRICS_MAX_PLUGINS 16
+#define METRICS_MAX_SESSIONS 64
+
+struct metrics_entry {
+	uint32_t seq;
+	char name[METRICS_NAME_LEN];
+
+	/* Operations running right now */
+	int64_t inflight;
+
+	/* Completed operations, failed ones and their latency (nsec) */
+	uint64_t nr_ops;
+	uint64_t nr_errors;
+	struct prof_hist latency;
+};
+
+struct metrics_session {
+	uint32_t seq;
+
+	/* Id of the session using the slot, 0 if the slot is free */
+	uint32_t id;
+
+	int64_t inflight;
+	uint64_t nr_ops;
+	uint64_t nr_errors;
+	uint64_t total_time;
+};
+
+struct metrics_shm {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t size;
+	int32_t pid;
+
+	/* CLOCK_MONOTONIC time (nsec) the segment was created */
+	uint64_t start_time;
+
+	/* Gauges of the whole process */
+	int64_t inflight;
+	int64_t async_queue;
+	int64_t nr_sessions;
+
+	/* Plugins are added as they run their first operation, and
+	 * `nr_plugins` is bumped once the name of the entry is set */
+	uint32_t nr_plugins;
+
+	struct metrics_entry ops[VACCEL_FUNCTIONS_NR];
+	struct metrics_entry plugins[METRICS_MAX_PLUGINS];
+	struct metrics_session sessions[METRICS_MAX_SESSIONS];
+};
+
+/* Copy `size` bytes of a seqlock-protected entry starting with its
+ * sequence number. Returns false if writers kept it busy */
+static inline bool metrics_snapshot(const void *entry, void *copy,
+		size_t size)
+{
+	const uint32_t *seq = (const uint32_t *)entry;
+
+	for (int tries = 0; tries < 1000; ++tries) {
+		uint32_t start = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+		if (start & 1)
+			continue;
+
+		memcpy(copy, entry, size);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if (__atomic_load_n(seq, __ATOMIC_RELAXED) == start)
+			return true;
+	}
+
+	return false;
+}
+
+/* Writer side, used by the runtime */
+bool metrics_enabled(void);
+int metrics_bootstrap(void);
+void metrics_shutdown(void);
+
+void metrics_op_begin(unsigned int op_type, const char *plugin,
+		uint32_t sess_id);
+void metrics_op_end(unsigned int op_type, const char *plugin,
+		uint32_t sess_id, uint64_t time, int ret);
+
+/* Returns true if the session is counted, in which case it must be
+ * closed with metrics_session_close() */
+bool metrics_session_open(uint32_t sess_id);
+void metrics_session_close(uint32_t sess_id);
+
+void metrics_async_queue(int depth);
+
+#endif /* __PROF_METRICS_H__ */
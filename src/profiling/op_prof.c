@@ -0,0 +1,357 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "metrics.h"
+#include "op_prof.h"
+#include "sampling.h"
+#include "vaccel_prof.h"
+
+#include "log.h"
+#include "ops/vaccel_ops.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#define OP_PROF_NAME 64
+#define OP_PROF_MAX_PLUGINS 16
+
+int op_instr_flags = OP_INSTR_UNKNOWN;
+
+static const char *op_phase_name[OP_PHASE_NR] = {
+	[OP_PHASE_LOOKUP] = "lookup",
+	[OP_PHASE_DISPATCH] = "dispatch",
+	[OP_PHASE_UNPACK] = "unpack",
+	[OP_PHASE_PLUGIN] = "plugin",
+};
+
+static struct {
+	pthread_once_t once;
+
+	/* Regions of every phase of every operation type */
+	struct vaccel_prof_region regions[VACCEL_FUNCTIONS_NR][OP_PHASE_NR];
+	char names[VACCEL_FUNCTIONS_NR][OP_PHASE_NR][OP_PROF_NAME];
+
+	/* Regions of the plugins that have run operations, keyed by the
+	 * address of their name. `key` is published once the rest of
+	 * the slot is set, and slots are never reused */
+	struct {
+		const char *key;
+		char name[OP_PROF_NAME];
+		struct vaccel_prof_region region;
+	} plugins[OP_PROF_MAX_PLUGINS];
+	pthread_mutex_t plugins_lock;
+} op_prof = {
+	.once = PTHREAD_ONCE_INIT,
+	.plugins_lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static __thread struct op_span *op_span_current;
+
+static void op_prof_init_regions(void)
+{
+	for (int op = 0; op < VACCEL_FUNCTIONS_NR; ++op) {
+		for (int phase = 0; phase < OP_PHASE_NR; ++phase) {
+			char *name = op_prof.names[op][phase];
+
+			snprintf(name, OP_PROF_NAME, "%s/%s",
+					vaccel_op_type_str(op),
+					op_phase_name[phase]);
+			op_prof.regions[op][phase] = (struct vaccel_prof_region)
+				VACCEL_PROF_REGION_INIT(name);
+		}
+	}
+}
+
+int op_instr_init(void)
+{
+	int flags = 0;
+
+	if (vaccel_prof_enabled())
+		flags |= OP_INSTR_PROF;
+	if (vaccel_trace_enabled())
+		flags |= OP_INSTR_TRACE;
+	if (metrics_enabled())
+		flags |= OP_INSTR_METRICS;
+
+	pthread_once(&op_prof.once, op_prof_init_regions);
+	__atomic_store_n(&op_instr_flags, flags, __ATOMIC_RELEASE);
+
+	return flags;
+}
+
+static struct vaccel_prof_region *op_prof_plugin_slot(const char *plugin)
+{
+	int i;
+
+	for (i = 0; i < OP_PROF_MAX_PLUGINS; ++i) {
+		const char *key = __atomic_load_n(&op_prof.plugins[i].key,
+				__ATOMIC_ACQUIRE);
+		if (!key)
+			break;
+		if (key == plugin)
+			return &op_prof.plugins[i].region;
+	}
+
+	struct vaccel_prof_region *region = NULL;
+
+	pthread_mutex_lock(&op_prof.plugins_lock);
+
+	/* Somebody might have filled in slots in the meantime */
+	for (; i < OP_PROF_MAX_PLUGINS; ++i) {
+		const char *key = op_prof.plugins[i].key;
+		if (key && key != plugin)
+			continue;
+
+		region = &op_prof.plugins[i].region;
+		if (key)
+			break;
+
+		char *name = op_prof.plugins[i].name;
+		snprintf(name, OP_PROF_NAME, "plugin/%s", plugin);
+		*region = (struct vaccel_prof_region)
+			VACCEL_PROF_REGION_INIT(name);
+		__atomic_store_n(&op_prof.plugins[i].key, plugin,
+				__ATOMIC_RELEASE);
+		break;
+	}
+
+	pthread_mutex_unlock(&op_prof.plugins_lock);
+
+	return region;
+}
+
+void op_span_begin(struct op_span *span, int flags, enum op_phase phase,
+		const struct trace_info *info)
+{
+	span->info = *info;
+	span->info.cat = op_phase_name[phase];
+	span->phase = phase;
+	span->child_time = 0;
+
+	span->parent = op_span_current;
+	op_span_current = span;
+
+	if (!span->info.sess_id && span->parent)
+		span->info.sess_id = span->parent->info.sess_id;
+
+	/* Operations are sampled as a whole, so the phases of an operation
+	 * follow the decision taken for its outermost span */
+	span->info.weight = 1;
+	if (flags & (OP_INSTR_PROF | OP_INSTR_TRACE)) {
+		span->info.weight = span->parent ?
+			span->parent->info.weight : prof_sample();
+		if (!span->info.weight)
+			flags &= ~(OP_INSTR_PROF | OP_INSTR_TRACE);
+	}
+	span->flags = flags;
+
+	if (flags & OP_INSTR_TRACE)
+		trace_begin(&span->info);
+
+	if ((flags & OP_INSTR_METRICS) && phase == OP_PHASE_PLUGIN)
+		metrics_op_begin(span->info.op_type, span->info.plugin,
+				span->info.sess_id);
+
+	span->counters.mask = 0;
+	span->child_counters.mask = 0;
+	if ((flags & OP_INSTR_PROF) &&
+			prof_counters_read(&span->counters)) {
+		span->child_counters = span->counters;
+		memset(span->child_counters.values, 0,
+				sizeof(span->child_counters.values));
+	}
+
+	if (flags & (OP_INSTR_PROF | OP_INSTR_METRICS))
+		span->start = prof_get_tstamp();
+}
+
+/* Account the counters of a span to its parent, and subtract the
+ * counters of its children from them */
+static bool op_span_counters(struct op_span *span,
+		struct prof_counters *self, struct prof_counters *total)
+{
+	if (!span->counters.mask || !prof_counters_read(total))
+		return false;
+
+	prof_counters_sub(total, &span->counters);
+
+	struct op_span *parent = span->parent;
+	if (parent && parent->child_counters.mask) {
+		for (int i = 0; i < VACCEL_PROF_COUNTERS_NR; ++i) {
+			if (total->mask & (1U << i))
+				parent->child_counters.values[i] +=
+					total->values[i];
+		}
+	}
+
+	*self = *total;
+	prof_counters_sub(self, &span->child_counters);
+
+	return true;
+}
+
+void op_span_end(struct op_span *span, int ret)
+{
+	op_span_current = span->parent;
+
+	uint64_t time = 0;
+	if (span->flags & (OP_INSTR_PROF | OP_INSTR_METRICS))
+		time = prof_get_tstamp() - span->start;
+
+	if (span->flags & OP_INSTR_PROF) {
+		uint64_t self = (time > span->child_time) ?
+			time - span->child_time : 0;
+
+		if (span->parent)
+			span->parent->child_time += time;
+
+		struct prof_counters self_counters, total_counters;
+		bool counted = op_span_counters(span, &self_counters,
+				&total_counters);
+
+		prof_region_add(&op_prof.regions[span->info.op_type][span->phase],
+				span->start, self,
+				counted ? &self_counters : NULL,
+				span->info.weight);
+
+		if (span->phase == OP_PHASE_PLUGIN && span->info.plugin) {
+			struct vaccel_prof_region *region =
+				op_prof_plugin_slot(span->info.plugin);
+			if (region)
+				prof_region_add(region, span->start, time,
+						counted ? &total_counters : NULL,
+						span->info.weight);
+		}
+	}
+
+	if ((span->flags & OP_INSTR_METRICS) && span->phase == OP_PHASE_PLUGIN)
+		metrics_op_end(span->info.op_type, span->info.plugin,
+				span->info.sess_id, time, ret);
+
+	if (span->flags & OP_INSTR_TRACE)
+		trace_end(&span->info, ret);
+}
+
+struct vaccel_prof_region *op_prof_region(unsigned int op_type,
+		enum op_phase phase)
+{
+	if (op_type >= VACCEL_FUNCTIONS_NR || phase >= OP_PHASE_NR)
+		return NULL;
+
+	pthread_once(&op_prof.once, op_prof_init_regions);
+
+	return &op_prof.regions[op_type][phase];
+}
+
+struct vaccel_prof_region *op_prof_plugin_region(const char *plugin)
+{
+	for (int i = 0; i < OP_PROF_MAX_PLUGINS; ++i) {
+		const char *key = __atomic_load_n(&op_prof.plugins[i].key,
+				__ATOMIC_ACQUIRE);
+		if (!key)
+			break;
+		if (!strcmp(op_prof.plugins[i].name + strlen("plugin/"),
+					plugin))
+			return &op_prof.plugins[i].region;
+	}
+
+	return NULL;
+}
+
+void op_prof_print(void)
+{
+	if (!vaccel_prof_enabled())
+		return;
+
+	pthread_once(&op_prof.once, op_prof_init_regions);
+
+	for (int op = 0; op < VACCEL_FUNCTIONS_NR; ++op) {
+		for (int phase = 0; phase < OP_PHASE_NR; ++phase)
+			vaccel_prof_region_print(&op_prof.regions[op][phase]);
+	}
+
+	for (int i = 0; i < OP_PROF_MAX_PLUGINS; ++i) {
+		if (!__atomic_load_n(&op_prof.plugins[i].key, __ATOMIC_ACQUIRE))
+			break;
+
+		vaccel_prof_region_print(&op_prof.plugins[i].region);
+	}
+}
+
+static int op_prof_dump_region(FILE *file,
+		const struct vaccel_prof_region *region)
+{
+	char line[1024];
+
+	int len = prof_region_snprintf(region, line, sizeof(line));
+	if (len < 0)
+		return -len;
+
+	if (len && fprintf(file, "%s\n", line) < 0)
+		return VACCEL_EIO;
+
+	return VACCEL_OK;
+}
+
+int op_prof_dump(FILE *file)
+{
+	pthread_once(&op_prof.once, op_prof_init_regions);
+
+	for (int op = 0; op < VACCEL_FUNCTIONS_NR; ++op) {
+		for (int phase = 0; phase < OP_PHASE_NR; ++phase) {
+			int ret = op_prof_dump_region(file,
+					&op_prof.regions[op][phase]);
+			if (ret)
+				return ret;
+		}
+	}
+
+	for (int i = 0; i < OP_PROF_MAX_PLUGINS; ++i) {
+		if (!__atomic_load_n(&op_prof.plugins[i].key, __ATOMIC_ACQUIRE))
+			break;
+
+		int ret = op_prof_dump_region(file,
+				&op_prof.plugins[i].region);
+		if (ret)
+			return ret;
+	}
+
+	return VACCEL_OK;
+}
+
+void op_prof_reset(void)
+{
+	struct vaccel_prof_region *regions[VACCEL_FUNCTIONS_NR * OP_PHASE_NR +
+		OP_PROF_MAX_PLUGINS];
+	int nr_regions = 0;
+
+	pthread_once(&op_prof.once, op_prof_init_regions);
+
+	for (int op = 0; op < VACCEL_FUNCTIONS_NR; ++op) {
+		for (int phase = 0; phase < OP_PHASE_NR; ++phase)
+			regions[nr_regions++] = &op_prof.regions[op][phase];
+	}
+
+	for (int i = 0; i < OP_PROF_MAX_PLUGINS; ++i) {
+		if (!__atomic_load_n(&op_prof.plugins[i].key, __ATOMIC_ACQUIRE))
+			break;
+
+		regions[nr_regions++] = &op_prof.plugins[i].region;
+	}
+
+	prof_regions_reset(regions, nr_regions);
+}
@@ -0,0 +1,117 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __PROF_OP_PROF_H__
+#define __PROF_OP_PROF_H__
+
+#include "counters.h"
+#include "trace.h"
+#include "include/vaccel_prof.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Instrumentation of operation dispatching
+ *
+ * Every operation the runtime runs goes through up to four phases,
+ * which are timed separately for every operation type:
+ * - lookup: finding the plugin implementing the operation,
+ * - dispatch: vaccel_genop() handling of the arguments,
+ * - unpack: the *_unpack function of the operation,
+ * - plugin: the plugin running the operation.
+ * Phases nest, e.g. the plugin runs from within unpack, so the time of
+ * a phase does not include the time of the phases it encloses. The
+ * plugin phase is also accounted to a region of the plugin.
+ *
+ * Spans are recorded as profiling samples if VACCEL_PROF_ENABLED is
+ * set, and as trace events if VACCEL_TRACE_ENABLED is set. Plugin
+ * spans are also published as live metrics if VACCEL_METRICS_ENABLED
+ * is set.
+ */
+enum op_phase {
+	OP_PHASE_LOOKUP = 0,
+	OP_PHASE_DISPATCH,
+	OP_PHASE_UNPACK,
+	OP_PHASE_PLUGIN,
+	OP_PHASE_NR
+};
+
+#define OP_INSTR_PROF 0x1
+#define OP_INSTR_TRACE 0x2
+#define OP_INSTR_UNKNOWN 0x4
+#define OP_INSTR_METRICS 0x8
+
+extern int op_instr_flags;
+
+/* Find out which instrumentation is enabled. This is called again
+ * whenever that changes */
+int op_instr_init(void);
+
+/* Which instrumentation is enabled. When none is, this is a single
+ * load and a branch that is predicted not taken */
+static inline int op_instr(void)
+{
+	int flags = __atomic_load_n(&op_instr_flags, __ATOMIC_ACQUIRE);
+	if (__builtin_expect(!flags, 1))
+		return 0;
+
+	return (flags & OP_INSTR_UNKNOWN) ? op_instr_init() : flags;
+}
+
+struct op_span {
+	struct trace_info info;
+	enum op_phase phase;
+	int flags;
+
+	/* Entry time and time spent in enclosed spans */
+	uint64_t start;
+	uint64_t child_time;
+
+	/* Same for hardware counters, if enabled */
+	struct prof_counters counters;
+	struct prof_counters child_counters;
+
+	/* Enclosing span of the thread */
+	struct op_span *parent;
+};
+
+/* Start a span of `phase` for the operation described by `info`, with
+ * the instrumentation in `flags`, as returned by op_instr(). If the
+ * session is unknown, it is taken from the enclosing span */
+void op_span_begin(struct op_span *span, int flags, enum op_phase phase,
+		const struct trace_info *info);
+
+/* End the last span started by the thread. `ret` is its result */
+void op_span_end(struct op_span *span, int ret);
+
+/* Profiling region of a phase of an operation type */
+struct vaccel_prof_region *op_prof_region(unsigned int op_type,
+		enum op_phase phase);
+
+/* Profiling region of the operations run by a plugin, or NULL if the
+ * plugin has not run anything */
+struct vaccel_prof_region *op_prof_plugin_region(const char *plugin);
+
+/* Print the profiling regions of operations and plugins */
+void op_prof_print(void);
+
+/* Write the profiling regions of operations and plugins that have
+ * samples to `file`, one per line */
+int op_prof_dump(FILE *file);
+
+/* Drop the samples of the regions of operations and plugins */
+void op_prof_reset(void);
+
+#endif /* __PROF_OP_PROF_H__ */
@@ -0,0 +1,415 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#define _GNU_SOURCE
+
+#include "prof_ctl.h"
+#include "op_prof.h"
+
+#include "error.h"
+#include "log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+static struct {
+	/* Serializes the runtime control functions */
+	pthread_mutex_t lock;
+
+	pthread_t thread;
+	bool running;
+
+	/* Wakes up the control thread: 's' for a signal, 'q' to exit */
+	int wakeup[2];
+
+	/* Listening control socket, if any */
+	int sock;
+	char sock_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+	/* Signal toggling profiling, if any, and its previous action */
+	int signo;
+	struct sigaction old_action;
+
+	unsigned int nr_dumps;
+} prof_ctl = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.wakeup = { -1, -1 },
+	.sock = -1,
+};
+
+static volatile sig_atomic_t prof_ctl_signaled;
+
+/* Header and profile of a dump. Called with the lock held */
+static int prof_ctl_dump(FILE *file)
+{
+	char date[64] = "";
+	time_t now = time(NULL);
+	struct tm tm;
+
+	if (localtime_r(&now, &tm))
+		strftime(date, sizeof(date), "%F %T", &tm);
+
+	fprintf(file, "# vAccel profile of pid %d, dump %u at %s\n",
+			getpid(), ++prof_ctl.nr_dumps, date);
+
+	return op_prof_dump(file);
+}
+
+int vaccel_prof_dump(const char *path)
+{
+	if (!path)
+		return VACCEL_EINVAL;
+
+	FILE *file = fopen(path, "ae");
+	if (!file) {
+		vaccel_error("[prof] Could not open %s: %s", path,
+				strerror(errno));
+		return VACCEL_EIO;
+	}
+
+	pthread_mutex_lock(&prof_ctl.lock);
+	int ret = prof_ctl_dump(file);
+	pthread_mutex_unlock(&prof_ctl.lock);
+
+	if (fclose(file) && !ret)
+		ret = VACCEL_EIO;
+
+	return ret;
+}
+
+int vaccel_prof_reset(void)
+{
+	pthread_mutex_lock(&prof_ctl.lock);
+	op_prof_reset();
+	pthread_mutex_unlock(&prof_ctl.lock);
+
+	return VACCEL_OK;
+}
+
+static void prof_ctl_dump_path(char *path, size_t size)
+{
+	char *env = getenv("VACCEL_PROF_DUMP_FILE");
+
+	if (env && *env)
+		snprintf(path, size, "%s", env);
+	else
+		snprintf(path, size, "vaccel-prof-%d.txt", getpid());
+}
+
+/* What the signal does: start a new profile, or finish and dump the
+ * current one */
+static void prof_ctl_toggle(void)
+{
+	if (!vaccel_prof_enabled()) {
+		vaccel_prof_reset();
+		vaccel_prof_set_enabled(true);
+		vaccel_info("[prof] Profiling enabled");
+		return;
+	}
+
+	char path[256];
+	prof_ctl_dump_path(path, sizeof(path));
+
+	vaccel_prof_set_enabled(false);
+	if (!vaccel_prof_dump(path))
+		vaccel_info("[prof] Profiling disabled, profile in %s", path);
+}
+
+static void prof_ctl_command(char *cmd, FILE *out)
+{
+	int ret = VACCEL_OK;
+
+	if (!strcmp(cmd, "enable")) {
+		vaccel_prof_reset();
+		vaccel_prof_set_enabled(true);
+	} else if (!strcmp(cmd, "disable")) {
+		vaccel_prof_set_enabled(false);
+	} else if (!strcmp(cmd, "reset")) {
+		vaccel_prof_reset();
+	} else if (!strcmp(cmd, "status")) {
+		fprintf(out, "%s\n", vaccel_prof_enabled() ?
+				"enabled" : "disabled");
+	} else if (!strcmp(cmd, "dump")) {
+		pthread_mutex_lock(&prof_ctl.lock);
+		ret = prof_ctl_dump(out);
+		pthread_mutex_unlock(&prof_ctl.lock);
+	} else if (!strncmp(cmd, "dump ", 5)) {
+		ret = vaccel_prof_dump(cmd + 5);
+	} else {
+		fprintf(out, "error unknown command: %s\n", cmd);
+		return;
+	}
+
+	if (ret)
+		fprintf(out, "error %d\n", ret);
+	else
+		fprintf(out, "ok\n");
+}
+
+/* Serve the commands of a client of the control socket, one per line */
+static void prof_ctl_client(void)
+{
+	int fd = accept4(prof_ctl.sock, NULL, NULL, SOCK_CLOEXEC);
+	if (fd < 0)
+		return;
+
+	/* Do not let a stuck client keep us from handling signals */
+	struct timeval timeout = { .tv_sec = 1 };
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+	FILE *in = fdopen(fd, "r");
+	if (!in) {
+		close(fd);
+		return;
+	}
+
+	int out_fd = dup(fd);
+	FILE *out = (out_fd >= 0) ? fdopen(out_fd, "w") : NULL;
+	if (!out) {
+		if (out_fd >= 0)
+			close(out_fd);
+		fclose(in);
+		return;
+	}
+
+	char line[512];
+	while (fgets(line, sizeof(line), in)) {
+		line[strcspn(line, "\r\n")] = '\0';
+		if (!*line)
+			continue;
+
+		prof_ctl_command(line, out);
+		if (fflush(out))
+			break;
+	}
+
+	fclose(out);
+	fclose(in);
+}
+
+static void *prof_ctl_thread(void *arg)
+{
+	(void)arg;
+
+	while (true) {
+		struct pollfd fds[2] = {
+			{ .fd = prof_ctl.wakeup[0], .events = POLLIN },
+			{ .fd = prof_ctl.sock, .events = POLLIN },
+		};
+
+		if (poll(fds, (prof_ctl.sock >= 0) ? 2 : 1, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+
+			vaccel_error("[prof] Control thread failed: %s",
+					strerror(errno));
+			break;
+		}
+
+		bool quit = false;
+		if (fds[0].revents & POLLIN) {
+			char buf[64];
+			ssize_t len;
+
+			while ((len = read(prof_ctl.wakeup[0], buf,
+							sizeof(buf))) > 0)
+				quit |= memchr(buf, 'q', len) != NULL;
+		}
+
+		if (quit)
+			break;
+
+		if (prof_ctl_signaled) {
+			prof_ctl_signaled = 0;
+			prof_ctl_toggle();
+		}
+
+		if (fds[1].revents & POLLIN)
+			prof_ctl_client();
+	}
+
+	return NULL;
+}
+
+static void prof_ctl_signal(int signo)
+{
+	(void)signo;
+
+	int saved_errno = errno;
+
+	prof_ctl_signaled = 1;
+	ssize_t ret = write(prof_ctl.wakeup[1], "s", 1);
+	(void)ret;
+
+	errno = saved_errno;
+}
+
+static int prof_ctl_parse_signal(const char *name)
+{
+	if (!strncmp(name, "SIG", 3))
+		name += 3;
+
+	if (!strcmp(name, "USR1"))
+		return SIGUSR1;
+	if (!strcmp(name, "USR2"))
+		return SIGUSR2;
+
+	int signo = atoi(name);
+	return (signo > 0 && signo < NSIG) ? signo : 0;
+}
+
+static int prof_ctl_setup_signal(const char *name)
+{
+	int signo = prof_ctl_parse_signal(name);
+	if (!signo) {
+		vaccel_warn("[prof] Invalid VACCEL_PROF_SIGNAL: %s", name);
+		return VACCEL_EINVAL;
+	}
+
+	/* Do not take the signal over from the application, whether it
+	 * handles the signal or ignores it */
+	struct sigaction action;
+	if (sigaction(signo, NULL, &action))
+		return VACCEL_EINVAL;
+
+	if ((action.sa_flags & SA_SIGINFO) || action.sa_handler != SIG_DFL) {
+		vaccel_warn("[prof] Signal %d is already handled", signo);
+		return VACCEL_EBUSY;
+	}
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = prof_ctl_signal;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+
+	if (sigaction(signo, &action, &prof_ctl.old_action))
+		return VACCEL_EINVAL;
+
+	prof_ctl.signo = signo;
+	vaccel_debug("[prof] Signal %d toggles profiling", signo);
+
+	return VACCEL_OK;
+}
+
+static int prof_ctl_setup_socket(const char *path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		vaccel_warn("[prof] Control socket path too long: %s", path);
+		return VACCEL_ENAMETOOLONG;
+	}
+	strcpy(addr.sun_path, path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return VACCEL_EIO;
+
+	/* Only the owner of the process gets to control it */
+	mode_t mask = umask(0077);
+	int ret = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+	umask(mask);
+
+	if (ret || listen(fd, 4)) {
+		vaccel_warn("[prof] Could not listen on %s: %s", path,
+				strerror(errno));
+		close(fd);
+		return VACCEL_EIO;
+	}
+
+	prof_ctl.sock = fd;
+	strcpy(prof_ctl.sock_path, path);
+	vaccel_debug("[prof] Listening for commands on %s", path);
+
+	return VACCEL_OK;
+}
+
+int prof_ctl_bootstrap(void)
+{
+	char *signal_env = getenv("VACCEL_PROF_SIGNAL");
+	char *socket_env = getenv("VACCEL_PROF_CONTROL");
+
+	if (prof_ctl.running || (!signal_env && !socket_env))
+		return VACCEL_OK;
+
+	if (pipe2(prof_ctl.wakeup, O_NONBLOCK | O_CLOEXEC))
+		return VACCEL_EIO;
+
+	if (socket_env)
+		prof_ctl_setup_socket(socket_env);
+
+	if (signal_env)
+		prof_ctl_setup_signal(signal_env);
+
+	if (prof_ctl.sock < 0 && !prof_ctl.signo)
+		goto close_pipe;
+
+	if (pthread_create(&prof_ctl.thread, NULL, prof_ctl_thread, NULL)) {
+		vaccel_error("[prof] Could not start control thread");
+		prof_ctl_shutdown();
+		return VACCEL_ENOMEM;
+	}
+
+	prof_ctl.running = true;
+
+	return VACCEL_OK;
+
+close_pipe:
+	close(prof_ctl.wakeup[0]);
+	close(prof_ctl.wakeup[1]);
+	prof_ctl.wakeup[0] = prof_ctl.wakeup[1] = -1;
+	return VACCEL_EINVAL;
+}
+
+void prof_ctl_shutdown(void)
+{
+	if (prof_ctl.signo) {
+		sigaction(prof_ctl.signo, &prof_ctl.old_action, NULL);
+		prof_ctl.signo = 0;
+	}
+
+	if (prof_ctl.running) {
+		ssize_t ret = write(prof_ctl.wakeup[1], "q", 1);
+		(void)ret;
+
+		pthread_join(prof_ctl.thread, NULL);
+		prof_ctl.running = false;
+	}
+
+	if (prof_ctl.sock >= 0) {
+		close(prof_ctl.sock);
+		unlink(prof_ctl.sock_path);
+		prof_ctl.sock = -1;
+	}
+
+	if (prof_ctl.wakeup[0] >= 0) {
+		close(prof_ctl.wakeup[0]);
+		close(prof_ctl.wakeup[1]);
+		prof_ctl.wakeup[0] = prof_ctl.wakeup[1] = -1;
+	}
+}
@@ -0,0 +1,40 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __PROF_CTL_H__
+#define __PROF_CTL_H__
+
+/* Runtime control of profiling
+ *
+ * Profiling of a running process can be switched on and off, and its
+ * results dumped, without restarting it:
+ * - VACCEL_PROF_SIGNAL=<signal> installs a handler for the signal
+ *   (e.g. USR2 or 12), which toggles profiling. Enabling it drops the
+ *   samples recorded so far, and disabling it appends the profile to
+ *   VACCEL_PROF_DUMP_FILE (default: vaccel-prof-<pid>.txt).
+ * - VACCEL_PROF_CONTROL=<path> listens on a Unix socket at <path> for
+ *   the commands "enable", "disable", "reset", "status", "dump", which
+ *   replies with the profile, and "dump <file>", one per line. Replies
+ *   end with a line reading "ok" or "error ...".
+ *
+ * Commands run in a control thread that sleeps until triggered, and the
+ * signal handler only sets a flag and wakes it up, so there is no
+ * overhead while profiling is off.
+ */
+
+int prof_ctl_bootstrap(void);
+void prof_ctl_shutdown(void);
+
+#endif /* __PROF_CTL_H__ */
@@ -0,0 +1,152 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "sampling.h"
+
+#include "log.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* Upper bound of VACCEL_PROF_SAMPLE and of VACCEL_PROF_SAMPLE_PERIOD */
+#define PROF_SAMPLE_MAX_RATE (1 << 30)
+#define PROF_SAMPLE_MAX_PERIOD 60000000
+
+int prof_sample_mode = PROF_SAMPLE_UNKNOWN;
+
+static struct {
+	/* 1/rate of the calls are measured, those for which a random
+	 * number falls below `threshold` */
+	uint64_t rate;
+	uint64_t threshold;
+
+	/* Period (nsec) of periodic sampling */
+	uint64_t period;
+} prof_sampling;
+
+static __thread struct {
+	/* xorshift64* state, 0 until seeded */
+	uint64_t rng;
+
+	/* Calls since the previous measurement, and when the next one is
+	 * due (nsec) */
+	uint64_t calls;
+	uint64_t next;
+} prof_sampler;
+
+static long env_to_long(const char *name, long max)
+{
+	char *env = getenv(name);
+	if (!env)
+		return 0;
+
+	long val = atol(env);
+	if (val <= 0)
+		return 0;
+
+	return (val > max) ? max : val;
+}
+
+int prof_sample_init(void)
+{
+	long rate = env_to_long("VACCEL_PROF_SAMPLE", PROF_SAMPLE_MAX_RATE);
+	long period = env_to_long("VACCEL_PROF_SAMPLE_PERIOD",
+			PROF_SAMPLE_MAX_PERIOD);
+	int mode = PROF_SAMPLE_ALL;
+
+	if (rate > 1) {
+		prof_sampling.rate = rate;
+		prof_sampling.threshold = UINT64_MAX / rate;
+		mode = PROF_SAMPLE_RATE;
+		vaccel_debug("[prof] Measuring 1 in %ld calls", rate);
+	} else if (period) {
+		prof_sampling.period = period * 1000;
+		mode = PROF_SAMPLE_PERIOD;
+		vaccel_debug("[prof] Measuring a call every %ld usec per thread",
+				period);
+	}
+
+	/* Publish the settings along with the mode */
+	__atomic_store_n(&prof_sample_mode, mode, __ATOMIC_RELEASE);
+
+	return mode;
+}
+
+static uint64_t prof_sample_random(void)
+{
+	uint64_t x = prof_sampler.rng;
+
+	if (!x) {
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		x = ((uintptr_t)&prof_sampler ^ ts.tv_nsec ^
+				((uint64_t)ts.tv_sec << 32)) | 1;
+	}
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	prof_sampler.rng = x;
+
+	return x * 0x2545f4914f6cdd1dULL;
+}
+
+/* The coarse clock is served from the vDSO without reading the
+ * hardware clock, and its resolution is fine for periods */
+static uint64_t prof_sample_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint64_t prof_sample_slow(void)
+{
+	int mode = __atomic_load_n(&prof_sample_mode, __ATOMIC_ACQUIRE);
+	if (mode == PROF_SAMPLE_UNKNOWN)
+		mode = prof_sample_init();
+
+	switch (mode) {
+	case PROF_SAMPLE_RATE:
+		if (prof_sample_random() >= prof_sampling.threshold)
+			return 0;
+
+		return prof_sampling.rate;
+	case PROF_SAMPLE_PERIOD: {
+		prof_sampler.calls++;
+
+		uint64_t now = prof_sample_now();
+		if (now < prof_sampler.next)
+			return 0;
+
+		uint64_t weight = prof_sampler.calls;
+		prof_sampler.calls = 0;
+		prof_sampler.next = now + prof_sampling.period;
+
+		return weight;
+	}
+	default:
+		return 1;
+	}
+}
+
+uint64_t prof_sample_weight(void)
+{
+	int mode = __atomic_load_n(&prof_sample_mode, __ATOMIC_ACQUIRE);
+
+	return (mode == PROF_SAMPLE_RATE) ? prof_sampling.rate : 1;
+}
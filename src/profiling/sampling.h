@@ -0,0 +1,68 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __PROF_SAMPLING_H__
+#define __PROF_SAMPLING_H__
+
+#include <stdint.h>
+
+/* Sampled profiling
+ *
+ * By default every call into a profiling region is measured. To bound
+ * the overhead at high call rates, only some calls can be measured:
+ * - VACCEL_PROF_SAMPLE=<n> measures every call with probability 1/n,
+ *   accounting each measurement as n calls.
+ * - VACCEL_PROF_SAMPLE_PERIOD=<usec> makes every thread measure its
+ *   first call after each period, accounting the measurement as all
+ *   the calls the thread made since its previous measurement.
+ * Counts, totals, percentiles and hardware counters are extrapolated
+ * from the weights of the measurements, so reports estimate what
+ * measuring every call would have shown. Random sampling is unbiased;
+ * periodic sampling is unbiased as long as call durations do not
+ * correlate with the period.
+ *
+ * Operations are sampled as a whole: all the phases of an operation,
+ * and its trace events, are recorded or none are.
+ */
+enum prof_sample_mode {
+	PROF_SAMPLE_UNKNOWN = -1,
+	PROF_SAMPLE_ALL = 0,
+	PROF_SAMPLE_RATE,
+	PROF_SAMPLE_PERIOD,
+};
+
+extern int prof_sample_mode;
+
+/* Read the sampling settings from the environment */
+int prof_sample_init(void);
+
+uint64_t prof_sample_slow(void);
+
+/* Whether to measure the next call. Returns the number of calls the
+ * measurement stands for, or 0 if the call should not be measured */
+static inline uint64_t prof_sample(void)
+{
+	if (__builtin_expect(__atomic_load_n(&prof_sample_mode,
+					__ATOMIC_RELAXED) == PROF_SAMPLE_ALL, 1))
+		return 1;
+
+	return prof_sample_slow();
+}
+
+/* Number of calls a measurement stands for when the decision to take
+ * it has been lost, e.g. because too many regions are nested */
+uint64_t prof_sample_weight(void);
+
+#endif /* __PROF_SAMPLING_H__ */
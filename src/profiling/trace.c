@@ -0,0 +1,312 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "trace.h"
+#include "clock.h"
+
+#include "log.h"
+#include "error.h"
+#include "ops/vaccel_ops.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TRACE_DEFAULT_EVENTS (1 << 16)
+#define TRACE_MAX_EVENTS (1 << 24)
+#define TRACE_PLUGIN_NAME 32
+
+struct trace_record {
+	uint64_t tstamp;
+	uint64_t read_bytes;
+	uint64_t write_bytes;
+	uint64_t weight;
+	const char *cat;
+	uint32_t tid;
+	uint32_t sess_id;
+	int32_t ret;
+	uint16_t op_type;
+	char phase;
+	char plugin[TRACE_PLUGIN_NAME];
+};
+
+struct trace_event {
+	/* Position of the event in the stream plus one, or 0 while the
+	 * event is being written */
+	_Atomic uint64_t seq;
+	struct trace_record rec;
+};
+
+struct trace_ring {
+	uint64_t mask;
+	struct trace_event events[];
+};
+
+static struct {
+	/* -1 until we have looked at the environment */
+	_Atomic int enabled;
+
+	/* Allocated on the first event */
+	struct trace_ring *_Atomic ring;
+
+	/* Number of events recorded so far */
+	_Atomic uint64_t head;
+} trace_state = {
+	.enabled = -1,
+};
+
+static __thread uint32_t trace_tid;
+
+/* Same clock as profiling, so that traces line up with samples */
+static inline uint64_t get_tstamp_nsec(void)
+{
+	return prof_clock_nsec();
+}
+
+bool vaccel_trace_enabled(void)
+{
+	int enabled = atomic_load_explicit(&trace_state.enabled,
+			memory_order_relaxed);
+	if (enabled >= 0)
+		return enabled;
+
+	char *env = getenv("VACCEL_TRACE_ENABLED");
+	enabled = env && !strncmp(env, "enabled", 7);
+	atomic_store_explicit(&trace_state.enabled, enabled,
+			memory_order_relaxed);
+
+	return enabled;
+}
+
+static size_t trace_ring_size(void)
+{
+	char *env = getenv("VACCEL_TRACE_BUFFER");
+	long nr = env ? atol(env) : 0;
+	if (nr <= 0)
+		return TRACE_DEFAULT_EVENTS;
+	if (nr > TRACE_MAX_EVENTS)
+		nr = TRACE_MAX_EVENTS;
+
+	/* Round up to a power of two, so that positions wrap around
+	 * with a mask */
+	size_t size = 1;
+	while (size < (size_t)nr)
+		size <<= 1;
+
+	return size;
+}
+
+static struct trace_ring *trace_ring(void)
+{
+	struct trace_ring *ring = atomic_load_explicit(&trace_state.ring,
+			memory_order_acquire);
+	if (ring)
+		return ring;
+
+	size_t size = trace_ring_size();
+	struct trace_ring *new_ring = calloc(1, sizeof(*new_ring) +
+			size * sizeof(new_ring->events[0]));
+	if (!new_ring) {
+		vaccel_error("[trace] Could not allocate trace buffer");
+		return NULL;
+	}
+
+	new_ring->mask = size - 1;
+
+	/* Somebody else might have beaten us to it */
+	if (!atomic_compare_exchange_strong(&trace_state.ring, &ring,
+				new_ring)) {
+		free(new_ring);
+		return ring;
+	}
+
+	vaccel_debug("[trace] Tracing up to %zu events", size);
+
+	return new_ring;
+}
+
+static void trace_record(char phase, const struct trace_info *info, int ret)
+{
+	struct trace_ring *ring = trace_ring();
+	if (!ring)
+		return;
+
+	if (!trace_tid)
+		trace_tid = syscall(SYS_gettid);
+
+	/* Claim a slot. When the ring is full this overwrites the oldest
+	 * event, which readers detect through its sequence number */
+	uint64_t pos = atomic_fetch_add_explicit(&trace_state.head, 1,
+			memory_order_relaxed);
+	struct trace_event *ev = &ring->events[pos & ring->mask];
+
+	atomic_store_explicit(&ev->seq, 0, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	struct trace_record *rec = &ev->rec;
+	rec->tstamp = get_tstamp_nsec();
+	rec->read_bytes = info->read_bytes;
+	rec->write_bytes = info->write_bytes;
+	rec->weight = info->weight;
+	rec->cat = info->cat;
+	rec->tid = trace_tid;
+	rec->sess_id = info->sess_id;
+	rec->ret = ret;
+	rec->op_type = info->op_type;
+	rec->phase = phase;
+	if (info->plugin)
+		snprintf(rec->plugin, sizeof(rec->plugin), "%s", info->plugin);
+	else
+		rec->plugin[0] = '\0';
+
+	atomic_store_explicit(&ev->seq, pos + 1, memory_order_release);
+}
+
+void trace_begin(const struct trace_info *info)
+{
+	trace_record('B', info, 0);
+}
+
+void trace_end(const struct trace_info *info, int ret)
+{
+	trace_record('E', info, ret);
+}
+
+/* Copy an event out of the ring. Returns false if the event has been
+ * overwritten or is still being written */
+static bool trace_read(struct trace_ring *ring, uint64_t pos,
+		struct trace_record *rec)
+{
+	struct trace_event *ev = &ring->events[pos & ring->mask];
+
+	if (atomic_load_explicit(&ev->seq, memory_order_acquire) != pos + 1)
+		return false;
+
+	*rec = ev->rec;
+	atomic_thread_fence(memory_order_acquire);
+
+	return atomic_load_explicit(&ev->seq, memory_order_relaxed) == pos + 1;
+}
+
+static void trace_write_str(FILE *fp, const char *str)
+{
+	fputc('"', fp);
+	for (; *str; ++str) {
+		if (*str == '"' || *str == '\\')
+			fputc('\\', fp);
+		if ((unsigned char)*str >= 0x20)
+			fputc(*str, fp);
+	}
+	fputc('"', fp);
+}
+
+static void trace_write_event(FILE *fp, const struct trace_record *rec,
+		int pid)
+{
+	const char *name = (rec->op_type < VACCEL_FUNCTIONS_NR) ?
+		vaccel_op_type_str(rec->op_type) : "unknown";
+
+	fprintf(fp, "{\"name\":");
+	trace_write_str(fp, name);
+	fprintf(fp, ",\"cat\":\"%s\",\"ph\":\"%c\","
+			"\"ts\":%ju.%03ju,\"pid\":%d,\"tid\":%u,\"args\":{",
+			rec->cat, rec->phase,
+			(uintmax_t)(rec->tstamp / 1000),
+			(uintmax_t)(rec->tstamp % 1000), pid, rec->tid);
+
+	if (rec->phase == 'B') {
+		fprintf(fp, "\"session\":%u,\"plugin\":", rec->sess_id);
+		trace_write_str(fp, rec->plugin);
+		fprintf(fp, ",\"read_bytes\":%ju,\"write_bytes\":%ju",
+				(uintmax_t)rec->read_bytes,
+				(uintmax_t)rec->write_bytes);
+		if (rec->weight > 1)
+			fprintf(fp, ",\"weight\":%ju",
+					(uintmax_t)rec->weight);
+	} else {
+		fprintf(fp, "\"ret\":%d", rec->ret);
+	}
+
+	fprintf(fp, "}}");
+}
+
+int vaccel_trace_flush(const char *path)
+{
+	char default_path[64];
+
+	if (!path)
+		path = getenv("VACCEL_TRACE_FILE");
+	if (!path) {
+		snprintf(default_path, sizeof(default_path),
+				"vaccel-trace-%d.json", getpid());
+		path = default_path;
+	}
+
+	FILE *fp = fopen(path, "w");
+	if (!fp) {
+		vaccel_error("[trace] Could not open %s", path);
+		return VACCEL_EIO;
+	}
+
+	int pid = getpid();
+	fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+			"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+			"\"args\":{\"name\":\"vaccel\"}}", pid);
+
+	size_t nr_events = 0;
+	struct trace_ring *ring = atomic_load_explicit(&trace_state.ring,
+			memory_order_acquire);
+	if (ring) {
+		uint64_t head = atomic_load_explicit(&trace_state.head,
+				memory_order_acquire);
+		uint64_t size = ring->mask + 1;
+		uint64_t first = (head > size) ? head - size : 0;
+
+		for (uint64_t pos = first; pos < head; ++pos) {
+			struct trace_record rec;
+			if (!trace_read(ring, pos, &rec))
+				continue;
+
+			fprintf(fp, ",\n");
+			trace_write_event(fp, &rec, pid);
+			nr_events++;
+		}
+	}
+
+	fprintf(fp, "\n]}\n");
+
+	if (fclose(fp)) {
+		vaccel_error("[trace] Could not write %s", path);
+		return VACCEL_EIO;
+	}
+
+	vaccel_info("[trace] Wrote %zu events to %s", nr_events, path);
+
+	return VACCEL_OK;
+}
+
+void trace_shutdown(void)
+{
+	if (!atomic_load(&trace_state.ring))
+		return;
+
+	/* The buffer is not freed, as other threads might still be
+	 * recording events while the process exits */
+	vaccel_trace_flush(NULL);
+}
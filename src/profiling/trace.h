@@ -0,0 +1,52 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __PROF_TRACE_H__
+#define __PROF_TRACE_H__
+
+#include "include/vaccel_trace.h"
+
+#include <stdint.h>
+
+struct trace_info {
+	/* Category of the event. This needs to be a static string */
+	const char *cat;
+
+	/* Operation the event is about */
+	uint32_t sess_id;
+	unsigned int op_type;
+
+	/* Plugin running the operation, if known */
+	const char *plugin;
+
+	/* Total size of the read and write arguments, if known */
+	uint64_t read_bytes;
+	uint64_t write_bytes;
+
+	/* Number of operations the event stands for when sampling */
+	uint64_t weight;
+};
+
+/* Record the beginning of a traced span */
+void trace_begin(const struct trace_info *info);
+
+/* Record the end of the span started by the last trace_begin() of the
+ * thread with the same category. `ret` is the result of the span */
+void trace_end(const struct trace_info *info, int ret);
+
+/* Write out the trace at exit */
+void trace_shutdown(void);
+
+#endif /* __PROF_TRACE_H__ */
@@ -12,91 +12,686 @@
  * limitations under the License.
  */
 
+
 #include "vaccel_prof.h"
+#include "clock.h"
+#include "counters.h"
+#include "histogram.h"
+#include "op_prof.h"
+#include "sampling.h"
 
 #include "log.h"
 #include "error.h"
 
-#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
 #include <string.h>
 #include <time.h>
 
-#define MIN_SAMPLES 1024
 #define MAX_NAME 256
 
-static uint64_t get_tstamp_nsec(void)
+/* Upper bound of VACCEL_PROF_SAMPLES */
+#define PROF_MAX_RING (1 << 24)
+
+/* Maximum nesting of vaccel_prof_region_start() calls for the same
+ * region on a thread */
+#define PROF_MAX_OPEN 32
+
+/* Size of the per-thread cache of buffers */
+#define PROF_TCACHE_SIZE 16
+
+/* Maximum number of vaccel_prof_region_enter() calls a thread can be
+ * in at once while collecting hardware counters */
+#define PROF_MAX_PENDING 32
+
+#define PROF_DETACHED UINT64_MAX
+
+struct vaccel_prof_thread_buf {
+	/* Next buffer of the region */
+	struct vaccel_prof_thread_buf *next;
+
+	/* Id of the thread owning the buffer, 0 once it has exited or
+	 * PROF_DETACHED once it has been removed from its region */
+	_Atomic uint64_t owner;
+
+	/* Next buffer owned by the same thread */
+	struct vaccel_prof_thread_buf *thread_next;
+
+	/* Distribution of the time spent in the region, extrapolated from
+	 * the `nr_sampled` measured entries */
+	struct prof_hist hist;
+	uint64_t nr_sampled;
+
+	/* The last `prof_ring_size` raw samples, if enabled. `nr_samples`
+	 * is published after the sample it accounts for has been
+	 * written */
+	struct vaccel_prof_sample *ring;
+	_Atomic size_t nr_samples;
+
+	/* Hardware counter totals, if enabled */
+	uint64_t counter_totals[VACCEL_PROF_COUNTERS_NR];
+	uint64_t nr_counted;
+	uint32_t counters;
+
+	/* Regions entered with vaccel_prof_region_start(), and the number
+	 * of calls each entry stands for, 0 if it is not measured */
+	uint64_t open[PROF_MAX_OPEN];
+	uint64_t open_weight[PROF_MAX_OPEN];
+	struct prof_counters open_counters[PROF_MAX_OPEN];
+	int nr_open;
+};
+
+/* -1 until we have looked at the environment */
+static _Atomic int prof_enabled = -1;
+
+/* Number of raw samples kept per thread and region, -1 until we have
+ * looked at the environment */
+static _Atomic long prof_ring_size = -1;
+
+/* Bumped whenever buffers are freed, invalidating the per-thread
+ * caches */
+static _Atomic uint64_t prof_epoch;
+
+/* Threads walking the buffers of a region, counted in the slot of the
+ * phase they started in. Buffers retired by prof_regions_reset() are
+ * freed once the walks that might have seen them are over */
+static _Atomic uint64_t prof_walk_phase;
+static _Atomic long prof_walkers[2];
+
+/* Serializes waiting for walks */
+static pthread_mutex_t prof_walk_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static _Atomic uint64_t prof_next_thread_id = 1;
+static pthread_key_t prof_thread_key;
+static pthread_once_t prof_thread_once = PTHREAD_ONCE_INIT;
+
+static __thread uint64_t prof_thread_id;
+
+/* Buffers owned by this thread */
+static __thread struct vaccel_prof_thread_buf *prof_thread_bufs;
+
+static __thread struct {
+	const struct vaccel_prof_region *region;
+	struct vaccel_prof_thread_buf *buf;
+	uint64_t epoch;
+} prof_tcache[PROF_TCACHE_SIZE];
+
+/* Counters at the time of vaccel_prof_region_enter() calls, and the
+ * number of calls each entry stands for when sampling, matched by
+ * region and token on exit */
+static __thread struct {
+	const struct vaccel_prof_region *region;
+	vaccel_prof_token_t token;
+	struct prof_counters counters;
+	uint64_t weight;
+} prof_pending[PROF_MAX_PENDING];
+static __thread int prof_nr_pending;
+
+static inline uint64_t get_tstamp_nsec(void)
 {
-	struct timespec tp;
-
-	clock_gettime(CLOCK_MONOTONIC_RAW, &tp);
-
-	return tp.tv_sec * 1e9 + tp.tv_nsec;
+	return prof_clock_nsec();
 }
 
 bool vaccel_prof_enabled(void)
 {
+	int enabled = atomic_load_explicit(&prof_enabled,
+			memory_order_relaxed);
+	if (enabled >= 0)
+		return enabled;
+
 	char *env = getenv("VACCEL_PROF_ENABLED");
+	enabled = env && !strncmp(env, "enabled", 7);
+	atomic_store_explicit(&prof_enabled, enabled, memory_order_relaxed);
 
-	return env && !strncmp(env, "enabled", 7);
+	return enabled;
 }
 
-static void prof_sample_start(struct vaccel_prof_sample *sample)
+int vaccel_prof_set_enabled(bool enabled)
 {
-	sample->start = get_tstamp_nsec();
+	atomic_store_explicit(&prof_enabled, enabled, memory_order_relaxed);
+
+	/* Let the dispatching layer pick up the change */
+	op_instr_init();
+
+	return VACCEL_OK;
 }
 
-static void prof_sample_stop(struct vaccel_prof_sample *sample)
+/* VACCEL_PROF_SAMPLES=<n> keeps the last <n> samples of each thread in
+ * every region, on top of the histograms */
+static size_t prof_ring_capacity(void)
 {
-	sample->time = get_tstamp_nsec() - sample->start;
+	long size = atomic_load_explicit(&prof_ring_size, memory_order_relaxed);
+	if (size >= 0)
+		return size;
+
+	char *env = getenv("VACCEL_PROF_SAMPLES");
+	size = env ? atol(env) : 0;
+	if (size < 0)
+		size = 0;
+	if (size > PROF_MAX_RING)
+		size = PROF_MAX_RING;
+
+	atomic_store_explicit(&prof_ring_size, size, memory_order_relaxed);
+
+	return size;
 }
 
-static int grow_samples_array(struct vaccel_prof_region *region)
+static unsigned int prof_walk_begin(void)
 {
-	size_t alloc_size = (region->size) ? region->size * 2 : MIN_SAMPLES;
+	unsigned int idx = atomic_load(&prof_walk_phase) & 1;
 
-	struct vaccel_prof_sample *new_ptr =
-		realloc(region->samples, alloc_size * sizeof(*new_ptr));
-	if (!new_ptr)
-		return VACCEL_ENOMEM;
+	/* Ordered before loading the head of the buffer list */
+	atomic_fetch_add(&prof_walkers[idx], 1);
 
-	region->samples = new_ptr;
-	region->size = alloc_size;
+	return idx;
+}
 
-	return VACCEL_OK;
+static void prof_walk_end(unsigned int idx)
+{
+	atomic_fetch_sub_explicit(&prof_walkers[idx], 1, memory_order_release);
 }
 
-/* This will return that last used sample entry or NULL if no entries
- * have been used */
-static struct vaccel_prof_sample *get_last_sample(
-		const struct vaccel_prof_region *region
-) {
-	size_t size = region->nr_entries;
+/* Wait for the walks that started before the buffer lists were detached
+ *
+ * Walks that started after that only see the new lists, so we only need
+ * to wait for the counts of the current phase and of the one before to
+ * drain. New walks are moved to the other slot before each wait, so
+ * that they cannot hold us back. Called with `prof_walk_lock` held. */
+static void prof_walk_sync(void)
+{
+	for (int i = 0; i < 2; ++i) {
+		uint64_t phase = atomic_fetch_add(&prof_walk_phase, 1);
 
-	if (!size)
-		return NULL;
+		while (atomic_load(&prof_walkers[phase & 1]))
+			sched_yield();
+	}
+}
+
+static void prof_buf_free(struct vaccel_prof_thread_buf *buf)
+{
+	free(buf->ring);
+	free(buf);
+}
+
+/* Hand the buffers of an exiting thread over to future threads, and
+ * free the ones that are not part of a region anymore, once nobody can
+ * be walking past them */
+static void prof_thread_exit(void *data)
+{
+	struct vaccel_prof_thread_buf *buf = data, *detached = NULL;
+
+	while (buf) {
+		struct vaccel_prof_thread_buf *next = buf->thread_next;
+
+		if (atomic_exchange(&buf->owner, 0) == PROF_DETACHED) {
+			buf->thread_next = detached;
+			detached = buf;
+		}
+
+		buf = next;
+	}
+
+	if (!detached)
+		return;
 
-	return &region->samples[size - 1];
+	pthread_mutex_lock(&prof_walk_lock);
+	prof_walk_sync();
+	pthread_mutex_unlock(&prof_walk_lock);
+
+	while (detached) {
+		struct vaccel_prof_thread_buf *next = detached->thread_next;
+		prof_buf_free(detached);
+		detached = next;
+	}
 }
 
-/* Get next available profiling sample entry
+static void prof_thread_key_create(void)
+{
+	pthread_key_create(&prof_thread_key, prof_thread_exit);
+}
+
+static uint64_t prof_thread_self(void)
+{
+	if (!prof_thread_id) {
+		pthread_once(&prof_thread_once, prof_thread_key_create);
+		prof_thread_id = atomic_fetch_add(&prof_next_thread_id, 1);
+	}
+
+	return prof_thread_id;
+}
+
+static void prof_thread_own(struct vaccel_prof_thread_buf *buf)
+{
+	buf->thread_next = prof_thread_bufs;
+	prof_thread_bufs = buf;
+	pthread_setspecific(prof_thread_key, prof_thread_bufs);
+}
+
+/* Find the buffer of the current thread for `region`
  *
- * This will return the first unused sample entry. If needed it will
- * grow the capacity of the array */
-static struct vaccel_prof_sample *get_next_sample(
-		struct vaccel_prof_region *region
+ * If the thread does not have one yet and `create` is set, it will
+ * take over a buffer of a thread that has exited or allocate a new
+ * one. Only the owner of a buffer writes to it, so no locking is needed
+ * for recording samples. */
+static struct vaccel_prof_thread_buf *prof_thread_buf(
+		const struct vaccel_prof_region *region,
+		bool create
 ) {
-	size_t pos = region->nr_entries;
+	uint64_t self = prof_thread_self();
+	uint64_t epoch = atomic_load_explicit(&prof_epoch,
+			memory_order_acquire);
+	unsigned int slot = ((uintptr_t)region >> 4) % PROF_TCACHE_SIZE;
+
+	if (prof_tcache[slot].region == region &&
+			prof_tcache[slot].epoch == epoch)
+		return prof_tcache[slot].buf;
+
+	struct vaccel_prof_region *r = (struct vaccel_prof_region *)region;
+	struct vaccel_prof_thread_buf *buf, *orphan = NULL;
+
+	unsigned int walk = prof_walk_begin();
+
+	buf = __atomic_load_n(&r->bufs, __ATOMIC_ACQUIRE);
+	for (; buf; buf = buf->next) {
+		uint64_t owner = atomic_load(&buf->owner);
+		if (owner == self)
+			break;
+
+		if (!owner && !orphan)
+			orphan = buf;
+	}
+
+	/* Once we own it, the buffer cannot be retired */
+	uint64_t none = 0;
+	if (!buf && create && orphan &&
+			atomic_compare_exchange_strong(&orphan->owner, &none,
+				self)) {
+		buf = orphan;
+		buf->nr_open = 0;
+		prof_thread_own(buf);
+	}
+
+	prof_walk_end(walk);
+
+	if (buf)
+		goto found;
+
+	if (!create)
+		return NULL;
 
-	/* The array is full. Try to grow it */
-	if (pos >= region->size)
-		if (grow_samples_array(region) != VACCEL_OK)
+	buf = calloc(1, sizeof(*buf));
+	if (!buf)
+		return NULL;
+
+	size_t ring_size = prof_ring_capacity();
+	if (ring_size) {
+		buf->ring = malloc(ring_size * sizeof(*buf->ring));
+		if (!buf->ring) {
+			free(buf);
 			return NULL;
+		}
+	}
+
+	atomic_init(&buf->owner, self);
+	atomic_init(&buf->nr_samples, 0);
+	hist_init(&buf->hist);
+
+	buf->next = __atomic_load_n(&r->bufs, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&r->bufs, &buf->next, buf, false,
+				__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		;
+
+	prof_thread_own(buf);
+
+found:
+	prof_tcache[slot].region = region;
+	prof_tcache[slot].buf = buf;
+	prof_tcache[slot].epoch = epoch;
+
+	return buf;
+}
+
+static int prof_buf_add(struct vaccel_prof_thread_buf *buf, uint64_t start,
+		uint64_t time, uint64_t weight)
+{
+	hist_record_n(&buf->hist, time, weight);
+	__atomic_store_n(&buf->nr_sampled, buf->nr_sampled + 1,
+			__ATOMIC_RELAXED);
+
+	if (!buf->ring)
+		return VACCEL_OK;
+
+	size_t nr = atomic_load_explicit(&buf->nr_samples,
+			memory_order_relaxed);
+	size_t pos = nr % prof_ring_capacity();
+
+	buf->ring[pos].start = start;
+	buf->ring[pos].time = time;
+	atomic_store_explicit(&buf->nr_samples, nr + 1, memory_order_release);
+
+	return VACCEL_OK;
+}
+
+static void prof_buf_add_counters(struct vaccel_prof_thread_buf *buf,
+		const struct prof_counters *delta, uint64_t weight)
+{
+	if (!delta->mask)
+		return;
+
+	for (int i = 0; i < VACCEL_PROF_COUNTERS_NR; ++i) {
+		if (!(delta->mask & (1U << i)))
+			continue;
+
+		__atomic_store_n(&buf->counter_totals[i],
+				buf->counter_totals[i] +
+				delta->values[i] * weight,
+				__ATOMIC_RELAXED);
+	}
+
+	__atomic_store_n(&buf->counters, buf->counters | delta->mask,
+			__ATOMIC_RELAXED);
+	__atomic_store_n(&buf->nr_counted, buf->nr_counted + weight,
+			__ATOMIC_RELAXED);
+}
+
+/* Merge the histograms of all the threads of `region` in `hist`. This
+ * can run concurrently with threads recording samples */
+static void prof_region_hist(const struct vaccel_prof_region *region,
+		struct prof_hist *hist)
+{
+	struct vaccel_prof_thread_buf *buf =
+		__atomic_load_n(&region->bufs, __ATOMIC_ACQUIRE);
 
-	region->nr_entries++;
-	return &region->samples[pos];
+	hist_init(hist);
+	for (; buf; buf = buf->next)
+		hist_merge(hist, &buf->hist);
+}
+
+int vaccel_prof_region_stats(
+		const struct vaccel_prof_region *region,
+		struct vaccel_prof_stats *stats
+) {
+	if (!region || !stats)
+		return VACCEL_EINVAL;
+
+	struct prof_hist *hist = malloc(sizeof(*hist));
+	if (!hist)
+		return VACCEL_ENOMEM;
+
+	unsigned int walk = prof_walk_begin();
+
+	prof_region_hist(region, hist);
+
+	memset(stats, 0, sizeof(*stats));
+
+	struct vaccel_prof_thread_buf *buf =
+		__atomic_load_n(&region->bufs, __ATOMIC_ACQUIRE);
+	for (; buf; buf = buf->next) {
+		stats->counters |= __atomic_load_n(&buf->counters,
+				__ATOMIC_RELAXED);
+		stats->nr_counted += __atomic_load_n(&buf->nr_counted,
+				__ATOMIC_RELAXED);
+		stats->nr_sampled += __atomic_load_n(&buf->nr_sampled,
+				__ATOMIC_RELAXED);
+		for (int i = 0; i < VACCEL_PROF_COUNTERS_NR; ++i)
+			stats->counter_totals[i] += __atomic_load_n(
+					&buf->counter_totals[i],
+					__ATOMIC_RELAXED);
+	}
+
+	prof_walk_end(walk);
+
+	stats->nr_entries = hist->count;
+	if (stats->nr_entries) {
+		stats->total_time = hist->total;
+		stats->min = hist->min;
+		stats->max = hist->max;
+		stats->mean = stats->total_time / stats->nr_entries;
+		stats->p50 = hist_percentile(hist, 50.0);
+		stats->p90 = hist_percentile(hist, 90.0);
+		stats->p99 = hist_percentile(hist, 99.0);
+		stats->p999 = hist_percentile(hist, 99.9);
+	}
+
+	free(hist);
+
+	return VACCEL_OK;
+}
+
+/* Append to a string built with snprintf(), which might be too small
+ * or NULL when we are only computing its length */
+#define prof_append(str, size, len, ...) \
+	((len) += snprintf((str) ? (str) + (len) : NULL, \
+			((size_t)(len) < (size)) ? (size) - (len) : 0, \
+			__VA_ARGS__))
+
+static int prof_stats_snprintf(char *str, size_t size, const char *name,
+		const struct vaccel_prof_stats *stats)
+{
+	int len = 0;
+
+	prof_append(str, size, len,
+			"[prof] %s: total_time: %ju nsec nr_entries: %ju "
+			"min: %ju mean: %ju p50: %ju p90: %ju p99: %ju "
+			"p99.9: %ju max: %ju nsec",
+			name, stats->total_time, stats->nr_entries,
+			stats->min, stats->mean, stats->p50, stats->p90,
+			stats->p99, stats->p999, stats->max);
+
+	/* Totals are estimates when not every entry was measured */
+	if (stats->nr_sampled != stats->nr_entries)
+		prof_append(str, size, len, " (sampled: %ju)",
+				stats->nr_sampled);
+
+	if (!stats->nr_counted)
+		return len;
+
+	/* Hardware counters, per call */
+	static const char *names[VACCEL_PROF_COUNTERS_NR] = {
+		[VACCEL_PROF_CYCLES] = "cycles",
+		[VACCEL_PROF_INSTRUCTIONS] = "instructions",
+		[VACCEL_PROF_LLC_MISSES] = "llc_misses",
+		[VACCEL_PROF_BRANCH_MISSES] = "branch_misses",
+		[VACCEL_PROF_CTX_SWITCHES] = "ctx_switches",
+	};
+	const uint32_t ipc_mask = (1U << VACCEL_PROF_CYCLES) |
+		(1U << VACCEL_PROF_INSTRUCTIONS);
+
+	for (int i = 0; i < VACCEL_PROF_COUNTERS_NR; ++i) {
+		if (stats->counters & (1U << i))
+			prof_append(str, size, len, " %s/call: %.1f", names[i],
+					(double)stats->counter_totals[i] /
+					stats->nr_counted);
+	}
+
+	if ((stats->counters & ipc_mask) == ipc_mask &&
+			stats->counter_totals[VACCEL_PROF_CYCLES])
+		prof_append(str, size, len, " ipc: %.2f",
+				(double)stats->counter_totals[VACCEL_PROF_INSTRUCTIONS] /
+				stats->counter_totals[VACCEL_PROF_CYCLES]);
+
+	return len;
+}
+
+/* Free the buffers of a region. This must not run concurrently with
+ * anybody using the region */
+static void prof_region_free_bufs(struct vaccel_prof_region *region)
+{
+	struct vaccel_prof_thread_buf *buf = region->bufs;
+
+	region->bufs = NULL;
+	atomic_fetch_add_explicit(&prof_epoch, 1, memory_order_release);
+
+	while (buf) {
+		struct vaccel_prof_thread_buf *next = buf->next;
+
+		/* The owner of the buffer links to it from its list of
+		 * owned buffers, so if it is still alive it is the one to
+		 * free the buffer when it exits */
+		if (!atomic_exchange(&buf->owner, PROF_DETACHED))
+			prof_buf_free(buf);
+
+		buf = next;
+	}
+}
+
+int prof_region_snprintf(const struct vaccel_prof_region *region,
+		char *str, size_t size)
+{
+	struct vaccel_prof_stats stats;
+	int ret = vaccel_prof_region_stats(region, &stats);
+	if (ret)
+		return -ret;
+
+	if (!stats.nr_entries)
+		return 0;
+
+	return prof_stats_snprintf(str, size, region->name, &stats);
+}
+
+/* Detach the buffers of a region, adding the ones of exited threads to
+ * `retired` */
+static void prof_region_retire(struct vaccel_prof_region *region,
+		struct vaccel_prof_thread_buf **retired)
+{
+	struct vaccel_prof_thread_buf *buf =
+		__atomic_exchange_n(&region->bufs, NULL, __ATOMIC_ACQ_REL);
+
+	for (; buf; buf = buf->next) {
+		if (atomic_exchange(&buf->owner, PROF_DETACHED))
+			continue;
+
+		buf->thread_next = *retired;
+		*retired = buf;
+	}
+}
+
+void prof_regions_reset(struct vaccel_prof_region **regions, int nr_regions)
+{
+	/* Buffers of exited threads, which nobody records to anymore but
+	 * other threads might be walking past */
+	struct vaccel_prof_thread_buf *retired = NULL;
+
+	for (int i = 0; i < nr_regions; ++i)
+		prof_region_retire(regions[i], &retired);
+	atomic_fetch_add_explicit(&prof_epoch, 1, memory_order_release);
+
+	pthread_mutex_lock(&prof_walk_lock);
+	prof_walk_sync();
+	pthread_mutex_unlock(&prof_walk_lock);
+
+	while (retired) {
+		struct vaccel_prof_thread_buf *next = retired->thread_next;
+		prof_buf_free(retired);
+		retired = next;
+	}
+}
+
+uint64_t prof_get_tstamp(void)
+{
+	return get_tstamp_nsec();
+}
+
+int prof_region_add(struct vaccel_prof_region *region, uint64_t start,
+		uint64_t time, const struct prof_counters *counters,
+		uint64_t weight)
+{
+	struct vaccel_prof_thread_buf *buf = prof_thread_buf(region, true);
+	if (!buf)
+		return VACCEL_ENOMEM;
+
+	if (counters)
+		prof_buf_add_counters(buf, counters, weight);
+
+	return prof_buf_add(buf, start, time, weight);
+}
+
+vaccel_prof_token_t vaccel_prof_region_enter(struct vaccel_prof_region *region)
+{
+	if (!vaccel_prof_enabled() || !region)
+		return 0;
+
+	uint64_t weight = prof_sample();
+	if (!weight)
+		return 0;
+
+	/* Entries only need to be remembered for counters or to keep the
+	 * weight of sampled ones */
+	bool counted = prof_counters_enabled();
+	if ((!counted && weight == 1) || prof_nr_pending == PROF_MAX_PENDING)
+		return get_tstamp_nsec();
+
+	/* Read the counters first, so that the time in the region does
+	 * not include reading them */
+	struct prof_counters counters;
+	if (!counted || !prof_counters_read(&counters)) {
+		if (weight == 1)
+			return get_tstamp_nsec();
+		counters.mask = 0;
+	}
+
+	vaccel_prof_token_t token = get_tstamp_nsec();
+
+	prof_pending[prof_nr_pending].region = region;
+	prof_pending[prof_nr_pending].token = token;
+	prof_pending[prof_nr_pending].counters = counters;
+	prof_pending[prof_nr_pending].weight = weight;
+	prof_nr_pending++;
+
+	return token;
+}
+
+/* Get the weight of an exit from a region and its counters, if they
+ * were read on entering it */
+static bool prof_pending_exit(const struct vaccel_prof_region *region,
+		vaccel_prof_token_t token, struct prof_counters *counters,
+		uint64_t *weight)
+{
+	for (int i = prof_nr_pending - 1; i >= 0; --i) {
+		if (prof_pending[i].region != region ||
+				prof_pending[i].token != token)
+			continue;
+
+		struct prof_counters start = prof_pending[i].counters;
+		*weight = prof_pending[i].weight;
+		prof_pending[i] = prof_pending[--prof_nr_pending];
+
+		if (!start.mask || !prof_counters_read(counters))
+			return false;
+
+		prof_counters_sub(counters, &start);
+		return true;
+	}
+
+	return false;
+}
+
+int vaccel_prof_region_exit(
+		struct vaccel_prof_region *region,
+		vaccel_prof_token_t token
+) {
+	if (!token)
+		return VACCEL_OK;
+
+	if (!region) {
+		vaccel_error("[prof] exit region: Invalid profiling region");
+		return VACCEL_EINVAL;
+	}
+
+	uint64_t now = get_tstamp_nsec();
+
+	struct prof_counters counters;
+	uint64_t weight = prof_sample_weight();
+	bool counted = prof_nr_pending &&
+		prof_pending_exit(region, token, &counters, &weight);
+
+	return prof_region_add(region, token, now - token,
+			counted ? &counters : NULL, weight);
 }
 
 int vaccel_prof_region_start(struct vaccel_prof_region *region)
@@ -111,11 +706,28 @@ int vaccel_prof_region_start(struct vaccel_prof_region *region)
 
 	vaccel_debug("Start profiling region %s", region->name);
 
-	struct vaccel_prof_sample *sample = get_next_sample(region);
-	if (!sample)
+	struct vaccel_prof_thread_buf *buf = prof_thread_buf(region, true);
+	if (!buf)
+		return VACCEL_ENOMEM;
+
+	if (buf->nr_open == PROF_MAX_OPEN) {
+		vaccel_error("[prof] start region: %s nested too deep",
+				region->name);
 		return VACCEL_ENOMEM;
+	}
 
-	prof_sample_start(sample);
+	/* Entries that are not measured are still kept, to be matched by
+	 * their vaccel_prof_region_stop() */
+	uint64_t weight = prof_sample();
+	buf->open_weight[buf->nr_open] = weight;
+	if (!weight) {
+		buf->open_counters[buf->nr_open].mask = 0;
+		buf->open[buf->nr_open++] = 0;
+		return VACCEL_OK;
+	}
+
+	prof_counters_read(&buf->open_counters[buf->nr_open]);
+	buf->open[buf->nr_open++] = get_tstamp_nsec();
 
 	return VACCEL_OK;
 }
@@ -132,22 +744,90 @@ int vaccel_prof_region_stop(const struct vaccel_prof_region *region)
 
 	vaccel_debug("Stop profiling region %s", region->name);
 
-	struct vaccel_prof_sample *sample = get_last_sample(region);
-	if (!sample)
+	uint64_t now = get_tstamp_nsec();
+
+	struct vaccel_prof_thread_buf *buf = prof_thread_buf(region, false);
+	if (!buf || !buf->nr_open)
 		return VACCEL_ENOENT;
 
-	prof_sample_stop(sample);
+	uint64_t start = buf->open[--buf->nr_open];
+	uint64_t weight = buf->open_weight[buf->nr_open];
+	if (!weight)
+		return VACCEL_OK;
 
-	return VACCEL_OK;
+	struct prof_counters counters;
+	if (buf->open_counters[buf->nr_open].mask &&
+			prof_counters_read(&counters)) {
+		prof_counters_sub(&counters,
+				&buf->open_counters[buf->nr_open]);
+		prof_buf_add_counters(buf, &counters, weight);
+	}
+
+	return prof_buf_add(buf, start, now - start, weight);
+}
+
+int vaccel_prof_region_samples(
+		const struct vaccel_prof_region *region,
+		struct vaccel_prof_sample **samples,
+		size_t *nr_samples
+) {
+	if (!region || !samples || !nr_samples)
+		return VACCEL_EINVAL;
+
+	*samples = NULL;
+	*nr_samples = 0;
+
+	size_t ring_size = prof_ring_capacity();
+	if (!ring_size)
+		return VACCEL_OK;
+
+	int ret = VACCEL_OK;
+	unsigned int walk = prof_walk_begin();
+	struct vaccel_prof_thread_buf *bufs =
+		__atomic_load_n(&region->bufs, __ATOMIC_ACQUIRE);
+
+	/* Samples might be added after we count them, so only copy up to
+	 * what we have counted */
+	size_t size = 0;
+	for (struct vaccel_prof_thread_buf *buf = bufs; buf; buf = buf->next) {
+		size_t nr = atomic_load_explicit(&buf->nr_samples,
+				memory_order_acquire);
+		size += (nr < ring_size) ? nr : ring_size;
+	}
+
+	if (!size)
+		goto out;
+
+	struct vaccel_prof_sample *copy = malloc(size * sizeof(*copy));
+	if (!copy) {
+		ret = VACCEL_ENOMEM;
+		goto out;
+	}
+
+	size_t pos = 0;
+	for (struct vaccel_prof_thread_buf *buf = bufs; buf; buf = buf->next) {
+		size_t nr = atomic_load_explicit(&buf->nr_samples,
+				memory_order_acquire);
+		size_t first = (nr > ring_size) ? nr - ring_size : 0;
+
+		for (size_t i = first; i < nr && pos < size; ++i)
+			copy[pos++] = buf->ring[i % ring_size];
+	}
+
+	*samples = copy;
+	*nr_samples = pos;
+
+out:
+	prof_walk_end(walk);
+	return ret;
 }
 
 int vaccel_prof_region_init(
 		struct vaccel_prof_region *region,
 		const char *name
 ) {
-	if (!vaccel_prof_enabled())
-		return VACCEL_OK;
-
+	/* Regions are set up even when profiling is disabled, as it can
+	 * be enabled at runtime */
 	if (!region) {
 		vaccel_error("[prof] init region: Invalid profiling region");
 		return VACCEL_EINVAL;
@@ -168,39 +848,25 @@ int vaccel_prof_region_init(
 	}
 
 	region->name_owned = true;
-
-	region->nr_entries = 0;
-	if (grow_samples_array(region) != VACCEL_OK)
-		goto free_name;
+	region->bufs = NULL;
 
 	return VACCEL_OK;
-	
-free_name:
-	free((void *)region->name);
-	return VACCEL_ENOMEM;
 }
 
 int vaccel_prof_region_destroy(struct vaccel_prof_region *region)
 {
-	if (!vaccel_prof_enabled())
-		return VACCEL_OK;
-
 	if (!region) {
 		vaccel_error("[prof] destroy region: Invalid profiling region");
 		return VACCEL_EINVAL;
 	}
 
-	if (region->samples)
-		free(region->samples);
+	prof_region_free_bufs(region);
 
 	if (region->name && region->name_owned)
 		free((void *)region->name);
 
 	region->name = NULL;
 	region->name_owned = false;
-	region->nr_entries = 0;
-	region->samples = NULL;
-	region->size = 0;
 
 	return VACCEL_OK;
 }
@@ -215,15 +881,14 @@ int vaccel_prof_region_print(const struct vaccel_prof_region *region)
 		return VACCEL_EINVAL;
 	}
 
-	if (!region->nr_entries)
-		return VACCEL_OK;
-
-	uint64_t total_time = 0;
-	for (size_t i = 0; i < region->nr_entries; ++i)
-		total_time += region->samples[i].time;
+	struct vaccel_prof_stats stats;
+	int ret = vaccel_prof_region_stats(region, &stats);
+	if (ret || !stats.nr_entries)
+		return ret;
 
-	vaccel_info("[prof] %s: total_time: %lu nsec nr_entries: %lu",
-			region->name, total_time, region->nr_entries);
+	char line[MAX_NAME + 256];
+	prof_stats_snprintf(line, sizeof(line), region->name, &stats);
+	vaccel_info("%s", line);
 
 	return VACCEL_OK;
 }
@@ -261,15 +926,7 @@ int vaccel_prof_regions_start_by_name(
 		return VACCEL_EINVAL;
 	}
 
-	vaccel_debug("Start profiling region %s", r->name);
-
-	struct vaccel_prof_sample *sample = get_next_sample(r);
-	if (!sample)
-		return VACCEL_ENOMEM;
-
-	prof_sample_start(sample);
-
-	return VACCEL_OK;
+	return vaccel_prof_region_start(r);
 }
 
 int vaccel_prof_regions_stop_by_name(
@@ -292,26 +949,15 @@ int vaccel_prof_regions_stop_by_name(
 		return VACCEL_EINVAL;
 	}
 
-	vaccel_debug("Stop profiling region %s", r->name);
-
-	struct vaccel_prof_sample *sample = get_last_sample(r);
-	if (!sample)
-		return VACCEL_ENOENT;
-
-	prof_sample_stop(sample);
-
-	return VACCEL_OK;
+	return vaccel_prof_region_stop(r);
 }
 
 void vaccel_prof_regions_clear(
 		struct vaccel_prof_region *regions,
 		int nregions
 ) {
-	for (int i = 0; i < nregions; i++) {
-		free(regions[i].samples);
-		regions[i].samples = NULL;
-		regions[i].size = 0;
-	}
+	for (int i = 0; i < nregions; i++)
+		prof_region_free_bufs(&regions[i]);
 }
 
 int vaccel_prof_regions_init(
@@ -319,8 +965,7 @@ int vaccel_prof_regions_init(
 		int nregions
 ) {
 	for (int i = 0; i < nregions; i++) {
-		regions[i].size = 0;
-		regions[i].samples = NULL;
+		regions[i].bufs = NULL;
 		int ret = vaccel_prof_region_init(&regions[i], NULL);
 		if (ret != VACCEL_OK) {
 			vaccel_prof_regions_clear(regions, i);
@@ -343,17 +988,8 @@ int vaccel_prof_regions_print_all(
 		return VACCEL_EINVAL;
 	}
 
-	for (int i = 0; i < nregions; i++) {
-		if (!regions[i].nr_entries)
-			continue;
-
-		uint64_t total_time = 0;
-		for (size_t j = 0; j < regions[i].nr_entries; ++j)
-			total_time += regions[i].samples[j].time;
-
-		vaccel_info("[prof] %s: total_time: %lu nsec nr_entries: %lu",
-				regions[i].name, total_time, regions[i].nr_entries);
-	}
+	for (int i = 0; i < nregions; i++)
+		vaccel_prof_region_print(&regions[i]);
 
 	return VACCEL_OK;
 }
@@ -374,18 +1010,16 @@ int vaccel_prof_regions_print_all_to_buf(
 		return -VACCEL_EINVAL;
 	}
 
-	uint64_t total_time[size];
-	memset(total_time, 0, size * sizeof(uint64_t));
+	struct vaccel_prof_stats stats[size];
 	for (int i = 0; i < size; i++) {
-		if (!regions[i].nr_entries)
+		int ret = vaccel_prof_region_stats(&regions[i], &stats[i]);
+		if (ret)
+			return -ret;
+		if (!stats[i].nr_entries)
 			continue;
 
-		for (size_t j = 0; j < regions[i].nr_entries; ++j)
-			total_time[i] += regions[i].samples[j].time;
-
-		ssize += snprintf(NULL, 0,
-				"[prof] %s: total_time: %ju nsec nr_entries: %zu",
-				regions[i].name, total_time[i], regions[i].nr_entries) + 1;
+		ssize += prof_stats_snprintf(NULL, 0, regions[i].name,
+				&stats[i]) + 1;
 	}
 
 	if (tbuf == NULL)
@@ -396,12 +1030,17 @@ int vaccel_prof_regions_print_all_to_buf(
 		return -VACCEL_ENOMEM;
 
 	for (int i = 0; i < size; i++) {
-		if (!regions[i].nr_entries)
+		if (!stats[i].nr_entries)
 			continue;
 
-		tsize += snprintf(*tbuf+tsize, tbuf_len-tsize,
-				"[prof] %s: total_time: %ju nsec nr_entries: %zu",
-				regions[i].name, total_time[i], regions[i].nr_entries) + 1;
+		/* Entries that do not fit are truncated and the offset
+		 * stays within the buffer */
+		size_t avail = (size_t)tsize < tbuf_len ?
+			tbuf_len - tsize : 0;
+		tsize += prof_stats_snprintf(*tbuf + tsize, avail,
+				regions[i].name, &stats[i]) + 1;
+		if (tbuf_len && (size_t)tsize > tbuf_len - 1)
+			tsize = tbuf_len - 1;
 	}
 
 	return size;
@@ -15,3 +15,27 @@
 #pragma once
 
 #include "include/vaccel_prof.h"
+#include "counters.h"
+
+#include <stdint.h>
+
+/* Current time (nsec) of the profiling clock */
+uint64_t prof_get_tstamp(void);
+
+/* Record a sample for `region` on behalf of the calling thread, along
+ * with the hardware counters of the sample if not NULL. The sample
+ * stands for `weight` calls, as returned by prof_sample() */
+int prof_region_add(struct vaccel_prof_region *region, uint64_t start,
+		uint64_t time, const struct prof_counters *counters,
+		uint64_t weight);
+
+/* Format the statistics of a region as printed by
+ * vaccel_prof_region_print(), whether profiling is enabled or not.
+ * Returns the length of the line, 0 if the region has no samples, or a
+ * negative error code */
+int prof_region_snprintf(const struct vaccel_prof_region *region,
+		char *str, size_t size);
+
+/* Drop the samples of regions. Threads can keep recording while this
+ * runs, but nobody else may be reading the regions */
+void prof_regions_reset(struct vaccel_prof_region **regions, int nr_regions);
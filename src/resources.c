@@ -20,7 +20,9 @@
 #include "utils.h"
 #include "vaccel.h"
 #include "plugin.h"
+#include "async.h"
 
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -39,6 +41,10 @@ static id_pool_t id_pool;
  */
 static list_t live_resources[VACCEL_RES_MAX];
 
+/* Resources might be created concurrently by the asynchronous
+ * workers, so accesses to the live resources lists are serialized */
+static pthread_mutex_t live_resources_lock = PTHREAD_MUTEX_INITIALIZER;
+
 int resources_bootstrap(void)
 {
 	int ret = id_pool_new(&id_pool, MAX_RESOURCES);
@@ -58,6 +64,9 @@ int resources_cleanup(void)
 	if (!initialized)
 		return VACCEL_OK;
 
+	/* Make sure no resources are being created under our feet */
+	async_wait();
+
 	for (int i = 0; i < VACCEL_RES_MAX; ++i) {
 		struct vaccel_resource *res, *tmp;
 		for_each_vaccel_resource_safe(res, tmp, &live_resources[i])
@@ -102,7 +111,9 @@ int resource_new(struct vaccel_resource *res, vaccel_resource_t type,
 	res->data = data;
 	res->cleanup_resource = cleanup_resource;
 	list_init_entry(&res->entry);
+	pthread_mutex_lock(&live_resources_lock);
 	list_add_tail(&live_resources[0], &res->entry);
+	pthread_mutex_unlock(&live_resources_lock);
 	atomic_init(&res->refcount, 0);
 	res->rundir = NULL;
 	return VACCEL_OK;
@@ -113,15 +124,18 @@ int resource_get_by_id(struct vaccel_resource **resource, vaccel_id_t id)
 	if (!initialized)
 		return VACCEL_EPERM;
 
+	pthread_mutex_lock(&live_resources_lock);
 	for (int i = 0; i < VACCEL_RES_MAX; ++i) {
 		struct vaccel_resource *res, *tmp;
 		for_each_vaccel_resource_safe(res, tmp, &live_resources[i]) {
 			if (id == res->id) {
 				*resource = res;
+				pthread_mutex_unlock(&live_resources_lock);
 				return VACCEL_OK;
 			}
 		}
 	}
+	pthread_mutex_unlock(&live_resources_lock);
 
 	if (*resource != NULL) return VACCEL_OK;
 	return VACCEL_EINVAL;
@@ -138,7 +152,7 @@ int resource_destroy(struct vaccel_resource *res)
 	/* Check if this resources is currently registered to a session.
 	 * We do not destroy currently-used resources */
 	if (atomic_load(&res->refcount)) {
-		vaccel_warn("Cannot destroy used resource %u", res->id);
+		vaccel_warn("Cannot destroy used resource %lld", res->id);
 		return VACCEL_EBUSY;
 	}
 
@@ -146,13 +160,13 @@ int resource_destroy(struct vaccel_resource *res)
 	if (virtio) {
 		int err = virtio->info->resource_destroy(res->id);
 		if (err)
-			vaccel_warn("Could not destroy host-side resource %u",
+			vaccel_warn("Could not destroy host-side resource %lld",
 					res->id);
-	} else if (res->id) {
-		id_pool_release(&id_pool, res->id);
 	}
 
+	pthread_mutex_lock(&live_resources_lock);
 	list_unlink_entry(&res->entry);
+	pthread_mutex_unlock(&live_resources_lock);
 
 	/* Cleanup the type-specific resource */
 	if (res->cleanup_resource)
@@ -163,6 +177,10 @@ int resource_destroy(struct vaccel_resource *res)
 		free(res->rundir);
 	}
 
+	/* Only now can the id, and thus its rundir path, be reused */
+	if (!virtio && res->id)
+		id_pool_release(&id_pool, res->id);
+
 	return VACCEL_OK;
 }
 
@@ -186,6 +204,11 @@ void resource_refcount_dec(struct vaccel_resource *res)
 	atomic_fetch_sub(&res->refcount, 1);
 }
 
+int vaccel_resources_wait(void)
+{
+	return async_wait();
+}
+
 int resource_create_rundir(struct vaccel_resource *res)
 {
 	if (!res) {
@@ -199,7 +222,7 @@ int resource_create_rundir(struct vaccel_resource *res)
 	int len = snprintf(rundir, MAX_RESOURCE_RUNDIR, "%s/resource.%lld",
 			root_rundir, res->id);
 	if (len == MAX_RESOURCE_RUNDIR) {
-		vaccel_error("rundir path '%s/resource.%lu' too long",
+		vaccel_error("rundir path '%s/resource.%lld' too long",
 				root_rundir, res->id);
 		return VACCEL_ENAMETOOLONG;
 	}
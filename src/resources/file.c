@@ -17,14 +17,274 @@
 #include "error.h"
 #include "log.h"
 #include "utils.h"
+#include "checksum.h"
+#include "decompress.h"
+#include "store.h"
+#include "vaccel.h"
 
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdio.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdbool.h>
+#include <time.h>
+#include <linux/fs.h>
+
+#define CHECKSUM_CHUNK (1 << 20)
+#define CHECKSUM_VERSION 1
+#define MAX_SIDECAR_PATH 1024
+
+/* Cached checksum of a file. It is valid only for as long as the
+ * inode, size and modification time of the file do not change */
+struct checksum_cache {
+	uint32_t version;
+	uint32_t checksum;
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t size;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+};
+
+static bool verify_files_enabled(void)
+{
+	char *env = getenv("VACCEL_VERIFY_FILES");
+
+	return env && !strncmp(env, "enabled", 7);
+}
+
+/* Look up the trusted checksum of `path` in the manifest pointed to by
+ * VACCEL_VERIFY_MANIFEST
+ *
+ * Every line of the manifest holds the hex CRC32C checksum of a file
+ * followed by its path, e.g. as printed by `crc32c`-style tools. Empty
+ * lines and lines starting with '#' are ignored.
+ */
+static int manifest_lookup(const char *path, uint32_t *checksum)
+{
+	char *manifest = getenv("VACCEL_VERIFY_MANIFEST");
+	if (!manifest) {
+		vaccel_warn("File verification enabled without a manifest");
+		return VACCEL_ENOENT;
+	}
+
+	char real[PATH_MAX], entry_real[PATH_MAX];
+	if (!realpath(path, real))
+		return errno;
+
+	FILE *fp = fopen(manifest, "r");
+	if (!fp) {
+		vaccel_warn("Could not open manifest: %s", manifest);
+		return errno;
+	}
+
+	int ret = VACCEL_EPERM;
+	char *line = NULL;
+	size_t len = 0;
+	while (getline(&line, &len, fp) > 0) {
+		char *end;
+		unsigned long crc = strtoul(line, &end, 16);
+		if (line[0] == '#' || end == line || (*end != ' ' && *end != '\t'))
+			continue;
+
+		end += strspn(end, " \t");
+		end[strcspn(end, "\n")] = '\0';
+		if (!*end || !realpath(end, entry_real))
+			continue;
+
+		if (!strcmp(real, entry_real)) {
+			*checksum = (uint32_t)crc;
+			ret = VACCEL_OK;
+			break;
+		}
+	}
+
+	free(line);
+	fclose(fp);
+	return ret;
+}
+
+static double elapsed_sec(const struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec)
+		+ (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void checksum_cache_key(struct checksum_cache *entry,
+		const struct stat *st)
+{
+	memset(entry, 0, sizeof(*entry));
+	entry->version = CHECKSUM_VERSION;
+	entry->dev = st->st_dev;
+	entry->ino = st->st_ino;
+	entry->size = st->st_size;
+	entry->mtime_sec = st->st_mtim.tv_sec;
+	entry->mtime_nsec = st->st_mtim.tv_nsec;
+}
+
+/* Checksums are kept in a sidecar file under the user's rundir, so they
+ * are shared across vAccel processes without touching the files
+ * themselves, which belong to the caller */
+static int checksum_sidecar_path(char *path, size_t len, const struct stat *st)
+{
+	const char *rundir = vaccel_rundir();
+	const char *sep = strrchr(rundir, '/');
+	if (!sep)
+		return VACCEL_ENOENT;
+
+	int ret = snprintf(path, len, "%.*s/checksums", (int)(sep - rundir),
+			rundir);
+	if (ret < 0 || (size_t)ret >= len)
+		return VACCEL_ENAMETOOLONG;
+
+	if (mkdir(path, 0700) && errno != EEXIST)
+		return errno;
+
+	ret = snprintf(path, len, "%.*s/checksums/%ju.%ju", (int)(sep - rundir),
+			rundir, (uintmax_t)st->st_dev, (uintmax_t)st->st_ino);
+	if (ret < 0 || (size_t)ret >= len)
+		return VACCEL_ENAMETOOLONG;
+
+	return VACCEL_OK;
+}
+
+static bool checksum_cache_lookup(const struct stat *st, uint32_t *checksum)
+{
+	struct checksum_cache key, entry;
+	char sidecar[MAX_SIDECAR_PATH];
+
+	checksum_cache_key(&key, st);
+
+	if (checksum_sidecar_path(sidecar, sizeof(sidecar), st))
+		return false;
+
+	int sfd = open(sidecar, O_RDONLY);
+	if (sfd < 0)
+		return false;
+
+	ssize_t len = read(sfd, &entry, sizeof(entry));
+	close(sfd);
+
+	if (len != sizeof(entry))
+		return false;
+
+	uint32_t cached = entry.checksum;
+	entry.checksum = 0;
+	if (memcmp(&entry, &key, sizeof(key)))
+		return false;
+
+	*checksum = cached;
+	return true;
+}
+
+static void checksum_cache_store(const struct stat *st, uint32_t checksum)
+{
+	struct checksum_cache entry;
+	char sidecar[MAX_SIDECAR_PATH], tmp[MAX_SIDECAR_PATH + 8];
+
+	checksum_cache_key(&entry, st);
+	entry.checksum = checksum;
+
+	if (checksum_sidecar_path(sidecar, sizeof(sidecar), st))
+		return;
+
+	/* Write in a temporary and rename it, so that concurrent readers
+	 * never see a partially written entry */
+	snprintf(tmp, sizeof(tmp), "%s.XXXXXX", sidecar);
+	int sfd = mkstemp(tmp);
+	if (sfd < 0)
+		return;
+
+	bool written = write(sfd, &entry, sizeof(entry)) == sizeof(entry);
+	close(sfd);
+
+	if (!written || rename(tmp, sidecar))
+		remove(tmp);
+}
+
+/* Checksum the contents of a file, streaming them in chunks */
+static int checksum_fd(int fd, uint32_t *checksum)
+{
+	uint8_t *buf = malloc(CHECKSUM_CHUNK);
+	if (!buf)
+		return VACCEL_ENOMEM;
+
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	int ret = VACCEL_OK;
+	uint32_t crc = 0;
+	off_t off = 0;
+	while (true) {
+		ssize_t len = pread(fd, buf, CHECKSUM_CHUNK, off);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+
+			ret = errno;
+			break;
+		}
+
+		if (!len)
+			break;
+
+		crc = crc32c(crc, buf, len);
+		off += len;
+	}
+
+	free(buf);
+	if (!ret)
+		*checksum = crc;
+
+	return ret;
+}
+
+static int checksum_path(const char *path, uint32_t *checksum)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return errno;
+
+	struct stat st;
+	int ret = VACCEL_OK;
+	if (fstat(fd, &st)) {
+		ret = errno;
+		goto close_file;
+	}
+
+	if (checksum_cache_lookup(&st, checksum)) {
+		vaccel_debug("Using cached checksum %08x for %s", *checksum,
+				path);
+		goto close_file;
+	}
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	ret = checksum_fd(fd, checksum);
+	if (ret)
+		goto close_file;
+
+	double secs = elapsed_sec(&start);
+	vaccel_debug("Checksum of %s: %08x (%zu bytes, %.2f GB/s%s)", path,
+			*checksum, (size_t)st.st_size,
+			secs > 0 ? st.st_size / secs / 1e9 : 0.0,
+			crc32c_hw_enabled() ? "" : ", no hw acceleration");
+
+	checksum_cache_store(&st, *checksum);
+
+close_file:
+	close(fd);
+	return ret;
+}
 
 /* Create a file resource from an existing file in the filesystem
  *
@@ -47,31 +307,57 @@ int vaccel_file_new(struct vaccel_file *file, const char *path)
 	file->path_owned = false;
 	file->data = NULL;
 	file->size = 0;
+	file->checksum_valid = false;
+	file->store_fd = -1;
+
+	/* Verify the file against the trusted manifest before anyone gets
+	 * to use it. This is cheap for files we have seen before, since
+	 * checksums are cached */
+	if (verify_files_enabled()) {
+		uint32_t expected;
+		int ret = manifest_lookup(path, &expected);
+		if (ret == VACCEL_EPERM)
+			vaccel_warn("File not in manifest: %s", path);
+		if (!ret)
+			ret = vaccel_file_verify(file, expected);
+		if (ret) {
+			free(file->path);
+			file->path = NULL;
+			return ret;
+		}
+	}
 
 	return VACCEL_OK;
 }
 
-/* Persist a file in the filesystem
- *
- * For files that have been initialized from in-memory data, this
- * will persist them in the filesystem under the requested directory
- * using the provided filename.
+/* Create a file resource from an existing file in the filesystem,
+ * failing with VACCEL_EBADMSG unless its contents match `checksum` */
+int vaccel_file_new_verified(struct vaccel_file *file, const char *path,
+		uint32_t checksum)
+{
+	int ret = vaccel_file_new(file, path);
+	if (ret)
+		return ret;
+
+	ret = vaccel_file_verify(file, checksum);
+	if (ret) {
+		free(file->path);
+		file->path = NULL;
+	}
+
+	return ret;
+}
+
+/* Create the backing file of a file we persist under `dir`
  *
- * It will fail if the file has been initialized through an existing
- * path in the filesystem.
+ * On success, the path of the file is set and an open descriptor to
+ * it is returned in `fd`.
  */
-int vaccel_file_persist(struct vaccel_file *file, const char *dir,
-		const char *filename, bool randomize)
+static int file_create(struct vaccel_file *file, const char *dir,
+		const char *filename, bool randomize, int *fd)
 {
 	int ret;
 
-	vaccel_debug("Persisting file");
-
-	if (!file || !file->data | !file->size) {
-		vaccel_error("Invalid file");
-		return VACCEL_EINVAL;
-	}
-
 	if (!dir_exists(dir)) {
 		vaccel_error("Invalid directory");
 		return VACCEL_ENOENT;
@@ -106,22 +392,231 @@ int vaccel_file_persist(struct vaccel_file *file, const char *dir,
 	} else {
 		snprintf(file->path, path_len, "%s/%s", dir, filename);
 	}
-	file->path_owned = true;
 
 	/* FIXME: use a random value for the filename as we're hitting 
 	 * a weird cache issue: https://github.com/nubificus/roadmap#106
 	 */
-	FILE *fp;
-	if (randomize) {
-		int fd = mkstemp(file->path);
-		fp = fdopen(fd, "w+");
-	} else {
-		fp = fopen(file->path, "w+");
-	}
+	if (randomize)
+		*fd = mkstemp(file->path);
+	else
+		*fd = open(file->path, O_RDWR | O_CREAT | O_TRUNC, 0666);
 
 	/* Check if we managed to open the file */
+	if (*fd < 0) {
+		ret = errno;
+		free(file->path);
+		file->path = NULL;
+		return ret;
+	}
+
+	/* Only now is the file ours to remove */
+	file->path_owned = true;
+
+	return VACCEL_OK;
+}
+
+/* Atomically replace `path` with a hard or symbolic link to `target`
+ *
+ * The link is created under a temporary name and moved over `path`, so
+ * that the name is never up for grabs */
+static int replace_with_link(const char *path, const char *target,
+		bool symbolic)
+{
+	int ret = VACCEL_OK;
+	size_t len = strlen(path) + sizeof(".link");
+	char *tmp = malloc(len);
+	if (!tmp)
+		return VACCEL_ENOMEM;
+
+	snprintf(tmp, len, "%s.link", path);
+	if (symbolic ? symlink(target, tmp) : link(target, tmp)) {
+		ret = errno;
+		goto free_tmp;
+	}
+
+	if (rename(tmp, path)) {
+		ret = errno;
+		remove(tmp);
+	}
+
+free_tmp:
+	free(tmp);
+	return ret;
+}
+
+/* Persist a copy of a file that was created from a path
+ *
+ * The copy is made as cheaply as the filesystem allows: a reflink
+ * first, then a hard link, then an in-kernel copy and only as a last
+ * resort through userspace. Note that a hard link shares its inode with
+ * the original, so in-place changes to the original are visible through
+ * the copy; that is not the case for the other methods.
+ *
+ * On success, the file points to the new copy, which is removed when
+ * the file is destroyed.
+ */
+static int file_clone(struct vaccel_file *file, const char *dir,
+		const char *filename, bool randomize)
+{
+	int ret, fd;
+	const char *method;
+	char *src = file->path;
+	struct stat st;
+	struct timespec start;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	int src_fd = open(src, O_RDONLY);
+	if (src_fd < 0)
+		return errno;
+
+	if (fstat(src_fd, &st)) {
+		ret = errno;
+		goto close_src;
+	}
+
+	file->path = NULL;
+	ret = file_create(file, dir, filename, randomize, &fd);
+	if (ret) {
+		file->path = src;
+		file->path_owned = false;
+		goto close_src;
+	}
+
+	if (!ioctl(fd, FICLONE, src_fd)) {
+		method = "reflink";
+		goto done;
+	}
+
+	if (!replace_with_link(file->path, src, false)) {
+		method = "hardlink";
+		goto done;
+	}
+
+	ret = copy_fd(src_fd, fd, st.st_size);
+	if (ret) {
+		vaccel_error("Could not copy %s to %s", src, file->path);
+		goto remove_file;
+	}
+	method = "copy";
+
+done:
+	vaccel_debug("Persisted %s to %s using %s (%zu bytes, %.3f ms)", src,
+			file->path, method, (size_t)st.st_size,
+			elapsed_sec(&start) * 1e3);
+
+	close(fd);
+	close(src_fd);
+	free(src);
+	return VACCEL_OK;
+
+remove_file:
+	close(fd);
+	remove(file->path);
+	free(file->path);
+	file->path = src;
+	file->path_owned = false;
+close_src:
+	close(src_fd);
+	return ret;
+}
+
+/* Persist in-memory data through the shared store
+ *
+ * The data are added to the store, unless another process has already
+ * added them, and the file under `dir` becomes a symbolic link to the
+ * store object. All processes persisting the same data map the same
+ * page cache pages, instead of each keeping a private copy.
+ */
+static int file_share(struct vaccel_file *file, const char *dir,
+		const char *filename, bool randomize)
+{
+	char object[PATH_MAX];
+	int ret, fd, store_fd;
+
+	ret = store_acquire(file->data, file->size, object, sizeof(object),
+			&store_fd);
+	if (ret)
+		return ret;
+
+	ret = file_create(file, dir, filename, randomize, &fd);
+	if (ret)
+		goto release;
+
+	close(fd);
+
+	ret = replace_with_link(file->path, object, true);
+	if (ret)
+		goto remove_file;
+
+	void *old_ptr = file->data;
+	size_t old_size = file->size;
+	ret = read_file(file->path, (void **)&file->data, &file->size);
+	if (ret) {
+		file->data = old_ptr;
+		file->size = old_size;
+		goto remove_file;
+	}
+
+	file->store_fd = store_fd;
+
+	return VACCEL_OK;
+
+remove_file:
+	remove(file->path);
+	free(file->path);
+	file->path = NULL;
+	file->path_owned = false;
+release:
+	store_release(store_fd, object);
+	return ret;
+}
+
+/* Persist a file in the filesystem
+ *
+ * For files that have been initialized from in-memory data, this
+ * will persist them in the filesystem under the requested directory
+ * using the provided filename.
+ *
+ * Files that have been initialized through an existing path in the
+ * filesystem are copied under the requested directory instead, see
+ * file_clone(). It will fail if the file has already been persisted.
+ *
+ * If the shared store is enabled, in-memory data are persisted through
+ * it, see file_share().
+ */
+int vaccel_file_persist(struct vaccel_file *file, const char *dir,
+		const char *filename, bool randomize)
+{
+	int ret, fd;
+
+	vaccel_debug("Persisting file");
+
+	if (file && file->path && !file->path_owned)
+		return file_clone(file, dir, filename, randomize);
+
+	if (!file || !file->data | !file->size) {
+		vaccel_error("Invalid file");
+		return VACCEL_EINVAL;
+	}
+
+	if (store_enabled() && !file->path) {
+		ret = file_share(file, dir, filename, randomize);
+		if (!ret)
+			return VACCEL_OK;
+
+		vaccel_warn("Could not use shared store, persisting a private copy");
+	}
+
+	ret = file_create(file, dir, filename, randomize, &fd);
+	if (ret)
+		return ret;
+
+	FILE *fp = fdopen(fd, "w+");
 	if (!fp) {
 		ret = errno;
+		close(fd);
+		remove(file->path);
 		goto free_path;
 	}
 
@@ -131,6 +626,13 @@ int vaccel_file_persist(struct vaccel_file *file, const char *dir,
 		goto remove_file;
 	}
 
+	/* Make sure the data have reached the file before mapping it */
+	if (fflush(fp)) {
+		vaccel_error("Could not persist file %s", file->path);
+		ret = VACCEL_EIO;
+		goto remove_file;
+	}
+
 	/* We deallocate the initial pointer and mmap a new one,
 	 * so that changes through the pointer are synced with the
 	 * file */
@@ -153,6 +655,7 @@ remove_file:
 free_path:
 	free(file->path);
 	file->path = NULL;
+	file->path_owned = false;
 	return ret;
 
 }
@@ -179,6 +682,8 @@ int vaccel_file_from_buffer(
 	file->path = NULL;
 	file->data = (uint8_t *)buff;
 	file->size = size;
+	file->checksum_valid = false;
+	file->store_fd = -1;
 
 	if (persist)
 		return vaccel_file_persist(file, dir, filename, randomize);
@@ -186,6 +691,150 @@ int vaccel_file_from_buffer(
 	return VACCEL_OK;
 }
 
+static int decompress_threads(void)
+{
+	char *env = getenv("VACCEL_DECOMPRESS_THREADS");
+	if (env && atoi(env) > 0)
+		return atoi(env);
+
+	long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return nr_cpus > 0 ? nr_cpus : 1;
+}
+
+/* Initialize a file from compressed in-memory data.
+ *
+ * The data are decompressed straight into a file persisted under the
+ * requested directory, which is then mapped the same way as with
+ * vaccel_file_persist(). LZ4 frames made of independent blocks are
+ * decompressed in parallel; the number of threads defaults to the
+ * number of online CPUs and can be set with VACCEL_DECOMPRESS_THREADS.
+ *
+ * Data that are not compressed are persisted as they are.
+ */
+int vaccel_file_from_compressed_buffer(
+	struct vaccel_file *file,
+	const uint8_t *buff, size_t size,
+	const char *filename,
+	const char *dir,
+	bool randomize
+) {
+	int ret, fd;
+	size_t bound, len;
+
+	if (!file || !buff || !size)
+		return VACCEL_EINVAL;
+
+	if (compression_detect(buff, size) == COMPRESSION_NONE)
+		return vaccel_file_from_buffer(file, buff, size, filename,
+				true, dir, randomize);
+
+	ret = decompress_bound(buff, size, &bound);
+	if (ret)
+		return ret;
+
+	if (!bound) {
+		vaccel_error("Compressed file is empty");
+		return VACCEL_EINVAL;
+	}
+
+	file->path = NULL;
+	file->data = NULL;
+	file->size = 0;
+	file->checksum_valid = false;
+	file->store_fd = -1;
+
+	ret = file_create(file, dir, filename, randomize, &fd);
+	if (ret)
+		return ret;
+
+	if (ftruncate(fd, bound)) {
+		ret = errno;
+		goto remove_file;
+	}
+
+	uint8_t *dst = mmap(NULL, bound, PROT_READ | PROT_WRITE, MAP_SHARED,
+			fd, 0);
+	if (dst == MAP_FAILED) {
+		ret = errno;
+		goto remove_file;
+	}
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	ret = decompress(buff, size, dst, bound, &len,
+			decompress_threads());
+	munmap(dst, bound);
+	if (ret)
+		goto remove_file;
+
+	double secs = elapsed_sec(&start);
+	vaccel_debug("Decompressed %zu to %zu bytes in %.3f ms (%.2f GB/s)",
+			size, len, secs * 1e3, secs > 0 ? len / secs / 1e9 : 0.0);
+
+	if (!len || (len < bound && ftruncate(fd, len))) {
+		ret = len ? errno : VACCEL_EINVAL;
+		goto remove_file;
+	}
+
+	ret = read_file(file->path, (void **)&file->data, &file->size);
+	if (ret) {
+		vaccel_debug("Could not map file");
+		goto remove_file;
+	}
+
+	close(fd);
+	return VACCEL_OK;
+
+remove_file:
+	close(fd);
+	remove(file->path);
+	free(file->path);
+	file->path = NULL;
+	return ret;
+}
+
+/* Create a file resource from a compressed file in the filesystem
+ *
+ * Only the compressed bytes are read from `path`. They are decompressed
+ * into a new file under `dir`, named after `path` without its
+ * compression extension.
+ */
+int vaccel_file_new_compressed(struct vaccel_file *file, const char *path,
+		const char *dir, bool randomize)
+{
+	void *buff;
+	size_t size;
+
+	if (!file || !path)
+		return VACCEL_EINVAL;
+
+	int ret = read_file(path, &buff, &size);
+	if (ret) {
+		vaccel_warn("Cannot read file: %s", path);
+		return ret;
+	}
+
+	const char *base = strrchr(path, '/');
+	char *filename = strdup(base ? base + 1 : path);
+	if (!filename) {
+		ret = VACCEL_ENOMEM;
+		goto unmap;
+	}
+
+	char *ext = strrchr(filename, '.');
+	if (ext && (!strcmp(ext, ".lz4") || !strcmp(ext, ".zst")))
+		*ext = '\0';
+
+	ret = vaccel_file_from_compressed_buffer(file, buff, size, filename,
+			dir, randomize);
+
+	free(filename);
+unmap:
+	munmap(buff, size);
+	return ret;
+}
+
 /* Destroy a file
  *
  * Releases any resources reserved for the file, If the file
@@ -214,6 +863,15 @@ int vaccel_file_destroy(struct vaccel_file *file)
 		}
 	}
 
+	/* The file is a link into the shared store. Drop our reference
+	 * to the object it points to, once the link is gone */
+	char object[PATH_MAX];
+	bool shared = file->path_owned && file->store_fd >= 0;
+	if (shared) {
+		ssize_t len = readlink(file->path, object, sizeof(object) - 1);
+		object[len < 0 ? 0 : len] = '\0';
+	}
+
 	/* If we own the path to the file, just remove it from the
 	 * file system */
 	if (file->path_owned) {
@@ -223,6 +881,11 @@ int vaccel_file_destroy(struct vaccel_file *file)
 					file->path);
 	}
 
+	if (shared) {
+		store_release(file->store_fd, object);
+		file->store_fd = -1;
+	}
+
 	free(file->path);
 
 	return VACCEL_OK;
@@ -257,6 +920,25 @@ int vaccel_file_read(struct vaccel_file *file)
 	return read_file(file->path, (void **)&file->data, &file->size);
 }
 
+/* Prefetch the contents of the file
+ *
+ * Reads the file in memory, if not already done, and hints the kernel
+ * to start reading in its pages, so that the first access from the
+ * plugin does not pay for the I/O.
+ */
+int vaccel_file_prefetch(struct vaccel_file *file)
+{
+	int ret = vaccel_file_read(file);
+	if (ret)
+		return ret;
+
+	/* Only files backed by a path are mmaped */
+	if (file->path && madvise(file->data, file->size, MADV_WILLNEED))
+		vaccel_debug("Could not prefetch file %s", file->path);
+
+	return VACCEL_OK;
+}
+
 /* Get a pointer to the data of the file
  *
  * If the data have not been loaded to memory, this will
@@ -289,3 +971,60 @@ const char *vaccel_file_path(struct vaccel_file *file)
 
 	return file->path;
 }
+
+/* Get the CRC32C checksum of the file
+ *
+ * The checksum is calculated once per vaccel_file. For files backed
+ * by a path in the filesystem it is also cached in a sidecar file under
+ * the user's rundir, named after the device and inode of the file and
+ * holding its size and modification time, so unchanged files are not
+ * read again by subsequent vAccel instances. The files themselves are
+ * never modified. This is also what keeps checking files against the
+ * VACCEL_VERIFY_MANIFEST manifest cheap.
+ */
+int vaccel_file_checksum(struct vaccel_file *file, uint32_t *checksum)
+{
+	if (!file || !checksum || !vaccel_file_initialized(file))
+		return VACCEL_EINVAL;
+
+	if (file->checksum_valid) {
+		*checksum = file->checksum;
+		return VACCEL_OK;
+	}
+
+	if (file->path) {
+		int ret = checksum_path(file->path, &file->checksum);
+		if (ret)
+			return ret;
+	} else {
+		file->checksum = crc32c(0, file->data, file->size);
+	}
+
+	file->checksum_valid = true;
+	*checksum = file->checksum;
+
+	return VACCEL_OK;
+}
+
+/* Verify the integrity of the file
+ *
+ * Returns VACCEL_EBADMSG if the checksum of the file does not match
+ * the expected CRC32C checksum
+ */
+int vaccel_file_verify(struct vaccel_file *file, uint32_t checksum)
+{
+	uint32_t actual;
+
+	int ret = vaccel_file_checksum(file, &actual);
+	if (ret)
+		return ret;
+
+	if (actual != checksum) {
+		vaccel_warn("Checksum mismatch for file %s: %08x (expected %08x)",
+				file->path ? file->path : "<memory>", actual,
+				checksum);
+		return VACCEL_EBADMSG;
+	}
+
+	return VACCEL_OK;
+}
@@ -15,3 +15,6 @@
 #pragma once
 
 #include "include/vaccel_file.h"
+
+/* Map the file in memory and start reading it in the background */
+int vaccel_file_prefetch(struct vaccel_file *file);
@@ -17,12 +17,39 @@
 #include "log.h"
 #include "error.h"
 #include "session.h"
+#include "async.h"
+#include "plugin.h"
 
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <dlfcn.h>
+
+static void shared_object_init(struct vaccel_shared_object *object)
+{
+	object->plugin_data = NULL;
+	object->plugin_data_free = NULL;
+	object->dl_handle = NULL;
+	object->symbols = NULL;
+	object->nr_symbols = 0;
+}
+
+static void shared_object_unload(struct vaccel_shared_object *object)
+{
+	for (size_t i = 0; i < object->nr_symbols; ++i)
+		free(object->symbols[i].name);
+
+	free(object->symbols);
+	object->symbols = NULL;
+	object->nr_symbols = 0;
+
+	if (object->dl_handle) {
+		dlclose(object->dl_handle);
+		object->dl_handle = NULL;
+	}
+}
 
 static int shared_object_destructor(void *data)
 {
@@ -31,6 +58,7 @@ static int shared_object_destructor(void *data)
 	if (!object)
 		return VACCEL_EINVAL;
 
+	shared_object_unload(object);
 	vaccel_file_destroy(&object->file);
 
 	return VACCEL_OK;
@@ -42,6 +70,8 @@ int vaccel_shared_object_new(struct vaccel_shared_object *object, const char *pa
 	if (!res)
 		return VACCEL_ENOMEM;
 
+	shared_object_init(object);
+
 	int ret = vaccel_file_new(&object->file, path);
 	if (ret)
 		goto free_resource;
@@ -72,6 +102,8 @@ int vaccel_shared_object_new_from_buffer(struct vaccel_shared_object *object,
 	if (!res)
 		return VACCEL_ENOMEM;
 
+	shared_object_init(object);
+
 	int ret = vaccel_file_from_buffer(&object->file, buff, size, NULL,
 			NULL, false, false);
 	if (ret)
@@ -106,6 +138,65 @@ free_resource:
 	return ret;
 }
 
+struct shared_object_req {
+	struct vaccel_shared_object *object;
+	const uint8_t *buff;
+	size_t size;
+	vaccel_resource_cb_t cb;
+	void *priv;
+};
+
+static int shared_object_new_job(void *arg)
+{
+	struct shared_object_req *req = arg;
+
+	return vaccel_shared_object_new_from_buffer(req->object, req->buff,
+			req->size);
+}
+
+static void shared_object_new_done(int ret, void *priv)
+{
+	struct shared_object_req *req = priv;
+
+	if (req->cb)
+		req->cb(ret, req->priv);
+
+	free(req);
+}
+
+/* Create a shared object from in-memory data asynchronously
+ *
+ * Same as `vaccel_shared_object_new_from_buffer`, but persisting the
+ * data in the rundir happens on a vAccel worker thread. `cb`, if set,
+ * is called with the result once the object has been created. Neither
+ * the object nor the buffer must be accessed until then.
+ */
+int vaccel_shared_object_new_from_buffer_async(
+	struct vaccel_shared_object *object,
+	const uint8_t *buff, size_t size,
+	vaccel_resource_cb_t cb, void *priv
+) {
+	if (!object || !buff || !size)
+		return VACCEL_EINVAL;
+
+	struct shared_object_req *req = malloc(sizeof(*req));
+	if (!req)
+		return VACCEL_ENOMEM;
+
+	req->object = object;
+	req->buff = buff;
+	req->size = size;
+	req->cb = cb;
+	req->priv = priv;
+
+	int ret = async_submit(shared_object_new_job, req,
+			shared_object_new_done, req);
+	if (ret)
+		free(req);
+
+	return ret;
+}
+
 /* Get a pointer to the data of the shared object file
  *
  * This will return a pointer to the data of shared object file.
@@ -129,7 +220,16 @@ int vaccel_shared_object_destroy(struct vaccel_shared_object *object)
 	if (!object)
 		return VACCEL_EINVAL;
 
-	vaccel_debug("Destroying resource %u", object->resource->id);
+	vaccel_debug("Destroying resource %lld", object->resource->id);
+
+	/* Let plugins drop their state before the id of the resource
+	 * can be handed out again */
+	if (object->plugin_data_free) {
+		object->plugin_data_free(object);
+		object->plugin_data_free = NULL;
+		object->plugin_data = NULL;
+	}
+
 	/* This will destroy the underlying resource and call our
 	 * destructor callback */
 	int ret = resource_destroy(object->resource);
@@ -141,6 +241,86 @@ int vaccel_shared_object_destroy(struct vaccel_shared_object *object)
 	return VACCEL_OK;
 }
 
+int vaccel_shared_object_preload(
+	struct vaccel_shared_object *object,
+	const char *const *symbols,
+	size_t nr_symbols
+) {
+	if (!object || !object->resource || (nr_symbols && !symbols))
+		return VACCEL_EINVAL;
+
+	if (get_virtio_plugin())
+		return VACCEL_OK;
+
+	/* Drop whatever was preloaded before */
+	shared_object_unload(object);
+
+	const char *path = object->file.path;
+	if (!path)
+		return VACCEL_EINVAL;
+
+	object->dl_handle = dlopen(path, RTLD_NOW);
+	if (!object->dl_handle) {
+		vaccel_error("Could not preload %s: %s", path, dlerror());
+		return VACCEL_EINVAL;
+	}
+
+	if (!nr_symbols)
+		return VACCEL_OK;
+
+	object->symbols = calloc(nr_symbols, sizeof(*object->symbols));
+	if (!object->symbols) {
+		shared_object_unload(object);
+		return VACCEL_ENOMEM;
+	}
+
+	int ret = VACCEL_OK;
+	for (size_t i = 0; i < nr_symbols; ++i) {
+		struct vaccel_shared_object_symbol *sym =
+			&object->symbols[object->nr_symbols];
+
+		sym->addr = dlsym(object->dl_handle, symbols[i]);
+		if (!sym->addr) {
+			vaccel_error("Could not resolve %s: %s", symbols[i],
+					dlerror());
+			ret = VACCEL_EINVAL;
+			goto unload;
+		}
+
+		sym->name = strdup(symbols[i]);
+		if (!sym->name) {
+			ret = VACCEL_ENOMEM;
+			goto unload;
+		}
+
+		object->nr_symbols++;
+	}
+
+	vaccel_debug("Preloaded %zu symbols of resource %lld", nr_symbols,
+			object->resource->id);
+
+	return VACCEL_OK;
+
+unload:
+	shared_object_unload(object);
+	return ret;
+}
+
+void *vaccel_shared_object_symbol(
+	const struct vaccel_shared_object *object,
+	const char *name
+) {
+	if (!object || !name)
+		return NULL;
+
+	for (size_t i = 0; i < object->nr_symbols; ++i) {
+		if (!strcmp(object->symbols[i].name, name))
+			return object->symbols[i].addr;
+	}
+
+	return NULL;
+}
+
 vaccel_id_t vaccel_shared_object_get_id(const struct vaccel_shared_object *object)
 {
 	if (!object || !object->resource)
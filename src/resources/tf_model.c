@@ -110,7 +110,7 @@ int vaccel_tf_model_destroy(struct vaccel_tf_model *model)
 	if (!model)
 		return VACCEL_EINVAL;
 
-	vaccel_debug("Destroying resource %u", model->resource->id);
+	vaccel_debug("Destroying resource %lld", model->resource->id);
 	/* This will destroy the underlying resource and call our
 	 * destructor callback */
 	int ret = resource_destroy(model->resource);
@@ -17,6 +17,8 @@
 #include "error.h"
 #include "log.h"
 #include "resources.h"
+#include "file.h"
+#include "async.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -389,7 +391,7 @@ int vaccel_tf_saved_model_register(struct vaccel_tf_saved_model *model)
 
 	model->path = res->rundir;
 out:
-	vaccel_debug("New resource %lu", res->id);
+	vaccel_debug("New resource %lld", res->id);
 	model->resource = res;
 
 	return VACCEL_OK;
@@ -402,6 +404,42 @@ free_resource:
 	return ret;
 }
 
+static int tf_saved_model_register_job(void *arg)
+{
+	struct vaccel_tf_saved_model *model = arg;
+
+	int ret = vaccel_tf_saved_model_register(model);
+	if (ret)
+		return ret;
+
+	/* Get the files in memory while we are still off the caller's
+	 * thread. Failing to do so is not fatal, the plugin will read
+	 * them when it needs them. */
+	vaccel_file_prefetch(&model->model);
+	vaccel_file_prefetch(&model->checkpoint);
+	vaccel_file_prefetch(&model->var_index);
+
+	return VACCEL_OK;
+}
+
+/* Register the file as a vAccel resource asynchronously
+ *
+ * Same as `vaccel_tf_saved_model_register`, but the registration,
+ * including persisting in-memory files and reading in the model files,
+ * happens on a vAccel worker thread. `cb`, if set, is called with the
+ * result once the registration completes. The model must not be
+ * accessed until then.
+ */
+int vaccel_tf_saved_model_register_async(
+	struct vaccel_tf_saved_model *model,
+	vaccel_resource_cb_t cb, void *priv
+) {
+	if (!model)
+		return VACCEL_EINVAL;
+
+	return async_submit(tf_saved_model_register_job, model, cb, priv);
+}
+
 /* Destroy the SavedModel resource
  *
  * This will handle the destruction of the underlying resource and
@@ -413,7 +451,7 @@ int vaccel_tf_saved_model_destroy(struct vaccel_tf_saved_model *model)
 	if (!model)
 		return VACCEL_EINVAL;
 
-	vaccel_debug("Destroying resource %u", model->resource->id);
+	vaccel_debug("Destroying resource %lld", model->resource->id);
 	/* This will destroy the underlying resource and call our
 	 * destructor callback */
 	int ret = resource_destroy(model->resource);
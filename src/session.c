@@ -17,6 +17,7 @@
 #include "log.h"
 #include "utils.h"
 #include "id_pool.h"
+#include "profiling/metrics.h"
 
 #include <stdbool.h>
 #include <stdint.h>
@@ -36,6 +37,10 @@ struct {
 
 	/* Active sessions */
 	struct vaccel_session *running_sessions[MAX_VACCEL_SESSIONS];
+
+	/* Active sessions the metrics know about, i.e. opened while
+	 * metrics were enabled */
+	bool metrics_sessions[MAX_VACCEL_SESSIONS];
 } sessions;
 
 static uint32_t get_sess_id(void)
@@ -54,8 +59,10 @@ int sessions_bootstrap(void)
 	if (ret)
 		return ret;
 
-	for (size_t i = 0; i < MAX_VACCEL_SESSIONS; ++i)
+	for (size_t i = 0; i < MAX_VACCEL_SESSIONS; ++i) {
 		sessions.running_sessions[i] = NULL;
+		sessions.metrics_sessions[i] = false;
+	}
 
 	sessions.initialized = true;
 
@@ -70,6 +77,25 @@ int sessions_cleanup(void)
 	return VACCEL_OK;
 }
 
+/* Containers of registered resources are allocated from the session's
+ * metadata arena and recycled through a free list, so that they are
+ * all released at once when the session is freed */
+static struct registered_resource *
+get_container_entry(struct session_resources *resources)
+{
+	list_entry_t *entry = list_remove_head(&resources->free_containers);
+	if (entry)
+		return get_container(entry, struct registered_resource, entry);
+
+	return arena_alloc(&resources->meta, sizeof(struct registered_resource));
+}
+
+static void put_container_entry(struct session_resources *resources,
+		struct registered_resource *container)
+{
+	list_add_tail(&resources->free_containers, &container->entry);
+}
+
 int vaccel_sess_register(struct vaccel_session *sess,
 		struct vaccel_resource *res)
 {
@@ -77,7 +103,7 @@ int vaccel_sess_register(struct vaccel_session *sess,
 		return VACCEL_EINVAL;
 
 	struct session_resources *resources = sess->resources;
-	struct registered_resource *container = malloc(sizeof(*container));
+	struct registered_resource *container = get_container_entry(resources);
 	if (!container)
 		return VACCEL_ENOMEM;
 
@@ -85,7 +111,7 @@ int vaccel_sess_register(struct vaccel_session *sess,
 	if (plugin) {
 		int ret = plugin->info->sess_register(sess->session_id, res->id);
 		if (ret) {
-			free(container);
+			put_container_entry(resources, container);
 			return ret;
 		}
 	}
@@ -123,7 +149,7 @@ int vaccel_sess_unregister(struct vaccel_session *sess,
 	struct registered_resource *container =
 		find_registered_resource(sess, res);
 	if (!container) {
-		vaccel_warn("Resource %u not registered with session %u\n",
+		vaccel_warn("Resource %lld not registered with session %u\n",
 				res->id, sess->session_id);
 		return VACCEL_EINVAL;
 	}
@@ -132,14 +158,14 @@ int vaccel_sess_unregister(struct vaccel_session *sess,
 	if (plugin) {
 		int ret = plugin->info->sess_unregister(sess->session_id, res->id);
 		if (ret) {
-			vaccel_error("BUG: Could not unregister host-side resource %u",
+			vaccel_error("BUG: Could not unregister host-side resource %lld",
 					res->id);
 		}
 	}
 
 	list_unlink_entry(&container->entry);
 	resource_refcount_dec(container->res);
-	free(container);
+	put_container_entry(sess->resources, container);
 
 	return VACCEL_OK;
 }
@@ -178,6 +204,10 @@ static int initialize_session_resources(struct vaccel_session *sess)
 	for (int i = 0; i < VACCEL_RES_MAX; ++i)
 		list_init(&res->registered[i]);
 
+	arena_init(&res->arena);
+	arena_init(&res->meta);
+	list_init(&res->free_containers);
+
 	return VACCEL_OK;
 
 cleanup_res:
@@ -207,6 +237,9 @@ static int cleanup_session_resources(struct vaccel_session *sess)
 		vaccel_warn("Could not cleanup rundir '%s' for session %u",
 				sess->resources->rundir, sess->session_id);
 
+	arena_destroy(&resources->arena);
+	arena_destroy(&resources->meta);
+
 	free(sess->resources);
 	sess->resources = NULL;
 
@@ -247,6 +280,8 @@ int vaccel_sess_init(struct vaccel_session *sess, uint32_t flags)
 	vaccel_debug("session:%u New session", sess->session_id);
 
 	sessions.running_sessions[sess->session_id - 1] = sess;
+	sessions.metrics_sessions[sess->session_id - 1] =
+		metrics_session_open(sess->session_id);
 
 	return VACCEL_OK;
 
@@ -297,6 +332,11 @@ int vaccel_sess_free(struct vaccel_session *sess)
 	if (!sessions.initialized)
 		return VACCEL_ESESS;
 
+	if (sessions.metrics_sessions[sess->session_id - 1]) {
+		metrics_session_close(sess->session_id);
+		sessions.metrics_sessions[sess->session_id - 1] = false;
+	}
+
 	/* if we're using virtio as a plugin offload the session cleanup to the
 	 * host */
 	struct vaccel_plugin *virtio = get_virtio_plugin();
@@ -305,14 +345,48 @@ int vaccel_sess_free(struct vaccel_session *sess)
 		if (ret) {
 			vaccel_warn("Could not cleanup host-side session");
 		}
-	} else {
-		put_sess_id(sess->session_id);
 	}
 
 	cleanup_session_resources(sess);
 	sessions.running_sessions[sess->session_id - 1] = NULL;
 
+	/* The id may be handed out again right away, so release it only
+	 * once its rundir and slot are gone */
+	if (!virtio)
+		put_sess_id(sess->session_id);
+
 	vaccel_debug("session:%u Free session", sess->session_id);
 
 	return VACCEL_OK;
 }
+
+void *vaccel_sess_alloc(struct vaccel_session *sess, size_t size)
+{
+	if (!sess || !sess->resources)
+		return NULL;
+
+	return arena_alloc(&sess->resources->arena, size);
+}
+
+char *vaccel_sess_strdup(struct vaccel_session *sess, const char *str)
+{
+	if (!str)
+		return NULL;
+
+	size_t len = strlen(str) + 1;
+	char *ret = vaccel_sess_alloc(sess, len);
+	if (ret)
+		memcpy(ret, str, len);
+
+	return ret;
+}
+
+int vaccel_sess_reset(struct vaccel_session *sess)
+{
+	if (!sess || !sess->resources)
+		return VACCEL_EINVAL;
+
+	arena_reset(&sess->resources->arena);
+
+	return VACCEL_OK;
+}
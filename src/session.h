@@ -19,6 +19,7 @@
 
 #include "resources.h"
 #include "list.h"
+#include "arena.h"
 
 #define MAX_SESSION_RUNDIR_PATH 512
 
@@ -50,6 +51,16 @@ struct session_resources {
 	 * is an array where each element holds a list of resources of
 	 * the same resource type */
 	list_t registered[VACCEL_RES_MAX];
+
+	/* Transient allocations of the session. Released on
+	 * vaccel_sess_reset() and vaccel_sess_free() */
+	struct arena arena;
+
+	/* Allocations that live as long as the session, i.e. the
+	 * containers of registered resources. Containers of unregistered
+	 * resources are kept in `free_containers` for reuse */
+	struct arena meta;
+	list_t free_containers;
 };
 
 int sessions_bootstrap(void);
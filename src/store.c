@@ -0,0 +1,289 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#include "store.h"
+#include "checksum.h"
+#include "error.h"
+#include "log.h"
+#include "vaccel.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define STORE_DIR "vaccel-store"
+#define STORE_TMP_PREFIX ".tmp."
+#define MAX_STORE_PATH 1024
+
+/* Objects with the same checksum and size but different contents */
+#define MAX_STORE_COLLISIONS 16
+
+/* Attempts to get a reference to an object that keeps being removed
+ * under our feet */
+#define MAX_STORE_RETRIES 8
+
+static char store_dir[MAX_STORE_PATH];
+static int store_init_ret;
+static pthread_once_t store_once = PTHREAD_ONCE_INIT;
+
+bool store_enabled(void)
+{
+	char *env = getenv("VACCEL_SHARED_STORE");
+
+	return env && !strncmp(env, "enabled", 7);
+}
+
+/* Whether `fd` is still the object linked at `path` */
+static bool store_linked(int fd, const char *path)
+{
+	struct stat fd_st, path_st;
+
+	if (fstat(fd, &fd_st) || stat(path, &path_st))
+		return false;
+
+	return fd_st.st_dev == path_st.st_dev && fd_st.st_ino == path_st.st_ino;
+}
+
+/* Remove the object at `path` if nobody holds a reference to it */
+static bool store_collect(const char *path)
+{
+	bool removed = false;
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	/* Anyone taking a reference after we get the lock will notice
+	 * the object is gone and will add it again */
+	if (!flock(fd, LOCK_EX | LOCK_NB)) {
+		if (store_linked(fd, path) && !unlink(path)) {
+			vaccel_debug("Removed unused shared object %s", path);
+			removed = true;
+		}
+	}
+
+	close(fd);
+	return removed;
+}
+
+static void store_init(void)
+{
+	const char *rundir = vaccel_rundir();
+	const char *sep = strrchr(rundir, '/');
+	if (!sep) {
+		store_init_ret = VACCEL_ENOENT;
+		return;
+	}
+
+	int ret = snprintf(store_dir, sizeof(store_dir), "%.*s/%s",
+			(int)(sep - rundir), rundir, STORE_DIR);
+	if (ret < 0 || (size_t)ret >= sizeof(store_dir)) {
+		store_init_ret = VACCEL_ENAMETOOLONG;
+		return;
+	}
+
+	if (mkdir(store_dir, 0700) && errno != EEXIST) {
+		store_init_ret = errno;
+		return;
+	}
+
+	/* Clean up after processes that exited without doing so */
+	store_gc();
+}
+
+int store_gc(void)
+{
+	char path[MAX_STORE_PATH];
+
+	DIR *dir = opendir(store_dir);
+	if (!dir)
+		return errno;
+
+	int nr_removed = 0;
+	struct dirent *entry;
+	while ((entry = readdir(dir))) {
+		if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+			continue;
+
+		int ret = snprintf(path, sizeof(path), "%s/%s", store_dir,
+				entry->d_name);
+		if (ret < 0 || (size_t)ret >= sizeof(path))
+			continue;
+
+		nr_removed += store_collect(path);
+	}
+
+	closedir(dir);
+
+	if (nr_removed)
+		vaccel_debug("Removed %d unused objects from %s", nr_removed,
+				store_dir);
+
+	return VACCEL_OK;
+}
+
+static bool store_same_contents(int fd, const void *data, size_t size)
+{
+	struct stat st;
+	if (fstat(fd, &st) || (size_t)st.st_size != size)
+		return false;
+
+	void *ptr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (ptr == MAP_FAILED)
+		return false;
+
+	bool same = !memcmp(ptr, data, size);
+	munmap(ptr, size);
+
+	return same;
+}
+
+/* Add a new object at `path`. Returns VACCEL_EEXISTS if someone else
+ * added it first */
+static int store_add(const void *data, size_t size, const char *path,
+		int *fd)
+{
+	char tmp[MAX_STORE_PATH];
+	int ret = snprintf(tmp, sizeof(tmp), "%s/%sXXXXXX", store_dir,
+			STORE_TMP_PREFIX);
+	if (ret < 0 || (size_t)ret >= sizeof(tmp))
+		return VACCEL_ENAMETOOLONG;
+
+	/* Processes we spawn must not inherit references to objects */
+	int tmp_fd = mkostemp(tmp, O_CLOEXEC);
+	if (tmp_fd < 0)
+		return errno;
+
+	/* Hold a reference before anyone can see the object, so that
+	 * the garbage collector leaves it alone */
+	if (flock(tmp_fd, LOCK_SH)) {
+		ret = errno;
+		goto remove_tmp;
+	}
+
+	const char *p = data;
+	for (size_t left = size; left;) {
+		ssize_t len = write(tmp_fd, p, left);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+
+			ret = errno;
+			goto remove_tmp;
+		}
+
+		p += len;
+		left -= len;
+	}
+
+	/* Unlike rename(), this never replaces an object someone else
+	 * added in the meantime */
+	if (link(tmp, path)) {
+		ret = (errno == EEXIST) ? VACCEL_EEXISTS : errno;
+		goto remove_tmp;
+	}
+
+	unlink(tmp);
+	*fd = tmp_fd;
+
+	vaccel_debug("Added %zu bytes to shared store as %s", size, path);
+
+	return VACCEL_OK;
+
+remove_tmp:
+	close(tmp_fd);
+	unlink(tmp);
+	return ret;
+}
+
+int store_acquire(const void *data, size_t size, char *path, size_t len,
+		int *fd)
+{
+	if (!data || !size || !path || !fd)
+		return VACCEL_EINVAL;
+
+	pthread_once(&store_once, store_init);
+	if (store_init_ret)
+		return store_init_ret;
+
+	uint32_t checksum = crc32c(0, data, size);
+
+	int collision = 0, retries = 0;
+	while (collision < MAX_STORE_COLLISIONS) {
+		int ret = snprintf(path, len, "%s/%08x-%zx.%d", store_dir,
+				checksum, size, collision);
+		if (ret < 0 || (size_t)ret >= len)
+			return VACCEL_ENAMETOOLONG;
+
+		if (++retries > MAX_STORE_RETRIES)
+			return VACCEL_EBUSY;
+
+		int obj_fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (obj_fd < 0) {
+			if (errno != ENOENT)
+				return errno;
+
+			ret = store_add(data, size, path, fd);
+			if (ret == VACCEL_EEXISTS)
+				continue;
+
+			return ret;
+		}
+
+		if (flock(obj_fd, LOCK_SH)) {
+			ret = errno;
+			close(obj_fd);
+			return ret;
+		}
+
+		/* The object was collected before we got our reference */
+		if (!store_linked(obj_fd, path)) {
+			close(obj_fd);
+			continue;
+		}
+
+		if (store_same_contents(obj_fd, data, size)) {
+			*fd = obj_fd;
+			vaccel_debug("Found %zu bytes in shared store as %s",
+					size, path);
+			return VACCEL_OK;
+		}
+
+		close(obj_fd);
+		collision++;
+		retries = 0;
+	}
+
+	return VACCEL_EEXISTS;
+}
+
+int store_release(int fd, const char *path)
+{
+	if (fd < 0 || !path)
+		return VACCEL_EINVAL;
+
+	close(fd);
+	store_collect(path);
+
+	return VACCEL_OK;
+}
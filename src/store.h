@@ -0,0 +1,49 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __STORE_H__
+#define __STORE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Shared, content-addressed store for file resources
+ *
+ * Objects live under the user's runtime directory and are shared by
+ * all the vAccel processes of the user, so identical data persisted by
+ * different processes end up in the same page cache pages.
+ *
+ * A reference to an object is an open descriptor holding a shared
+ * flock() on it. Objects that nobody holds a shared lock on can be
+ * removed at any time. The kernel drops the locks of processes that
+ * exit, so references are never leaked.
+ */
+
+/* Whether the store is enabled, through VACCEL_SHARED_STORE=enabled */
+bool store_enabled(void);
+
+/* Get a reference to the object holding `data`, adding it to the store
+ * if it is not there yet. The path of the object is returned in `path`
+ * and the reference in `fd` */
+int store_acquire(const void *data, size_t size, char *path, size_t len,
+		int *fd);
+
+/* Drop a reference to the object at `path` and remove the object if
+ * this was the last one */
+int store_release(int fd, const char *path);
+
+/* Remove all the objects that are not referenced by anyone */
+int store_gc(void);
+
+#endif /* __STORE_H__ */
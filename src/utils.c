@@ -12,6 +12,8 @@
  * limitations under the License.
  */
 
+#define _GNU_SOURCE
+
 #include "utils.h"
 #include "error.h"
 #include "log.h"
@@ -26,6 +28,8 @@
 #include <stdlib.h>
 #include <sys/mman.h>
 
+#define COPY_CHUNK (1 << 20)
+
 bool dir_exists(const char *path)
 {
 	DIR *dir = opendir(path);
@@ -67,7 +71,7 @@ int read_file(const char *path, void **data, size_t *size)
 
 	void *ptr = mmap(NULL, stat.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE,
 			fd, 0);
-	if (!ptr) {
+	if (ptr == MAP_FAILED) {
 		vaccel_debug("Could not mmap file");
 		ret = VACCEL_ENOMEM;
 		goto close_file;
@@ -80,3 +84,73 @@ close_file:
 	close(fd);
 	return ret;
 }
+
+/* Copy `size` bytes between two files, starting from their current
+ * offsets. The copy happens in the kernel if possible, otherwise we fall
+ * back to a plain read/write loop */
+int copy_fd(int src_fd, int dst_fd, size_t size)
+{
+	bool in_kernel = true;
+	char *buf = NULL;
+
+	while (size) {
+		ssize_t len;
+
+		if (in_kernel) {
+			len = copy_file_range(src_fd, NULL, dst_fd, NULL, size,
+					0);
+			if (len < 0 && errno != EINTR) {
+				/* Filesystem or kernel does not support it, e.g.
+				 * a copy across filesystems. Nothing has been
+				 * copied by the failed call, so just switch */
+				if (errno != EXDEV && errno != ENOSYS &&
+						errno != EOPNOTSUPP &&
+						errno != EINVAL)
+					goto out;
+
+				in_kernel = false;
+				continue;
+			}
+		} else {
+			if (!buf) {
+				buf = malloc(COPY_CHUNK);
+				if (!buf)
+					return VACCEL_ENOMEM;
+			}
+
+			len = read(src_fd, buf, size < COPY_CHUNK ?
+					size : COPY_CHUNK);
+			for (ssize_t off = 0; len > 0 && off < len;) {
+				ssize_t written = write(dst_fd, buf + off,
+						len - off);
+				if (written < 0) {
+					if (errno == EINTR)
+						continue;
+
+					goto out;
+				}
+
+				off += written;
+			}
+		}
+
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+
+			goto out;
+		}
+
+		/* Source is shorter than expected */
+		if (!len) {
+			errno = EIO;
+			goto out;
+		}
+
+		size -= len;
+	}
+
+out:
+	free(buf);
+	return size ? errno : VACCEL_OK;
+}
@@ -33,4 +33,10 @@ int cleanup_rundir(const char *path);
  * size of the file */
 int read_file(const char *path, void **data, size_t *size);
 
+/* Copy `size` bytes from `src_fd` to `dst_fd`
+ *
+ * This uses copy_file_range(), if the underlying filesystems support
+ * it, and falls back to copying through a userspace buffer */
+int copy_fd(int src_fd, int dst_fd, size_t size);
+
 #endif /* __UTILS_H__ */
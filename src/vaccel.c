@@ -18,6 +18,11 @@
 #include "vaccel.h"
 #include "resources.h"
 #include "utils.h"
+#include "async.h"
+#include "profiling/metrics.h"
+#include "profiling/op_prof.h"
+#include "profiling/prof_ctl.h"
+#include "profiling/trace.h"
 
 #include <sys/stat.h>
 #include <unistd.h>
@@ -185,6 +190,12 @@ static void vaccel_init(void)
 		exit(ret);
 	}
 
+	/* metrics are best-effort, so we just go on without them */
+	metrics_bootstrap();
+
+	/* same for runtime control of profiling */
+	prof_ctl_bootstrap();
+
 	/* initialize the backends system */
 	plugins_bootstrap();
 
@@ -200,8 +211,16 @@ __attribute__((destructor))
 static void vaccel_fini(void)
 {
 	vaccel_debug("Shutting down vAccel");
+	async_shutdown();
+	prof_ctl_shutdown();
+	op_prof_print();
+	trace_shutdown();
+	metrics_shutdown();
 	plugins_shutdown();
 	resources_cleanup();
 	sessions_cleanup();
 	cleanup_vaccel_rundir();
+
+	/* write out whatever the asynchronous logger still holds */
+	vaccel_log_flush();
 }
@@ -0,0 +1,197 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/* Functions the exec tests run */
+
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+struct vaccel_arg {
+	uint32_t size;
+	uint32_t flags;
+	void *buf;
+};
+
+/* Write twice the integer it reads */
+int exec_test_double(struct vaccel_arg *read, size_t nr_read,
+		struct vaccel_arg *write, size_t nr_write)
+{
+	if (nr_read < 1 || nr_write < 1 || read[0].size != sizeof(int) ||
+			write[0].size != sizeof(int))
+		return 1;
+
+	int in;
+	memcpy(&in, read[0].buf, sizeof(in));
+	in *= 2;
+	memcpy(write[0].buf, &in, sizeof(in));
+
+	return 0;
+}
+
+int exec_test_fail(struct vaccel_arg *read, size_t nr_read,
+		struct vaccel_arg *write, size_t nr_write)
+{
+	(void)read;
+	(void)nr_read;
+	(void)write;
+	(void)nr_write;
+
+	return 1;
+}
+
+int exec_test_crash(struct vaccel_arg *read, size_t nr_read,
+		struct vaccel_arg *write, size_t nr_write)
+{
+	(void)read;
+	(void)nr_read;
+	(void)write;
+	(void)nr_write;
+
+	raise(SIGSEGV);
+	return 0;
+}
+
+int exec_test_slow(struct vaccel_arg *read, size_t nr_read,
+		struct vaccel_arg *write, size_t nr_write)
+{
+	(void)read;
+	(void)nr_read;
+	(void)write;
+	(void)nr_write;
+
+	sleep(10);
+	return 0;
+}
+
+/* Claim to have written more than the caller's buffer can hold */
+int exec_test_grow(struct vaccel_arg *read, size_t nr_read,
+		struct vaccel_arg *write, size_t nr_write)
+{
+	(void)read;
+	(void)nr_read;
+
+	if (nr_write < 1)
+		return 1;
+
+	write[0].size *= 2;
+	return 0;
+}
+
+/* Keep writing to the write argument until killed */
+int exec_test_scribble(struct vaccel_arg *read, size_t nr_read,
+		struct vaccel_arg *write, size_t nr_write)
+{
+	(void)read;
+	(void)nr_read;
+
+	if (nr_write < 1)
+		return 1;
+
+	while (1)
+		memset(write[0].buf, 0xff, write[0].size);
+
+	return 0;
+}
+
+/* Write the address of the data of the argument it reads */
+int exec_test_addr(struct vaccel_arg *read, size_t nr_read,
+		struct vaccel_arg *write, size_t nr_write)
+{
+	if (nr_read < 1 || nr_write < 1 ||
+			write[0].size != sizeof(uintptr_t))
+		return 1;
+
+	uintptr_t addr = (uintptr_t)read[0].buf;
+	memcpy(write[0].buf, &addr, sizeof(addr));
+
+	return 0;
+}
+
+/* Write the bytes it reads in reverse order */
+int exec_test_reverse(struct vaccel_arg *read, size_t nr_read,
+		struct vaccel_arg *write, size_t nr_write)
+{
+	if (nr_read < 1 || nr_write < 1 || read[0].size != write[0].size)
+		return 1;
+
+	const uint8_t *in = read[0].buf;
+	uint8_t *out = write[0].buf;
+	for (uint32_t i = 0; i < read[0].size; ++i)
+		out[i] = in[read[0].size - 1 - i];
+
+	return 0;
+}
+
+struct vaccel_genop_set {
+	struct vaccel_arg *read;
+	int nr_read;
+	struct vaccel_arg *write;
+	int nr_write;
+	int ret;
+};
+
+#define NESTED_SETS 8
+
+/* Provided by the exec plugin, when the library runs in its process */
+extern int exec_batch(void *sess, struct vaccel_genop_set *sets,
+		int nr_sets) __attribute__((weak));
+
+/* Run a batch of exec_test_double on [in, in + NESTED_SETS) and write
+ * the sum of the results. It reads the integer, the session and the path
+ * of this library */
+int exec_test_nested(struct vaccel_arg *read, size_t nr_read,
+		struct vaccel_arg *write, size_t nr_write)
+{
+	if (!exec_batch || nr_read < 3 || nr_write < 1 ||
+			read[0].size != sizeof(int) ||
+			write[0].size != sizeof(int))
+		return 1;
+
+	int in;
+	memcpy(&in, read[0].buf, sizeof(in));
+
+	char symbol[] = "exec_test_double";
+	int inputs[NESTED_SETS], outputs[NESTED_SETS];
+	struct vaccel_arg args[NESTED_SETS][3], res[NESTED_SETS];
+	struct vaccel_genop_set sets[NESTED_SETS];
+
+	for (int i = 0; i < NESTED_SETS; ++i) {
+		inputs[i] = in + i;
+		args[i][0] = read[2];
+		args[i][1] = (struct vaccel_arg){ sizeof(symbol), 0, symbol };
+		args[i][2] = (struct vaccel_arg){ sizeof(int), 0, &inputs[i] };
+		res[i] = (struct vaccel_arg){ sizeof(int), 0, &outputs[i] };
+		sets[i] = (struct vaccel_genop_set){ args[i], 3, &res[i], 1,
+			-1 };
+	}
+
+	if (exec_batch(read[1].buf, sets, NESTED_SETS))
+		return 1;
+
+	int sum = 0;
+	for (int i = 0; i < NESTED_SETS; ++i) {
+		if (sets[i].ret)
+			return 1;
+
+		sum += outputs[i];
+	}
+
+	memcpy(write[0].buf, &sum, sizeof(sum));
+
+	return 0;
+}
@@ -0,0 +1,67 @@
+#include <gtest/gtest.h>
+
+extern "C" {
+#include "async.h"
+#include "error.h"
+
+#include <stdlib.h>
+}
+
+#include <atomic>
+
+/* The bound is read when the workers start, so set it before any job
+ * is submitted */
+static int async_env = setenv("VACCEL_ASYNC_WORKERS", "1", 1) |
+    setenv("VACCEL_ASYNC_MAX_INFLIGHT", "1", 1);
+
+static std::atomic<int> nr_done;
+
+static int job(void *arg)
+{
+    (void)arg;
+    return VACCEL_OK;
+}
+
+static void job_done(int ret, void *priv)
+{
+    (void)priv;
+    if (!ret)
+        nr_done++;
+}
+
+/* Submit one more job from the callback, while its own job still
+ * counts as in flight */
+static void resubmit(int ret, void *priv)
+{
+    int *left = (int *)priv;
+
+    job_done(ret, NULL);
+    if (--*left) {
+        EXPECT_EQ(async_submit(job, NULL, resubmit, left), VACCEL_OK);
+    }
+}
+
+static int submit_job(void *arg)
+{
+    (void)arg;
+    return async_submit(job, NULL, job_done, NULL);
+}
+
+TEST(Async, submit_from_callback)
+{
+    ASSERT_EQ(async_env, 0);
+
+    int left = 10;
+    nr_done = 0;
+    ASSERT_EQ(async_submit(job, NULL, resubmit, &left), VACCEL_OK);
+    ASSERT_EQ(async_wait(), VACCEL_OK);
+    EXPECT_EQ(nr_done, 10);
+}
+
+TEST(Async, submit_from_job)
+{
+    nr_done = 0;
+    ASSERT_EQ(async_submit(submit_job, NULL, job_done, NULL), VACCEL_OK);
+    ASSERT_EQ(async_wait(), VACCEL_OK);
+    EXPECT_EQ(nr_done, 2);
+}
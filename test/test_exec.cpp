@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+
+extern "C" {
+#include "error.h"
+#include "workers.h"
+
+#include <stdlib.h>
+}
+
+#include <thread>
+#include <vector>
+
+class ExecWorkers : public ::testing::Test {
+protected:
+    static void SetUpTestSuite()
+    {
+        setenv("VACCEL_EXEC_WORKERS", "2", 1);
+        setenv("VACCEL_EXEC_TIMEOUT", "300", 1);
+        ASSERT_EQ(exec_workers_init(), VACCEL_OK);
+    }
+
+    static void TearDownTestSuite()
+    {
+        exec_workers_shutdown();
+    }
+
+    static int run(const char *symbol, int in, int *out)
+    {
+        struct vaccel_arg read[] = { { sizeof(in), 0, &in } };
+        struct vaccel_arg write[] = { { sizeof(*out), 0, out } };
+
+        return exec_workers_run(EXEC_TEST_LIB, symbol, read, 1, write, 1);
+    }
+};
+
+TEST_F(ExecWorkers, run)
+{
+    int out = 0;
+
+    ASSERT_TRUE(exec_workers_enabled());
+    ASSERT_EQ(run("exec_test_double", 21, &out), VACCEL_OK);
+    EXPECT_EQ(out, 42);
+
+    EXPECT_EQ(run("exec_test_fail", 1, &out), VACCEL_ENOEXEC);
+    EXPECT_NE(run("exec_test_missing", 1, &out), VACCEL_OK);
+}
+
+TEST_F(ExecWorkers, concurrent)
+{
+    std::vector<std::thread> threads;
+    std::vector<int> errors(4, 0);
+
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([t, &errors]() {
+            for (int i = 0; i < 100; ++i) {
+                int out = 0;
+                if (run("exec_test_double", t * 1000 + i, &out) ||
+                        out != 2 * (t * 1000 + i))
+                    errors[t]++;
+            }
+        });
+    }
+
+    for (auto &thread : threads)
+        thread.join();
+
+    for (int t = 0; t < 4; ++t)
+        EXPECT_EQ(errors[t], 0);
+}
+
+TEST_F(ExecWorkers, crash)
+{
+    int out = 0;
+
+    /* The worker is replaced, while other threads keep calling */
+    std::thread other([]() {
+        for (int i = 0; i < 50; ++i) {
+            int out = 0;
+            EXPECT_EQ(run("exec_test_double", i, &out), VACCEL_OK);
+        }
+    });
+
+    for (int i = 0; i < 5; ++i)
+        EXPECT_EQ(run("exec_test_crash", 1, &out), VACCEL_EIO);
+
+    other.join();
+
+    ASSERT_EQ(run("exec_test_double", 2, &out), VACCEL_OK);
+    EXPECT_EQ(out, 4);
+}
+
+TEST_F(ExecWorkers, timeout)
+{
+    int out = 0;
+
+    EXPECT_EQ(run("exec_test_slow", 1, &out), VACCEL_ETIMEDOUT);
+
+    ASSERT_EQ(run("exec_test_double", 3, &out), VACCEL_OK);
+    EXPECT_EQ(out, 6);
+}
+
+TEST_F(ExecWorkers, write_size)
+{
+    int out = 0;
+
+    /* The size reported back never exceeds the buffer */
+    struct vaccel_arg write[] = { { sizeof(out), 0, &out } };
+    ASSERT_EQ(exec_workers_run(EXEC_TEST_LIB, "exec_test_grow", NULL, 0,
+            write, 1), VACCEL_OK);
+    EXPECT_EQ(write[0].size, sizeof(out));
+}
+
+/* A worker that timed out is gone before the memory of its call is
+ * handed out again */
+TEST_F(ExecWorkers, timeout_reuse)
+{
+    int out = 0;
+
+    EXPECT_EQ(run("exec_test_scribble", 1, &out), VACCEL_ETIMEDOUT);
+
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_EQ(run("exec_test_double", i, &out), VACCEL_OK);
+        ASSERT_EQ(out, 2 * i);
+    }
+}
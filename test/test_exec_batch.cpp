@@ -0,0 +1,203 @@
+#include <gtest/gtest.h>
+
+extern "C" {
+#include "batch.h"
+#include "error.h"
+#include "session.h"
+#include "ops/exec.h"
+#include "ops/genop.h"
+}
+
+#include <thread>
+#include <vector>
+
+class ExecBatch : public ::testing::Test {
+protected:
+    static void TearDownTestSuite()
+    {
+        exec_batch_shutdown();
+    }
+
+    struct batch {
+        std::vector<int> inputs, outputs;
+        std::vector<struct vaccel_arg> args, res;
+        std::vector<struct vaccel_genop_set> sets;
+
+        /* Sets running `symbol` on [first, first + nr) in the unpacked
+         * format, with the library and the symbol as read arguments.
+         * Given a session, the sets also pass it along with the path of
+         * the library, for exec_test_nested */
+        batch(const char *symbol, int first, int nr,
+                struct vaccel_session *sess = NULL)
+            : inputs(nr), outputs(nr, 0), args(5 * nr), res(nr),
+              sets(nr)
+        {
+            for (int i = 0; i < nr; ++i) {
+                struct vaccel_arg *a = &args[5 * i];
+
+                inputs[i] = first + i;
+                a[0] = { sizeof(EXEC_TEST_LIB), 0,
+                    (void *)EXEC_TEST_LIB };
+                a[1] = { (uint32_t)strlen(symbol) + 1, 0,
+                    (void *)symbol };
+                a[2] = { sizeof(int), 0, &inputs[i] };
+                a[3] = { 0, 0, sess };
+                a[4] = a[0];
+                res[i] = { sizeof(int), 0, &outputs[i] };
+                sets[i] = { a, sess ? 5 : 3, &res[i], 1, -1 };
+            }
+        }
+
+        int run(struct vaccel_session *sess)
+        {
+            return exec_batch(sess, sets.data(), (int)sets.size());
+        }
+    };
+
+    struct vaccel_session sess = {};
+};
+
+TEST_F(ExecBatch, run)
+{
+    batch b("exec_test_double", 0, 1000);
+
+    ASSERT_EQ(b.run(&sess), VACCEL_OK);
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_EQ(b.sets[i].ret, VACCEL_OK);
+        EXPECT_EQ(b.outputs[i], 2 * i);
+    }
+
+    EXPECT_EQ(exec_batch(&sess, NULL, 1), VACCEL_EINVAL);
+    EXPECT_EQ(exec_batch(&sess, b.sets.data(), 0), VACCEL_EINVAL);
+}
+
+TEST_F(ExecBatch, failure)
+{
+    batch b("exec_test_fail", 0, 16);
+
+    ASSERT_EQ(b.run(&sess), VACCEL_OK);
+    for (int i = 0; i < 16; ++i)
+        EXPECT_EQ(b.sets[i].ret, VACCEL_ENOEXEC);
+}
+
+/* Batches of several threads run at the same time */
+TEST_F(ExecBatch, concurrent)
+{
+    std::vector<std::thread> threads;
+    std::vector<int> errors(4, 0);
+
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([this, t, &errors]() {
+            for (int n = 0; n < 20; ++n) {
+                batch b("exec_test_double", t * 1000, 100);
+                if (b.run(&sess)) {
+                    errors[t]++;
+                    continue;
+                }
+
+                for (int i = 0; i < 100; ++i) {
+                    if (b.sets[i].ret ||
+                            b.outputs[i] != 2 * (t * 1000 + i))
+                        errors[t]++;
+                }
+            }
+        });
+    }
+
+    for (auto &thread : threads)
+        thread.join();
+
+    for (int t = 0; t < 4; ++t)
+        EXPECT_EQ(errors[t], 0);
+}
+
+/* Functions of a batch run batches of their own */
+TEST_F(ExecBatch, nested)
+{
+    batch b("exec_test_nested", 0, 16, &sess);
+
+    ASSERT_EQ(b.run(&sess), VACCEL_OK);
+    for (int i = 0; i < 16; ++i) {
+        /* 2 * (i + (i + 1) + ... + (i + 7)) */
+        EXPECT_EQ(b.sets[i].ret, VACCEL_OK);
+        EXPECT_EQ(b.outputs[i], 2 * (8 * i + 28));
+    }
+}
+
+class ExecArgs : public ::testing::Test {
+protected:
+    struct vaccel_session sess;
+
+    void SetUp() override
+    {
+        ASSERT_EQ(vaccel_sess_init(&sess, 0), VACCEL_OK);
+    }
+
+    void TearDown() override
+    {
+        vaccel_sess_free(&sess);
+    }
+};
+
+/* A single segment reaches the library in place, not as a copy */
+TEST_F(ExecArgs, in_place)
+{
+    char data[64] = "in place";
+    uintptr_t addr = 0;
+
+    struct vaccel_iovec seg = { data, sizeof(data) };
+    struct vaccel_arg_ext ext;
+    struct vaccel_arg read[1];
+    struct vaccel_arg write[] = { { sizeof(addr), 0, &addr } };
+    ASSERT_EQ(vaccel_arg_init_ext(&read[0], &ext, &seg, 1), VACCEL_OK);
+
+    ASSERT_EQ(vaccel_exec(&sess, EXEC_TEST_LIB, "exec_test_addr", read, 1,
+                write, 1), VACCEL_OK);
+    EXPECT_EQ(addr, (uintptr_t)data);
+
+    struct vaccel_arg set_read[] = {
+        { sizeof(EXEC_TEST_LIB), 0, (void *)EXEC_TEST_LIB },
+        { sizeof("exec_test_addr"), 0, (void *)"exec_test_addr" },
+        read[0],
+    };
+    struct vaccel_genop_set set = { set_read, 3, write, 1, -1 };
+
+    addr = 0;
+    ASSERT_EQ(exec_batch(&sess, &set, 1), VACCEL_OK);
+    EXPECT_EQ(set.ret, VACCEL_OK);
+    EXPECT_EQ(addr, (uintptr_t)data);
+}
+
+/* Segments are gathered for the library and what it writes is scattered
+ * back to them */
+TEST_F(ExecArgs, segments)
+{
+    uint8_t in_lo[3] = { 1, 2, 3 }, in_hi[4] = { 4, 5, 6, 7 };
+    uint8_t out_lo[5] = { 0 }, out_hi[2] = { 0 };
+
+    struct vaccel_iovec in_segs[] = {
+        { in_lo, sizeof(in_lo) }, { in_hi, sizeof(in_hi) }
+    };
+    struct vaccel_iovec out_segs[] = {
+        { out_lo, sizeof(out_lo) }, { out_hi, sizeof(out_hi) }
+    };
+    struct vaccel_arg_ext in_ext, out_ext;
+    struct vaccel_arg read[1], write[1];
+    ASSERT_EQ(vaccel_arg_init_ext(&read[0], &in_ext, in_segs, 2), VACCEL_OK);
+    ASSERT_EQ(vaccel_arg_init_ext(&write[0], &out_ext, out_segs, 2),
+            VACCEL_OK);
+
+    ASSERT_EQ(vaccel_exec(&sess, EXEC_TEST_LIB, "exec_test_reverse", read, 1,
+                write, 1), VACCEL_OK);
+    EXPECT_EQ(out_lo[0], 7);
+    EXPECT_EQ(out_lo[4], 3);
+    EXPECT_EQ(out_hi[0], 2);
+    EXPECT_EQ(out_hi[1], 1);
+
+    /* Nothing is written back when the library fails */
+    memset(out_lo, 0, sizeof(out_lo));
+    out_segs[1].len = 1;
+    EXPECT_EQ(vaccel_exec(&sess, EXEC_TEST_LIB, "exec_test_reverse", read, 1,
+                write, 1), VACCEL_ENOEXEC);
+    EXPECT_EQ(out_lo[0], 0);
+}
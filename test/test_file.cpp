@@ -0,0 +1,461 @@
+#include <gtest/gtest.h>
+
+extern "C" {
+#include "checksum.h"
+#include "error.h"
+#include "vaccel_file.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+}
+
+#include <string>
+#include <vector>
+
+TEST(Checksum, known_vector)
+{
+    const char *data = "123456789";
+
+    EXPECT_EQ(crc32c(0, data, strlen(data)), 0xe3069283u);
+    EXPECT_EQ(crc32c(0, NULL, 0), 0u);
+}
+
+TEST(Checksum, incremental)
+{
+    size_t len = 3 * 4096 * 4 + 123;
+    unsigned char *buf = (unsigned char *)malloc(len);
+    ASSERT_NE(buf, nullptr);
+    for (size_t i = 0; i < len; ++i)
+        buf[i] = (unsigned char)(i * 7 + 3);
+
+    uint32_t whole = crc32c(0, buf, len);
+    uint32_t parts = crc32c(0, buf, 17);
+    parts = crc32c(parts, buf + 17, len - 17);
+    EXPECT_EQ(whole, parts);
+
+    free(buf);
+}
+
+class FileChecksum : public ::testing::Test {
+protected:
+    char path[64];
+
+    void SetUp() override
+    {
+        strcpy(path, "/tmp/vaccel_file_test.XXXXXX");
+        int fd = mkstemp(path);
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(write(fd, "123456789", 9), 9);
+        close(fd);
+    }
+
+    void TearDown() override
+    {
+        unlink(path);
+    }
+};
+
+TEST_F(FileChecksum, path)
+{
+    struct vaccel_file file;
+    uint32_t checksum;
+
+    ASSERT_EQ(vaccel_file_new(&file, path), VACCEL_OK);
+    ASSERT_EQ(vaccel_file_checksum(&file, &checksum), VACCEL_OK);
+    EXPECT_EQ(checksum, 0xe3069283u);
+    EXPECT_EQ(vaccel_file_verify(&file, 0xe3069283u), VACCEL_OK);
+    EXPECT_EQ(vaccel_file_verify(&file, 0), VACCEL_EBADMSG);
+    ASSERT_EQ(vaccel_file_destroy(&file), VACCEL_OK);
+
+    /* The second time around the checksum comes from the cache */
+    ASSERT_EQ(vaccel_file_new(&file, path), VACCEL_OK);
+    ASSERT_EQ(vaccel_file_checksum(&file, &checksum), VACCEL_OK);
+    EXPECT_EQ(checksum, 0xe3069283u);
+    ASSERT_EQ(vaccel_file_destroy(&file), VACCEL_OK);
+}
+
+TEST_F(FileChecksum, modified)
+{
+    struct vaccel_file file;
+    uint32_t checksum;
+
+    ASSERT_EQ(vaccel_file_new(&file, path), VACCEL_OK);
+    ASSERT_EQ(vaccel_file_checksum(&file, &checksum), VACCEL_OK);
+    ASSERT_EQ(vaccel_file_destroy(&file), VACCEL_OK);
+
+    /* A stale cached checksum must not be used */
+    FILE *fp = fopen(path, "a");
+    ASSERT_NE(fp, nullptr);
+    fputs("0", fp);
+    fclose(fp);
+
+    ASSERT_EQ(vaccel_file_new(&file, path), VACCEL_OK);
+    ASSERT_EQ(vaccel_file_checksum(&file, &checksum), VACCEL_OK);
+    EXPECT_EQ(checksum, crc32c(0, "1234567890", 10));
+    ASSERT_EQ(vaccel_file_destroy(&file), VACCEL_OK);
+}
+
+TEST_F(FileChecksum, new_verified)
+{
+    struct vaccel_file file;
+
+    ASSERT_EQ(vaccel_file_new_verified(&file, path, 0xe3069283u), VACCEL_OK);
+    ASSERT_EQ(vaccel_file_destroy(&file), VACCEL_OK);
+
+    EXPECT_EQ(vaccel_file_new_verified(&file, path, 0xdeadbeef),
+            VACCEL_EBADMSG);
+    EXPECT_EQ(file.path, nullptr);
+
+    /* The checksum is not stored on the file itself */
+    EXPECT_LT(getxattr(path, "user.vaccel.crc32c", NULL, 0), 0);
+}
+
+TEST_F(FileChecksum, manifest)
+{
+    struct vaccel_file file;
+    char manifest[] = "/tmp/vaccel_manifest_test.XXXXXX";
+
+    int fd = mkstemp(manifest);
+    ASSERT_GE(fd, 0);
+    close(fd);
+
+    setenv("VACCEL_VERIFY_FILES", "enabled", 1);
+
+    /* No manifest to verify against */
+    EXPECT_NE(vaccel_file_new(&file, path), VACCEL_OK);
+
+    /* Not listed in the manifest */
+    setenv("VACCEL_VERIFY_MANIFEST", manifest, 1);
+    EXPECT_EQ(vaccel_file_new(&file, path), VACCEL_EPERM);
+
+    FILE *fp = fopen(manifest, "w");
+    ASSERT_NE(fp, nullptr);
+    fprintf(fp, "# trusted files\ne3069283  %s\n", path);
+    fclose(fp);
+    ASSERT_EQ(vaccel_file_new(&file, path), VACCEL_OK);
+    ASSERT_EQ(vaccel_file_destroy(&file), VACCEL_OK);
+
+    fp = fopen(manifest, "w");
+    ASSERT_NE(fp, nullptr);
+    fprintf(fp, "00000000 %s\n", path);
+    fclose(fp);
+    EXPECT_EQ(vaccel_file_new(&file, path), VACCEL_EBADMSG);
+
+    unsetenv("VACCEL_VERIFY_FILES");
+    unsetenv("VACCEL_VERIFY_MANIFEST");
+    unlink(manifest);
+}
+
+TEST(FileChecksumBuffer, memory)
+{
+    struct vaccel_file file;
+    uint32_t checksum;
+    uint8_t data[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+
+    ASSERT_EQ(vaccel_file_from_buffer(&file, data, sizeof(data), NULL, false,
+            NULL, false), VACCEL_OK);
+    ASSERT_EQ(vaccel_file_checksum(&file, &checksum), VACCEL_OK);
+    EXPECT_EQ(checksum, 0xe3069283u);
+    EXPECT_EQ(vaccel_file_checksum(NULL, &checksum), VACCEL_EINVAL);
+}
+
+/* Helpers building LZ4 frames by hand */
+static void lz4_put_le32(std::vector<uint8_t> &out, uint32_t v)
+{
+    for (int i = 0; i < 4; ++i)
+        out.push_back((v >> (8 * i)) & 0xff);
+}
+
+static void lz4_put_length(std::vector<uint8_t> &out, size_t len)
+{
+    for (; len >= 255; len -= 255)
+        out.push_back(255);
+    out.push_back(len);
+}
+
+/* A compressed block expanding to `n` bytes of `c` */
+static std::vector<uint8_t> lz4_rle_block(uint8_t c, size_t n)
+{
+    std::vector<uint8_t> block = { 0x1f, c, 0x01, 0x00 };
+    lz4_put_length(block, n - 6 - 4 - 15);
+    block.push_back(0x50);
+    block.insert(block.end(), 5, c);
+    return block;
+}
+
+static std::vector<uint8_t> lz4_frame(
+    const std::vector<std::vector<uint8_t>> &blocks, bool independent,
+    size_t content_size, std::vector<bool> uncompressed = {})
+{
+    std::vector<uint8_t> frame;
+    lz4_put_le32(frame, 0x184D2204);
+    frame.push_back(0x40 | (independent ? 0x20 : 0) |
+            (content_size ? 0x08 : 0));
+    frame.push_back(0x40);
+    if (content_size) {
+        lz4_put_le32(frame, content_size);
+        lz4_put_le32(frame, 0);
+    }
+    frame.push_back(0);
+
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        uint32_t size = blocks[i].size();
+        if (i < uncompressed.size() && uncompressed[i])
+            size |= 1U << 31;
+        lz4_put_le32(frame, size);
+        frame.insert(frame.end(), blocks[i].begin(), blocks[i].end());
+    }
+    lz4_put_le32(frame, 0);
+
+    return frame;
+}
+
+TEST(FileCompressed, linked_blocks)
+{
+    struct vaccel_file file;
+    std::vector<uint8_t> block = {
+        0x48, 'a', 'b', 'c', 'd', 0x04, 0x00, 0x30, 'x', 'y', 'z'
+    };
+    std::vector<uint8_t> raw = { 'r', 'a', 'w' };
+    std::vector<uint8_t> frame = lz4_frame({ block, raw }, false, 0,
+            { false, true });
+
+    ASSERT_EQ(vaccel_file_from_compressed_buffer(&file, frame.data(),
+            frame.size(), "linked", "/tmp", true), VACCEL_OK);
+
+    size_t size;
+    uint8_t *data = vaccel_file_data(&file, &size);
+    ASSERT_NE(data, nullptr);
+    EXPECT_EQ(std::string((char *)data, size), "abcdabcdabcdabcdxyzraw");
+    ASSERT_EQ(vaccel_file_destroy(&file), VACCEL_OK);
+}
+
+TEST(FileCompressed, parallel_blocks)
+{
+    struct vaccel_file file;
+    size_t sizes[] = { 65536, 65536, 65536, 1000 };
+    std::vector<std::vector<uint8_t>> blocks;
+    size_t total = 0;
+
+    for (size_t i = 0; i < 4; ++i) {
+        blocks.push_back(lz4_rle_block('A' + i, sizes[i]));
+        total += sizes[i];
+    }
+
+    setenv("VACCEL_DECOMPRESS_THREADS", "3", 1);
+    std::vector<uint8_t> frame = lz4_frame(blocks, true, total);
+    ASSERT_EQ(vaccel_file_from_compressed_buffer(&file, frame.data(),
+            frame.size(), "parallel", "/tmp", true), VACCEL_OK);
+    unsetenv("VACCEL_DECOMPRESS_THREADS");
+
+    size_t size;
+    uint8_t *data = vaccel_file_data(&file, &size);
+    ASSERT_NE(data, nullptr);
+    ASSERT_EQ(size, total);
+
+    size_t off = 0;
+    for (size_t i = 0; i < 4; ++i) {
+        for (size_t j = 0; j < sizes[i]; ++j)
+            ASSERT_EQ(data[off + j], 'A' + i);
+        off += sizes[i];
+    }
+    ASSERT_EQ(vaccel_file_destroy(&file), VACCEL_OK);
+
+    /* Without a content size, the file is trimmed after decompression */
+    frame = lz4_frame(blocks, true, 0);
+    ASSERT_EQ(vaccel_file_from_compressed_buffer(&file, frame.data(),
+            frame.size(), "parallel", "/tmp", true), VACCEL_OK);
+    data = vaccel_file_data(&file, &size);
+    ASSERT_EQ(size, total);
+    ASSERT_EQ(vaccel_file_destroy(&file), VACCEL_OK);
+}
+
+TEST(FileCompressed, from_path)
+{
+    struct vaccel_file file;
+    std::vector<uint8_t> frame =
+        lz4_frame({ lz4_rle_block('z', 100) }, true, 100);
+    const char *path = "/tmp/vaccel_file_test_model.bin.lz4";
+
+    FILE *fp = fopen(path, "w");
+    ASSERT_NE(fp, nullptr);
+    ASSERT_EQ(fwrite(frame.data(), 1, frame.size(), fp), frame.size());
+    fclose(fp);
+
+    ASSERT_EQ(vaccel_file_new_compressed(&file, path, "/tmp", false),
+            VACCEL_OK);
+    EXPECT_STREQ(vaccel_file_path(&file), "/tmp/vaccel_file_test_model.bin");
+
+    size_t size;
+    uint8_t *data = vaccel_file_data(&file, &size);
+    ASSERT_EQ(size, 100u);
+    EXPECT_EQ(data[99], 'z');
+
+    ASSERT_EQ(vaccel_file_destroy(&file), VACCEL_OK);
+    unlink(path);
+}
+
+TEST(FileCompressed, invalid)
+{
+    struct vaccel_file file;
+
+    /* Match offset pointing before the start of the data */
+    std::vector<uint8_t> bad = { 0x10, 'a', 0x02, 0x00, 0x00 };
+    std::vector<uint8_t> frame = lz4_frame({ bad }, true, 0);
+    EXPECT_EQ(vaccel_file_from_compressed_buffer(&file, frame.data(),
+            frame.size(), "invalid", "/tmp", false), VACCEL_EINVAL);
+    EXPECT_NE(access("/tmp/invalid", F_OK), 0);
+
+    /* Truncated frame */
+    frame.resize(frame.size() - 6);
+    EXPECT_EQ(vaccel_file_from_compressed_buffer(&file, frame.data(),
+            frame.size(), "invalid", "/tmp", false), VACCEL_EINVAL);
+
+    /* Data after the frame, here a skippable frame */
+    frame = lz4_frame({ lz4_rle_block('z', 100) }, true, 0);
+    lz4_put_le32(frame, 0x184D2A50U);
+    lz4_put_le32(frame, 4);
+    lz4_put_le32(frame, 0);
+    EXPECT_EQ(vaccel_file_from_compressed_buffer(&file, frame.data(),
+            frame.size(), "invalid", "/tmp", false), VACCEL_EINVAL);
+
+    /* Header truncated right before the header checksum */
+    std::vector<uint8_t> header;
+    lz4_put_le32(header, 0x184D2204U);
+    header.push_back(0x68);
+    header.push_back(0x70);
+    header.insert(header.end(), 8, 0);
+    EXPECT_EQ(vaccel_file_from_compressed_buffer(&file, header.data(),
+            header.size(), "invalid", "/tmp", false), VACCEL_EINVAL);
+
+    uint8_t zstd[] = { 0x28, 0xb5, 0x2f, 0xfd, 0x00, 0x00 };
+    EXPECT_NE(vaccel_file_from_compressed_buffer(&file, zstd,
+            sizeof(zstd), "invalid", "/tmp", false), VACCEL_OK);
+    EXPECT_NE(access("/tmp/invalid", F_OK), 0);
+}
+
+TEST(FileCompressed, zstd)
+{
+    struct vaccel_file file;
+    const char *expected =
+        "vAccel zstd frame, vAccel zstd frame, vAccel zstd frame!";
+
+    /* Output of `zstd -19` */
+    uint8_t frame[] = {
+        0x28, 0xb5, 0x2f, 0xfd, 0x04, 0x68, 0xd5, 0x00, 0x00, 0xa0,
+        0x76, 0x41, 0x63, 0x63, 0x65, 0x6c, 0x20, 0x7a, 0x73, 0x74,
+        0x64, 0x20, 0x66, 0x72, 0x61, 0x6d, 0x65, 0x2c, 0x20, 0x21,
+        0x01, 0x00, 0x1b, 0x39, 0xc3, 0x56, 0xa1, 0x83, 0xdc,
+    };
+
+    int ret = vaccel_file_from_compressed_buffer(&file, frame,
+            sizeof(frame), "zstd", "/tmp", true);
+    if (ret == VACCEL_ENOTSUP)
+        GTEST_SKIP() << "libzstd is not available";
+    ASSERT_EQ(ret, VACCEL_OK);
+
+    size_t size;
+    uint8_t *data = vaccel_file_data(&file, &size);
+    ASSERT_NE(data, nullptr);
+    EXPECT_EQ(std::string((char *)data, size), expected);
+    ASSERT_EQ(vaccel_file_destroy(&file), VACCEL_OK);
+
+    /* Corrupted payload */
+    frame[20] ^= 0xff;
+    EXPECT_EQ(vaccel_file_from_compressed_buffer(&file, frame,
+            sizeof(frame), "zstd", "/tmp", true), VACCEL_EINVAL);
+}
+
+TEST_F(FileChecksum, persist_from_path)
+{
+    struct vaccel_file file;
+    char dir[] = "/tmp/vaccel_file_test_dir.XXXXXX";
+
+    ASSERT_NE(mkdtemp(dir), nullptr);
+    ASSERT_EQ(vaccel_file_new(&file, path), VACCEL_OK);
+    ASSERT_EQ(vaccel_file_persist(&file, dir, "copy", true), VACCEL_OK);
+
+    const char *copy = vaccel_file_path(&file);
+    ASSERT_NE(copy, nullptr);
+    EXPECT_EQ(strncmp(copy, dir, strlen(dir)), 0);
+
+    size_t size;
+    uint8_t *data = vaccel_file_data(&file, &size);
+    ASSERT_NE(data, nullptr);
+    EXPECT_EQ(std::string((char *)data, size), "123456789");
+
+    /* Already persisted */
+    EXPECT_EQ(vaccel_file_persist(&file, dir, "copy", true),
+            VACCEL_EEXISTS);
+
+    std::string copy_path(copy);
+    ASSERT_EQ(vaccel_file_destroy(&file), VACCEL_OK);
+    EXPECT_NE(access(copy_path.c_str(), F_OK), 0);
+    EXPECT_EQ(access(path, F_OK), 0);
+    EXPECT_EQ(rmdir(dir), 0);
+}
+
+/* A failed persist leaves the original file alone */
+TEST_F(FileChecksum, persist_failure)
+{
+    struct vaccel_file file;
+    char dir[] = "/tmp/vaccel_file_test_dir.XXXXXX";
+
+    ASSERT_NE(mkdtemp(dir), nullptr);
+    std::string target = std::string(dir) + "/copy";
+    ASSERT_EQ(mkdir(target.c_str(), 0700), 0);
+
+    ASSERT_EQ(vaccel_file_new(&file, path), VACCEL_OK);
+    EXPECT_EQ(vaccel_file_persist(&file, dir, "copy", false), EISDIR);
+    EXPECT_STREQ(vaccel_file_path(&file), path);
+
+    ASSERT_EQ(vaccel_file_destroy(&file), VACCEL_OK);
+    EXPECT_EQ(access(path, F_OK), 0);
+    EXPECT_EQ(rmdir(target.c_str()), 0);
+    EXPECT_EQ(rmdir(dir), 0);
+}
+
+TEST(FileSharedStore, dedup)
+{
+    struct vaccel_file a, b;
+    char dir[] = "/tmp/vaccel_file_test_dir.XXXXXX";
+    char data_a[] = "shared model weights";
+    char data_b[] = "shared model weights";
+
+    ASSERT_NE(mkdtemp(dir), nullptr);
+    setenv("VACCEL_SHARED_STORE", "enabled", 1);
+
+    ASSERT_EQ(vaccel_file_from_buffer(&a, (uint8_t *)data_a,
+            sizeof(data_a), "model", true, dir, true), VACCEL_OK);
+    ASSERT_EQ(vaccel_file_from_buffer(&b, (uint8_t *)data_b,
+            sizeof(data_b), "model", true, dir, true), VACCEL_OK);
+
+    unsetenv("VACCEL_SHARED_STORE");
+
+    /* Both files point to the same object */
+    char *object_a = realpath(vaccel_file_path(&a), NULL);
+    char *object_b = realpath(vaccel_file_path(&b), NULL);
+    ASSERT_NE(object_a, nullptr);
+    ASSERT_NE(object_b, nullptr);
+    EXPECT_STREQ(object_a, object_b);
+    EXPECT_STRNE(vaccel_file_path(&a), vaccel_file_path(&b));
+
+    size_t size;
+    uint8_t *data = vaccel_file_data(&a, &size);
+    ASSERT_EQ(size, sizeof(data_a));
+    EXPECT_STREQ((char *)data, "shared model weights");
+
+    /* The object stays around for as long as it is referenced */
+    ASSERT_EQ(vaccel_file_destroy(&a), VACCEL_OK);
+    EXPECT_EQ(access(object_b, F_OK), 0);
+    ASSERT_EQ(vaccel_file_destroy(&b), VACCEL_OK);
+    EXPECT_NE(access(object_b, F_OK), 0);
+
+    free(object_a);
+    free(object_b);
+    EXPECT_EQ(rmdir(dir), 0);
+}
@@ -0,0 +1,313 @@
+#include <gtest/gtest.h>
+
+extern "C" {
+#include "error.h"
+#include "session.h"
+#include "ops/exec.h"
+#include "ops/genop.h"
+#include "ops/pipeline.h"
+#include "ops/vaccel_ops.h"
+}
+
+class GenopSession : public ::testing::Test {
+protected:
+    struct vaccel_session sess;
+
+    void SetUp() override
+    {
+        ASSERT_EQ(vaccel_sess_init(&sess, 0), VACCEL_OK);
+    }
+
+    void TearDown() override
+    {
+        EXPECT_EQ(vaccel_sess_free(&sess), VACCEL_OK);
+    }
+};
+
+class GenopBatch : public GenopSession {};
+class GenopScatter : public GenopSession {};
+class GenopPipeline : public GenopSession {};
+
+TEST_F(GenopBatch, single_noop)
+{
+    enum vaccel_op_type op = VACCEL_NO_OP;
+    struct vaccel_arg read[] = { { sizeof(op), 0, &op } };
+
+    EXPECT_EQ(vaccel_genop(&sess, read, 1, NULL, 0), VACCEL_OK);
+}
+
+TEST_F(GenopBatch, mixed_types)
+{
+    enum vaccel_op_type noop = VACCEL_NO_OP, exec = VACCEL_EXEC;
+    enum vaccel_op_type invalid = VACCEL_FUNCTIONS_NR;
+    char library[] = "libfoo.so", symbol[] = "foo";
+    int input = 1, output = 0;
+
+    struct vaccel_arg noop_read[] = { { sizeof(noop), 0, &noop } };
+    struct vaccel_arg exec_read[] = {
+        { sizeof(exec), 0, &exec },
+        { sizeof(library), 0, library },
+        { sizeof(symbol), 0, symbol },
+        { sizeof(input), 0, &input },
+    };
+    struct vaccel_arg exec_write[] = { { sizeof(output), 0, &output } };
+    struct vaccel_arg invalid_read[] = { { sizeof(invalid), 0, &invalid } };
+
+    struct vaccel_genop_set sets[] = {
+        { noop_read, 1, NULL, 0, -1 },
+        { exec_read, 4, exec_write, 1, -1 },
+        { noop_read, 1, NULL, 0, -1 },
+        { exec_read, 4, exec_write, 1, -1 },
+        { noop_read, 1, NULL, 0, -1 },
+    };
+    int nr_sets = sizeof(sets) / sizeof(sets[0]);
+
+    ASSERT_EQ(vaccel_genop_batch(&sess, sets, nr_sets), VACCEL_OK);
+    for (int i = 0; i < nr_sets; ++i)
+        EXPECT_EQ(sets[i].ret, VACCEL_OK);
+
+    /* Failures are reported per operation */
+    sets[1].read = invalid_read;
+    sets[1].nr_read = 1;
+    sets[2].nr_read = 0;
+    EXPECT_EQ(vaccel_genop_batch(&sess, sets, nr_sets), VACCEL_EINVAL);
+    EXPECT_EQ(sets[0].ret, VACCEL_OK);
+    EXPECT_EQ(sets[1].ret, VACCEL_EINVAL);
+    EXPECT_EQ(sets[2].ret, VACCEL_EINVAL);
+    EXPECT_EQ(sets[3].ret, VACCEL_OK);
+    EXPECT_EQ(sets[4].ret, VACCEL_OK);
+}
+
+TEST_F(GenopBatch, invalid_arguments)
+{
+    struct vaccel_genop_set set = { NULL, 0, NULL, 0, 0 };
+
+    EXPECT_EQ(vaccel_genop_batch(NULL, &set, 1), VACCEL_EINVAL);
+    EXPECT_EQ(vaccel_genop_batch(&sess, NULL, 1), VACCEL_EINVAL);
+    EXPECT_EQ(vaccel_genop_batch(&sess, &set, 0), VACCEL_EINVAL);
+}
+
+TEST_F(GenopBatch, exec_batch)
+{
+    int inputs[4] = { 1, 2, 3, 4 }, outputs[4] = { 0 };
+    struct vaccel_arg read[4], write[4];
+    struct vaccel_genop_set sets[4];
+
+    for (int i = 0; i < 4; ++i) {
+        read[i] = { sizeof(inputs[i]), 0, &inputs[i] };
+        write[i] = { sizeof(outputs[i]), 0, &outputs[i] };
+        sets[i] = { &read[i], 1, &write[i], 1, -1 };
+    }
+
+    /* The caller's sets do not include the library and the symbol */
+    ASSERT_EQ(vaccel_exec_batch(&sess, "libfoo.so", "foo", sets, 4),
+            VACCEL_OK);
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_EQ(sets[i].ret, VACCEL_OK);
+        EXPECT_EQ(sets[i].read, &read[i]);
+        EXPECT_EQ(sets[i].nr_read, 1);
+    }
+
+    EXPECT_EQ(vaccel_exec_batch(NULL, "libfoo.so", "foo", sets, 4),
+            VACCEL_EINVAL);
+    EXPECT_EQ(vaccel_exec_batch(&sess, NULL, "foo", sets, 4),
+            VACCEL_EINVAL);
+    EXPECT_EQ(vaccel_exec_batch(&sess, "libfoo.so", "foo", sets, 0),
+            VACCEL_EINVAL);
+
+    sets[2].write = NULL;
+    EXPECT_EQ(vaccel_exec_batch(&sess, "libfoo.so", "foo", sets, 4),
+            VACCEL_EINVAL);
+    sets[2] = { &read[2], 1, &write[2], -1, -1 };
+    EXPECT_EQ(vaccel_exec_batch(&sess, "libfoo.so", "foo", sets, 4),
+            VACCEL_EINVAL);
+}
+
+TEST(GenopArgs, ext_helpers)
+{
+    char a[4] = "abc", b[8] = "defghij";
+    struct vaccel_iovec segs[] = { { a, 3 }, { b, 7 } };
+    struct vaccel_arg_ext ext;
+    struct vaccel_arg arg, plain = { sizeof(a), 0, a };
+
+    ASSERT_EQ(vaccel_arg_init_ext(&arg, &ext, segs, 2), VACCEL_OK);
+    EXPECT_TRUE(vaccel_arg_is_ext(&arg));
+    EXPECT_EQ(vaccel_arg_size(&arg), 10u);
+    EXPECT_EQ(vaccel_arg_buf(&arg), nullptr);
+
+    struct vaccel_iovec single;
+    const struct vaccel_iovec *out;
+    EXPECT_EQ(vaccel_arg_segs(&arg, &single, &out), 2u);
+    EXPECT_EQ(out, segs);
+
+    EXPECT_FALSE(vaccel_arg_is_ext(&plain));
+    EXPECT_EQ(vaccel_arg_size(&plain), sizeof(a));
+    EXPECT_EQ(vaccel_arg_buf(&plain), a);
+    EXPECT_EQ(vaccel_arg_segs(&plain, &single, &out), 1u);
+    EXPECT_EQ(out, &single);
+    EXPECT_EQ(single.base, a);
+
+    /* Any size is a valid size for a regular argument */
+    struct vaccel_arg big = { UINT32_MAX, 0, a };
+    EXPECT_FALSE(vaccel_arg_is_ext(&big));
+    EXPECT_EQ(vaccel_arg_size(&big), UINT32_MAX);
+    EXPECT_EQ(vaccel_arg_buf(&big), a);
+
+    struct vaccel_arg tensor = { UINT32_MAX - 1, 0, a };
+    vaccel_pipeline_tensor_arg(&tensor, 3);
+    EXPECT_EQ(tensor.flags, VACCEL_ARG_FLAG_TENSOR);
+    EXPECT_FALSE(vaccel_arg_is_ext(&tensor));
+
+    EXPECT_EQ(vaccel_arg_init_ext(&arg, &ext, segs, 0), VACCEL_EINVAL);
+    EXPECT_EQ(vaccel_arg_init_ext(&arg, &ext, NULL, 1), VACCEL_EINVAL);
+
+    /* Sizes beyond 32 bits */
+    segs[0].len = 5ULL << 30;
+    ASSERT_EQ(vaccel_arg_init_ext(&arg, &ext, segs, 1), VACCEL_OK);
+    EXPECT_EQ(vaccel_arg_size(&arg), 5ULL << 30);
+    EXPECT_EQ(vaccel_arg_buf(&arg), a);
+}
+
+TEST_F(GenopScatter, linearize)
+{
+    enum vaccel_op_type op = VACCEL_F_ARRAYCOPY;
+    int in_lo[] = { 1, 2, 3 }, in_hi[] = { 4, 5 };
+    int out_lo[2] = { 0 }, out_hi[3] = { 0 };
+
+    struct vaccel_iovec in_segs[] = {
+        { in_lo, sizeof(in_lo) }, { in_hi, sizeof(in_hi) }
+    };
+    struct vaccel_iovec out_segs[] = {
+        { out_lo, sizeof(out_lo) }, { out_hi, sizeof(out_hi) }
+    };
+    struct vaccel_arg_ext in_ext, out_ext;
+    struct vaccel_arg read[2] = { { sizeof(op), 0, &op } };
+    struct vaccel_arg write[1];
+
+    ASSERT_EQ(vaccel_arg_init_ext(&read[1], &in_ext, in_segs, 2), VACCEL_OK);
+    ASSERT_EQ(vaccel_arg_init_ext(&write[0], &out_ext, out_segs, 2),
+            VACCEL_OK);
+
+    ASSERT_EQ(vaccel_genop(&sess, read, 2, write, 1), VACCEL_OK);
+    EXPECT_EQ(out_lo[0], 1);
+    EXPECT_EQ(out_lo[1], 2);
+    EXPECT_EQ(out_hi[0], 3);
+    EXPECT_EQ(out_hi[1], 4);
+    EXPECT_EQ(out_hi[2], 5);
+
+    /* A single segment reaches the plugin as a regular argument */
+    int out[5] = { 0 };
+    struct vaccel_iovec out_seg = { out, sizeof(out) };
+    ASSERT_EQ(vaccel_arg_init_ext(&write[0], &out_ext, &out_seg, 1),
+            VACCEL_OK);
+    ASSERT_EQ(vaccel_genop(&sess, read, 2, write, 1), VACCEL_OK);
+    EXPECT_EQ(out[0], 1);
+    EXPECT_EQ(out[4], 5);
+
+    /* Extended arguments without segments are rejected */
+    out_ext.nr_segs = 0;
+    EXPECT_EQ(vaccel_genop(&sess, read, 2, write, 1), VACCEL_EINVAL);
+
+    /* Unknown descriptor versions are rejected */
+    out_ext.nr_segs = 1;
+    in_ext.version = VACCEL_ARG_EXT_VERSION + 1;
+    EXPECT_EQ(vaccel_genop(&sess, read, 2, write, 1), VACCEL_EINVAL);
+}
+
+/* Tensor references are only valid in pipeline stages */
+TEST_F(GenopScatter, tensor_arg)
+{
+    enum vaccel_op_type op = VACCEL_F_ARRAYCOPY;
+    int in[2] = { 1, 2 }, out[2] = { 0 };
+    struct vaccel_arg read[] = {
+        { sizeof(op), 0, &op }, { sizeof(in), 0, in },
+    };
+    struct vaccel_arg write[] = { { sizeof(out), 0, out } };
+
+    vaccel_pipeline_tensor_arg(&read[1], 0);
+    EXPECT_EQ(vaccel_genop(&sess, read, 2, write, 1), VACCEL_EINVAL);
+
+    read[1] = { sizeof(in), 0, in };
+    vaccel_pipeline_tensor_arg(&write[0], 0);
+    EXPECT_EQ(vaccel_genop(&sess, read, 2, write, 1), VACCEL_EINVAL);
+    EXPECT_EQ(out[0], 0);
+}
+
+TEST_F(GenopPipeline, run)
+{
+    enum vaccel_op_type vadd = VACCEL_F_VECTORADD;
+    float a[] = { 1, 2, 3, 4 }, b[] = { 10, 20, 30, 40 };
+    float out[4] = { 0 };
+    struct vaccel_pipeline *pipeline;
+    int t1, t2, stage;
+
+    ASSERT_EQ(vaccel_pipeline_new(&pipeline), VACCEL_OK);
+    ASSERT_EQ(vaccel_pipeline_tensor(pipeline, sizeof(a), &t1), VACCEL_OK);
+    ASSERT_EQ(vaccel_pipeline_tensor(pipeline, sizeof(a), &t2), VACCEL_OK);
+
+    /* t1 = a + b and t2 = a + b are independent, out = t1 + t2 */
+    struct vaccel_arg read[3] = {
+        { sizeof(vadd), 0, &vadd }, { sizeof(a), 0, a }, { sizeof(b), 0, b }
+    };
+    struct vaccel_arg write[1];
+
+    vaccel_pipeline_tensor_arg(&write[0], t1);
+    ASSERT_EQ(vaccel_pipeline_add(pipeline, read, 3, write, 1, NULL),
+            VACCEL_OK);
+    vaccel_pipeline_tensor_arg(&write[0], t2);
+    ASSERT_EQ(vaccel_pipeline_add(pipeline, read, 3, write, 1, NULL),
+            VACCEL_OK);
+
+    /* A tensor has a single producer */
+    EXPECT_EQ(vaccel_pipeline_add(pipeline, read, 3, write, 1, NULL),
+            VACCEL_EINVAL);
+
+    vaccel_pipeline_tensor_arg(&read[1], t1);
+    vaccel_pipeline_tensor_arg(&read[2], t2);
+    write[0] = { sizeof(out), 0, out };
+    ASSERT_EQ(vaccel_pipeline_add(pipeline, read, 3, write, 1, &stage),
+            VACCEL_OK);
+    EXPECT_EQ(stage, 2);
+
+    ASSERT_EQ(vaccel_pipeline_run(&sess, pipeline), VACCEL_OK);
+    for (int i = 0; i < 4; ++i)
+        EXPECT_FLOAT_EQ(out[i], 2 * (a[i] + b[i]));
+
+    /* Pipelines can run again, with new inputs */
+    a[0] = 100;
+    ASSERT_EQ(vaccel_pipeline_run(&sess, pipeline), VACCEL_OK);
+    EXPECT_FLOAT_EQ(out[0], 220);
+
+    EXPECT_EQ(vaccel_pipeline_destroy(pipeline), VACCEL_OK);
+}
+
+TEST_F(GenopPipeline, failure)
+{
+    enum vaccel_op_type noop = VACCEL_NO_OP, vadd = VACCEL_F_VECTORADD;
+    float out[2];
+    struct vaccel_pipeline *pipeline;
+    int t;
+
+    ASSERT_EQ(vaccel_pipeline_new(&pipeline), VACCEL_OK);
+    ASSERT_EQ(vaccel_pipeline_tensor(pipeline, sizeof(out), &t), VACCEL_OK);
+
+    /* noop does not take any arguments, so this stage fails */
+    struct vaccel_arg read[3] = { { sizeof(noop), 0, &noop } };
+    struct vaccel_arg write[1];
+    vaccel_pipeline_tensor_arg(&write[0], t);
+    ASSERT_EQ(vaccel_pipeline_add(pipeline, read, 1, write, 1, NULL),
+            VACCEL_OK);
+
+    read[0] = { sizeof(vadd), 0, &vadd };
+    vaccel_pipeline_tensor_arg(&read[1], t);
+    vaccel_pipeline_tensor_arg(&read[2], t);
+    write[0] = { sizeof(out), 0, out };
+    ASSERT_EQ(vaccel_pipeline_add(pipeline, read, 3, write, 1, NULL),
+            VACCEL_OK);
+
+    EXPECT_EQ(vaccel_pipeline_run(&sess, pipeline), VACCEL_EINVAL);
+    EXPECT_EQ(vaccel_pipeline_stage_result(pipeline, 0), VACCEL_EINVAL);
+    EXPECT_EQ(vaccel_pipeline_stage_result(pipeline, 1), VACCEL_ECANCELED);
+
+    EXPECT_EQ(vaccel_pipeline_destroy(pipeline), VACCEL_OK);
+}
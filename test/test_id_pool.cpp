@@ -1,4 +1,8 @@
 #include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
 // #include <fff.h>
 
 // DEFINE_FFF_GLOBALS;
@@ -60,6 +64,44 @@ TEST(IdPoolTest, IdPoolRelease) {
     EXPECT_EQ(id_test, 1);
 }
 
+TEST(IdPoolTest, IdPoolContention) {
+    const int nr_threads = 4;
+    const int nr_ids = 8;
+    id_pool_t test_pool;
+    ASSERT_EQ(id_pool_new(&test_pool, nr_ids), VACCEL_OK);
+
+    /* No id may be held by two threads at the same time */
+    std::atomic<int> owners[nr_ids + 1] = {};
+    std::atomic<int> duplicates(0);
+
+    std::vector<std::thread> threads;
+    for (int t = 1; t <= nr_threads; ++t) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < 20000; ++i) {
+                vaccel_id_t id = id_pool_get(&test_pool);
+                if (!id)
+                    continue;
+
+                if (owners[id].exchange(t))
+                    duplicates++;
+                owners[id].store(0);
+                id_pool_release(&test_pool, id);
+            }
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+
+    EXPECT_EQ(duplicates.load(), 0);
+
+    /* All the ids are back in the pool */
+    for (int i = 0; i < nr_ids; ++i)
+        EXPECT_NE(id_pool_get(&test_pool), 0);
+    EXPECT_EQ(id_pool_get(&test_pool), 0);
+
+    EXPECT_EQ(id_pool_destroy(&test_pool), VACCEL_OK);
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -2,9 +2,20 @@
 #include "error.h"
 #include "log.h"
 
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
 extern "C" {
+#include <stdio.h>
 #include <stdlib.h>
+#include <signal.h>
 #include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
 #include <slog.h>
 }
 
@@ -55,6 +66,176 @@ TEST(LogLevel4, Log) {
     EXPECT_EQ(ret, VACCEL_OK);
 }
 
+TEST(LogFlags, Log) {
+    setenv("VACCEL_DEBUG_LEVEL", "2", 1);
+    int ret = vaccel_log_init();
+    EXPECT_EQ(ret, VACCEL_OK);
+    EXPECT_EQ(vaccel_log_flags, SLOG_WARN | SLOG_ERROR);
+
+    testing::internal::CaptureStdout();
+    vaccel_debug("hidden %d", 1);
+    vaccel_warn("shown %d", 2);
+    fflush(stdout);
+    std::string out = testing::internal::GetCapturedStdout();
+
+    EXPECT_EQ(out.find("hidden"), std::string::npos);
+    EXPECT_NE(out.find("shown 2"), std::string::npos);
+
+    ret = vaccel_log_shutdown();
+    EXPECT_EQ(ret, VACCEL_OK);
+}
+
+TEST(LogAsync, Log) {
+    const int nr_threads = 4;
+    const int nr_msgs = 100;
+
+    setenv("VACCEL_DEBUG_LEVEL", "4", 1);
+    setenv("VACCEL_LOG_ASYNC", "enabled", 1);
+    int ret = vaccel_log_init();
+    EXPECT_EQ(ret, VACCEL_OK);
+
+    testing::internal::CaptureStdout();
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nr_threads; ++t) {
+        threads.emplace_back([t]() {
+            for (int i = 0; i < nr_msgs; ++i)
+                vaccel_debug("thread %d message %d", t, i);
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+
+    ret = vaccel_log_flush();
+    EXPECT_EQ(ret, VACCEL_OK);
+    fflush(stdout);
+    std::string out = testing::internal::GetCapturedStdout();
+
+    /* Everything is written out, in the order each thread logged it */
+    for (int t = 0; t < nr_threads; ++t) {
+        size_t prev = 0;
+        for (int i = 0; i < nr_msgs; ++i) {
+            std::string msg = "thread " + std::to_string(t) +
+                " message " + std::to_string(i) + "\n";
+            size_t pos = out.find(msg);
+            ASSERT_NE(pos, std::string::npos);
+            EXPECT_GE(pos, prev);
+            prev = pos;
+        }
+    }
+    EXPECT_EQ(out.find("Dropped"), std::string::npos);
+
+    unsetenv("VACCEL_LOG_ASYNC");
+    ret = vaccel_log_shutdown();
+    EXPECT_EQ(ret, VACCEL_OK);
+}
+
+/* Records show when and by whom they were logged, not when the writer
+ * got to them */
+TEST(LogAsync, Origin) {
+    setenv("VACCEL_DEBUG_LEVEL", "4", 1);
+    setenv("VACCEL_LOG_ASYNC", "enabled", 1);
+    int ret = vaccel_log_init();
+    EXPECT_EQ(ret, VACCEL_OK);
+
+    SLogConfig cfg;
+    slog_config_get(&cfg);
+    cfg.nTraceTid = 1;
+    slog_config_set(&cfg);
+
+    testing::internal::CaptureStdout();
+
+    /* Stall the writer on the slog lock until well after the message
+     * was logged */
+    slog_fork_prepare();
+
+    pid_t tid = 0;
+    time_t before = 0, after = 0;
+    std::thread thread([&]() {
+        tid = gettid();
+        before = time(NULL);
+        vaccel_debug("origin message");
+        after = time(NULL);
+    });
+    thread.join();
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    slog_fork_parent();
+
+    ret = vaccel_log_flush();
+    EXPECT_EQ(ret, VACCEL_OK);
+    fflush(stdout);
+    std::string out = testing::internal::GetCapturedStdout();
+
+    size_t end = out.find("origin message");
+    ASSERT_NE(end, std::string::npos);
+    size_t start = out.rfind('\n', end);
+    std::string line = out.substr(start == std::string::npos ? 0 : start + 1,
+            end - start);
+
+    EXPECT_EQ(line.find("(" + std::to_string(tid) + ") "), 0u) << line;
+
+    bool logged_at = false;
+    for (time_t t : { before, after }) {
+        struct tm tm;
+        char date[32];
+        localtime_r(&t, &tm);
+        strftime(date, sizeof(date), "%H:%M:%S.", &tm);
+        logged_at |= line.find(date) != std::string::npos;
+    }
+    EXPECT_TRUE(logged_at) << line;
+
+    cfg.nTraceTid = 0;
+    slog_config_set(&cfg);
+    unsetenv("VACCEL_LOG_ASYNC");
+    ret = vaccel_log_shutdown();
+    EXPECT_EQ(ret, VACCEL_OK);
+}
+
+/* Children forked while other threads log can log too */
+TEST(LogFork, Log) {
+    setenv("VACCEL_DEBUG_LEVEL", "4", 1);
+    int ret = vaccel_log_init();
+    EXPECT_EQ(ret, VACCEL_OK);
+
+    testing::internal::CaptureStdout();
+
+    std::atomic<bool> done(false);
+    std::thread logger([&done]() {
+        while (!done.load())
+            vaccel_debug("parent message");
+    });
+
+    int hung = 0;
+    for (int i = 0; i < 100; ++i) {
+        pid_t pid = fork();
+        ASSERT_GE(pid, 0);
+        if (!pid) {
+            vaccel_debug("child message");
+            _exit(0);
+        }
+
+        int status, waited = 0;
+        while (!waitpid(pid, &status, WNOHANG) && waited++ < 2000)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        if (waited > 2000) {
+            hung++;
+            kill(pid, SIGKILL);
+            waitpid(pid, &status, 0);
+        }
+    }
+
+    done.store(true);
+    logger.join();
+    testing::internal::GetCapturedStdout();
+
+    EXPECT_EQ(hung, 0);
+
+    ret = vaccel_log_shutdown();
+    EXPECT_EQ(ret, VACCEL_OK);
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -0,0 +1,180 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+
+extern "C" {
+#include "error.h"
+#include "session.h"
+#include "ops/genop.h"
+#include "ops/vaccel_ops.h"
+#include "profiling/metrics.h"
+}
+
+/* The runtime looks for the setting when the library is loaded, which
+ * is before we get to set it, so tests bootstrap metrics themselves */
+static int metrics_env = setenv("VACCEL_METRICS_ENABLED", "enabled", 1);
+
+/* Attach to the segment the way a monitor would */
+static const struct metrics_shm *metrics_attach()
+{
+    std::string name = METRICS_SHM_PREFIX + std::to_string(getpid());
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return NULL;
+
+    void *addr = mmap(NULL, sizeof(struct metrics_shm), PROT_READ,
+            MAP_SHARED, fd, 0);
+    close(fd);
+
+    return addr == MAP_FAILED ? NULL : (const struct metrics_shm *)addr;
+}
+
+class Metrics : public ::testing::Test {
+protected:
+    struct vaccel_session sess;
+    const struct metrics_shm *shm = NULL;
+
+    void SetUp() override
+    {
+        ASSERT_EQ(metrics_env, 0);
+        ASSERT_EQ(metrics_bootstrap(), VACCEL_OK);
+        ASSERT_TRUE(metrics_enabled());
+        ASSERT_EQ(vaccel_sess_init(&sess, 0), VACCEL_OK);
+
+        shm = metrics_attach();
+        ASSERT_NE(shm, nullptr);
+    }
+
+    void TearDown() override
+    {
+        if (shm)
+            munmap((void *)shm, sizeof(*shm));
+        EXPECT_EQ(vaccel_sess_free(&sess), VACCEL_OK);
+    }
+
+    int genop_noop()
+    {
+        enum vaccel_op_type op = VACCEL_NO_OP;
+        int arg = 0;
+        struct vaccel_arg read[] = {
+            { sizeof(op), 0, &op },
+            { sizeof(arg), 0, &arg },
+        };
+
+        return vaccel_genop(&sess, read, 2, NULL, 0);
+    }
+};
+
+TEST_F(Metrics, segment)
+{
+    EXPECT_EQ(shm->magic, (uint32_t)METRICS_MAGIC);
+    EXPECT_EQ(shm->version, (uint32_t)METRICS_VERSION);
+    EXPECT_EQ(shm->size, sizeof(*shm));
+    EXPECT_EQ(shm->pid, getpid());
+    EXPECT_STREQ(shm->ops[VACCEL_NO_OP].name, "noop");
+    EXPECT_GE(shm->nr_sessions, 1);
+}
+
+TEST_F(Metrics, op_counters)
+{
+    struct metrics_entry before, after;
+    ASSERT_TRUE(metrics_snapshot(&shm->ops[VACCEL_NO_OP], &before,
+            sizeof(before)));
+
+    int ran = 0;
+    for (int i = 0; i < 10; ++i) {
+        if (genop_noop() == VACCEL_OK)
+            ran++;
+    }
+
+    ASSERT_TRUE(metrics_snapshot(&shm->ops[VACCEL_NO_OP], &after,
+            sizeof(after)));
+    EXPECT_EQ(after.nr_ops - before.nr_ops, (uint64_t)ran);
+    EXPECT_EQ(after.nr_errors, before.nr_errors);
+    EXPECT_EQ(after.latency.count, after.nr_ops);
+    EXPECT_EQ(after.inflight, 0);
+    EXPECT_EQ(shm->inflight, 0);
+
+    /* Only a loaded plugin runs operations */
+    if (!ran)
+        return;
+
+    struct metrics_session slot;
+    ASSERT_TRUE(metrics_snapshot(
+            &shm->sessions[sess.session_id % METRICS_MAX_SESSIONS],
+            &slot, sizeof(slot)));
+    EXPECT_EQ(slot.id, sess.session_id);
+    EXPECT_EQ(slot.nr_ops, (uint64_t)ran);
+    EXPECT_EQ(slot.inflight, 0);
+
+    ASSERT_GE(shm->nr_plugins, 1U);
+    EXPECT_GE(shm->plugins[0].nr_ops, (uint64_t)ran);
+}
+
+/* Readers must never see an entry in the middle of an update */
+TEST_F(Metrics, consistent_snapshots)
+{
+    std::atomic<bool> done(false);
+    uint64_t torn = 0, snapshots = 0;
+
+    std::thread reader([&]() {
+        struct metrics_entry copy;
+
+        while (!done.load()) {
+            if (!metrics_snapshot(&shm->ops[VACCEL_NO_OP], &copy,
+                        sizeof(copy)))
+                continue;
+
+            snapshots++;
+            if (copy.latency.count != copy.nr_ops)
+                torn++;
+        }
+    });
+
+    std::thread writers[4];
+    for (auto &writer : writers) {
+        writer = std::thread([&]() {
+            for (int i = 0; i < 2000; ++i)
+                genop_noop();
+        });
+    }
+
+    for (auto &writer : writers)
+        writer.join();
+    done.store(true);
+    reader.join();
+
+    EXPECT_GT(snapshots, 0U);
+    EXPECT_EQ(torn, 0U);
+    EXPECT_EQ(shm->inflight, 0);
+}
+
+/* Sessions opened before metrics were enabled are not counted */
+TEST(MetricsSessions, opened_before)
+{
+    struct vaccel_session before, after;
+
+    if (metrics_enabled())
+        GTEST_SKIP() << "metrics enabled already";
+
+    ASSERT_EQ(vaccel_sess_init(&before, 0), VACCEL_OK);
+    ASSERT_EQ(metrics_bootstrap(), VACCEL_OK);
+    ASSERT_EQ(vaccel_sess_init(&after, 0), VACCEL_OK);
+
+    const struct metrics_shm *shm = metrics_attach();
+    ASSERT_NE(shm, nullptr);
+    EXPECT_EQ(shm->nr_sessions, 1);
+
+    EXPECT_EQ(vaccel_sess_free(&before), VACCEL_OK);
+    EXPECT_EQ(shm->nr_sessions, 1);
+    EXPECT_EQ(vaccel_sess_free(&after), VACCEL_OK);
+    EXPECT_EQ(shm->nr_sessions, 0);
+
+    munmap((void *)shm, sizeof(*shm));
+}
@@ -0,0 +1,625 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <signal.h>
+#include <sstream>
+#include <stdlib.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+extern "C" {
+#include "error.h"
+#include "vaccel_prof.h"
+#include "profiling/clock.h"
+#include "profiling/histogram.h"
+#include "profiling/op_prof.h"
+#include "profiling/prof_ctl.h"
+#include "profiling/sampling.h"
+#include "session.h"
+#include "ops/genop.h"
+#include "ops/vaccel_ops.h"
+}
+
+/* The enable flag is read once, so set it before anything asks */
+static int prof_env = setenv("VACCEL_PROF_ENABLED", "enabled", 1) |
+    setenv("VACCEL_PROF_SAMPLES", "16384", 1) |
+    setenv("VACCEL_PROF_COUNTERS", "enabled", 1);
+
+TEST(Prof, token_pairing)
+{
+    ASSERT_EQ(prof_env, 0);
+    ASSERT_TRUE(vaccel_prof_enabled());
+
+    struct vaccel_prof_region region = VACCEL_PROF_REGION_INIT("token");
+
+    /* Overlapping entries are paired by their tokens */
+    vaccel_prof_token_t outer = vaccel_prof_region_enter(&region);
+    vaccel_prof_token_t inner = vaccel_prof_region_enter(&region);
+    ASSERT_NE(outer, 0u);
+    EXPECT_EQ(vaccel_prof_region_exit(&region, outer), VACCEL_OK);
+    EXPECT_EQ(vaccel_prof_region_exit(&region, inner), VACCEL_OK);
+
+    struct vaccel_prof_sample *samples;
+    size_t nr_samples;
+    ASSERT_EQ(vaccel_prof_region_samples(&region, &samples, &nr_samples),
+            VACCEL_OK);
+    ASSERT_EQ(nr_samples, 2u);
+    EXPECT_EQ(samples[0].start, outer);
+    EXPECT_EQ(samples[1].start, inner);
+    free(samples);
+
+    /* A token of 0 means profiling was off when entering */
+    EXPECT_EQ(vaccel_prof_region_exit(&region, 0), VACCEL_OK);
+    EXPECT_EQ(vaccel_prof_region_exit(NULL, outer), VACCEL_EINVAL);
+
+    region.name_owned = false;
+    EXPECT_EQ(vaccel_prof_region_destroy(&region), VACCEL_OK);
+}
+
+TEST(Prof, start_stop)
+{
+    struct vaccel_prof_region region = VACCEL_PROF_REGION_INIT("start_stop");
+
+    EXPECT_EQ(vaccel_prof_region_stop(&region), VACCEL_ENOENT);
+    EXPECT_EQ(vaccel_prof_region_start(&region), VACCEL_OK);
+    EXPECT_EQ(vaccel_prof_region_start(&region), VACCEL_OK);
+    EXPECT_EQ(vaccel_prof_region_stop(&region), VACCEL_OK);
+    EXPECT_EQ(vaccel_prof_region_stop(&region), VACCEL_OK);
+    EXPECT_EQ(vaccel_prof_region_stop(&region), VACCEL_ENOENT);
+
+    struct vaccel_prof_sample *samples;
+    size_t nr_samples;
+    ASSERT_EQ(vaccel_prof_region_samples(&region, &samples, &nr_samples),
+            VACCEL_OK);
+    EXPECT_EQ(nr_samples, 2u);
+    free(samples);
+
+    EXPECT_EQ(vaccel_prof_region_destroy(&region), VACCEL_OK);
+}
+
+TEST(Prof, concurrent_threads)
+{
+    struct vaccel_prof_region region = VACCEL_PROF_REGION_INIT("threads");
+    const int nr_threads = 8, nr_iters = 5000;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nr_threads; ++t) {
+        threads.emplace_back([&region]() {
+            for (int i = 0; i < nr_iters; ++i) {
+                vaccel_prof_token_t token = vaccel_prof_region_enter(&region);
+                vaccel_prof_region_exit(&region, token);
+
+                vaccel_prof_region_start(&region);
+                vaccel_prof_region_stop(&region);
+            }
+        });
+    }
+
+    /* Reports can be taken while samples are being recorded */
+    EXPECT_EQ(vaccel_prof_region_print(&region), VACCEL_OK);
+
+    for (auto &t : threads)
+        t.join();
+
+    struct vaccel_prof_stats stats;
+    ASSERT_EQ(vaccel_prof_region_stats(&region, &stats), VACCEL_OK);
+    EXPECT_EQ(stats.nr_entries, (uint64_t)(2 * nr_threads * nr_iters));
+
+    EXPECT_EQ(vaccel_prof_region_destroy(&region), VACCEL_OK);
+}
+
+TEST(Prof, histogram_percentiles)
+{
+    struct prof_hist *hist =
+        (struct prof_hist *)malloc(sizeof(struct prof_hist));
+    ASSERT_NE(hist, nullptr);
+    hist_init(hist);
+
+    EXPECT_EQ(hist_percentile(hist, 50.0), 0u);
+
+    for (uint64_t v = 1; v <= 100000; ++v)
+        hist_record(hist, v);
+
+    EXPECT_EQ(hist->count, 100000u);
+    EXPECT_EQ(hist->min, 1u);
+    EXPECT_EQ(hist->max, 100000u);
+
+    /* Values are known within 1/64th of themselves */
+    const double percentiles[] = { 1.0, 50.0, 90.0, 99.0, 99.9 };
+    for (double p : percentiles) {
+        double expected = p * 1000;
+        double value = hist_percentile(hist, p);
+        EXPECT_NEAR(value, expected, expected / 64 + 1) << "p" << p;
+    }
+    EXPECT_EQ(hist_percentile(hist, 100.0), 100000u);
+
+    /* Small values are exact, huge ones are still counted */
+    hist_init(hist);
+    hist_record(hist, 3);
+    hist_record(hist, UINT64_MAX / 2);
+    EXPECT_EQ(hist_percentile(hist, 50.0), 3u);
+    EXPECT_EQ(hist_percentile(hist, 99.0), UINT64_MAX / 2);
+
+    free(hist);
+}
+
+TEST(Prof, region_stats)
+{
+    struct vaccel_prof_region region = VACCEL_PROF_REGION_INIT("stats");
+    struct vaccel_prof_stats stats;
+
+    ASSERT_EQ(vaccel_prof_region_stats(&region, &stats), VACCEL_OK);
+    EXPECT_EQ(stats.nr_entries, 0u);
+
+    for (int i = 0; i < 1000; ++i) {
+        vaccel_prof_token_t token = vaccel_prof_region_enter(&region);
+        vaccel_prof_region_exit(&region, token);
+    }
+
+    ASSERT_EQ(vaccel_prof_region_stats(&region, &stats), VACCEL_OK);
+    EXPECT_EQ(stats.nr_entries, 1000u);
+    EXPECT_LE(stats.min, stats.p50);
+    EXPECT_LE(stats.p50, stats.p90);
+    EXPECT_LE(stats.p90, stats.p99);
+    EXPECT_LE(stats.p99, stats.p999);
+    EXPECT_LE(stats.p999, stats.max);
+    EXPECT_GE(stats.mean, stats.min);
+    EXPECT_LE(stats.mean, stats.max);
+
+    EXPECT_EQ(vaccel_prof_region_stats(NULL, &stats), VACCEL_EINVAL);
+    EXPECT_EQ(vaccel_prof_region_print(&region), VACCEL_OK);
+
+    EXPECT_EQ(vaccel_prof_region_destroy(&region), VACCEL_OK);
+}
+
+/* Regions that do not fit in the buffer are cut short */
+TEST(Prof, print_to_small_buf)
+{
+    struct vaccel_prof_region regions[] = {
+        VACCEL_PROF_REGION_INIT("first"),
+        VACCEL_PROF_REGION_INIT("second"),
+        VACCEL_PROF_REGION_INIT("third"),
+    };
+
+    for (auto &region : regions) {
+        vaccel_prof_token_t token = vaccel_prof_region_enter(&region);
+        vaccel_prof_region_exit(&region, token);
+    }
+
+    int needed = vaccel_prof_regions_print_all_to_buf(NULL, 0, regions, 3);
+    ASSERT_GT(needed, 0);
+
+    char *buf = NULL;
+    size_t len = 40;
+    ASSERT_EQ(vaccel_prof_regions_print_all_to_buf(&buf, len, regions, 3),
+            3);
+    ASSERT_NE(buf, nullptr);
+    EXPECT_EQ(buf[len - 1], '\0');
+    EXPECT_EQ(strncmp(buf, "[prof] first:", 13), 0);
+    free(buf);
+
+    for (auto &region : regions)
+        EXPECT_EQ(vaccel_prof_region_destroy(&region), VACCEL_OK);
+}
+
+TEST(Prof, bounded_samples)
+{
+    struct vaccel_prof_region region = VACCEL_PROF_REGION_INIT("bounded");
+    const int nr_entries = 20000;
+
+    for (int i = 0; i < nr_entries; ++i) {
+        vaccel_prof_token_t token = vaccel_prof_region_enter(&region);
+        vaccel_prof_region_exit(&region, token);
+    }
+
+    /* Only the most recent samples are kept, oldest first */
+    struct vaccel_prof_sample *samples;
+    size_t nr_samples;
+    ASSERT_EQ(vaccel_prof_region_samples(&region, &samples, &nr_samples),
+            VACCEL_OK);
+    ASSERT_EQ(nr_samples, 16384u);
+    for (size_t i = 1; i < nr_samples; ++i)
+        EXPECT_LE(samples[i - 1].start, samples[i].start);
+    free(samples);
+
+    /* ... but the histogram accounts for all of them */
+    struct vaccel_prof_stats stats;
+    ASSERT_EQ(vaccel_prof_region_stats(&region, &stats), VACCEL_OK);
+    EXPECT_EQ(stats.nr_entries, (uint64_t)nr_entries);
+
+    EXPECT_EQ(vaccel_prof_region_destroy(&region), VACCEL_OK);
+}
+
+TEST(Prof, op_phases)
+{
+    struct vaccel_session sess;
+    ASSERT_EQ(vaccel_sess_init(&sess, 0), VACCEL_OK);
+
+    struct vaccel_prof_stats before[OP_PHASE_NR], after[OP_PHASE_NR];
+    for (int phase = 0; phase < OP_PHASE_NR; ++phase)
+        ASSERT_EQ(vaccel_prof_region_stats(
+                op_prof_region(VACCEL_NO_OP, (enum op_phase)phase),
+                &before[phase]), VACCEL_OK);
+
+    enum vaccel_op_type op = VACCEL_NO_OP;
+    struct vaccel_arg read[] = { { sizeof(op), 0, &op } };
+    int ret = vaccel_genop(&sess, read, 1, NULL, 0);
+
+    for (int phase = 0; phase < OP_PHASE_NR; ++phase)
+        ASSERT_EQ(vaccel_prof_region_stats(
+                op_prof_region(VACCEL_NO_OP, (enum op_phase)phase),
+                &after[phase]), VACCEL_OK);
+
+    /* Every phase the call went through is accounted once */
+    EXPECT_EQ(after[OP_PHASE_DISPATCH].nr_entries,
+            before[OP_PHASE_DISPATCH].nr_entries + 1);
+    EXPECT_EQ(after[OP_PHASE_UNPACK].nr_entries,
+            before[OP_PHASE_UNPACK].nr_entries + 1);
+    EXPECT_EQ(after[OP_PHASE_LOOKUP].nr_entries,
+            before[OP_PHASE_LOOKUP].nr_entries + 1);
+
+    /* The plugin only runs if there is one, e.g. the noop plugin */
+    uint64_t nr_plugin = (ret == VACCEL_OK) ? 1 : 0;
+    EXPECT_EQ(after[OP_PHASE_PLUGIN].nr_entries,
+            before[OP_PHASE_PLUGIN].nr_entries + nr_plugin);
+    if (nr_plugin) {
+        EXPECT_NE(op_prof_plugin_region("noop"), nullptr);
+    }
+
+    EXPECT_EQ(op_prof_region(VACCEL_FUNCTIONS_NR, OP_PHASE_LOOKUP),
+            nullptr);
+
+    EXPECT_EQ(vaccel_sess_free(&sess), VACCEL_OK);
+}
+
+TEST(Prof, hardware_counters)
+{
+    struct vaccel_prof_region region = VACCEL_PROF_REGION_INIT("counters");
+    volatile uint64_t sum = 0;
+
+    for (int i = 0; i < 10; ++i) {
+        vaccel_prof_token_t token = vaccel_prof_region_enter(&region);
+        for (int j = 0; j < 100000; ++j)
+            sum = sum + j;
+        vaccel_prof_region_exit(&region, token);
+    }
+
+    struct vaccel_prof_stats stats;
+    ASSERT_EQ(vaccel_prof_region_stats(&region, &stats), VACCEL_OK);
+    EXPECT_EQ(stats.nr_entries, 10u);
+
+    /* Counters might not be available, e.g. in containers or because
+     * of perf_event_paranoid, in which case entries are still
+     * recorded without them */
+    if (!stats.counters) {
+        EXPECT_EQ(stats.nr_counted, 0u);
+    } else {
+        EXPECT_EQ(stats.nr_counted, 10u);
+        if (stats.counters & (1U << VACCEL_PROF_INSTRUCTIONS)) {
+            EXPECT_GE(stats.counter_totals[VACCEL_PROF_INSTRUCTIONS],
+                    10u * 100000u);
+        }
+    }
+
+    EXPECT_EQ(vaccel_prof_region_print(&region), VACCEL_OK);
+    EXPECT_EQ(vaccel_prof_region_destroy(&region), VACCEL_OK);
+}
+
+static uint64_t lookup_entries()
+{
+    struct vaccel_prof_stats stats;
+    EXPECT_EQ(vaccel_prof_region_stats(
+            op_prof_region(VACCEL_NO_OP, OP_PHASE_LOOKUP), &stats),
+            VACCEL_OK);
+
+    return stats.nr_entries;
+}
+
+static void run_noop(struct vaccel_session *sess)
+{
+    enum vaccel_op_type op = VACCEL_NO_OP;
+    struct vaccel_arg read[] = { { sizeof(op), 0, &op } };
+
+    vaccel_genop(sess, read, 1, NULL, 0);
+}
+
+static std::string read_file(const char *path)
+{
+    std::ifstream file(path);
+    std::stringstream contents;
+    contents << file.rdbuf();
+
+    return contents.str();
+}
+
+TEST(Prof, runtime_toggle)
+{
+    struct vaccel_session sess;
+    ASSERT_EQ(vaccel_sess_init(&sess, 0), VACCEL_OK);
+
+    ASSERT_EQ(vaccel_prof_set_enabled(false), VACCEL_OK);
+    EXPECT_FALSE(vaccel_prof_enabled());
+    EXPECT_EQ(op_instr() & OP_INSTR_PROF, 0);
+
+    uint64_t before = lookup_entries();
+    run_noop(&sess);
+    EXPECT_EQ(lookup_entries(), before);
+
+    ASSERT_EQ(vaccel_prof_set_enabled(true), VACCEL_OK);
+    EXPECT_NE(op_instr() & OP_INSTR_PROF, 0);
+    run_noop(&sess);
+    EXPECT_EQ(lookup_entries(), before + 1);
+
+    /* Dumps work without ending the process, and a reset starts a new
+     * profile */
+    char path[] = "/tmp/vaccel_prof_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+
+    ASSERT_EQ(vaccel_prof_dump(path), VACCEL_OK);
+    std::string dump = read_file(path);
+    EXPECT_NE(dump.find("# vAccel profile of pid"), std::string::npos);
+    EXPECT_NE(dump.find("[prof] noop/lookup:"), std::string::npos);
+    unlink(path);
+
+    EXPECT_EQ(vaccel_prof_reset(), VACCEL_OK);
+    EXPECT_EQ(lookup_entries(), 0u);
+    run_noop(&sess);
+    EXPECT_EQ(lookup_entries(), 1u);
+
+    EXPECT_EQ(vaccel_prof_dump(NULL), VACCEL_EINVAL);
+    EXPECT_EQ(vaccel_sess_free(&sess), VACCEL_OK);
+}
+
+/* Buffers of exited threads are freed by resets while other threads
+ * look at the regions and new threads take buffers over */
+TEST(Prof, reset_exited_threads)
+{
+    struct vaccel_session sess;
+    ASSERT_EQ(vaccel_sess_init(&sess, 0), VACCEL_OK);
+
+    std::atomic<bool> done(false);
+    std::thread reader([&]() {
+        while (!done.load())
+            lookup_entries();
+    });
+
+    std::thread spawner([&]() {
+        for (int i = 0; i < 200; ++i) {
+            std::thread worker([&]() {
+                for (int j = 0; j < 10; ++j)
+                    run_noop(&sess);
+            });
+            worker.join();
+        }
+    });
+
+    for (int i = 0; i < 200; ++i) {
+        EXPECT_EQ(vaccel_prof_reset(), VACCEL_OK);
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+
+    spawner.join();
+    done.store(true);
+    reader.join();
+
+    EXPECT_EQ(vaccel_prof_reset(), VACCEL_OK);
+    EXPECT_EQ(lookup_entries(), 0u);
+    run_noop(&sess);
+    EXPECT_EQ(lookup_entries(), 1u);
+
+    EXPECT_EQ(vaccel_sess_free(&sess), VACCEL_OK);
+}
+
+/* Send a command to the control socket and return the reply */
+static std::string control(const char *path, const std::string &cmd)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    EXPECT_GE(fd, 0);
+
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    EXPECT_EQ(connect(fd, (struct sockaddr *)&addr, sizeof(addr)), 0);
+
+    std::string line = cmd + "\n";
+    EXPECT_EQ(write(fd, line.c_str(), line.size()), (ssize_t)line.size());
+    shutdown(fd, SHUT_WR);
+
+    std::string reply;
+    char buf[4096];
+    ssize_t len;
+    while ((len = read(fd, buf, sizeof(buf))) > 0)
+        reply.append(buf, len);
+    close(fd);
+
+    return reply;
+}
+
+TEST(Prof, control)
+{
+    char sock_path[64], dump_path[] = "/tmp/vaccel_prof_XXXXXX";
+    snprintf(sock_path, sizeof(sock_path), "/tmp/vaccel_prof_ctl_%d",
+            getpid());
+    int fd = mkstemp(dump_path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+
+    setenv("VACCEL_PROF_CONTROL", sock_path, 1);
+    setenv("VACCEL_PROF_SIGNAL", "USR2", 1);
+    setenv("VACCEL_PROF_DUMP_FILE", dump_path, 1);
+    ASSERT_EQ(prof_ctl_bootstrap(), VACCEL_OK);
+
+    EXPECT_EQ(control(sock_path, "disable"), "ok\n");
+    EXPECT_EQ(control(sock_path, "status"), "disabled\nok\n");
+    EXPECT_EQ(control(sock_path, "enable"), "ok\n");
+    EXPECT_TRUE(vaccel_prof_enabled());
+    EXPECT_EQ(control(sock_path, "bogus").rfind("error", 0), 0u);
+
+    struct vaccel_session sess;
+    ASSERT_EQ(vaccel_sess_init(&sess, 0), VACCEL_OK);
+    run_noop(&sess);
+
+    std::string reply = control(sock_path, "dump");
+    EXPECT_NE(reply.find("[prof] noop/lookup:"), std::string::npos);
+    EXPECT_EQ(reply.substr(reply.size() - 3), "ok\n");
+
+    /* The signal ends the profile and dumps it */
+    raise(SIGUSR2);
+    for (int i = 0; i < 100 && vaccel_prof_enabled(); ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_FALSE(vaccel_prof_enabled());
+
+    prof_ctl_shutdown();
+    EXPECT_NE(read_file(dump_path).find("[prof] noop/lookup:"),
+            std::string::npos);
+    EXPECT_NE(access(sock_path, F_OK), 0);
+
+    /* ... and starts a new one */
+    ASSERT_EQ(prof_ctl_bootstrap(), VACCEL_OK);
+    raise(SIGUSR2);
+    for (int i = 0; i < 100 && !vaccel_prof_enabled(); ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_TRUE(vaccel_prof_enabled());
+    EXPECT_EQ(lookup_entries(), 0u);
+
+    prof_ctl_shutdown();
+    unlink(dump_path);
+    EXPECT_EQ(vaccel_sess_free(&sess), VACCEL_OK);
+}
+
+static void prof_test_sigaction(int, siginfo_t *, void *)
+{
+}
+
+/* Signals the application handles or ignores are left alone */
+TEST(Prof, signal_taken)
+{
+    struct sigaction action = {}, cur;
+
+    unsetenv("VACCEL_PROF_CONTROL");
+    setenv("VACCEL_PROF_SIGNAL", "USR1", 1);
+
+    action.sa_handler = SIG_IGN;
+    ASSERT_EQ(sigaction(SIGUSR1, &action, NULL), 0);
+    EXPECT_EQ(prof_ctl_bootstrap(), VACCEL_EINVAL);
+    ASSERT_EQ(sigaction(SIGUSR1, NULL, &cur), 0);
+    EXPECT_EQ(cur.sa_handler, SIG_IGN);
+
+    action.sa_sigaction = prof_test_sigaction;
+    action.sa_flags = SA_SIGINFO;
+    ASSERT_EQ(sigaction(SIGUSR1, &action, NULL), 0);
+    EXPECT_EQ(prof_ctl_bootstrap(), VACCEL_EINVAL);
+    ASSERT_EQ(sigaction(SIGUSR1, NULL, &cur), 0);
+    EXPECT_EQ(cur.sa_sigaction, prof_test_sigaction);
+
+    action = {};
+    action.sa_handler = SIG_DFL;
+    sigaction(SIGUSR1, &action, NULL);
+    unsetenv("VACCEL_PROF_SIGNAL");
+}
+
+TEST(Prof, sampling)
+{
+    struct vaccel_prof_region region = VACCEL_PROF_REGION_INIT("sampled");
+    const int calls = 20000;
+
+    setenv("VACCEL_PROF_SAMPLE", "10", 1);
+    ASSERT_EQ(prof_sample_init(), PROF_SAMPLE_RATE);
+
+    for (int i = 0; i < calls; ++i) {
+        vaccel_prof_token_t token = vaccel_prof_region_enter(&region);
+        vaccel_prof_region_exit(&region, token);
+    }
+    for (int i = 0; i < calls; ++i) {
+        ASSERT_EQ(vaccel_prof_region_start(&region), VACCEL_OK);
+        ASSERT_EQ(vaccel_prof_region_stop(&region), VACCEL_OK);
+    }
+
+    /* Every measurement stands for 10 calls, and about 1 in 10 calls
+     * is measured */
+    struct vaccel_prof_stats stats;
+    ASSERT_EQ(vaccel_prof_region_stats(&region, &stats), VACCEL_OK);
+    EXPECT_EQ(stats.nr_entries, stats.nr_sampled * 10);
+    EXPECT_NEAR((double)stats.nr_entries, 2.0 * calls, 0.15 * 2 * calls);
+    EXPECT_LE(stats.min, stats.p50);
+    EXPECT_LE(stats.p50, stats.max);
+
+    /* All the phases of an operation are sampled together */
+    struct vaccel_session sess;
+    ASSERT_EQ(vaccel_sess_init(&sess, 0), VACCEL_OK);
+    ASSERT_EQ(vaccel_prof_reset(), VACCEL_OK);
+    for (int i = 0; i < 1000; ++i)
+        run_noop(&sess);
+
+    struct vaccel_prof_stats lookup, dispatch;
+    ASSERT_EQ(vaccel_prof_region_stats(
+            op_prof_region(VACCEL_NO_OP, OP_PHASE_LOOKUP), &lookup),
+            VACCEL_OK);
+    ASSERT_EQ(vaccel_prof_region_stats(
+            op_prof_region(VACCEL_NO_OP, OP_PHASE_DISPATCH), &dispatch),
+            VACCEL_OK);
+    EXPECT_EQ(lookup.nr_sampled, dispatch.nr_sampled);
+    EXPECT_LT(lookup.nr_sampled, 1000u);
+    EXPECT_EQ(vaccel_sess_free(&sess), VACCEL_OK);
+
+    /* Periodic sampling accounts every call up to the last
+     * measurement */
+    unsetenv("VACCEL_PROF_SAMPLE");
+    setenv("VACCEL_PROF_SAMPLE_PERIOD", "1000", 1);
+    ASSERT_EQ(prof_sample_init(), PROF_SAMPLE_PERIOD);
+
+    struct vaccel_prof_region periodic = VACCEL_PROF_REGION_INIT("periodic");
+    auto end = std::chrono::steady_clock::now() +
+        std::chrono::milliseconds(20);
+    uint64_t nr_calls = 0;
+    while (std::chrono::steady_clock::now() < end) {
+        vaccel_prof_token_t token = vaccel_prof_region_enter(&periodic);
+        vaccel_prof_region_exit(&periodic, token);
+        nr_calls++;
+    }
+
+    ASSERT_EQ(vaccel_prof_region_stats(&periodic, &stats), VACCEL_OK);
+    EXPECT_GE(stats.nr_sampled, 1u);
+    EXPECT_LE(stats.nr_sampled, 30u);
+    EXPECT_LE(stats.nr_entries, nr_calls);
+    EXPECT_GT(stats.nr_entries, stats.nr_sampled);
+
+    unsetenv("VACCEL_PROF_SAMPLE_PERIOD");
+    EXPECT_EQ(prof_sample_init(), PROF_SAMPLE_ALL);
+
+    EXPECT_EQ(vaccel_prof_region_destroy(&region), VACCEL_OK);
+    EXPECT_EQ(vaccel_prof_region_destroy(&periodic), VACCEL_OK);
+}
+
+TEST(Prof, clock)
+{
+    /* Whatever the source, timestamps are CLOCK_MONOTONIC nsec */
+    uint64_t before = prof_clock_monotonic();
+    uint64_t now = prof_clock_nsec();
+    uint64_t after = prof_clock_monotonic();
+
+    EXPECT_NE(prof_clock_name(), nullptr);
+    EXPECT_GE(now + 100000, before);
+    EXPECT_LE(now, after + 100000);
+
+    uint64_t prev = prof_clock_nsec();
+    for (int i = 0; i < 1000; ++i) {
+        now = prof_clock_nsec();
+        ASSERT_GE(now, prev);
+        prev = now;
+    }
+
+    uint64_t start = prof_clock_nsec();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    uint64_t elapsed = prof_clock_nsec() - start;
+    EXPECT_GE(elapsed, 19000000u);
+    EXPECT_LT(elapsed, 200000000u);
+}
@@ -11,12 +11,18 @@ extern "C" {
 #include "utils.h"
 #include "vaccel.h"
 #include "plugin.h"
+#include "resources/shared_object.h"
+#include "resources/tf_saved_model.h"
+#include "resources/torch_saved_model.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <math.h>
 }
 
 extern "C"{
@@ -124,4 +130,194 @@ TEST(ResourcesGetById, ResourceExists) {
     // EXPECT_EQ(result, VACCEL_OK);
     // printf("works");
     // cant free a pointer 
-}
\ No newline at end of file
+}
+static void async_done_cb(int ret, void *priv)
+{
+    *(int *)priv = ret;
+}
+
+TEST(ResourcesAsync, shared_object_from_buffer) {
+    int ret = resources_bootstrap();
+    ASSERT_EQ(ret, VACCEL_OK);
+
+    const uint8_t buff[] = "not really a shared object";
+    struct vaccel_shared_object objects[8];
+    int results[8];
+
+    for (int i = 0; i < 8; ++i) {
+        results[i] = -1;
+        ret = vaccel_shared_object_new_from_buffer_async(&objects[i],
+                buff, sizeof(buff), async_done_cb, &results[i]);
+        ASSERT_EQ(ret, VACCEL_OK);
+    }
+
+    ret = vaccel_resources_wait();
+    ASSERT_EQ(ret, VACCEL_OK);
+
+    for (int i = 0; i < 8; ++i) {
+        EXPECT_EQ(results[i], VACCEL_OK);
+
+        size_t len = 0;
+        const uint8_t *data = vaccel_shared_object_get(&objects[i], &len);
+        EXPECT_EQ(len, sizeof(buff));
+        EXPECT_EQ(memcmp(data, buff, len), 0);
+
+        ret = vaccel_shared_object_destroy(&objects[i]);
+        EXPECT_EQ(ret, VACCEL_OK);
+    }
+}
+
+TEST(ResourcesAsync, tf_saved_model_register) {
+    int ret = resources_bootstrap();
+    ASSERT_EQ(ret, VACCEL_OK);
+
+    const uint8_t graph[] = "graph", ckpt[] = "checkpoint", index[] = "index";
+    struct vaccel_tf_saved_model *model = vaccel_tf_saved_model_new();
+    ASSERT_NE(model, nullptr);
+    ASSERT_EQ(vaccel_tf_saved_model_set_model(model, graph, sizeof(graph)),
+            VACCEL_OK);
+    ASSERT_EQ(vaccel_tf_saved_model_set_checkpoint(model, ckpt,
+                sizeof(ckpt)), VACCEL_OK);
+    ASSERT_EQ(vaccel_tf_saved_model_set_var_index(model, index,
+                sizeof(index)), VACCEL_OK);
+
+    int result = -1;
+    ret = vaccel_tf_saved_model_register_async(model, async_done_cb,
+            &result);
+    ASSERT_EQ(ret, VACCEL_OK);
+    ASSERT_EQ(vaccel_resources_wait(), VACCEL_OK);
+    ASSERT_EQ(result, VACCEL_OK);
+
+    /* The files were persisted under the resource's rundir */
+    EXPECT_GT(vaccel_tf_saved_model_id(model), 0);
+    const char *path = vaccel_tf_saved_model_get_path(model);
+    ASSERT_NE(path, nullptr);
+    std::string pb = std::string(path) + "/saved_model.pb";
+    EXPECT_EQ(access(pb.c_str(), R_OK), 0);
+
+    size_t len = 0;
+    const uint8_t *data = vaccel_tf_saved_model_get_checkpoint(model, &len);
+    ASSERT_EQ(len, sizeof(ckpt));
+    EXPECT_EQ(memcmp(data, ckpt, len), 0);
+
+    EXPECT_EQ(vaccel_tf_saved_model_destroy(model), VACCEL_OK);
+    EXPECT_NE(access(pb.c_str(), F_OK), 0);
+    free(model);
+}
+
+TEST(ResourcesAsync, tf_saved_model_register_error) {
+    int ret = resources_bootstrap();
+    ASSERT_EQ(ret, VACCEL_OK);
+
+    /* No files set: submission succeeds, the registration does not */
+    struct vaccel_tf_saved_model *model = vaccel_tf_saved_model_new();
+    ASSERT_NE(model, nullptr);
+
+    int result = -1;
+    ret = vaccel_tf_saved_model_register_async(model, async_done_cb,
+            &result);
+    ASSERT_EQ(ret, VACCEL_OK);
+    ASSERT_EQ(vaccel_resources_wait(), VACCEL_OK);
+    EXPECT_EQ(result, VACCEL_EINVAL);
+    EXPECT_EQ(model->resource, nullptr);
+
+    free(model);
+}
+
+TEST(ResourcesAsync, torch_saved_model_register) {
+    int ret = resources_bootstrap();
+    ASSERT_EQ(ret, VACCEL_OK);
+
+    const uint8_t buff[] = "not really a TorchScript module";
+    struct vaccel_torch_saved_model *model = vaccel_torch_saved_model_new();
+    ASSERT_NE(model, nullptr);
+    ASSERT_EQ(vaccel_torch_saved_model_set_model(model, buff,
+                sizeof(buff)), VACCEL_OK);
+
+    int result = -1;
+    ret = vaccel_torch_saved_model_register_async(model, async_done_cb,
+            &result);
+    ASSERT_EQ(ret, VACCEL_OK);
+    ASSERT_EQ(vaccel_resources_wait(), VACCEL_OK);
+    ASSERT_EQ(result, VACCEL_OK);
+
+    EXPECT_GT(vaccel_torch_saved_model_id(model), 0);
+    ASSERT_NE(vaccel_torch_saved_model_get_path(model), nullptr);
+
+    size_t len = 0;
+    const uint8_t *data = vaccel_torch_saved_model_get_model(model, &len);
+    ASSERT_EQ(len, sizeof(buff));
+    EXPECT_EQ(memcmp(data, buff, len), 0);
+
+    EXPECT_EQ(vaccel_torch_saved_model_destroy(model), VACCEL_OK);
+    free(model);
+}
+
+TEST(ResourcesAsync, torch_saved_model_register_error) {
+    int ret = resources_bootstrap();
+    ASSERT_EQ(ret, VACCEL_OK);
+
+    struct vaccel_torch_saved_model *model = vaccel_torch_saved_model_new();
+    ASSERT_NE(model, nullptr);
+
+    int result = -1;
+    ret = vaccel_torch_saved_model_register_async(model, async_done_cb,
+            &result);
+    ASSERT_EQ(ret, VACCEL_OK);
+    ASSERT_EQ(vaccel_resources_wait(), VACCEL_OK);
+    EXPECT_EQ(result, VACCEL_EINVAL);
+    EXPECT_EQ(model->resource, nullptr);
+
+    free(model);
+}
+
+TEST(ResourcesAsync, invalid_arguments) {
+    const uint8_t buff[] = "data";
+    struct vaccel_shared_object object;
+
+    EXPECT_EQ(vaccel_tf_saved_model_register_async(NULL, NULL, NULL),
+            VACCEL_EINVAL);
+    EXPECT_EQ(vaccel_torch_saved_model_register_async(NULL, NULL, NULL),
+            VACCEL_EINVAL);
+    EXPECT_EQ(vaccel_shared_object_new_from_buffer_async(NULL, buff,
+                sizeof(buff), NULL, NULL), VACCEL_EINVAL);
+    EXPECT_EQ(vaccel_shared_object_new_from_buffer_async(&object, NULL, 0,
+                NULL, NULL), VACCEL_EINVAL);
+}
+
+TEST(SharedObject, preload) {
+    int ret = resources_bootstrap();
+    ASSERT_EQ(ret, VACCEL_OK);
+
+    /* Use the library of a function we know the location of */
+    Dl_info info;
+    ASSERT_NE(dladdr((void *)(double (*)(double))&cos, &info), 0);
+
+    struct vaccel_shared_object object;
+    ret = vaccel_shared_object_new(&object, info.dli_fname);
+    ASSERT_EQ(ret, VACCEL_OK);
+    EXPECT_EQ(vaccel_shared_object_symbol(&object, "cos"), nullptr);
+
+    const char *symbols[] = { "cos", "sin" };
+    ret = vaccel_shared_object_preload(&object, symbols, 2);
+    ASSERT_EQ(ret, VACCEL_OK);
+
+    double (*fcos)(double) =
+        (double (*)(double))vaccel_shared_object_symbol(&object, "cos");
+    ASSERT_NE(fcos, nullptr);
+    EXPECT_EQ(fcos(0.0), 1.0);
+    EXPECT_NE(vaccel_shared_object_symbol(&object, "sin"), nullptr);
+    EXPECT_EQ(vaccel_shared_object_symbol(&object, "tan"), nullptr);
+
+    /* A missing symbol fails the whole preload */
+    const char *missing[] = { "cos", "vaccel_no_such_symbol" };
+    ret = vaccel_shared_object_preload(&object, missing, 2);
+    EXPECT_EQ(ret, VACCEL_EINVAL);
+    EXPECT_EQ(vaccel_shared_object_symbol(&object, "cos"), nullptr);
+
+    EXPECT_EQ(vaccel_shared_object_preload(NULL, symbols, 2), VACCEL_EINVAL);
+    EXPECT_EQ(vaccel_shared_object_preload(&object, NULL, 2), VACCEL_EINVAL);
+
+    ret = vaccel_shared_object_destroy(&object);
+    EXPECT_EQ(ret, VACCEL_OK);
+}
@@ -3,6 +3,8 @@
 #include <gtest/gtest.h>
 #include "fff.h"
 #include <atomic>
+#include <cstddef>
+#include <cstring>
 
 DEFINE_FFF_GLOBALS;
 
@@ -176,6 +178,70 @@ TEST_F(SessionTest, sess_unregister_null) {
 
 }
 
+TEST_F(SessionTest, sess_alloc) {
+    struct vaccel_session sess;
+    int result = vaccel_sess_init(&sess, 1);
+    ASSERT_EQ(result, VACCEL_OK);
+
+    EXPECT_EQ(vaccel_sess_alloc(NULL, 16), nullptr);
+    EXPECT_EQ(vaccel_sess_alloc(&sess, 0), nullptr);
+
+    char *a = (char *)vaccel_sess_alloc(&sess, 3);
+    char *b = (char *)vaccel_sess_alloc(&sess, 5);
+    ASSERT_NE(a, nullptr);
+    ASSERT_NE(b, nullptr);
+    EXPECT_EQ((uintptr_t)b % alignof(max_align_t), 0u);
+    memset(a, 'a', 3);
+    memset(b, 'b', 5);
+    EXPECT_EQ(a[2], 'a');
+
+    /* Bigger than the default chunk size */
+    char *big = (char *)vaccel_sess_alloc(&sess, 64 * 1024);
+    ASSERT_NE(big, nullptr);
+    memset(big, 0, 64 * 1024);
+
+    char *str = vaccel_sess_strdup(&sess, "vaccel");
+    ASSERT_NE(str, nullptr);
+    EXPECT_STREQ(str, "vaccel");
+
+    /* Memory is reused after a reset */
+    result = vaccel_sess_reset(&sess);
+    EXPECT_EQ(result, VACCEL_OK);
+    EXPECT_EQ(vaccel_sess_alloc(&sess, 3), a);
+
+    EXPECT_EQ(vaccel_sess_reset(NULL), VACCEL_EINVAL);
+
+    result = vaccel_sess_free(&sess);
+    EXPECT_EQ(result, VACCEL_OK);
+}
+
+TEST_F(SessionTest, sess_register_reuse) {
+    struct vaccel_session sess;
+    int result = vaccel_sess_init(&sess, 1);
+    ASSERT_EQ(result, VACCEL_OK);
+
+    struct vaccel_resource res[4];
+    for (int iter = 0; iter < 3; ++iter) {
+        for (auto &r : res) {
+            r.type = VACCEL_RES_SHARED_OBJ;
+            ASSERT_EQ(vaccel_sess_register(&sess, &r), VACCEL_OK);
+        }
+
+        /* Resetting the arena must not affect registered resources */
+        vaccel_sess_reset(&sess);
+        for (auto &r : res)
+            EXPECT_TRUE(vaccel_sess_has_resource(&sess, &r));
+
+        for (auto &r : res)
+            ASSERT_EQ(vaccel_sess_unregister(&sess, &r), VACCEL_OK);
+    }
+
+    /* Resources still registered are released with the session */
+    ASSERT_EQ(vaccel_sess_register(&sess, &res[0]), VACCEL_OK);
+    result = vaccel_sess_free(&sess);
+    EXPECT_EQ(result, VACCEL_OK);
+}
+
 TEST_F(SessionTest, sess_viritio) {
     struct vaccel_session sess;
     int result = vaccel_sess_init(&sess, 1);
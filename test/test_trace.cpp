@@ -0,0 +1,114 @@
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <sstream>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+
+extern "C" {
+#include "error.h"
+#include "session.h"
+#include "ops/genop.h"
+#include "ops/vaccel_ops.h"
+#include "vaccel_trace.h"
+}
+
+/* The settings are read on first use, so set them before anything
+ * asks */
+static int trace_env = setenv("VACCEL_TRACE_ENABLED", "enabled", 1) |
+    setenv("VACCEL_TRACE_BUFFER", "64", 1) |
+    setenv("VACCEL_TRACE_FILE", "/dev/null", 1);
+
+class Trace : public ::testing::Test {
+protected:
+    struct vaccel_session sess;
+    char path[32] = "/tmp/vaccel_trace_XXXXXX";
+
+    void SetUp() override
+    {
+        ASSERT_EQ(trace_env, 0);
+        ASSERT_EQ(vaccel_sess_init(&sess, 0), VACCEL_OK);
+
+        int fd = mkstemp(path);
+        ASSERT_GE(fd, 0);
+        close(fd);
+    }
+
+    void TearDown() override
+    {
+        unlink(path);
+        EXPECT_EQ(vaccel_sess_free(&sess), VACCEL_OK);
+    }
+
+    void genop_noop()
+    {
+        enum vaccel_op_type op = VACCEL_NO_OP;
+        int arg = 0;
+        struct vaccel_arg read[] = {
+            { sizeof(op), 0, &op },
+            { sizeof(arg), 0, &arg },
+        };
+
+        vaccel_genop(&sess, read, 2, NULL, 0);
+    }
+
+    std::string flush()
+    {
+        EXPECT_EQ(vaccel_trace_flush(path), VACCEL_OK);
+
+        std::ifstream file(path);
+        std::stringstream contents;
+        contents << file.rdbuf();
+
+        return contents.str();
+    }
+
+    static size_t count(const std::string &str, const std::string &what)
+    {
+        size_t nr = 0;
+        for (size_t pos = str.find(what); pos != std::string::npos;
+                pos = str.find(what, pos + 1))
+            nr++;
+
+        return nr;
+    }
+};
+
+TEST_F(Trace, genop_spans)
+{
+    ASSERT_TRUE(vaccel_trace_enabled());
+
+    genop_noop();
+
+    std::string trace = flush();
+    EXPECT_EQ(trace.rfind("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", 0),
+            0u);
+
+    /* Every span is closed and the genop spans carry the session and
+     * the size of the arguments */
+    EXPECT_EQ(count(trace, "\"ph\":\"B\""), count(trace, "\"ph\":\"E\""));
+    EXPECT_EQ(count(trace, "\"cat\":\"dispatch\",\"ph\":\"B\""), 1u);
+    EXPECT_EQ(count(trace, "\"cat\":\"unpack\",\"ph\":\"B\""), 1u);
+    EXPECT_NE(trace.find("\"session\":" + std::to_string(sess.session_id)),
+            std::string::npos);
+    EXPECT_NE(trace.find("\"read_bytes\":4,\"write_bytes\":0"),
+            std::string::npos);
+}
+
+TEST_F(Trace, bounded_buffer)
+{
+    for (int i = 0; i < 100; ++i)
+        genop_noop();
+
+    /* Only the last VACCEL_TRACE_BUFFER events are kept */
+    std::string trace = flush();
+    size_t nr_events = count(trace, "\"ph\":\"B\"") +
+        count(trace, "\"ph\":\"E\"");
+    EXPECT_EQ(nr_events, 64u);
+}
+
+TEST_F(Trace, flush_error)
+{
+    EXPECT_EQ(vaccel_trace_flush("/nonexistent/trace.json"), VACCEL_EIO);
+}
@@ -134,17 +134,17 @@ static const char* slog_get_color(SLOG_FLAGS_E eFlag)
     return SLOG_CLR_NORMAL;
 }
 
-static uint8_t slog_get_usec()
+static void slog_get_date(SLogDate *pDate, const struct timespec *pTime)
 {
-    struct timeval tv;
-    if (gettimeofday(&tv, NULL) < 0) return 0;
-    return (uint8_t)(tv.tv_usec / 10000);
-}
+    struct timespec now;
+    if (pTime == NULL)
+    {
+        clock_gettime(CLOCK_REALTIME, &now);
+        pTime = &now;
+    }
 
-static void slog_get_date(SLogDate *pDate) 
-{
     struct tm timeinfo;
-    time_t rawtime = time(NULL);
+    time_t rawtime = pTime->tv_sec;
     localtime_r(&rawtime, &timeinfo);
 
     pDate->nYear = timeinfo.tm_year + 1900;
@@ -153,7 +153,7 @@ static void slog_get_date(SLogDate *pDate)
     pDate->nHour = timeinfo.tm_hour;
     pDate->nMin = timeinfo.tm_min;
     pDate->nSec = timeinfo.tm_sec;
-    pDate->nUsec = slog_get_usec();
+    pDate->nUsec = (uint8_t)(pTime->tv_nsec / 10000000);
 }
 
 static void slog_create_tag( char *pOut, size_t nSize, SLOG_FLAGS_E eFlag, const char *pColor)
@@ -198,7 +198,7 @@ static void slog_display_output(char *pStr, uint8_t nNewLine)
     fclose(pFile);
 }
 
-static void slog_create_output(char* pOut, size_t nSize, const char* pStr, SLOG_FLAGS_E eFlag)
+static void slog_create_output(char* pOut, size_t nSize, const char* pStr, SLOG_FLAGS_E eFlag, uint32_t nTid)
 {
     const SLogConfig *pConfig = &g_slog.slogConfig;
     const SLogDate *pDate = &g_slog.slogDate;
@@ -214,7 +214,7 @@ static void slog_create_output(char* pOut, size_t nSize, const char* pStr, SLOG_
     const char *pColor = slog_get_color(eFlag);
     slog_create_tag(sTag, sizeof(sTag), eFlag, pColor);
 
-    if (pConfig->nTraceTid) snprintf(sTid, sizeof(sTid), "(%u) ", slog_get_tid());
+    if (pConfig->nTraceTid) snprintf(sTid, sizeof(sTid), "(%u) ", nTid ? nTid : slog_get_tid());
     if (pConfig->eColorFormat != SLOG_COLOR_FULL) snprintf(pOut, nSize, "%s%s - %s%s", sTid, sDate, sTag, pStr); 
     else snprintf(pOut, nSize, "%s%s%s - %s%s%s", pColor, sTid, sDate, sTag, pStr, SLOG_CLR_RESET); 
 }
@@ -262,29 +262,45 @@ void slog_disable(SLOG_FLAGS_E eFlag)
     slog_unlock(&g_slog);
 }
 
-void slog_print(SLOG_FLAGS_E eFlag, uint8_t nNewLine, const char *pMsg, ...)
+static void slog_vprint(SLOG_FLAGS_E eFlag, uint8_t nNewLine, const struct timespec *pTime,
+    uint32_t nTid, const char *pMsg, va_list args)
 {
     slog_lock(&g_slog);
 
     if ((SLOG_FLAGS_CHECK(g_slog.slogConfig.nFlags, eFlag)) &&
        (g_slog.slogConfig.nToScreen || g_slog.slogConfig.nToFile))
     {
-        slog_get_date(&g_slog.slogDate);
+        slog_get_date(&g_slog.slogDate, pTime);
         char sInput[SLOG_MESSAGE_MAX];
-
-        va_list args;
-        va_start(args, pMsg);
         vsnprintf(sInput, sizeof(sInput), pMsg, args);
-        va_end(args);
 
         char sOutput[SLOG_MESSAGE_MAX + SLOG_DATE_MAX + (SLOG_TAG_MAX * 3)];
-        slog_create_output(sOutput, sizeof(sOutput), sInput, eFlag);
+        slog_create_output(sOutput, sizeof(sOutput), sInput, eFlag, nTid);
         slog_display_output(sOutput, nNewLine);
     }
 
     slog_unlock(&g_slog);
 }
 
+void slog_print(SLOG_FLAGS_E eFlag, uint8_t nNewLine, const char *pMsg, ...)
+{
+    va_list args;
+    va_start(args, pMsg);
+    slog_vprint(eFlag, nNewLine, NULL, 0, pMsg, args);
+    va_end(args);
+}
+
+/* Print a message logged earlier, with the (CLOCK_REALTIME) time it was
+ * logged at and the ID of the thread that logged it */
+void slog_print_at(SLOG_FLAGS_E eFlag, uint8_t nNewLine, const struct timespec *pTime,
+    uint32_t nTid, const char *pMsg, ...)
+{
+    va_list args;
+    va_start(args, pMsg);
+    slog_vprint(eFlag, nNewLine, pTime, nTid, pMsg, args);
+    va_end(args);
+}
+
 void slog_init(const char* pName, uint16_t nFlags, uint8_t nTdSafe)
 {
     /* Set up default values */
@@ -306,6 +322,23 @@ void slog_init(const char* pName, uint16_t nFlags, uint8_t nTdSafe)
     slog_sync_init(&g_slog);
 }
 
+/* Keep the mutex free across fork(), see pthread_atfork(3). The child
+ * only has the forking thread, so it gets a fresh mutex */
+void slog_fork_prepare()
+{
+    slog_lock(&g_slog);
+}
+
+void slog_fork_parent()
+{
+    slog_unlock(&g_slog);
+}
+
+void slog_fork_child()
+{
+    slog_sync_init(&g_slog);
+}
+
 void slog_destroy()
 {
     if (!g_slog.nTdSafe) return;
@@ -35,6 +35,7 @@ extern "C" {
 
 #include <inttypes.h>
 #include <pthread.h>
+#include <time.h>
 
 /* SLog version information */
 #define SLOG_VERSION_MAJOR  1
@@ -136,8 +137,15 @@ void slog_disable(SLOG_FLAGS_E eFlag);
 
 void slog_init(const char* pName, uint16_t nFlags, uint8_t nTdSafe);
 void slog_print(SLOG_FLAGS_E eFlag, uint8_t nNewLine, const char *pMsg, ...);
+void slog_print_at(SLOG_FLAGS_E eFlag, uint8_t nNewLine, const struct timespec *pTime,
+    uint32_t nTid, const char *pMsg, ...);
 void slog_destroy(); // Needed only if the slog_init() function argument nTdSafe > 0
 
+/* Handlers for pthread_atfork(), if the process forks while other threads log */
+void slog_fork_prepare();
+void slog_fork_parent();
+void slog_fork_child();
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,535 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/* vaccel-bench: load generator for vAccel operations
+ *
+ * Drives an operation through vaccel_genop() from a number of threads
+ * and reports throughput and latency percentiles. It runs either in
+ * closed loop, where every thread issues its next request as soon as
+ * the previous one completes, or in open loop, where requests are
+ * issued at a fixed rate whatever the latency. In open loop latency is
+ * measured from the time a request was due, so that a runtime falling
+ * behind shows up as queueing delay rather than as a lower rate. That
+ * also includes the wake-up latency of the thread, a few microseconds.
+ *
+ * Arguments of the operation are a list of strings given with -a,
+ * followed by an input buffer of one of the -i sizes and an output
+ * buffer of the -O size, e.g. against the noop plugin:
+ *
+ *   VACCEL_BACKENDS=libvaccel-noop.so vaccel-bench -c 4 -d 5
+ *   VACCEL_BACKENDS=libvaccel-noop.so vaccel-bench -o exec \
+ *           -a lib.so -a fn -i 64,4096 -O 64 -r 10000 -t 2
+ */
+
+#include "error.h"
+#include "session.h"
+#include "ops/genop.h"
+#include "ops/vaccel_ops.h"
+#include "profiling/histogram.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/prctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_STRING_ARGS 8
+#define MAX_INPUT_SIZES 16
+
+static struct {
+	enum vaccel_op_type op;
+	int nr_threads;
+	int nr_sessions;
+
+	/* Requests per second over all threads. 0 for closed loop */
+	double rate;
+
+	double duration;
+	double warmup;
+
+	const char *strings[MAX_STRING_ARGS];
+	int nr_strings;
+
+	size_t input_sizes[MAX_INPUT_SIZES];
+	int nr_input_sizes;
+	size_t output_size;
+} cfg = {
+	.op = VACCEL_NO_OP,
+	.nr_threads = 1,
+	.nr_sessions = 1,
+	.duration = 10,
+	.warmup = 1,
+};
+
+struct worker {
+	int idx;
+	pthread_t thread;
+
+	/* Latency of requests, from when they were due in open loop */
+	struct prof_hist latency;
+
+	/* Time spent in vaccel_genop() */
+	struct prof_hist service;
+
+	uint64_t nr_requests;
+	uint64_t nr_errors;
+	int first_error;
+
+	/* Set if the worker could not set up its sessions */
+	int setup_error;
+};
+
+static pthread_barrier_t start_barrier;
+
+/* Start of the measurement and end of the run, set before the workers
+ * are released from the barrier */
+static uint64_t measure_start;
+static uint64_t run_end;
+
+static volatile sig_atomic_t interrupted;
+
+static uint64_t now_nsec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t nsec)
+{
+	struct timespec ts = {
+		.tv_sec = nsec / 1000000000ULL,
+		.tv_nsec = nsec % 1000000000ULL,
+	};
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)
+			== EINTR && !interrupted)
+		;
+}
+
+/* Per-thread xorshift for picking input sizes */
+static uint32_t next_random(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+
+	return x;
+}
+
+static void *worker_run(void *arg)
+{
+	struct worker *w = arg;
+	struct vaccel_session *sessions = NULL;
+	struct vaccel_arg read[MAX_STRING_ARGS + 2];
+	struct vaccel_arg write[1];
+	uint8_t *input = NULL, *output = NULL;
+	size_t max_input = 0;
+	int nr_sessions = 0;
+
+	hist_init(&w->latency);
+	hist_init(&w->service);
+
+	for (int i = 0; i < cfg.nr_input_sizes; ++i)
+		if (cfg.input_sizes[i] > max_input)
+			max_input = cfg.input_sizes[i];
+
+	sessions = calloc(cfg.nr_sessions, sizeof(*sessions));
+	input = malloc(max_input ? max_input : 1);
+	output = malloc(cfg.output_size ? cfg.output_size : 1);
+	if (!sessions || !input || !output) {
+		w->setup_error = VACCEL_ENOMEM;
+		goto wait;
+	}
+	memset(input, 0xa5, max_input);
+
+	for (; nr_sessions < cfg.nr_sessions; ++nr_sessions) {
+		int ret = vaccel_sess_init(&sessions[nr_sessions], 0);
+		if (ret) {
+			w->setup_error = ret;
+			break;
+		}
+	}
+
+	/* Arguments are the same for every request, but for the size of
+	 * the input */
+	int nr_read = 0;
+	read[nr_read++] = (struct vaccel_arg){
+		.size = sizeof(cfg.op), .buf = &cfg.op
+	};
+	for (int i = 0; i < cfg.nr_strings; ++i)
+		read[nr_read++] = (struct vaccel_arg){
+			.size = strlen(cfg.strings[i]) + 1,
+			.buf = (void *)cfg.strings[i]
+		};
+	int input_arg = cfg.nr_input_sizes ? nr_read++ : -1;
+	if (input_arg >= 0)
+		read[input_arg] = (struct vaccel_arg){ .buf = input };
+
+	int nr_write = 0;
+	if (cfg.output_size)
+		write[nr_write++] = (struct vaccel_arg){
+			.size = cfg.output_size, .buf = output
+		};
+
+wait:
+	/* Wait for everybody, so that no thread measures while the
+	 * others are still setting up */
+	pthread_barrier_wait(&start_barrier);
+	if (w->setup_error)
+		goto out;
+
+	/* Wake up as close to when requests are due as possible; the
+	 * default slack of 50us would be counted as latency */
+	prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+
+	/* Threads in open loop are staggered over one interval */
+	uint64_t interval = 0;
+	if (cfg.rate) {
+		interval = cfg.nr_threads * 1e9 / cfg.rate;
+		if (!interval)
+			interval = 1;
+	}
+	uint64_t due = measure_start - (uint64_t)(cfg.warmup * 1e9) +
+		interval * w->idx / cfg.nr_threads;
+	uint32_t random = 2463534242U + w->idx;
+
+	for (uint64_t n = 0; !interrupted; ++n) {
+		if (interval) {
+			sleep_until(due);
+			if (interrupted)
+				break;
+		} else {
+			due = now_nsec();
+		}
+
+		if (due >= run_end)
+			break;
+
+		if (input_arg >= 0)
+			read[input_arg].size = cfg.input_sizes[
+				next_random(&random) % cfg.nr_input_sizes];
+
+		uint64_t start = now_nsec();
+		int ret = vaccel_genop(&sessions[n % cfg.nr_sessions], read,
+				nr_read, nr_write ? write : NULL, nr_write);
+		uint64_t end = now_nsec();
+
+		if (due >= measure_start) {
+			w->nr_requests++;
+			hist_record(&w->latency, end - due);
+			hist_record(&w->service, end - start);
+
+			if (ret) {
+				if (!w->nr_errors)
+					w->first_error = ret;
+				w->nr_errors++;
+			}
+		}
+
+		due += interval;
+	}
+
+out:
+	for (int i = 0; i < nr_sessions; ++i)
+		vaccel_sess_free(&sessions[i]);
+
+	free(output);
+	free(input);
+	free(sessions);
+
+	return NULL;
+}
+
+static void format_time(char *buf, size_t size, uint64_t nsec)
+{
+	if (nsec < 10000)
+		snprintf(buf, size, "%luns", nsec);
+	else if (nsec < 10000000)
+		snprintf(buf, size, "%.1fus", nsec / 1e3);
+	else if (nsec < 10000000000ULL)
+		snprintf(buf, size, "%.1fms", nsec / 1e6);
+	else
+		snprintf(buf, size, "%.1fs", nsec / 1e9);
+}
+
+static void print_latency(const char *name, const struct prof_hist *hist)
+{
+	static const double percentiles[] = { 50, 90, 99, 99.9 };
+	char buf[16];
+
+	if (!hist->count)
+		return;
+
+	printf("%-10s", name);
+
+	format_time(buf, sizeof(buf), hist->min);
+	printf(" min %-9s", buf);
+	for (size_t i = 0; i < sizeof(percentiles) / sizeof(*percentiles);
+			++i) {
+		format_time(buf, sizeof(buf),
+				hist_percentile(hist, percentiles[i]));
+		printf(" p%g %-9s", percentiles[i], buf);
+	}
+	format_time(buf, sizeof(buf), hist->max);
+	printf(" max %s\n", buf);
+}
+
+static void report(struct worker *workers, double secs)
+{
+	struct prof_hist *latency = malloc(sizeof(*latency));
+	struct prof_hist *service = malloc(sizeof(*service));
+	uint64_t nr_requests = 0, nr_errors = 0;
+	int first_error = 0;
+
+	if (!latency || !service) {
+		fprintf(stderr, "Could not allocate histograms\n");
+		goto out;
+	}
+
+	hist_init(latency);
+	hist_init(service);
+	for (int i = 0; i < cfg.nr_threads; ++i) {
+		hist_merge(latency, &workers[i].latency);
+		hist_merge(service, &workers[i].service);
+		nr_requests += workers[i].nr_requests;
+		nr_errors += workers[i].nr_errors;
+		if (!first_error)
+			first_error = workers[i].first_error;
+	}
+
+	printf("op %s, %s, %d thread(s), %d session(s) per thread, %.1fs\n",
+			vaccel_op_type_str(cfg.op),
+			cfg.rate ? "open loop" : "closed loop",
+			cfg.nr_threads, cfg.nr_sessions, secs);
+	printf("requests   %lu\n", nr_requests);
+	if (nr_errors)
+		printf("errors     %lu (first: %d)\n", nr_errors, first_error);
+	if (cfg.rate)
+		printf("throughput %.1f req/s (target %.1f)\n",
+				nr_requests / secs, cfg.rate);
+	else
+		printf("throughput %.1f req/s\n", nr_requests / secs);
+
+	/* In closed loop requests are due when they are issued, so both
+	 * histograms are the same */
+	print_latency("latency", latency);
+	if (cfg.rate)
+		print_latency("service", service);
+
+out:
+	free(service);
+	free(latency);
+}
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	interrupted = 1;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -o <op>       operation, by number or name (default: noop)\n"
+		"  -a <string>   string argument, passed before the input\n"
+		"                (can be repeated)\n"
+		"  -i <sizes>    comma-separated input sizes in bytes; each\n"
+		"                request picks one at random\n"
+		"  -O <size>     output size in bytes\n"
+		"  -t <threads>  number of threads (default: 1)\n"
+		"  -s <nr>       sessions per thread, used in turn (default: 1)\n"
+		"  -c <nr>       closed loop with <nr> requests in flight; the\n"
+		"                API is synchronous, so this runs <nr> threads\n"
+		"  -r <rate>     open loop at <rate> requests/s over all threads\n"
+		"  -d <secs>     duration of the measurement (default: 10)\n"
+		"  -w <secs>     warm-up before measuring (default: 1)\n",
+		prog);
+}
+
+static int parse_op(const char *str)
+{
+	char *end;
+	long op = strtol(str, &end, 0);
+
+	if (*str && !*end)
+		return (op >= 0 && op < VACCEL_FUNCTIONS_NR) ? op : -1;
+
+	for (int i = 0; i < VACCEL_FUNCTIONS_NR; ++i)
+		if (!strcasecmp(str, vaccel_op_type_str(i)))
+			return i;
+
+	return -1;
+}
+
+static int parse_sizes(char *str)
+{
+	for (char *tok = strtok(str, ","); tok; tok = strtok(NULL, ",")) {
+		if (cfg.nr_input_sizes == MAX_INPUT_SIZES)
+			return -1;
+
+		char *end;
+		long long size = strtoll(tok, &end, 0);
+		if (*end || size < 0 || size > UINT32_MAX)
+			return -1;
+
+		cfg.input_sizes[cfg.nr_input_sizes++] = size;
+	}
+
+	return cfg.nr_input_sizes ? 0 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+	int concurrency = 0;
+	int opt, op;
+
+	while ((opt = getopt(argc, argv, "o:a:i:O:t:s:c:r:d:w:h")) != -1) {
+		switch (opt) {
+		case 'o':
+			op = parse_op(optarg);
+			if (op < 0) {
+				fprintf(stderr, "Unknown operation %s\n",
+						optarg);
+				return 1;
+			}
+			cfg.op = op;
+			break;
+		case 'a':
+			if (cfg.nr_strings == MAX_STRING_ARGS) {
+				fprintf(stderr, "Too many string arguments\n");
+				return 1;
+			}
+			cfg.strings[cfg.nr_strings++] = optarg;
+			break;
+		case 'i':
+			if (parse_sizes(optarg)) {
+				fprintf(stderr, "Invalid input sizes\n");
+				return 1;
+			}
+			break;
+		case 'O':
+			cfg.output_size = strtoull(optarg, NULL, 0);
+			break;
+		case 't':
+			cfg.nr_threads = atoi(optarg);
+			break;
+		case 's':
+			cfg.nr_sessions = atoi(optarg);
+			break;
+		case 'c':
+			concurrency = atoi(optarg);
+			if (concurrency <= 0) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'r':
+			cfg.rate = atof(optarg);
+			if (cfg.rate <= 0) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'd':
+			cfg.duration = atof(optarg);
+			break;
+		case 'w':
+			cfg.warmup = atof(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (concurrency && cfg.rate) {
+		fprintf(stderr, "-c and -r are mutually exclusive\n");
+		return 1;
+	}
+	if (concurrency)
+		cfg.nr_threads = concurrency;
+
+	if (optind != argc || cfg.nr_threads <= 0 || cfg.nr_sessions <= 0 ||
+			cfg.duration <= 0 || cfg.warmup < 0 ||
+			cfg.output_size > UINT32_MAX) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	struct worker *workers = calloc(cfg.nr_threads, sizeof(*workers));
+	if (!workers) {
+		fprintf(stderr, "Could not allocate workers\n");
+		return 1;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	pthread_barrier_init(&start_barrier, NULL, cfg.nr_threads + 1);
+
+	for (int i = 0; i < cfg.nr_threads; ++i) {
+		workers[i].idx = i;
+		if (pthread_create(&workers[i].thread, NULL, worker_run,
+					&workers[i])) {
+			fprintf(stderr, "Could not spawn %d threads\n",
+					cfg.nr_threads);
+			return 1;
+		}
+	}
+
+	measure_start = now_nsec() + cfg.warmup * 1e9;
+	run_end = measure_start + cfg.duration * 1e9;
+	pthread_barrier_wait(&start_barrier);
+
+	int ret = 0;
+	for (int i = 0; i < cfg.nr_threads; ++i) {
+		pthread_join(workers[i].thread, NULL);
+		if (workers[i].setup_error && !ret) {
+			fprintf(stderr, "Could not set up thread %d: %d\n",
+					i, workers[i].setup_error);
+			ret = 1;
+		}
+	}
+
+	if (!ret) {
+		/* Runs cut short report over the time actually measured */
+		uint64_t end = now_nsec();
+		if (end > run_end)
+			end = run_end;
+		double secs = end > measure_start ?
+			(end - measure_start) / 1e9 : 0;
+
+		if (secs > 0)
+			report(workers, secs);
+		else
+			fprintf(stderr, "Interrupted before measuring\n");
+	}
+
+	pthread_barrier_destroy(&start_barrier);
+	free(workers);
+
+	return ret;
+}
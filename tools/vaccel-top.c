@@ -0,0 +1,315 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/* vaccel-top: live view of the metrics of a vAccel process
+ *
+ * The process must run with VACCEL_METRICS_ENABLED=enabled. Rates and
+ * latency percentiles are computed over the refresh interval.
+ */
+
+#include "profiling/histogram.h"
+#include "profiling/metrics.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_INTERVAL_MS 1000
+
+struct snapshot {
+	uint64_t time;
+	uint32_t nr_plugins;
+	struct metrics_entry ops[VACCEL_FUNCTIONS_NR];
+	struct metrics_entry plugins[METRICS_MAX_PLUGINS];
+	struct metrics_session sessions[METRICS_MAX_SESSIONS];
+};
+
+static uint64_t now_nsec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-i interval_ms] [-n iterations] <pid>\n",
+			prog);
+}
+
+static const struct metrics_shm *attach(pid_t pid)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "%s%d", METRICS_SHM_PREFIX, pid);
+
+	int fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		fprintf(stderr, "Could not open %s: %s\n"
+				"Is the process running with "
+				"VACCEL_METRICS_ENABLED=enabled?\n",
+				name, strerror(errno));
+		return NULL;
+	}
+
+	const struct metrics_shm *shm = mmap(NULL, sizeof(*shm), PROT_READ,
+			MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED) {
+		fprintf(stderr, "Could not map %s: %s\n", name,
+				strerror(errno));
+		return NULL;
+	}
+
+	if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != METRICS_MAGIC ||
+			shm->version != METRICS_VERSION ||
+			shm->size != sizeof(*shm)) {
+		fprintf(stderr, "%s was not created by a compatible vAccel\n",
+				name);
+		munmap((void *)shm, sizeof(*shm));
+		return NULL;
+	}
+
+	return shm;
+}
+
+/* Copy one entry. If writers keep it busy, the entry of the previous
+ * snapshot is kept instead of a torn copy, so that it just shows no
+ * activity for this interval */
+static void snapshot_entry(const void *entry, void *copy, const void *prev,
+		size_t size)
+{
+	if (metrics_snapshot(entry, copy, size))
+		return;
+
+	if (prev)
+		memcpy(copy, prev, size);
+	else
+		memset(copy, 0, size);
+}
+
+/* Take a snapshot of all entries. `prev` is the previous snapshot, or
+ * NULL for the first one */
+static void take_snapshot(const struct metrics_shm *shm,
+		struct snapshot *snap, const struct snapshot *prev)
+{
+	snap->time = now_nsec();
+
+	for (int i = 0; i < VACCEL_FUNCTIONS_NR; ++i)
+		snapshot_entry(&shm->ops[i], &snap->ops[i],
+				prev ? &prev->ops[i] : NULL,
+				sizeof(snap->ops[i]));
+
+	snap->nr_plugins = __atomic_load_n(&shm->nr_plugins, __ATOMIC_ACQUIRE);
+	for (uint32_t i = 0; i < snap->nr_plugins; ++i)
+		snapshot_entry(&shm->plugins[i], &snap->plugins[i],
+				prev && i < prev->nr_plugins ?
+				&prev->plugins[i] : NULL,
+				sizeof(snap->plugins[i]));
+
+	for (int i = 0; i < METRICS_MAX_SESSIONS; ++i)
+		snapshot_entry(&shm->sessions[i], &snap->sessions[i],
+				prev ? &prev->sessions[i] : NULL,
+				sizeof(snap->sessions[i]));
+}
+
+static void format_time(char *buf, size_t size, uint64_t nsec)
+{
+	if (nsec < 10000)
+		snprintf(buf, size, "%luns", nsec);
+	else if (nsec < 10000000)
+		snprintf(buf, size, "%.1fus", nsec / 1e3);
+	else if (nsec < 10000000000ULL)
+		snprintf(buf, size, "%.1fms", nsec / 1e6);
+	else
+		snprintf(buf, size, "%.1fs", nsec / 1e9);
+}
+
+/* Latency percentile of the operations completed between two
+ * snapshots of an entry */
+static uint64_t interval_percentile(const struct metrics_entry *prev,
+		const struct metrics_entry *cur, double percentile,
+		struct prof_hist *delta)
+{
+	delta->count = cur->latency.count - prev->latency.count;
+	delta->total = cur->latency.total - prev->latency.total;
+	delta->min = cur->latency.min;
+	delta->max = cur->latency.max;
+	for (int i = 0; i < HIST_BUCKETS; ++i)
+		delta->buckets[i] = cur->latency.buckets[i] -
+			prev->latency.buckets[i];
+
+	return hist_percentile(delta, percentile);
+}
+
+static void print_entry(const struct metrics_entry *prev,
+		const struct metrics_entry *cur, double secs,
+		struct prof_hist *delta)
+{
+	uint64_t ops = cur->nr_ops - prev->nr_ops;
+	uint64_t errors = cur->nr_errors - prev->nr_errors;
+	char p50[16] = "-", p99[16] = "-";
+
+	if (ops) {
+		format_time(p50, sizeof(p50),
+				interval_percentile(prev, cur, 50, delta));
+		format_time(p99, sizeof(p99),
+				interval_percentile(prev, cur, 99, delta));
+	}
+
+	printf("%-24s %10.1f %8.1f %8ld %10s %10s %12lu\n", cur->name,
+			ops / secs, errors / secs, cur->inflight, p50, p99,
+			cur->nr_ops);
+}
+
+static void print_header(const char *what)
+{
+	printf("\n%-24s %10s %8s %8s %10s %10s %12s\n", what, "OPS/S",
+			"ERR/S", "INFLIGHT", "P50", "P99", "TOTAL");
+}
+
+static void print(const struct metrics_shm *shm, const struct snapshot *prev,
+		const struct snapshot *cur, struct prof_hist *delta)
+{
+	double secs = (cur->time - prev->time) / 1e9;
+
+	if (isatty(STDOUT_FILENO))
+		printf("\033[H\033[2J");
+
+	printf("pid %d  up %.1fs  in-flight %ld  async queue %ld  "
+			"sessions %ld\n", shm->pid,
+			(cur->time - shm->start_time) / 1e9,
+			__atomic_load_n(&shm->inflight, __ATOMIC_RELAXED),
+			__atomic_load_n(&shm->async_queue, __ATOMIC_RELAXED),
+			__atomic_load_n(&shm->nr_sessions, __ATOMIC_RELAXED));
+
+	print_header("PLUGIN");
+	for (uint32_t i = 0; i < cur->nr_plugins; ++i) {
+		/* Plugins added since the previous snapshot start from 0 */
+		static const struct metrics_entry none;
+		const struct metrics_entry *before =
+			(i < prev->nr_plugins) ? &prev->plugins[i] : &none;
+
+		print_entry(before, &cur->plugins[i], secs, delta);
+	}
+
+	print_header("OPERATION");
+	for (int i = 0; i < VACCEL_FUNCTIONS_NR; ++i) {
+		if (cur->ops[i].nr_ops || cur->ops[i].inflight)
+			print_entry(&prev->ops[i], &cur->ops[i], secs, delta);
+	}
+
+	printf("\n%-24s %10s %8s %8s %10s\n", "SESSION", "OPS/S", "ERR/S",
+			"INFLIGHT", "AVG");
+	for (int i = 0; i < METRICS_MAX_SESSIONS; ++i) {
+		const struct metrics_session *p = &prev->sessions[i];
+		const struct metrics_session *c = &cur->sessions[i];
+		if (!c->id)
+			continue;
+
+		/* The slot might have changed hands */
+		uint64_t ops = c->nr_ops, errors = c->nr_errors;
+		uint64_t time = c->total_time;
+		if (p->id == c->id) {
+			ops -= p->nr_ops;
+			errors -= p->nr_errors;
+			time -= p->total_time;
+		}
+
+		char avg[16] = "-";
+		if (ops)
+			format_time(avg, sizeof(avg), time / ops);
+
+		printf("%-24u %10.1f %8.1f %8ld %10s\n", c->id, ops / secs,
+				errors / secs, c->inflight, avg);
+	}
+
+	fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+	long interval = DEFAULT_INTERVAL_MS;
+	long iterations = -1;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "i:n:h")) != -1) {
+		switch (opt) {
+		case 'i':
+			interval = atol(optarg);
+			break;
+		case 'n':
+			iterations = atol(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (optind != argc - 1 || interval <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	pid_t pid = atoi(argv[optind]);
+	const struct metrics_shm *shm = attach(pid);
+	if (!shm)
+		return 1;
+
+	struct snapshot *snaps = calloc(2, sizeof(*snaps));
+	struct prof_hist *delta = malloc(sizeof(*delta));
+	if (!snaps || !delta) {
+		fprintf(stderr, "Could not allocate snapshots\n");
+		return 1;
+	}
+
+	struct snapshot *prev = &snaps[0], *cur = &snaps[1];
+	take_snapshot(shm, prev, NULL);
+
+	struct timespec ts = {
+		.tv_sec = interval / 1000,
+		.tv_nsec = (interval % 1000) * 1000000,
+	};
+
+	for (long i = 0; iterations < 0 || i < iterations; ++i) {
+		nanosleep(&ts, NULL);
+
+		if (kill(pid, 0) && errno == ESRCH) {
+			printf("Process %d exited\n", pid);
+			break;
+		}
+
+		take_snapshot(shm, cur, prev);
+		print(shm, prev, cur, delta);
+
+		struct snapshot *tmp = prev;
+		prev = cur;
+		cur = tmp;
+	}
+
+	free(delta);
+	free(snaps);
+	munmap((void *)shm, sizeof(*shm));
+
+	return 0;
+}